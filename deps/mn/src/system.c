@@ -1,5 +1,7 @@
 #include "mn/system.h"
 
+#include "aws/common/system_info.h"
+
 #include "mn/allocator.h"
 #include "mn/error.h"
 
@@ -18,7 +20,7 @@ int mn_system_setup(mn_system_t *system)
     memset(priv, 0, sizeof(*priv));
     system->priv = priv;
 
-    priv->cpu_count = 0;
+    priv->cpu_count = (uint32_t)aws_system_info_processor_count();
 
     return MN_SUCCESS;
 }
@@ -8,7 +8,11 @@ extern "C" {
 #endif
 
 #define RAWR_AUDIOSTREAM_SAMPLECOUNT_MAX
-#define RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER 10000.0
+
+#define RAWR_AUDIO_RATECACHE_PATH_MAX 1024
+
+/* the device buffer when none is set, short enough that it adds little to the codec frame's own latency */
+#define RAWR_AUDIOSTREAM_DEVICE_MS 5
 
 typedef short rawr_AudioSample;
 
@@ -56,13 +60,37 @@ typedef enum rawr_AudioDeviceProps {
     rawr_AudioDeviceProps_InputStereo = 1 << 4,
 } rawr_AudioDeviceProps;
 
+typedef enum rawr_AudioBackend {
+    rawr_AudioBackend_Device,
+    rawr_AudioBackend_File,
+} rawr_AudioBackend;
+
 typedef struct rawr_AudioDevice rawr_AudioDevice;
 
 typedef struct rawr_AudioStream rawr_AudioStream;
 
+/*
+ * where the rates each device supports are kept between runs, set before Setup. probing them opens the device at
+ * every rate, which is slow enough on some hosts that it happens only when a device's rates are first asked for and
+ * only once per device. NULL, the default, is a file in the user's cache directory, an empty path keeps nothing
+ */
+RAWR_API int RAWR_CALL rawr_Audio_SetRateCache(const char *path);
+
 RAWR_API int RAWR_CALL rawr_Audio_Setup(void);
 RAWR_API int RAWR_CALL rawr_Audio_Cleanup(void);
 
+/* what the next rawr_Audio_Setup brings up, the sound card unless told otherwise */
+RAWR_API int RAWR_CALL rawr_Audio_SetBackend(rawr_AudioBackend backend);
+RAWR_API rawr_AudioBackend RAWR_CALL rawr_Audio_Backend(void);
+
+/*
+ * For the file backend, which stands in for a sound card on machines without one. Capture reads 16 bit PCM from
+ * inputPath, a WAV file or headerless samples in the stream's rate and layout, looping at the end, or is silence
+ * when inputPath is NULL. Playback is written to outputPath as WAV, or dropped when it is NULL. speed scales the
+ * clock, 1.0 being real time, and 0 runs unclocked with capture produced as fast as the reader takes it.
+ */
+RAWR_API int RAWR_CALL rawr_Audio_SetFiles(const char *inputPath, const char *outputPath, double speed);
+
 RAWR_API rawr_AudioDevice * RAWR_CALL rawr_AudioDevice_Get(rawr_AudioDeviceId id);
 RAWR_API rawr_AudioDevice * RAWR_CALL rawr_AudioDevice_DefaultInput(void);
 RAWR_API rawr_AudioDevice * RAWR_CALL rawr_AudioDevice_DefaultOutput(void);
@@ -77,13 +105,87 @@ RAWR_API int RAWR_CALL rawr_AudioDevice_InputChannels(rawr_AudioDevice *dev);
 RAWR_API int RAWR_CALL rawr_AudioStream_Setup(rawr_AudioStream **out_stream, rawr_AudioRate sampleRate, int channelCount, int sampleCount);
 RAWR_API void RAWR_CALL rawr_AudioStream_Cleanup(rawr_AudioStream *stream);
 RAWR_API int RAWR_CALL rawr_AudioStream_AddDevice(rawr_AudioStream *stream, rawr_AudioDevice *dev);
+
+/*
+ * the rate the devices run at, set before Start. the stream converts between it and its own rate, so Read and
+ * Write always see the rate the stream was set up with. 0, the default, keeps the stream's rate when the devices
+ * support it and otherwise picks one they do, favouring whole multiples of the stream's rate, which convert cheapest
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_SetDeviceRate(rawr_AudioStream *stream, rawr_AudioRate deviceRate);
+RAWR_API rawr_AudioRate RAWR_CALL rawr_AudioStream_DeviceRate(rawr_AudioStream *stream);
+
+/*
+ * frames per device buffer at the device rate, set before Start. the device is serviced at this size and the stream
+ * gathers and splits codec frames in its queues, so Read and Write still move sampleCount at a time. a buffer that
+ * finds less than it needs queued plays that much and conceals the rest. 0, the default, is RAWR_AUDIOSTREAM_DEVICE_MS worth
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_SetDeviceFrames(rawr_AudioStream *stream, int deviceFrames);
+RAWR_API int RAWR_CALL rawr_AudioStream_DeviceFrames(rawr_AudioStream *stream);
+
+/*
+ * hold the playback queue at the depth it settles at once playing, however far the clock writing to it and the
+ * output device's clock drift apart, by trimming the rate it is played out at by up to 0.1%. set before Start, on
+ * by default. OutputDriftPpm is the trim, positive when the queue is played out faster than nominal
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_SetDriftCompensation(rawr_AudioStream *stream, int enabled);
+RAWR_API double RAWR_CALL rawr_AudioStream_OutputDriftPpm(rawr_AudioStream *stream);
+
+/*
+ * hold the playback queue at a target depth between minMs and maxMs rather than wherever it happens to settle. the
+ * target is the 95th percentile of how late writes land against one a frame over the last few seconds, plus a
+ * device buffer and half a frame, so steady writes sit at minMs and jittery ones push it towards maxMs, say 20 on a
+ * LAN and 80 on a cellular link. frames written while the queue runs deep are shortened by a pitch period and those
+ * written while it runs shallow lengthened by one. the queue is sized to hold at least twice maxMs and refuses
+ * writes past that. mono streams at a multiple of 4 kHz, set before Start and an error after, 0 for both turns it off, the default.
+ * LatencyTarget is the target now in ms, 0 when off
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_SetLatencyTarget(rawr_AudioStream *stream, int minMs, int maxMs);
+RAWR_API int RAWR_CALL rawr_AudioStream_LatencyTarget(rawr_AudioStream *stream);
+
 RAWR_API int RAWR_CALL rawr_AudioStream_Start(rawr_AudioStream *stream);
 RAWR_API int RAWR_CALL rawr_AudioStream_Stop(rawr_AudioStream *stream);
 RAWR_API int RAWR_CALL rawr_AudioStream_Read(rawr_AudioStream *stream, void *buffer);
 RAWR_API int RAWR_CALL rawr_AudioStream_Write(rawr_AudioStream *stream, void *buffer);
 
+/* blocks until a full frame has been captured and reads it, returns 0 if none arrived within timeoutMs */
+RAWR_API int RAWR_CALL rawr_AudioStream_WaitRead(rawr_AudioStream *stream, void *buffer, int timeoutMs);
+
+/*
+ * Read and Write without the copy. BeginRead points samples at the next captured frame where it sits in the queue
+ * and EndRead hands it back, BeginWrite points samples at room for the next frame to play and EndWrite queues what
+ * was put there. both return 0 like Read and Write when there is no whole frame or no room for one, and a write that
+ * is begun and never ended queues nothing. a frame that wraps around the end of a queue goes through a buffer of the
+ * stream's own, so samples is always one frame in a row. one frame open each way at a time
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_BeginRead(rawr_AudioStream *stream, rawr_AudioSample **samples);
+RAWR_API void RAWR_CALL rawr_AudioStream_EndRead(rawr_AudioStream *stream);
+RAWR_API int RAWR_CALL rawr_AudioStream_BeginWrite(rawr_AudioStream *stream, rawr_AudioSample **samples);
+RAWR_API void RAWR_CALL rawr_AudioStream_EndWrite(rawr_AudioStream *stream);
+RAWR_API int RAWR_CALL rawr_AudioStream_WaitBeginRead(rawr_AudioStream *stream, rawr_AudioSample **samples, int timeoutMs);
+
+/*
+ * copies out what the output was playing while the frame from BeginRead was captured, one frame in the stream's rate
+ * and layout, silence where nothing was played. an echo canceller's far end. only between BeginRead and EndRead, the
+ * two move on together whether or not it is called
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_ReadReference(rawr_AudioStream *stream, rawr_AudioSample *buffer);
+
+/*
+ * RMS and peak of the last few device buffers, from 0 at 60 dB below full scale (or silence) to 1 at full scale.
+ * output is measured as it is handed to the device. recording them is cheap and reading them takes no lock
+ */
 RAWR_API double RAWR_CALL rawr_AudioStream_InputLevel(rawr_AudioStream *stream);
 RAWR_API double RAWR_CALL rawr_AudioStream_OutputLevel(rawr_AudioStream *stream);
+RAWR_API double RAWR_CALL rawr_AudioStream_InputPeak(rawr_AudioStream *stream);
+RAWR_API double RAWR_CALL rawr_AudioStream_OutputPeak(rawr_AudioStream *stream);
+
+/* samples written and not yet played, and how many device buffers found less than they needed and concealed the rest */
+RAWR_API int RAWR_CALL rawr_AudioStream_OutputQueued(rawr_AudioStream *stream);
+RAWR_API uint64_t RAWR_CALL rawr_AudioStream_OutputUnderflows(rawr_AudioStream *stream);
+
+/* what is queued for playback in ms, and how many writes found no room for a frame and were refused */
+RAWR_API double RAWR_CALL rawr_AudioStream_OutputBufferedMs(rawr_AudioStream *stream);
+RAWR_API uint64_t RAWR_CALL rawr_AudioStream_OutputOverflows(rawr_AudioStream *stream);
 
 #ifdef __cplusplus
 }
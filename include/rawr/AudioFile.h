@@ -0,0 +1,40 @@
+#ifndef RAWR_AUDIOFILE_H
+#define RAWR_AUDIOFILE_H
+
+#include "rawr/Audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Timer clocked stand-in for a sound card, behind rawr_AudioBackend_File and set up from rawr_Audio_SetFiles.
+ * Every block it hands process one block of capture and one block to fill for playback, on a thread of its own,
+ * the same way a device callback would.
+ */
+
+#define RAWR_AUDIOFILE_PATH_MAX 1024
+#define RAWR_AUDIOFILE_CHANNELS_MAX 2
+
+typedef struct rawr_AudioFile rawr_AudioFile;
+
+typedef void (*rawr_AudioFileProcess)(const rawr_AudioSample *input, rawr_AudioSample *output, int frameCount, void *arg);
+
+/* frames captured and not yet read, only asked when running unclocked */
+typedef int (*rawr_AudioFileBacklog)(void *arg);
+
+/* the rate of the configured WAV input, 0 for silence or headerless samples, which take any rate */
+int rawr_AudioFile_InputRate(void);
+
+int rawr_AudioFile_Setup(rawr_AudioFile **out_file, rawr_AudioRate sampleRate, int channelCount, int frameCount, rawr_AudioFileProcess process, rawr_AudioFileBacklog backlog, void *arg);
+void rawr_AudioFile_Cleanup(rawr_AudioFile *file);
+int rawr_AudioFile_Start(rawr_AudioFile *file);
+
+/* joins the clock and finishes the WAV header, so the output is complete once this returns */
+int rawr_AudioFile_Stop(rawr_AudioFile *file);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
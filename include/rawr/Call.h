@@ -2,6 +2,11 @@
 #define RAWR_CALL_H
 
 #include "rawr/Platform.h"
+#include "rawr/Audio.h"
+#include "rawr/Codec.h"
+#include "rawr/Dsp.h"
+#include "rawr/Engine.h"
+#include "rawr/Histogram.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -24,11 +29,98 @@ typedef enum rawr_CallError {
     rawr_CallError_None,
 } rawr_CallError;
 
+/* SDES-keyed SRTP crypto suites (RFC 4568, RFC 7714) */
+typedef enum rawr_SrtpSuite {
+    rawr_SrtpSuite_None,
+    rawr_SrtpSuite_AesCm128HmacSha1_32,
+    rawr_SrtpSuite_AesCm128HmacSha1_80,
+    rawr_SrtpSuite_Aes256CmHmacSha1_32,
+    rawr_SrtpSuite_Aes256CmHmacSha1_80,
+    rawr_SrtpSuite_AesGcm128,
+    rawr_SrtpSuite_AesGcm256,
+} rawr_SrtpSuite;
+
+#define RAWR_CALL_SRTP_SUITES_MAX 6
+
 typedef struct rawr_Call rawr_Call;
 
+/* one frame of the call's audio at 48 kHz mono, sampleCount being the codec frame size */
+typedef void (*rawr_CallAudioHandler)(rawr_Call *call, rawr_AudioSample *samples, int sampleCount, void *arg);
+
+typedef struct rawr_CallStats {
+    uint64_t packetsSent;
+    uint64_t bytesSent;
+    uint64_t packetsReceived;
+    uint64_t reportsSent;
+    uint64_t reportsReceived;
+
+    /* loss and interarrival jitter we measure on the incoming stream (RFC 3550) */
+    int64_t packetsLost;
+    double fractionLost;
+    double jitterMs;
+
+    /* the same, as reported back by the peer in RTCP for our outgoing stream */
+    int64_t remotePacketsLost;
+    double remoteFractionLost;
+    double remoteJitterMs;
+
+    /* round trip time from the peer's reception reports, 0 until the first one echoes our SR */
+    double rttMs;
+
+    /* frames the encoder flagged as silence under DTX and we never sent */
+    uint64_t dtxFrames;
+
+    /* encoder settings the rate controller chose from those reports, bitrate is 0 until the first one */
+    int bitrate;
+    int inbandFec;
+    int packetLossPerc;
+} rawr_CallStats;
+
+typedef struct rawr_CallMetrics {
+    /* nanoseconds to encode and to decode or conceal one frame, and to protect or unprotect one RTP packet */
+    rawr_HistogramSnapshot encodeNs;
+    rawr_HistogramSnapshot decodeNs;
+    rawr_HistogramSnapshot srtpNs;
+
+    /* per packet transit difference against the previous packet (RFC 3550 A.8, before smoothing), in microseconds */
+    rawr_HistogramSnapshot jitterUs;
+
+    /* samples waiting in the playback ring each time a frame is written to it */
+    rawr_HistogramSnapshot outputQueued;
+
+    /* nanoseconds to cancel echo out of one captured frame */
+    rawr_HistogramSnapshot echoNs;
+
+    uint64_t underflows;       /* jitter buffer ran dry mid talk spurt */
+    uint64_t outputUnderflows; /* device buffers played as silence */
+    uint64_t overflows;        /* decoded frames dropped on a full playback ring */
+    uint64_t receiveDropped;   /* packets dropped because the media receive thread fell behind */
+    uint64_t latePackets;      /* arrived after their playout time */
+    uint64_t decodeErrors;
+
+    /* echo cancellation, the delay is -1 until the far end is found in the capture and the loss is 0 until it adapts */
+    int echoDelayMs;
+    double echoReturnLossDb;
+    uint64_t echoOverBudget; /* blocks that went uncancelled or unadapted to keep within the budget */
+
+    /* how much faster than nominal the device plays out to hold its queue against clock drift, 0 on engine calls */
+    double outputDriftPpm;
+
+    /* audio cut out of playout and repeated in it by time-stretching, to bring the jitter buffer to its target */
+    uint64_t acceleratedMs;
+    uint64_t expandedMs;
+
+    /* what the playback ring holds right now and the latency target it is held at, in ms, 0 on engine calls */
+    double outputBufferedMs;
+    int outputTargetMs;
+} rawr_CallMetrics;
+
 RAWR_API rawr_CallState RAWR_CALL rawr_Call_State(rawr_Call *call);
 
 RAWR_API int RAWR_CALL rawr_Call_Setup(rawr_Call **out_call, const char *sipRegistrar, const char *sipURI, const char *sipName, const char *sipUsername, const char *sipPassword);
+
+/* a call hosted by an engine, sharing its SIP stack and media workers instead of running threads of its own */
+RAWR_API int RAWR_CALL rawr_Call_SetupEngine(rawr_Call **out_call, rawr_Engine *engine, const char *sipURI, const char *sipName, const char *sipUsername, const char *sipPassword);
 RAWR_API void RAWR_CALL rawr_Call_Cleanup(rawr_Call *call);
 
 /* dial */
@@ -39,8 +131,66 @@ RAWR_API int RAWR_CALL rawr_Call_Stop(rawr_Call *call);
 
 RAWR_API int RAWR_CALL rawr_Call_BlockOnCall(rawr_Call *call);
 
+/*
+ * engine hosted calls have no audio device, these stand in for one. capture fills each frame before it is
+ * encoded and playback is handed each frame once it is decoded or concealed. both run on the call's media
+ * worker, so they must not block. set before Start, either may be NULL
+ */
+RAWR_API int RAWR_CALL rawr_Call_SetAudioHandlers(rawr_Call *call, rawr_CallAudioHandler capture, rawr_CallAudioHandler playback, void *arg);
+
+/*
+ * suites to offer, or to accept from a peer's offer, most preferred first, taking effect on the next Start. The
+ * default is AES-128-GCM, which is much cheaper per packet where AES-NI is available, then AES_CM_128_HMAC_SHA1_80
+ */
+RAWR_API int RAWR_CALL rawr_Call_SetSrtpSuites(rawr_Call *call, const rawr_SrtpSuite *suites, int count);
+
+/*
+ * the rate opus encodes and decodes at, taking effect on the next Start. the audio device keeps whatever rate it
+ * supports, the stream converts. 16 kHz is plenty for voice and costs the encoder far less than the 48 kHz default
+ */
+RAWR_API int RAWR_CALL rawr_Call_SetCodecRate(rawr_Call *call, rawr_CodecRate rate);
+
+/* what echo cancellation may spend per captured frame by default on calls with an audio device */
+#define RAWR_CALL_ECHO_BUDGET_US 1000
+
+/*
+ * cancel the far end's echo out of the capture before it is encoded, taking effect on the next Start. budgetUs is
+ * the CPU time it may take per frame, 0 turning it off, and past it frames go out partly cancelled rather than late.
+ * device calls cancel against what the device played and default to RAWR_CALL_ECHO_BUDGET_US. engine hosted calls
+ * cancel against the playback handler's frames and default to off, they share a worker with every other call on it
+ */
+RAWR_API int RAWR_CALL rawr_Call_SetEchoCancellation(rawr_Call *call, int budgetUs);
+
+/*
+ * hold the device's playback ring at a latency target between minMs and maxMs, following how regularly frames reach
+ * it, rather than wherever it settles. see rawr_AudioStream_SetLatencyTarget, 0 for both, the default, leaves it off.
+ * taking effect on the next Start, engine hosted calls have no ring and ignore it
+ */
+RAWR_API int RAWR_CALL rawr_Call_SetLatencyTarget(rawr_Call *call, int minMs, int maxMs);
+
+/*
+ * run the capture through chain after echo cancellation and before it is encoded, NULL for none. the call does not
+ * own the chain, which is set up at the call's codec rate with 20 ms frames and left alone until the call stops.
+ * taking effect on the next Start, which fails if the chain does not match
+ */
+RAWR_API int RAWR_CALL rawr_Call_SetCaptureChain(rawr_Call *call, rawr_DspChain *chain);
+
+/* the suite agreed with the peer, rawr_SrtpSuite_None until the offer/answer exchange completes */
+RAWR_API rawr_SrtpSuite RAWR_CALL rawr_Call_SrtpSuite(rawr_Call *call);
+
 RAWR_API double RAWR_CALL rawr_Call_InputLevel(rawr_Call *call);
 RAWR_API double RAWR_CALL rawr_Call_OutputLevel(rawr_Call *call);
+RAWR_API int RAWR_CALL rawr_Call_GetStats(rawr_Call *call, rawr_CallStats *out_stats);
+
+/* a snapshot taken without stopping the media threads, the block is large enough that it should not live on the stack */
+RAWR_API int RAWR_CALL rawr_Call_GetMetrics(rawr_Call *call, rawr_CallMetrics *out_metrics);
+
+/* jitter buffer playout delay and the adaptive target it is steering to, in milliseconds */
+RAWR_API int RAWR_CALL rawr_Call_JitterDelay(rawr_Call *call);
+RAWR_API int RAWR_CALL rawr_Call_JitterTargetDelay(rawr_Call *call);
+
+/* packets dropped because the media receive thread fell behind, plus frames dropped on a full playback ring */
+RAWR_API uint64_t RAWR_CALL rawr_Call_DroppedFrames(rawr_Call *call);
 
 #ifdef __cplusplus
 }
@@ -0,0 +1,83 @@
+#ifndef RAWR_CALLENGINE_H
+#define RAWR_CALLENGINE_H
+
+#include "rawr/Call.h"
+#include "rawr/Conference.h"
+#include "rawr/Engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* internal glue between rawr_Engine and the calls it hosts */
+
+struct sa;
+struct sip;
+struct sipsess_sock;
+
+typedef enum rawr_EngineMsg {
+    rawr_EngineMsg_CallStart,
+    rawr_EngineMsg_CallStop,
+    rawr_EngineMsg_Stop,
+} rawr_EngineMsg;
+
+/* engine side, everything but Post and Send must be called on the engine's re thread */
+struct sip *rawr_Engine_Sip(rawr_Engine *engine);
+struct sipsess_sock *rawr_Engine_SipSessSock(rawr_Engine *engine);
+int rawr_Engine_Post(rawr_Engine *engine, rawr_EngineMsg msg, rawr_Call *call);
+void rawr_Engine_Remove(rawr_Engine *engine, rawr_Call *call);
+
+/* assign the call to the least loaded worker, returns its index or rawr_Error when every worker is full */
+int rawr_Engine_Attach(rawr_Engine *engine, rawr_Call *call);
+
+/* the worker's shared RTP address, RTCP is on the port above it */
+void rawr_Engine_LocalAddress(rawr_Engine *engine, int worker, struct sa *out_rtp);
+
+/*
+ * start ticking the call and routing datagrams from its peer addresses to it. a peer sending from anywhere else, from
+ * behind a NAT say, is latched: a datagram from an address no call is routed from is offered to each call on the
+ * worker that has yet to hear from its peer, and the first that authenticates it is routed from and sends to that
+ * address from then on
+ */
+int rawr_Engine_Activate(rawr_Engine *engine, rawr_Call *call, int worker, const struct sa *rtpPeer, const struct sa *rtcpPeer);
+
+/* blocks until the worker is done with its current tick */
+void rawr_Engine_Detach(rawr_Engine *engine, rawr_Call *call, int worker);
+
+/* worker thread only, data must stay untouched until the end of the current tick */
+int rawr_Engine_Send(rawr_Engine *engine, int worker, int rtcp, const struct sa *dst, const uint8_t *data, size_t len);
+
+/* give the conference a worker to be ticked on, returns its index. Remove blocks until that worker is between ticks */
+int rawr_Engine_AddConference(rawr_Engine *engine, rawr_Conference *conference);
+void rawr_Engine_RemoveConference(rawr_Engine *engine, rawr_Conference *conference, int worker);
+
+/* conference side, Collect and Tick on the conference's worker. members are collected as it ticks its calls */
+int rawr_Conference_Worker(rawr_Conference *conference);
+int rawr_Conference_Collect(rawr_Conference *conference, rawr_Call *call);
+int rawr_Conference_Tick(rawr_Conference *conference);
+
+/* call side */
+int rawr_Call_EngineStart(rawr_Call *call);
+void rawr_Call_EngineStop(rawr_Call *call);
+int rawr_Call_MediaTick(rawr_Call *call);
+
+/* on the worker, MediaRecv returns rawr_Success once the datagram has authenticated. Latch sends to src from then on */
+int rawr_Call_MediaRecv(rawr_Call *call, int rtcp, const struct sa *src, const uint8_t *data, size_t len, uint64_t arrival);
+void rawr_Call_MediaLatch(rawr_Call *call, int rtcp, const struct sa *src);
+
+/* a conference member is decoded and sent to by its conference rather than ticked, SetConference only while stopped */
+rawr_Conference *rawr_Call_Conference(rawr_Call *call);
+int rawr_Call_SetConference(rawr_Call *call, rawr_Conference *conference, rawr_Engine *engine);
+
+/* the frame due for playout in the call's own buffer, 0 samples while nothing has played yet */
+int rawr_Call_MediaDecode(rawr_Call *call, rawr_AudioSample **out_samples);
+
+/* send a frame through the call's encoder, or a payload another encoder already made of it */
+int rawr_Call_SendFrame(rawr_Call *call, rawr_AudioSample *samples);
+int rawr_Call_SendPayload(rawr_Call *call, const uint8_t *payload, int len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
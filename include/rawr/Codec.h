@@ -61,6 +61,20 @@ RAWR_API void RAWR_CALL rawr_Codec_Cleanup(rawr_Codec *codec);
 RAWR_API int RAWR_CALL rawr_Codec_Encode(rawr_Codec *codec, void *inBuffer, void *outBuffer);
 RAWR_API int RAWR_CALL rawr_Codec_Decode(rawr_Codec *codec, void *inBuffer, int byteLen, void *outBuffer);
 
+/* rebuild the frame preceding inBuffer from its in-band FEC data */
+RAWR_API int RAWR_CALL rawr_Codec_DecodeFec(rawr_Codec *codec, void *inBuffer, int byteLen, void *outBuffer);
+
+/* packet loss concealment for one frame with no packet at all */
+RAWR_API int RAWR_CALL rawr_Codec_DecodeLost(rawr_Codec *codec, void *outBuffer);
+
+/*
+ * retune a running encoder, taking effect from the next Encode and only touching the settings that differ. call it
+ * from the thread that encodes. bitrate is in bits per second or OPUS_AUTO, packetLossPerc is the expected loss the
+ * encoder spends in-band FEC on, 0 - 100
+ */
+RAWR_API int RAWR_CALL rawr_Codec_Control(rawr_Codec *codec, int bitrate, int inbandFec, int packetLossPerc);
+RAWR_API void RAWR_CALL rawr_Codec_Config(rawr_Codec *codec, rawr_CodecConfig *out_config);
+
 RAWR_API int RAWR_CALL rawr_Codec_FrameSize(rawr_CodecRate sampleRate, rawr_CodecTiming timing);
 RAWR_API int RAWR_CALL rawr_Codec_FrameSizeCode(rawr_CodecRate sampleRate, int sampleCount);
 
@@ -0,0 +1,47 @@
+#ifndef RAWR_CONFERENCE_H
+#define RAWR_CONFERENCE_H
+
+#include "rawr/Platform.h"
+#include "rawr/Call.h"
+#include "rawr/Engine.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * a bridge hosted on an engine. members are engine calls, joined before rawr_Call_Start and dialled out as usual.
+ * once a member's session is up the conference's worker decodes it on the engine's 20 ms tick instead of running
+ * its audio handlers, and sends it a mix of up to RAWR_CONFERENCE_SPEAKERS_MAX of the loudest members. a speaker
+ * hears everyone mixed but themselves and costs an encode of their own, every other member hears the same full mix,
+ * encoded once per tick however many are listening
+ */
+typedef struct rawr_Conference rawr_Conference;
+
+#define RAWR_CONFERENCE_SPEAKERS_MAX 3
+
+typedef struct rawr_ConferenceStats {
+    uint64_t ticks;
+    uint64_t framesSent; /* one per member with media per tick */
+    uint64_t encodes;    /* less than framesSent by what sharing the full mix saved */
+    int members;         /* mixed on the last tick */
+    int speakers;
+} rawr_ConferenceStats;
+
+/* memberMax bounds the joined calls, which all run on the one worker the conference is given */
+RAWR_API int RAWR_CALL rawr_Conference_Setup(rawr_Conference **out_conference, rawr_Engine *engine, int memberMax);
+
+/* every member must have stopped and left first, a conference with members left is logged and not freed */
+RAWR_API void RAWR_CALL rawr_Conference_Cleanup(rawr_Conference *conference);
+
+/* the call must belong to the conference's engine and be stopped, and runs at 48 kHz while it is a member */
+RAWR_API int RAWR_CALL rawr_Conference_Join(rawr_Conference *conference, rawr_Call *call);
+RAWR_API int RAWR_CALL rawr_Conference_Leave(rawr_Conference *conference, rawr_Call *call);
+
+RAWR_API int RAWR_CALL rawr_Conference_GetStats(rawr_Conference *conference, rawr_ConferenceStats *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
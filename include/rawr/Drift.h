@@ -0,0 +1,58 @@
+#ifndef RAWR_DRIFT_H
+#define RAWR_DRIFT_H
+
+#include "rawr/Audio.h"
+
+#include "mn/atomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * holds a playback queue at a steady depth when the clock filling it and the device's clock emptying it disagree.
+ * the depth is sampled each time the device takes a buffer and smoothed over the sawtooth of frames going in and
+ * buffers coming out, and a PI controller turns its distance from the target into a trim for the resampler in
+ * front of the device. the integral settles on the drift between the two clocks, so the trim follows it and the
+ * depth stays put however long the stream runs.
+ */
+
+/* the trim never goes past this, about 2 cents of pitch and far more than any two clocks drift apart */
+#define RAWR_DRIFT_PPM_MAX 1000
+
+typedef struct rawr_Drift {
+    int sampleRate;
+    double level;   /* frames queued, smoothed */
+    double target;  /* frames, negative until taken from where the queue settles */
+    double settled; /* seconds played towards taking the target */
+    double integral;
+    double trim;
+    int idle;
+    mn_atomic_t ppm;       /* hundredths of a ppm, for readers on other threads */
+    mn_atomic_t retargets; /* counted up from the writer's side, and as many as the device side has taken up */
+    uint64_t retargeted;
+} rawr_Drift;
+
+void rawr_Drift_Reset(rawr_Drift *drift, int sampleRate);
+
+/*
+ * called by the device side each time it takes a buffer, with the frames queued before it takes them and the frames
+ * the buffer covers, both at sampleRate. returns the trim for the resampler, positive when the queue is to be
+ * played out faster. an empty queue holds the trim where it is, the stream is idle or has underflowed
+ */
+double rawr_Drift_Update(rawr_Drift *drift, int queued, int frames);
+
+/*
+ * the queue was moved on purpose from the side writing to it, so its depth is taken again as the target once it has
+ * settled. the trim meanwhile is the integral's estimate of the drift between the clocks alone. any thread
+ */
+void rawr_Drift_Retarget(rawr_Drift *drift);
+
+/* the trim being applied, in ppm */
+double rawr_Drift_Ppm(rawr_Drift *drift);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
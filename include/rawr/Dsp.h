@@ -0,0 +1,78 @@
+#ifndef RAWR_DSP_H
+#define RAWR_DSP_H
+
+#include "rawr/Platform.h"
+#include "rawr/Audio.h"
+#include "rawr/Histogram.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * a chain of processors run in place over each captured frame before it is encoded, one mono frame of a fixed size
+ * at a time. the built in stages are a high-pass to take out DC and rumble, automatic gain control, a noise gate
+ * that follows the noise floor and a lookahead limiter, usually added in that order, and a chain may hold stages of
+ * the caller's own. every stage is timed, and its timings can be read while the chain runs
+ */
+
+#define RAWR_DSP_STAGES_MAX 8
+
+typedef struct rawr_DspChain rawr_DspChain;
+
+/* runs on whichever thread reads the capture, so it must not block */
+typedef void (*rawr_DspProcess)(void *state, rawr_AudioSample *samples, int sampleCount);
+typedef void (*rawr_DspCleanup)(void *state);
+
+typedef struct rawr_DspProcessor {
+    const char *name;
+    rawr_DspProcess process;
+    rawr_DspCleanup cleanup; /* given state when the chain is cleaned up, may be NULL */
+    void *state;
+} rawr_DspProcessor;
+
+/* frameSize is the samples every Process takes, a multiple of 16 */
+RAWR_API int RAWR_CALL rawr_DspChain_Setup(rawr_DspChain **out_chain, int sampleRate, int frameSize);
+
+/* cleans up every stage as well, once nothing is attached to the chain */
+RAWR_API void RAWR_CALL rawr_DspChain_Cleanup(rawr_DspChain *chain);
+
+RAWR_API int RAWR_CALL rawr_DspChain_SampleRate(rawr_DspChain *chain);
+RAWR_API int RAWR_CALL rawr_DspChain_FrameSize(rawr_DspChain *chain);
+
+/* a stage of the caller's own, run after those already added. the chain owns it from here, even if adding fails */
+RAWR_API int RAWR_CALL rawr_DspChain_Add(rawr_DspChain *chain, const rawr_DspProcessor *processor);
+
+/* first-order high-pass, 80 Hz or so takes out DC and handling noise and leaves voice alone */
+RAWR_API int RAWR_CALL rawr_DspChain_AddHighPass(rawr_DspChain *chain, int cutoffHz);
+
+/* brings speech towards targetDbfs RMS, never boosting by more than maxGainDb, and leaves gaps in speech alone */
+RAWR_API int RAWR_CALL rawr_DspChain_AddAgc(rawr_DspChain *chain, double targetDbfs, double maxGainDb);
+
+/* turns down by attenuationDb whatever is not clearly above the noise floor it tracks, or quieter than thresholdDbfs */
+RAWR_API int RAWR_CALL rawr_DspChain_AddGate(rawr_DspChain *chain, double thresholdDbfs, double attenuationDb);
+
+/* holds peaks to ceilingDbfs, looking ahead 16 samples so it is never late, and delaying the audio that much */
+RAWR_API int RAWR_CALL rawr_DspChain_AddLimiter(rawr_DspChain *chain, double ceilingDbfs);
+
+/* runs every stage over one frame in place */
+RAWR_API void RAWR_CALL rawr_DspChain_Process(rawr_DspChain *chain, rawr_AudioSample *samples);
+
+RAWR_API int RAWR_CALL rawr_DspChain_StageCount(rawr_DspChain *chain);
+RAWR_API const char * RAWR_CALL rawr_DspChain_StageName(rawr_DspChain *chain, int stage);
+
+/* nanoseconds per frame the stage has taken, taken without stopping the chain */
+RAWR_API int RAWR_CALL rawr_DspChain_StageTiming(rawr_DspChain *chain, int stage, rawr_HistogramSnapshot *out_snapshot);
+
+/*
+ * run every frame Read or BeginRead hands out through the chain first, NULL to stop. the stream must be mono and the
+ * chain set up for its rate and frame size, and it is set while nothing is reading. a call cancelling echo wants the
+ * chain on the call instead, where it runs after the canceller and leaves it a linear echo path to model
+ */
+RAWR_API int RAWR_CALL rawr_AudioStream_SetCaptureChain(rawr_AudioStream *stream, rawr_DspChain *chain);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,52 @@
+#ifndef RAWR_ECHO_H
+#define RAWR_ECHO_H
+
+#include "rawr/Audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * acoustic echo cancellation for one mono stream. the far end is rendered into a history as it is played and each
+ * captured frame is processed once that frame's worth of far end is in. a search over block envelopes finds how
+ * long the far end takes to come back in through the microphone, and a partitioned block frequency domain adaptive
+ * filter models the RAWR_ECHO_TAIL_MS of echo path from there and subtracts its estimate from the capture.
+ */
+
+/* echo path covered past the bulk delay, and the longest bulk delay searched for */
+#define RAWR_ECHO_TAIL_MS 64
+#define RAWR_ECHO_DELAY_MAX_MS 480
+
+typedef struct rawr_Echo rawr_Echo;
+
+typedef struct rawr_EchoStats {
+    int delayMs;          /* where the filter starts, -1 until the far end has been found in the capture */
+    double erleDb;        /* echo return loss enhancement while the far end is active, smoothed */
+    uint64_t adaptSkipped; /* blocks filtered without adapting to stay within the budget */
+    uint64_t bypassed;     /* blocks passed through uncancelled, the budget was spent before they were filtered */
+} rawr_EchoStats;
+
+/* frameSize is what every Process takes, and must be a multiple of 16 */
+int rawr_Echo_Setup(rawr_Echo **out_echo, int sampleRate, int frameSize);
+void rawr_Echo_Cleanup(rawr_Echo *echo);
+
+/* forgets the far end, the delay and the filter */
+void rawr_Echo_Reset(rawr_Echo *echo);
+
+/* time Process may take per frame in nanoseconds, 0 for no limit */
+void rawr_Echo_SetBudget(rawr_Echo *echo, uint64_t budgetNs);
+
+/* the far end as it went to the device, in any amounts */
+void rawr_Echo_Render(rawr_Echo *echo, const rawr_AudioSample *samples, int count);
+
+/* cancel echo out of one captured frame in place, the last sample rendered being as old as its last sample */
+void rawr_Echo_Process(rawr_Echo *echo, rawr_AudioSample *samples);
+
+void rawr_Echo_Stats(rawr_Echo *echo, rawr_EchoStats *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
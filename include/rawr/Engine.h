@@ -0,0 +1,36 @@
+#ifndef RAWR_ENGINE_H
+#define RAWR_ENGINE_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * hosts many calls on one SIP stack and event loop, with media for every established call driven by a
+ * fixed pool of worker threads. create calls against it with rawr_Call_SetupEngine, after which the usual
+ * rawr_Call_* functions apply. engine calls are outgoing only, incoming INVITEs are answered busy
+ */
+typedef struct rawr_Engine rawr_Engine;
+
+/* workerCount 0 sizes the media pool to the number of cores */
+RAWR_API int RAWR_CALL rawr_Engine_Setup(rawr_Engine **out_engine, int workerCount);
+RAWR_API void RAWR_CALL rawr_Engine_Cleanup(rawr_Engine *engine);
+
+RAWR_API int RAWR_CALL rawr_Engine_Start(rawr_Engine *engine);
+
+/* hangs up any calls still running and waits for the SIP stack to wind down */
+RAWR_API int RAWR_CALL rawr_Engine_Stop(rawr_Engine *engine);
+
+RAWR_API int RAWR_CALL rawr_Engine_WorkerCount(rawr_Engine *engine);
+RAWR_API int RAWR_CALL rawr_Engine_CallCount(rawr_Engine *engine);
+
+/* media ticks that ran past their frame deadline, summed over all workers */
+RAWR_API uint64_t RAWR_CALL rawr_Engine_Overruns(rawr_Engine *engine);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
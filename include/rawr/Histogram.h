@@ -0,0 +1,48 @@
+#ifndef RAWR_HISTOGRAM_H
+#define RAWR_HISTOGRAM_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * HDR style log-linear histogram: exact below 16, then 8 buckets per power of two, so any recorded value is
+ * reported within 12.5% up to 2^40. Record is lock-free and may be called from any number of threads.
+ */
+
+#define RAWR_HISTOGRAM_SUB_BITS 3
+#define RAWR_HISTOGRAM_MAGNITUDE_MAX 40
+#define RAWR_HISTOGRAM_LINEAR (2 << RAWR_HISTOGRAM_SUB_BITS)
+#define RAWR_HISTOGRAM_BUCKETS (RAWR_HISTOGRAM_LINEAR + (RAWR_HISTOGRAM_MAGNITUDE_MAX - RAWR_HISTOGRAM_SUB_BITS - 1) * (1 << RAWR_HISTOGRAM_SUB_BITS))
+
+typedef struct rawr_Histogram rawr_Histogram;
+
+typedef struct rawr_HistogramSnapshot {
+    uint64_t count;
+    uint64_t sum;
+    uint64_t buckets[RAWR_HISTOGRAM_BUCKETS];
+} rawr_HistogramSnapshot;
+
+RAWR_API int RAWR_CALL rawr_Histogram_Setup(rawr_Histogram **out_histogram);
+RAWR_API void RAWR_CALL rawr_Histogram_Cleanup(rawr_Histogram *histogram);
+
+/* not safe against concurrent Record, reset while the writers are idle */
+RAWR_API void RAWR_CALL rawr_Histogram_Reset(rawr_Histogram *histogram);
+
+/* values past the top of the range land in the last bucket */
+RAWR_API void RAWR_CALL rawr_Histogram_Record(rawr_Histogram *histogram, uint64_t value);
+
+/* a copy of the counts that is consistent bucket by bucket, writers are never held up */
+RAWR_API void RAWR_CALL rawr_Histogram_Snapshot(rawr_Histogram *histogram, rawr_HistogramSnapshot *out_snapshot);
+
+/* highest value equivalent to the given percentile (0 - 100), 0 when nothing was recorded */
+RAWR_API uint64_t RAWR_CALL rawr_Histogram_Percentile(const rawr_HistogramSnapshot *snapshot, double percentile);
+RAWR_API double RAWR_CALL rawr_Histogram_Mean(const rawr_HistogramSnapshot *snapshot);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
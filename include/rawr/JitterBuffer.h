@@ -0,0 +1,63 @@
+#ifndef RAWR_JITTERBUFFER_H
+#define RAWR_JITTERBUFFER_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RAWR_JITTERBUFFER_SLOTS 64
+#define RAWR_JITTERBUFFER_PAYLOAD_MAX 1500
+
+/* target delay is this many times the measured interarrival jitter, on top of one frame */
+#define RAWR_JITTERBUFFER_JITTER_FACTOR 4
+
+typedef struct rawr_JitterBuffer rawr_JitterBuffer;
+
+typedef enum rawr_JitterBufferResult {
+    rawr_JitterBufferResult_Frame,     /* a frame was returned for playout */
+    rawr_JitterBufferResult_Buffering, /* filling up to the target delay, nothing to play */
+    rawr_JitterBufferResult_Lost,      /* the frame due for playout never arrived */
+    rawr_JitterBufferResult_Empty,     /* nothing buffered at all, an underflow or the sender in DTX */
+    rawr_JitterBufferResult_Silence,   /* the sender skipped this frame under DTX, play comfort noise */
+} rawr_JitterBufferResult;
+
+typedef struct rawr_JitterBufferStats {
+    uint64_t put;
+    uint64_t late;
+    uint64_t duplicate;
+    uint64_t lost;
+    uint64_t recoverable;
+    uint64_t overflow;
+    uint64_t underflow;
+    uint64_t dropped;
+    uint64_t inserted;
+    uint64_t silence;
+    uint64_t spurts;
+} rawr_JitterBufferStats;
+
+RAWR_API int RAWR_CALL rawr_JitterBuffer_Setup(rawr_JitterBuffer **out_jb, int clockRate, int frameSamples, int minDelayMs, int maxDelayMs);
+RAWR_API void RAWR_CALL rawr_JitterBuffer_Cleanup(rawr_JitterBuffer *jb);
+RAWR_API void RAWR_CALL rawr_JitterBuffer_Flush(rawr_JitterBuffer *jb);
+
+/* store one RTP payload, late and duplicate packets are counted and discarded */
+RAWR_API int RAWR_CALL rawr_JitterBuffer_Put(rawr_JitterBuffer *jb, uint16_t seq, uint32_t ts, const void *payload, int byteLen);
+
+/*
+ * called once per playout frame, payload must hold RAWR_JITTERBUFFER_PAYLOAD_MAX bytes.
+ * on Lost the following frame is copied out when it is already buffered (it stays queued), so its
+ * in-band FEC can rebuild the gap. out_byteLen is 0 when there is nothing to recover from.
+ */
+RAWR_API rawr_JitterBufferResult RAWR_CALL rawr_JitterBuffer_Get(rawr_JitterBuffer *jb, void *payload, int *out_byteLen);
+
+RAWR_API int RAWR_CALL rawr_JitterBuffer_Delay(rawr_JitterBuffer *jb);
+RAWR_API int RAWR_CALL rawr_JitterBuffer_TargetDelay(rawr_JitterBuffer *jb);
+RAWR_API int RAWR_CALL rawr_JitterBuffer_Jitter(rawr_JitterBuffer *jb);
+RAWR_API void RAWR_CALL rawr_JitterBuffer_Stats(rawr_JitterBuffer *jb, rawr_JitterBufferStats *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
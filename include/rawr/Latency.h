@@ -0,0 +1,51 @@
+#ifndef RAWR_LATENCY_H
+#define RAWR_LATENCY_H
+
+#include "rawr/Audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * holds a playback queue at a target depth by time-stretching the frames written to it. each write is timed against
+ * a schedule of one frame per frame's worth of time, and the target is the 95th percentile of how late writes land
+ * over the last few seconds, plus a device buffer and half a frame, kept between the bounds it was set up with. it
+ * rises as soon as writes get later and comes back down a millisecond a second. a frame written while the queue
+ * runs deep is shortened by a pitch period and one written while it runs shallow is lengthened by one
+ */
+
+/* writes the percentile is taken over, about five seconds of 20 ms frames, and how often it is taken again */
+#define RAWR_LATENCY_WINDOW 256
+#define RAWR_LATENCY_UPDATE 50
+
+/* a write this late is the writer starting over after a pause, not jitter */
+#define RAWR_LATENCY_RESTART_MS 1000
+
+typedef struct rawr_Latency rawr_Latency;
+
+/* a mono frame of frameSize at a rate that is a multiple of 4 kHz, and a target between minMs and maxMs */
+int rawr_Latency_Setup(rawr_Latency **out_latency, int sampleRate, int frameSize, int minMs, int maxMs);
+void rawr_Latency_Cleanup(rawr_Latency *latency);
+
+/* the most Apply writes, one frame and the longest period */
+int rawr_Latency_OutputMax(rawr_Latency *latency);
+
+/*
+ * called as each frame is about to be written, with the frames queued and the room left in the queue, and the
+ * device buffer in frames. returns nonzero when the frame will be stretched, in which case it has to be handed to
+ * Apply rather than written where it lies
+ */
+int rawr_Latency_Plan(rawr_Latency *latency, int queued, int room, int deviceFrames);
+
+/* runs what Plan decided over frame, pointing out at what to queue and returning how much of it there is */
+int rawr_Latency_Apply(rawr_Latency *latency, const rawr_AudioSample *frame, const rawr_AudioSample **out);
+
+/* the target in ms, for readers on other threads */
+int rawr_Latency_Target(rawr_Latency *latency);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
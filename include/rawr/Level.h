@@ -0,0 +1,46 @@
+#ifndef RAWR_LEVEL_H
+#define RAWR_LEVEL_H
+
+#include "rawr/Audio.h"
+
+#include "mn/atomic.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * RMS and peak metering for the device callbacks. Record costs one vectorised pass over the block and a single
+ * atomic store, the logarithms wait until someone asks for a level. Each block lands in a slot of a small ring, so
+ * readers on any thread see the last RAWR_LEVEL_BLOCKS blocks without a lock and never a half written one.
+ */
+
+#define RAWR_LEVEL_BLOCKS 8
+
+/* levels are reported from 0 at this many dB below full scale to 1 at full scale */
+#define RAWR_LEVEL_RANGE_DB 60.0
+
+typedef void (*rawr_LevelKernel)(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak);
+
+typedef struct rawr_LevelMeter {
+    rawr_LevelKernel kernel;
+    mn_atomic_t head;
+    mn_atomic_t blocks[RAWR_LEVEL_BLOCKS];
+} rawr_LevelMeter;
+
+/* the sum of squares and largest magnitude of count samples, through the best kernel this CPU has */
+void rawr_Level_Measure(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak);
+
+/* forgets recorded blocks and picks the kernel, so call it again after rawr_Simd_Limit */
+void rawr_LevelMeter_Reset(rawr_LevelMeter *meter);
+void rawr_LevelMeter_Record(rawr_LevelMeter *meter, const rawr_AudioSample *samples, int count);
+
+/* 0 to 1 over RAWR_LEVEL_RANGE_DB of the recent blocks' mean power and of their loudest sample */
+double rawr_LevelMeter_Rms(rawr_LevelMeter *meter);
+double rawr_LevelMeter_Peak(rawr_LevelMeter *meter);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef RAWR_MIX_H
+#define RAWR_MIX_H
+
+#include "rawr/Audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * summing 16 bit streams for the conference bridge. sources are added into 32 bit sums, which cannot clip however
+ * many are mixed, and a mix comes out of the sums with one source optionally taken back out and saturated to 16
+ * bits on the way, so every mix-minus costs one pass over the sums rather than a pass per source.
+ */
+
+typedef void (*rawr_MixAddKernel)(int32_t *sums, const rawr_AudioSample *samples, int count);
+typedef void (*rawr_MixOutKernel)(rawr_AudioSample *out, const int32_t *sums, const rawr_AudioSample *minus, int count);
+
+typedef struct rawr_MixKernels {
+    rawr_MixAddKernel add;
+    rawr_MixOutKernel out;
+} rawr_MixKernels;
+
+/* the best kernels this CPU has, picked once by whoever mixes. out takes a NULL minus for the full mix */
+void rawr_Mix_Kernels(rawr_MixKernels *out_kernels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef RAWR_RATECONTROL_H
+#define RAWR_RATECONTROL_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Closed loop sender bitrate and FEC control, fed by the reception reports the peer sends about our stream. Loss
+ * above RAWR_RATECONTROL_LOSS_HIGH cuts the bitrate in proportion to the loss, a round trip or jitter well above
+ * the best seen so far backs it off gently, and a clean report grows it again. FEC follows the smoothed loss.
+ */
+
+#define RAWR_RATECONTROL_BITRATE_MIN 8000
+#define RAWR_RATECONTROL_BITRATE_MAX 64000
+#define RAWR_RATECONTROL_BITRATE_START 32000
+
+/* fraction lost below which the bitrate may grow, and above which it is cut */
+#define RAWR_RATECONTROL_LOSS_LOW 0.02
+#define RAWR_RATECONTROL_LOSS_HIGH 0.10
+
+typedef struct rawr_RateControl rawr_RateControl;
+
+typedef struct rawr_RateControlTarget {
+    int bitrate;
+    int inbandFec;
+    int packetLossPerc;
+} rawr_RateControlTarget;
+
+int rawr_RateControl_Setup(rawr_RateControl **out_rc, int minBitrate, int maxBitrate);
+void rawr_RateControl_Cleanup(rawr_RateControl *rc);
+void rawr_RateControl_Reset(rawr_RateControl *rc);
+
+/* feed one reception report about our stream, rttMs is 0 while unknown. returns 1 when the target changed */
+int rawr_RateControl_Update(rawr_RateControl *rc, double fractionLost, double rttMs, double jitterMs);
+
+void rawr_RateControl_Target(rawr_RateControl *rc, rawr_RateControlTarget *out_target);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,61 @@
+#ifndef RAWR_RESAMPLER_H
+#define RAWR_RESAMPLER_H
+
+#include "rawr/Audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Polyphase windowed sinc sample rate converter for interleaved 16 bit audio. The rates are reduced to L/M and each
+ * output frame is one dot product of RAWR_RESAMPLER_TAPS coefficients against the input, widened by M/L when
+ * converting down so the cutoff still sits below the lower rate's Nyquist. The dot product has SSE, AVX2 and NEON
+ * kernels picked at Setup.
+ */
+
+#define RAWR_RESAMPLER_TAPS 64
+#define RAWR_RESAMPLER_CHANNELS_MAX 2
+#define RAWR_RESAMPLER_PHASES_MAX 4096
+
+/*
+ * a trim may stretch how much input each output frame takes by up to this fraction either way. filters have at least
+ * RAWR_RESAMPLER_TRIM_PHASES phases, and a trimmed output landing between two is interpolated from both
+ */
+#define RAWR_RESAMPLER_TRIM_MAX 0.002
+#define RAWR_RESAMPLER_TRIM_PHASES 32
+
+typedef struct rawr_Resampler rawr_Resampler;
+
+/* blockMax is the most frames a single Process is handed, which is what bounds its cost */
+int rawr_Resampler_Setup(rawr_Resampler **out_rs, int inRate, int outRate, int channelCount, int blockMax);
+void rawr_Resampler_Cleanup(rawr_Resampler *rs);
+void rawr_Resampler_Reset(rawr_Resampler *rs);
+
+/* bounds for sizing buffers, they hold whatever state the resampler is in */
+int rawr_Resampler_OutputMax(rawr_Resampler *rs, int inCount);
+int rawr_Resampler_InputMax(rawr_Resampler *rs, int outCount);
+
+/* exactly how many frames the next Process needs to produce outCount frames, for a consumer on a fixed clock */
+int rawr_Resampler_InputFor(rawr_Resampler *rs, int outCount);
+
+/*
+ * consumes every input frame and returns the frames written. outCapacity must hold OutputMax(inCount), unless
+ * inCount came from InputFor(outCapacity)
+ */
+int rawr_Resampler_Process(rawr_Resampler *rs, const rawr_AudioSample *in, int inCount, rawr_AudioSample *out, int outCapacity);
+
+/*
+ * take (1 + trim) times as much input for the same output from the next Process on, to follow a clock drifting
+ * against the nominal rates. clamped to RAWR_RESAMPLER_TRIM_MAX, and 0 converts exactly at the nominal rates again
+ */
+void rawr_Resampler_SetTrim(rawr_Resampler *rs, double trim);
+
+/* input frames of delay the filter adds */
+int rawr_Resampler_Latency(rawr_Resampler *rs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
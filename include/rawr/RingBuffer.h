@@ -9,6 +9,7 @@
  * modified for SMP safety on OS X by Bjorn Roche.
  * also allowed for const where possible.
  * modified for multiple-byte-sized data elements by Sven Fischer 
+ * indices moved to acquire/release atomics on separate cache lines for rawr
  *
  * Note that this is safe only for a single-thread reader
  * and a single-thread writer.
@@ -65,11 +66,21 @@
  The memory area used to store the buffer elements must be allocated by 
  the client prior to calling rawr_RingBuffer_Initialize() and must outlive
  the use of the ring buffer.
+
+ The write index belongs to the writer and the read index to the reader. Each
+ is published with a release store after the elements it covers have been
+ copied, and picked up by the other side with an acquire load. Each side keeps
+ a private copy of the other side's index and only goes back to the shared one
+ when that copy says there is not enough room or data, so a writer that stays
+ ahead of the reader does not pull the reader's cache line on every call.
+ Indices run freely and wrap with size_t.
  
  @note The ring buffer functions are not normally exposed in the PortAudio libraries. 
  If you want to call them then you will need to add pa_ringbuffer.c to your application source code.
 */
 
+#include "mn/atomic.h"
+
 #include <stdint.h>
 #include <stddef.h>
 
@@ -77,14 +88,23 @@
 extern "C" {
 #endif /* __cplusplus */
 
+#define RAWR_RINGBUFFER_CACHE_LINE 64
+
 typedef struct rawr_RingBuffer {
-    size_t bufferSize;          /**< Number of elements in FIFO. Power of 2. Set by PaUtil_InitRingBuffer. */
-    volatile size_t writeIndex; /**< Index of next writable element. Set by rawr_RingBuffer_AdvanceWriteIndex. */
-    volatile size_t readIndex;  /**< Index of next readable element. Set by rawr_RingBuffer_AdvanceReadIndex. */
-    size_t bigMask;             /**< Used for wrapping indices with extra bit to distinguish full/empty. */
-    size_t smallMask;           /**< Used for fitting indices to buffer. */
-    size_t elementSizeBytes;    /**< Number of bytes per element. */
-    char *buffer;                           /**< Pointer to the buffer containing the actual data. */
+    size_t bufferSize;       /**< Number of elements in FIFO. Power of 2. Set by rawr_RingBuffer_Initialize. */
+    size_t bigMask;          /**< Used for wrapping the positions returned by the Advance functions. */
+    size_t smallMask;        /**< Used for fitting indices to buffer. */
+    size_t elementSizeBytes; /**< Number of bytes per element. */
+    char *buffer;            /**< Pointer to the buffer containing the actual data. */
+    uint8_t pad0[RAWR_RINGBUFFER_CACHE_LINE - 4 * sizeof(size_t) - sizeof(char *)];
+
+    mn_atomic_t writeIndex;  /**< Index of next writable element. Set by rawr_RingBuffer_AdvanceWriteIndex. */
+    size_t readIndexCache;   /**< Writer's last look at readIndex. */
+    uint8_t pad1[RAWR_RINGBUFFER_CACHE_LINE - sizeof(mn_atomic_t) - sizeof(size_t)];
+
+    mn_atomic_t readIndex;   /**< Index of next readable element. Set by rawr_RingBuffer_AdvanceReadIndex. */
+    size_t writeIndexCache;  /**< Reader's last look at writeIndex. */
+    uint8_t pad2[RAWR_RINGBUFFER_CACHE_LINE - sizeof(mn_atomic_t) - sizeof(size_t)];
 } rawr_RingBuffer;
 
 /** Initialize Ring Buffer to empty state ready to have elements written to it.
@@ -109,6 +129,7 @@ size_t rawr_RingBuffer_Initialize(rawr_RingBuffer *rbuf, size_t elementSizeBytes
 void rawr_RingBuffer_Flush(rawr_RingBuffer *rbuf);
 
 /** Retrieve the number of elements available in the ring buffer for writing.
+ Safe to call from either side, and always reads both shared indices.
 
  @param rbuf The ring buffer.
 
@@ -117,6 +138,7 @@ void rawr_RingBuffer_Flush(rawr_RingBuffer *rbuf);
 size_t rawr_RingBuffer_GetWriteAvailable(const rawr_RingBuffer *rbuf);
 
 /** Retrieve the number of elements available in the ring buffer for reading.
+ Safe to call from either side, and always reads both shared indices.
 
  @param rbuf The ring buffer.
 
@@ -148,7 +170,7 @@ size_t rawr_RingBuffer_Write(rawr_RingBuffer *rbuf, const void *data, size_t ele
 */
 size_t rawr_RingBuffer_Read(rawr_RingBuffer *rbuf, void *data, size_t elementCount);
 
-/** Get address of region(s) to which we can write data.
+/** Get address of region(s) to which we can write data. Writer only.
 
  @param rbuf The ring buffer.
 
@@ -170,7 +192,8 @@ size_t rawr_RingBuffer_Read(rawr_RingBuffer *rbuf, void *data, size_t elementCou
 */
 size_t rawr_RingBuffer_GetWriteRegions(rawr_RingBuffer *rbuf, size_t elementCount, void **dataPtr1, size_t *sizePtr1, void **dataPtr2, size_t *sizePtr2);
 
-/** Advance the write index to the next location to be written.
+/** Advance the write index to the next location to be written, publishing the
+ elements written through the regions. Writer only.
 
  @param rbuf The ring buffer.
 
@@ -180,7 +203,7 @@ size_t rawr_RingBuffer_GetWriteRegions(rawr_RingBuffer *rbuf, size_t elementCoun
 */
 size_t rawr_RingBuffer_AdvanceWriteIndex(rawr_RingBuffer *rbuf, size_t elementCount);
 
-/** Get address of region(s) from which we can read data.
+/** Get address of region(s) from which we can read data. Reader only.
 
  @param rbuf The ring buffer.
 
@@ -202,7 +225,8 @@ size_t rawr_RingBuffer_AdvanceWriteIndex(rawr_RingBuffer *rbuf, size_t elementCo
 */
 size_t rawr_RingBuffer_GetReadRegions(rawr_RingBuffer *rbuf, size_t elementCount, void **dataPtr1, size_t *sizePtr1, void **dataPtr2, size_t *sizePtr2);
 
-/** Advance the read index to the next location to be read.
+/** Advance the read index to the next location to be read, handing the
+ regions back to the writer. Reader only.
 
  @param rbuf The ring buffer.
 
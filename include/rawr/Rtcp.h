@@ -0,0 +1,66 @@
+#ifndef RAWR_RTCP_H
+#define RAWR_RTCP_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* RFC 3550 minimum report interval, each report is randomized to 0.5x - 1.5x of this */
+#define RAWR_RTCP_INTERVAL_MS 5000
+#define RAWR_RTCP_SOURCES_MAX 4
+#define RAWR_RTCP_PACKET_MAX 512
+
+struct mbuf;
+struct rtcp_msg;
+
+typedef struct rawr_Rtcp rawr_Rtcp;
+
+typedef struct rawr_RtcpStats {
+    uint64_t packetsSent;
+    uint64_t bytesSent;
+    uint64_t packetsReceived;
+    uint64_t reportsSent;
+    uint64_t reportsReceived;
+
+    /* what we measure on the stream we receive */
+    int64_t packetsLost;
+    double fractionLost;
+    double jitterMs;
+
+    /* what the peer reports about the stream we send */
+    int64_t remotePacketsLost;
+    double remoteFractionLost;
+    double remoteJitterMs;
+
+    /* 0 until the peer echoes one of our sender reports */
+    double rttMs;
+} rawr_RtcpStats;
+
+int rawr_Rtcp_Setup(rawr_Rtcp **out_rtcp, uint32_t ssrc, int clockRate);
+void rawr_Rtcp_Cleanup(rawr_Rtcp *rtcp);
+void rawr_Rtcp_Reset(rawr_Rtcp *rtcp);
+
+/* account for an outgoing RTP packet */
+void rawr_Rtcp_OnSend(rawr_Rtcp *rtcp, uint32_t ts, size_t payloadBytes);
+
+/* account for an incoming RTP packet, arrival is the mn_tstamp taken when it came off the socket */
+void rawr_Rtcp_OnReceive(rawr_Rtcp *rtcp, uint32_t ssrc, uint16_t seq, uint32_t ts, uint64_t arrival);
+
+/* process one decoded SR or RR, anything else is ignored */
+void rawr_Rtcp_Handle(rawr_Rtcp *rtcp, const struct rtcp_msg *msg);
+
+/* returns 1 when the next report interval has elapsed */
+int rawr_Rtcp_Due(rawr_Rtcp *rtcp);
+
+/* write a compound SR (or RR if we have sent nothing) + SDES into mb and schedule the next report */
+int rawr_Rtcp_Encode(rawr_Rtcp *rtcp, struct mbuf *mb);
+
+void rawr_Rtcp_Stats(rawr_Rtcp *rtcp, rawr_RtcpStats *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
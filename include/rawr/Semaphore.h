@@ -0,0 +1,25 @@
+#ifndef RAWR_SEMAPHORE_H
+#define RAWR_SEMAPHORE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define RAWR_SEMAPHORE_TIMEOUT 1
+
+typedef struct rawr_Semaphore rawr_Semaphore;
+
+int rawr_Semaphore_Setup(rawr_Semaphore **out_sem);
+void rawr_Semaphore_Cleanup(rawr_Semaphore *sem);
+
+/* safe to call from a realtime audio callback, never blocks */
+int rawr_Semaphore_Post(rawr_Semaphore *sem);
+
+/* returns rawr_Success when signalled, RAWR_SEMAPHORE_TIMEOUT after timeoutMs, rawr_Error on failure */
+int rawr_Semaphore_Wait(rawr_Semaphore *sem, int timeoutMs);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef RAWR_SIMD_H
+#define RAWR_SIMD_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* instruction sets the compiler can emit for this target, whether the CPU running us has them is rawr_Simd_Features */
+#if defined(__x86_64__) || defined(_M_X64)
+#    define RAWR_SIMD_X86 1
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__) || defined(_M_ARM64)
+#    define RAWR_SIMD_NEON 1
+#endif
+
+/* AVX2 kernels are compiled per function so the rest of the library still runs on any x86-64 */
+#if RAWR_SIMD_X86 && (RAWR_C_GCC || RAWR_C_CLANG)
+#    define RAWR_SIMD_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#    define RAWR_SIMD_TARGET_AVX2
+#endif
+
+typedef enum rawr_SimdFeatures {
+    rawr_SimdFeatures_None,
+    rawr_SimdFeatures_SSE2 = 1 << 0,
+    rawr_SimdFeatures_AVX2 = 1 << 1,
+    rawr_SimdFeatures_NEON = 1 << 2,
+    rawr_SimdFeatures_All = 0xff,
+} rawr_SimdFeatures;
+
+/* probed on first use. kernels are picked when the object using them is set up */
+rawr_SimdFeatures rawr_Simd_Features(void);
+
+/* mask off features so benchmarks can compare kernels on one machine, rawr_SimdFeatures_All restores them */
+void rawr_Simd_Limit(rawr_SimdFeatures features);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef RAWR_STRETCH_H
+#define RAWR_STRETCH_H
+
+#include "rawr/Audio.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * pitch preserving time-scale modification of decoded frames by WSOLA. a frame is shortened by cross-fading one
+ * pitch period into the next and playing on from there, or lengthened by fading back into the period before. the
+ * period is the lag the frame best correlates with itself at, searched coarsely at 4 kHz and refined at the full
+ * rate, so every frame costs about the same. frames that are neither clearly periodic nor down at the noise floor
+ * come back as they are, stretching onsets and the like is what makes time-scaling audible
+ */
+
+/* the periods searched, 400 Hz down to 100 Hz or as long as half the frame allows */
+#define RAWR_STRETCH_LAG_MIN_US 2500
+#define RAWR_STRETCH_LAG_MAX_US 10000
+
+typedef struct rawr_Stretch rawr_Stretch;
+
+/* frameSize is what every frame given is, at a rate that is a multiple of 4 kHz */
+int rawr_Stretch_Setup(rawr_Stretch **out_stretch, int sampleRate, int frameSize);
+void rawr_Stretch_Cleanup(rawr_Stretch *stretch);
+
+/* the most Expand writes, one frame and the longest period */
+int rawr_Stretch_OutputMax(rawr_Stretch *stretch);
+
+/* one frame shortened or lengthened by a period into out, returning the samples written, frameSize if it was left alone */
+int rawr_Stretch_Accelerate(rawr_Stretch *stretch, const rawr_AudioSample *frame, rawr_AudioSample *out);
+int rawr_Stretch_Expand(rawr_Stretch *stretch, const rawr_AudioSample *frame, rawr_AudioSample *out);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef RAWR_UDPBATCH_H
+#define RAWR_UDPBATCH_H
+
+#include "rawr/Platform.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Batched datagram I/O for media sockets. Sends are queued and go out together on Flush, using sendmmsg and
+ * UDP GSO on Linux and one sendto per packet elsewhere. Recv drains a socket with recvmmsg into a packet vector.
+ */
+
+#define RAWR_UDPBATCH_PACKET_MAX 1500
+
+/* GSO segments per message, the kernel refuses more than 64 */
+#define RAWR_UDPBATCH_GSO_SEGMENTS_MAX 64
+
+struct sa;
+
+typedef struct rawr_UdpBatch rawr_UdpBatch;
+
+typedef struct rawr_UdpBatchStats {
+    uint64_t sendCalls;
+    uint64_t packetsSent;
+    uint64_t gsoSends;
+    uint64_t sendErrors;
+    uint64_t recvCalls;
+    uint64_t packetsReceived;
+} rawr_UdpBatchStats;
+
+/* data points into the batch's receive vector and is only valid for the duration of the call */
+typedef void (*rawr_UdpBatch_RecvHandler)(const struct sa *src, uint8_t *data, size_t len, uint64_t arrival, void *arg);
+
+/* open a non-blocking UDP socket bound to local, the bound port is written back to local */
+int rawr_UdpBatch_Open(RAWR_SOCK_TYPE *out_fd, struct sa *local);
+void rawr_UdpBatch_Close(RAWR_SOCK_TYPE fd);
+
+int rawr_UdpBatch_Setup(rawr_UdpBatch **out_batch, int sendCapacity, int recvCapacity);
+void rawr_UdpBatch_Cleanup(rawr_UdpBatch *batch);
+
+/* GSO is on by default wherever the kernel supports it */
+void rawr_UdpBatch_SetGso(rawr_UdpBatch *batch, int enabled);
+int rawr_UdpBatch_Gso(rawr_UdpBatch *batch);
+
+/* data is not copied and must stay valid until the next Flush, a full batch is flushed first */
+int rawr_UdpBatch_Queue(rawr_UdpBatch *batch, RAWR_SOCK_TYPE fd, const struct sa *dst, const uint8_t *data, size_t len);
+
+/* returns the number of packets handed to the kernel, or rawr_Error */
+int rawr_UdpBatch_Flush(rawr_UdpBatch *batch);
+
+/* read until the socket would block, returns the number of packets received or rawr_Error */
+int rawr_UdpBatch_Recv(rawr_UdpBatch *batch, RAWR_SOCK_TYPE fd, rawr_UdpBatch_RecvHandler handler, void *arg);
+
+/* returns 1 when any of fds is readable, 0 on timeout, rawr_Error on failure */
+int rawr_UdpBatch_Wait(const RAWR_SOCK_TYPE *fds, int count, int timeoutMs);
+
+void rawr_UdpBatch_Stats(rawr_UdpBatch *batch, rawr_UdpBatchStats *out_stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
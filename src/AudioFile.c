@@ -0,0 +1,433 @@
+#include "rawr/AudioFile.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+#include "mn/atomic.h"
+#include "mn/log.h"
+#include "mn/thread.h"
+#include "mn/time.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define RAWR_AUDIOFILE_WAV_HEADER 44
+#define RAWR_AUDIOFILE_WAV_PCM 1
+#define RAWR_AUDIOFILE_WAV_EXTENSIBLE 0xFFFE
+#define RAWR_AUDIOFILE_WAV_BYTES_MAX (0xFFFFFFFFu - (RAWR_AUDIOFILE_WAV_HEADER - 8))
+
+/* unclocked, how long to leave the reader before asking about the backlog again */
+#define RAWR_AUDIOFILE_BACKLOG_POLL_US 100
+
+/* a clock this many blocks behind stops trying to catch up and starts over from now */
+#define RAWR_AUDIOFILE_LATE_BLOCKS 4
+
+typedef struct rawr_AudioFileConfig {
+    rawr_AudioBackend backend;
+    char inputPath[RAWR_AUDIOFILE_PATH_MAX];
+    char outputPath[RAWR_AUDIOFILE_PATH_MAX];
+    double speed;
+} rawr_AudioFileConfig;
+
+typedef struct rawr_AudioFile {
+    rawr_AudioFileProcess process;
+    rawr_AudioFileBacklog backlog;
+    void *arg;
+
+    int sampleRate;
+    int channelCount;
+    int frameCount;
+    double speed;
+
+    FILE *input;
+    long inputStart;
+    uint64_t inputBytes;
+    uint64_t inputPos;
+
+    FILE *output;
+    uint64_t outputBytes;
+
+    rawr_AudioSample *inputSamples;
+    rawr_AudioSample *outputSamples;
+
+    mn_thread_t thread;
+    mn_atomic_t running;
+} rawr_AudioFile;
+
+static rawr_AudioFileConfig audiofile_config = {rawr_AudioBackend_Device, {0}, {0}, 1.0};
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Audio_SetBackend(rawr_AudioBackend backend)
+{
+    RAWR_GUARD(backend != rawr_AudioBackend_Device && backend != rawr_AudioBackend_File);
+    audiofile_config.backend = backend;
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+rawr_AudioBackend rawr_Audio_Backend(void)
+{
+    return audiofile_config.backend;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Audio_SetFiles(const char *inputPath, const char *outputPath, double speed)
+{
+    RAWR_GUARD(speed < 0.0);
+    RAWR_GUARD(inputPath && strlen(inputPath) >= RAWR_AUDIOFILE_PATH_MAX);
+    RAWR_GUARD(outputPath && strlen(outputPath) >= RAWR_AUDIOFILE_PATH_MAX);
+
+    audiofile_config.inputPath[0] = '\0';
+    audiofile_config.outputPath[0] = '\0';
+    if (inputPath) strcpy(audiofile_config.inputPath, inputPath);
+    if (outputPath) strcpy(audiofile_config.outputPath, outputPath);
+    audiofile_config.speed = speed;
+
+    return rawr_Success;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static uint32_t rawr_AudioFile_GetLe16(const uint8_t *src)
+{
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static uint32_t rawr_AudioFile_GetLe32(const uint8_t *src)
+{
+    return rawr_AudioFile_GetLe16(src) | (rawr_AudioFile_GetLe16(src + 2) << 16);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioFile_PutLe16(uint8_t *dst, uint32_t value)
+{
+    dst[0] = (uint8_t)value;
+    dst[1] = (uint8_t)(value >> 8);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioFile_PutLe32(uint8_t *dst, uint32_t value)
+{
+    rawr_AudioFile_PutLe16(dst, value);
+    rawr_AudioFile_PutLe16(dst + 2, value >> 16);
+}
+
+/*
+ * finds the samples in a RIFF WAVE file, leaving f at the first one. returns 1 for WAV, 0 for anything else, which
+ * is taken as headerless samples from the first byte, and rawr_Error when a WAV file cannot be used
+ */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioFile_ReadHeader(FILE *f, const char *path, uint32_t *out_rate, uint32_t *out_channels, long *out_start, uint64_t *out_bytes)
+{
+    RAWR_ASSERT(f && path && out_rate && out_channels && out_start && out_bytes);
+
+    uint8_t header[12], chunk[8], format[16];
+    uint32_t chunkBytes, formatTag, bits;
+    int haveFormat = 0;
+
+    *out_rate = 0;
+    *out_channels = 0;
+    *out_start = 0;
+    *out_bytes = 0;
+
+    if (fread(header, 1, sizeof(header), f) != sizeof(header) || memcmp(header, "RIFF", 4) || memcmp(header + 8, "WAVE", 4)) {
+        RAWR_GUARD(fseek(f, 0, SEEK_SET));
+        return 0;
+    }
+
+    while (fread(chunk, 1, sizeof(chunk), f) == sizeof(chunk)) {
+        chunkBytes = rawr_AudioFile_GetLe32(chunk + 4);
+
+        if (!memcmp(chunk, "fmt ", 4)) {
+            RAWR_GUARD(chunkBytes < sizeof(format));
+            RAWR_GUARD(fread(format, 1, sizeof(format), f) != sizeof(format));
+            chunkBytes -= sizeof(format);
+
+            formatTag = rawr_AudioFile_GetLe16(format);
+            *out_channels = rawr_AudioFile_GetLe16(format + 2);
+            *out_rate = rawr_AudioFile_GetLe32(format + 4);
+            bits = rawr_AudioFile_GetLe16(format + 14);
+
+            if ((formatTag != RAWR_AUDIOFILE_WAV_PCM && formatTag != RAWR_AUDIOFILE_WAV_EXTENSIBLE) || bits != 16) {
+                mn_log_error("%s is not 16 bit PCM", path);
+                return rawr_Error;
+            }
+
+            haveFormat = 1;
+        } else if (!memcmp(chunk, "data", 4)) {
+            if (!haveFormat) {
+                mn_log_error("%s has its data before its format", path);
+                return rawr_Error;
+            }
+
+            *out_start = ftell(f);
+            *out_bytes = chunkBytes;
+            return 1;
+        }
+
+        /* chunks are padded out to an even length */
+        RAWR_GUARD(fseek(f, (long)chunkBytes + (chunkBytes & 1), SEEK_CUR));
+    }
+
+    mn_log_error("%s has no data", path);
+    return rawr_Error;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioFile_OpenInput(rawr_AudioFile *file, const char *path)
+{
+    RAWR_ASSERT(file && path);
+
+    uint32_t rate, channels;
+    int ret;
+
+    if (!(file->input = fopen(path, "rb"))) {
+        mn_log_error("could not open %s", path);
+        return rawr_Error;
+    }
+
+    file->inputPos = 0;
+    RAWR_GUARD((ret = rawr_AudioFile_ReadHeader(file->input, path, &rate, &channels, &file->inputStart, &file->inputBytes)) < 0);
+
+    /* nothing here converts, a WAV file has to match the device the stream picked for it */
+    if (ret && ((int)channels != file->channelCount || (int)rate != file->sampleRate)) {
+        mn_log_error("%s is %u Hz with %u channels, the device runs %d Hz with %d", path, rate, channels, file->sampleRate, file->channelCount);
+        return rawr_Error;
+    }
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioFile_InputRate(void)
+{
+    FILE *f;
+    uint32_t rate, channels;
+    long start;
+    uint64_t bytes;
+    int ret;
+
+    if (!audiofile_config.inputPath[0]) return 0;
+    if (!(f = fopen(audiofile_config.inputPath, "rb"))) return 0;
+
+    ret = rawr_AudioFile_ReadHeader(f, audiofile_config.inputPath, &rate, &channels, &start, &bytes);
+    fclose(f);
+
+    return ret > 0 ? (int)rate : 0;
+}
+
+/* the sizes are placeholders until Stop knows how much was written, and saturate rather than wrap past 4GB */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioFile_WriteHeader(rawr_AudioFile *file)
+{
+    RAWR_ASSERT(file && file->output);
+
+    uint8_t header[RAWR_AUDIOFILE_WAV_HEADER];
+    const uint32_t blockAlign = (uint32_t)file->channelCount * sizeof(rawr_AudioSample);
+    const uint32_t dataBytes = file->outputBytes > RAWR_AUDIOFILE_WAV_BYTES_MAX ? RAWR_AUDIOFILE_WAV_BYTES_MAX : (uint32_t)file->outputBytes;
+
+    memcpy(header, "RIFF", 4);
+    rawr_AudioFile_PutLe32(header + 4, dataBytes + RAWR_AUDIOFILE_WAV_HEADER - 8);
+    memcpy(header + 8, "WAVEfmt ", 8);
+    rawr_AudioFile_PutLe32(header + 16, 16);
+    rawr_AudioFile_PutLe16(header + 20, RAWR_AUDIOFILE_WAV_PCM);
+    rawr_AudioFile_PutLe16(header + 22, (uint32_t)file->channelCount);
+    rawr_AudioFile_PutLe32(header + 24, (uint32_t)file->sampleRate);
+    rawr_AudioFile_PutLe32(header + 28, (uint32_t)file->sampleRate * blockAlign);
+    rawr_AudioFile_PutLe16(header + 32, blockAlign);
+    rawr_AudioFile_PutLe16(header + 34, 16);
+    memcpy(header + 36, "data", 4);
+    rawr_AudioFile_PutLe32(header + 40, dataBytes);
+
+    RAWR_GUARD(fseek(file->output, 0, SEEK_SET));
+    RAWR_GUARD(fwrite(header, 1, sizeof(header), file->output) != sizeof(header));
+    RAWR_GUARD(fseek(file->output, 0, SEEK_END));
+
+    return rawr_Success;
+}
+
+/* samples go through as they sit in memory, which is little endian on everything we build for */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioFile_ReadInput(rawr_AudioFile *file)
+{
+    RAWR_ASSERT(file);
+
+    const size_t sampleCount = (size_t)file->frameCount * file->channelCount;
+    size_t count = 0, want, got;
+    int rewound = 0;
+
+    if (!file->input) return;
+
+    while (count < sampleCount) {
+        want = sampleCount - count;
+        if (file->inputBytes && want > (file->inputBytes - file->inputPos) / sizeof(rawr_AudioSample)) {
+            want = (size_t)((file->inputBytes - file->inputPos) / sizeof(rawr_AudioSample));
+        }
+
+        got = want ? fread(file->inputSamples + count, sizeof(rawr_AudioSample), want, file->input) : 0;
+        if (got) {
+            count += got;
+            file->inputPos += got * sizeof(rawr_AudioSample);
+            rewound = 0;
+            continue;
+        }
+
+        /* loop back to the first sample, a file too short to hold one plays silence from here */
+        if (rewound || fseek(file->input, file->inputStart, SEEK_SET)) break;
+        file->inputPos = 0;
+        rewound = 1;
+    }
+
+    if (count < sampleCount) memset(file->inputSamples + count, 0, (sampleCount - count) * sizeof(rawr_AudioSample));
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioFile_WriteOutput(rawr_AudioFile *file)
+{
+    RAWR_ASSERT(file);
+
+    const size_t sampleCount = (size_t)file->frameCount * file->channelCount;
+
+    if (!file->output) return;
+
+    file->outputBytes += fwrite(file->outputSamples, sizeof(rawr_AudioSample), sampleCount, file->output) * sizeof(rawr_AudioSample);
+}
+
+// private thread -----------------------------------------------------------------------------------------------
+void rawr_AudioFile_ClockThread(void *arg)
+{
+    RAWR_ASSERT(arg);
+
+    rawr_AudioFile *file = (rawr_AudioFile *)arg;
+    uint64_t block_ns = 0, deadline, tstamp;
+
+    if (file->speed > 0.0) {
+        block_ns = (uint64_t)((double)file->frameCount * MN_TIME_NS_PER_S / ((double)file->sampleRate * file->speed));
+        if (!block_ns) block_ns = 1;
+    }
+
+    deadline = mn_tstamp();
+    while (mn_atomic_load(&file->running)) {
+        if (block_ns) {
+            tstamp = mn_tstamp();
+            if (tstamp < deadline) {
+                mn_thread_sleep(deadline - tstamp);
+                continue;
+            }
+
+            /* deadlines advance by whole blocks so oversleeping never drifts the rate, only a long stall resets it */
+            deadline += block_ns;
+            if (deadline + RAWR_AUDIOFILE_LATE_BLOCKS * block_ns <= tstamp) deadline = tstamp + block_ns;
+        } else if (file->backlog(file->arg) >= file->frameCount) {
+            mn_thread_sleep_us(RAWR_AUDIOFILE_BACKLOG_POLL_US);
+            continue;
+        }
+
+        rawr_AudioFile_ReadInput(file);
+        file->process(file->inputSamples, file->outputSamples, file->frameCount, file->arg);
+        rawr_AudioFile_WriteOutput(file);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioFile_Setup(rawr_AudioFile **out_file, rawr_AudioRate sampleRate, int channelCount, int frameCount, rawr_AudioFileProcess process, rawr_AudioFileBacklog backlog, void *arg)
+{
+    RAWR_ASSERT(out_file && process && backlog);
+
+    rawr_AudioFile *file;
+    size_t numBytes;
+
+    RAWR_GUARD(channelCount <= 0 || channelCount > RAWR_AUDIOFILE_CHANNELS_MAX || frameCount <= 0);
+    numBytes = (size_t)frameCount * channelCount * sizeof(rawr_AudioSample);
+
+    RAWR_GUARD_NULL(file = MN_MEM_ACQUIRE(sizeof(*file)));
+    memset(file, 0, sizeof(*file));
+
+    file->process = process;
+    file->backlog = backlog;
+    file->arg = arg;
+    file->sampleRate = (int)sampleRate;
+    file->channelCount = channelCount;
+    file->frameCount = frameCount;
+    file->speed = audiofile_config.speed;
+    mn_atomic_store(&file->running, 0);
+
+    RAWR_GUARD_NULL_CLEANUP(file->inputSamples = MN_MEM_ACQUIRE(numBytes));
+    RAWR_GUARD_NULL_CLEANUP(file->outputSamples = MN_MEM_ACQUIRE(numBytes));
+    memset(file->inputSamples, 0, numBytes);
+    memset(file->outputSamples, 0, numBytes);
+
+    if (audiofile_config.inputPath[0]) {
+        RAWR_GUARD_CLEANUP(rawr_AudioFile_OpenInput(file, audiofile_config.inputPath));
+    }
+
+    if (audiofile_config.outputPath[0]) {
+        if (!(file->output = fopen(audiofile_config.outputPath, "wb"))) {
+            mn_log_error("could not create %s", audiofile_config.outputPath);
+            goto cleanup;
+        }
+        RAWR_GUARD_CLEANUP(rawr_AudioFile_WriteHeader(file));
+    }
+
+    RAWR_GUARD_CLEANUP(mn_thread_setup(&file->thread));
+
+    *out_file = file;
+    return rawr_Success;
+
+cleanup:
+    if (file->input) fclose(file->input);
+    if (file->output) fclose(file->output);
+    MN_MEM_RELEASE(file->inputSamples);
+    MN_MEM_RELEASE(file->outputSamples);
+    MN_MEM_RELEASE(file);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_AudioFile_Cleanup(rawr_AudioFile *file)
+{
+    RAWR_ASSERT(file);
+
+    if (mn_atomic_load(&file->running)) rawr_AudioFile_Stop(file);
+    mn_thread_cleanup(&file->thread);
+
+    if (file->input) fclose(file->input);
+    if (file->output) fclose(file->output);
+    MN_MEM_RELEASE(file->inputSamples);
+    MN_MEM_RELEASE(file->outputSamples);
+    MN_MEM_RELEASE(file);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioFile_Start(rawr_AudioFile *file)
+{
+    RAWR_ASSERT(file);
+
+    RAWR_GUARD(mn_atomic_load(&file->running));
+    mn_atomic_store(&file->running, 1);
+    RAWR_GUARD_CLEANUP(mn_thread_launch(&file->thread, rawr_AudioFile_ClockThread, file));
+
+    return rawr_Success;
+
+cleanup:
+    mn_atomic_store(&file->running, 0);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioFile_Stop(rawr_AudioFile *file)
+{
+    RAWR_ASSERT(file);
+
+    if (!mn_atomic_load(&file->running)) return rawr_Success;
+
+    mn_atomic_store(&file->running, 0);
+    RAWR_GUARD(mn_thread_join(&file->thread));
+
+    if (file->output) {
+        RAWR_GUARD(rawr_AudioFile_WriteHeader(file));
+        RAWR_GUARD(fflush(file->output));
+    }
+
+    return rawr_Success;
+}
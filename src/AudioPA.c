@@ -1,17 +1,30 @@
 #include "rawr/Audio.h"
+#include "rawr/AudioFile.h"
+#include "rawr/Drift.h"
+#include "rawr/Dsp.h"
 #include "rawr/Error.h"
+#include "rawr/Latency.h"
+#include "rawr/Level.h"
+#include "rawr/Resampler.h"
 #include "rawr/RingBuffer.h"
+#include "rawr/Semaphore.h"
 #include "rawr/Util.h"
 
 #include "mn/allocator.h"
 #include "mn/atomic.h"
 #include "mn/error.h"
 #include "mn/log.h"
+#include "mn/time.h"
 
 #include "portaudio.h"
 
 #include <math.h>
 #include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+/* concealment keeps this many sixteenths of the held sample each frame, gone within about 3 ms at 48 kHz */
+#define RAWR_AUDIOSTREAM_CONCEAL_DECAY 15
 
 const double rawr_AudioRateList[] = {
     8000.0,
@@ -30,33 +43,53 @@ const double rawr_AudioRateList[] = {
     -1.0,
 };
 
+/* set in a device's rates once they are known, probed or read from the cache */
+#define RAWR_AUDIODEVICE_RATES_KNOWN (1ull << 32)
+
+/* a cache line is the key, host api, name and channel counts, then the rate flags, tab separated */
+#define RAWR_AUDIO_RATECACHE_LINE_MAX 1024
+#define RAWR_AUDIO_RATECACHE_FILE "rawr_audio_rates"
+
 typedef struct rawr_AudioPrivate {
     uint64_t initialized;
+    rawr_AudioBackend backend;
     rawr_AudioDeviceId defaultInputId;
     rawr_AudioDeviceId defaultOutputId;
     rawr_AudioDevice *deviceList;
     rawr_AudioDeviceId deviceCount;
+    int rateCacheSet;
+    char rateCachePath[RAWR_AUDIO_RATECACHE_PATH_MAX];
 } rawr_AudioPrivate;
 
 typedef struct rawr_AudioDevicePriv {
     const PaDeviceInfo *deviceInfo;
+    int ratesCached;
 } rawr_AudioDevicePriv;
 
 typedef struct rawr_AudioDevice {
     rawr_AudioDevicePriv *priv;
     rawr_AudioDeviceId id;
     rawr_AudioDeviceProps props;
-    rawr_AudioRateFlags rates;
+    mn_atomic_t rates;
 } rawr_AudioDevice;
 
 typedef struct rawr_AudioStreamPriv {
     PaStream *pa_stream;
+    rawr_AudioFile *file;
     PaStreamParameters inParameters;
     PaStreamParameters outParameters;
     rawr_AudioSample *ringBufferDataTo;
     rawr_AudioSample *ringBufferDataFrom;
     rawr_RingBuffer rbToDevice;
     rawr_RingBuffer rbFromDevice;
+    rawr_AudioSample *ringBufferDataReference;
+    rawr_RingBuffer rbReference; /* what was played alongside each captured sample, in step with rbFromDevice */
+    rawr_AudioSample *readBounce;
+    rawr_AudioSample *readFrame; /* the frame between BeginRead and EndRead, already through the capture chain */
+    rawr_AudioSample *writeBounce;
+    int writeStretching; /* the frame between BeginWrite and EndWrite is in writeBounce to be stretched */
+    rawr_Semaphore *readSignal;
+    int started; /* between Start and Stop, the callback owns the playback queue */
 } rawr_AudioStreamPriv;
 
 typedef struct rawr_AudioStream {
@@ -67,12 +100,119 @@ typedef struct rawr_AudioStream {
     size_t sampleCapacity;
     int channelCount;
     int sampleCount;
-    mn_atomic_t inputLevel;
-    mn_atomic_t outputLevel;
+
+    /* the devices may run at another rate, converted in the callback */
+    rawr_AudioRate deviceRateWanted;
+    rawr_AudioRate deviceRate;
+    int deviceFramesWanted;
+    int deviceFrames;
+    rawr_Resampler *captureResampler;
+    rawr_Resampler *playbackResampler;
+    rawr_AudioSample *captureScratch;
+    rawr_AudioSample *playbackScratch;
+    int captureScratchFrames;
+
+    /* trims the playback converter, which runs even at the device's own rate while compensating */
+    int driftCompensation;
+    rawr_Drift drift;
+
+    /* holds the playback queue at a target depth by stretching frames as they are written, NULL when off */
+    rawr_Latency *latency;
+
+    /* the last frame played, which concealment fades out when the queue runs dry mid buffer */
+    int concealSamples[RAWR_RESAMPLER_CHANNELS_MAX];
+
+    rawr_LevelMeter inputMeter;
+    rawr_LevelMeter outputMeter;
+    mn_atomic_t outputUnderflows;
+    mn_atomic_t outputOverflows;
+
+    rawr_DspChain *captureChain;
 } rawr_AudioStream;
 
 static rawr_AudioPrivate audio_priv = {0};
 
+/* the file backend leaves PortAudio alone and lists a single device that stands in for both directions */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Audio_SetupFile(void)
+{
+    rawr_AudioDevice *dev;
+    rawr_AudioDevicePriv *priv;
+    uint64_t rates;
+    int inputRate;
+
+    RAWR_GUARD_NULL(audio_priv.deviceList = MN_MEM_ACQUIRE(sizeof(*audio_priv.deviceList)));
+    RAWR_GUARD_NULL_CLEANUP(priv = MN_MEM_ACQUIRE(sizeof(*priv)));
+    priv->deviceInfo = NULL;
+    priv->ratesCached = 0;
+
+    dev = audio_priv.deviceList;
+    dev->priv = priv;
+    dev->id = 0;
+    dev->props = rawr_AudioDeviceProps_Default | rawr_AudioDeviceProps_Input | rawr_AudioDeviceProps_Output;
+    dev->props |= rawr_AudioDeviceProps_InputStereo | rawr_AudioDeviceProps_OutputStereo;
+    rates = rawr_AudioRateFlags_None;
+    inputRate = rawr_AudioFile_InputRate();
+
+    /* a WAV input pins the device to its rate, streams at any other rate convert as they would for a sound card */
+    for (int r = 0; rawr_AudioRateList[r] > 0.0; r++) {
+        if (!inputRate || (int)rawr_AudioRateList[r] == inputRate) rates |= 1 << r;
+    }
+    mn_atomic_store(&dev->rates, rates | RAWR_AUDIODEVICE_RATES_KNOWN);
+
+    audio_priv.deviceCount = 1;
+    audio_priv.defaultInputId = 0;
+    audio_priv.defaultOutputId = 0;
+    audio_priv.backend = rawr_AudioBackend_File;
+    audio_priv.initialized = 1;
+
+    return rawr_Success;
+
+cleanup:
+    MN_MEM_RELEASE(audio_priv.deviceList);
+    audio_priv.deviceList = NULL;
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Audio_SetRateCache(const char *path)
+{
+    RAWR_GUARD(path && strlen(path) >= RAWR_AUDIO_RATECACHE_PATH_MAX);
+
+    audio_priv.rateCacheSet = path != NULL;
+    audio_priv.rateCachePath[0] = '\0';
+    if (path) strcpy(audio_priv.rateCachePath, path);
+
+    return rawr_Success;
+}
+
+/* the per user cache directory, or nothing when there is none to be found */
+// private ------------------------------------------------------------------------------------------------------
+static const char *rawr_Audio_RateCachePath(void)
+{
+    const char *dir, *sub = "";
+
+    if (audio_priv.rateCacheSet) return audio_priv.rateCachePath;
+
+#if RAWR_PLATFORM_WINDOWS
+    dir = getenv("LOCALAPPDATA");
+#else
+    if (!(dir = getenv("XDG_CACHE_HOME")) || !dir[0]) {
+        dir = getenv("HOME");
+        sub = "/.cache";
+    }
+#endif
+    if (!dir || !dir[0]) return "";
+
+    if (snprintf(audio_priv.rateCachePath, sizeof(audio_priv.rateCachePath), "%s%s/%s", dir, sub, RAWR_AUDIO_RATECACHE_FILE) >= (int)sizeof(audio_priv.rateCachePath)) {
+        audio_priv.rateCachePath[0] = '\0';
+    }
+    audio_priv.rateCacheSet = 1;
+
+    return audio_priv.rateCachePath;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 int rawr_Audio_Setup(void)
 {
@@ -80,9 +220,11 @@ int rawr_Audio_Setup(void)
     PaError err;
 
     if (audio_priv.initialized) return RAWR_OK;
+    if (rawr_Audio_Backend() == rawr_AudioBackend_File) return rawr_Audio_SetupFile();
 
     errCode = -1;
     RAWR_GUARD_CLEANUP(err = Pa_Initialize());
+    audio_priv.backend = rawr_AudioBackend_Device;
     audio_priv.initialized = 1;
 
     errCode = -2;
@@ -103,6 +245,7 @@ int rawr_Audio_Setup(void)
         errCode = -4;
         RAWR_GUARD_NULL_CLEANUP(priv = MN_MEM_ACQUIRE(sizeof(*priv)));
         priv->deviceInfo = deviceInfo;
+        priv->ratesCached = 0;
         dev->priv = priv;
 
         dev->id = d;
@@ -110,41 +253,18 @@ int rawr_Audio_Setup(void)
         if (d == audio_priv.defaultInputId || d == audio_priv.defaultOutputId)
             dev->props |= rawr_AudioDeviceProps_Default;
 
-        PaStreamParameters inputParameters;
-        PaStreamParameters *pInParams = &inputParameters;
-        inputParameters.device = d;
-        inputParameters.channelCount = deviceInfo->maxInputChannels;
-        inputParameters.sampleFormat = paInt16;
-        inputParameters.suggestedLatency = 0;
-        inputParameters.hostApiSpecificStreamInfo = NULL;
-        if (inputParameters.channelCount <= 0)
-            pInParams = NULL;
-        if (inputParameters.channelCount > 0)
+        if (deviceInfo->maxInputChannels > 0)
             dev->props |= rawr_AudioDeviceProps_Input;
-        if (inputParameters.channelCount > 1)
+        if (deviceInfo->maxInputChannels > 1)
             dev->props |= rawr_AudioDeviceProps_InputStereo;
 
-        PaStreamParameters outputParameters;
-        PaStreamParameters *pOutParams = &outputParameters;
-        outputParameters.device = d;
-        outputParameters.channelCount = deviceInfo->maxOutputChannels;
-        outputParameters.sampleFormat = paInt16;
-        outputParameters.suggestedLatency = 0;
-        outputParameters.hostApiSpecificStreamInfo = NULL;
-        if (outputParameters.channelCount <= 0)
-            pOutParams = NULL;
-        if (outputParameters.channelCount > 0)
+        if (deviceInfo->maxOutputChannels > 0)
             dev->props |= rawr_AudioDeviceProps_Output;
-        if (outputParameters.channelCount > 1)
+        if (deviceInfo->maxOutputChannels > 1)
             dev->props |= rawr_AudioDeviceProps_OutputStereo;
 
-        dev->rates = rawr_AudioRateFlags_None;
-        for (int r = 0; rawr_AudioRateList[r] > 0.0; r++) {
-
-            if (Pa_IsFormatSupported(pInParams, pOutParams, rawr_AudioRateList[r]) == paFormatIsSupported) {
-                dev->rates |= 1 << r;
-            }
-        }
+        /* rates are probed when first asked for, opening every device at every rate here took seconds on some hosts */
+        mn_atomic_store(&dev->rates, rawr_AudioRateFlags_None);
     }
 
     return rawr_Success;
@@ -184,6 +304,8 @@ int rawr_Audio_Cleanup(void)
     MN_MEM_RELEASE(audio_priv.deviceList);
 
     audio_priv.initialized = 0;
+    if (audio_priv.backend == rawr_AudioBackend_File) return rawr_Success;
+
     RAWR_GUARD_CLEANUP(err = Pa_Terminate());
 
     return rawr_Success;
@@ -207,6 +329,122 @@ rawr_AudioDevicePriv *rawr_AudioDevice_Priv(const rawr_AudioDevice *const dev)
     return (rawr_AudioDevicePriv *)dev->priv;
 }
 
+/* what identifies a device across runs, its index can change whenever something is plugged in */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioDevice_CacheKey(rawr_AudioDevice *dev, char *key, size_t keySize)
+{
+    const PaDeviceInfo *deviceInfo = rawr_AudioDevice_Priv(dev)->deviceInfo;
+    const PaHostApiInfo *hostInfo = Pa_GetHostApiInfo(deviceInfo->hostApi);
+    int len;
+
+    len = snprintf(key, keySize, "%s\t%s\t%d\t%d\t", hostInfo ? hostInfo->name : "", deviceInfo->name, deviceInfo->maxInputChannels, deviceInfo->maxOutputChannels);
+    RAWR_GUARD(len < 0 || len >= (int)keySize);
+
+    /* the separators hold the line together */
+    for (char *c = key; *c; c++) {
+        if (*c == '\n' || *c == '\r') *c = ' ';
+    }
+
+    return rawr_Success;
+}
+
+/* the last line for the key wins, a device that changed is appended again rather than rewritten */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioDevice_CacheLookup(const char *key, uint64_t *out_rates)
+{
+    const char *path = rawr_Audio_RateCachePath();
+    const size_t keyLen = strlen(key);
+    char line[RAWR_AUDIO_RATECACHE_LINE_MAX];
+    FILE *f;
+    int found = 0;
+
+    if (!path[0] || !(f = fopen(path, "r"))) return 0;
+
+    while (fgets(line, sizeof(line), f)) {
+        if (strncmp(line, key, keyLen)) continue;
+        *out_rates = strtoull(line + keyLen, NULL, 16);
+        found = 1;
+    }
+
+    fclose(f);
+    return found;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioDevice_CacheStore(const char *key, uint64_t rates)
+{
+    const char *path = rawr_Audio_RateCachePath();
+    FILE *f;
+
+    if (!path[0] || !(f = fopen(path, "a"))) return;
+
+    fprintf(f, "%s%llx\n", key, (unsigned long long)rates);
+    fclose(f);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static uint64_t rawr_AudioDevice_ProbeRates(rawr_AudioDevice *dev)
+{
+    const PaDeviceInfo *deviceInfo = rawr_AudioDevice_Priv(dev)->deviceInfo;
+    PaStreamParameters inputParameters, outputParameters;
+    PaStreamParameters *pInParams = NULL, *pOutParams = NULL;
+    uint64_t rates = rawr_AudioRateFlags_None;
+
+    if (deviceInfo->maxInputChannels > 0) {
+        pInParams = &inputParameters;
+        inputParameters.device = dev->id;
+        inputParameters.channelCount = deviceInfo->maxInputChannels;
+        inputParameters.sampleFormat = paInt16;
+        inputParameters.suggestedLatency = 0;
+        inputParameters.hostApiSpecificStreamInfo = NULL;
+    }
+
+    if (deviceInfo->maxOutputChannels > 0) {
+        pOutParams = &outputParameters;
+        outputParameters.device = dev->id;
+        outputParameters.channelCount = deviceInfo->maxOutputChannels;
+        outputParameters.sampleFormat = paInt16;
+        outputParameters.suggestedLatency = 0;
+        outputParameters.hostApiSpecificStreamInfo = NULL;
+    }
+
+    for (int r = 0; rawr_AudioRateList[r] > 0.0; r++) {
+        if (Pa_IsFormatSupported(pInParams, pOutParams, rawr_AudioRateList[r]) == paFormatIsSupported) {
+            rates |= 1 << r;
+        }
+    }
+
+    return rates;
+}
+
+/*
+ * the cache first, then the device itself. probing a device the cache already knew rewrites its entry, which is
+ * how a stale one is corrected
+ */
+// private ------------------------------------------------------------------------------------------------------
+static uint64_t rawr_AudioDevice_LoadRates(rawr_AudioDevice *dev)
+{
+    rawr_AudioDevicePriv *priv = rawr_AudioDevice_Priv(dev);
+    char key[RAWR_AUDIO_RATECACHE_LINE_MAX];
+    uint64_t rates;
+    int haveKey;
+
+    haveKey = rawr_AudioDevice_CacheKey(dev, key, sizeof(key)) == rawr_Success;
+
+    if (haveKey && !priv->ratesCached && rawr_AudioDevice_CacheLookup(key, &rates)) {
+        priv->ratesCached = 1;
+    } else {
+        priv->ratesCached = 0;
+        rates = rawr_AudioDevice_ProbeRates(dev);
+        if (haveKey) rawr_AudioDevice_CacheStore(key, rates);
+    }
+
+    rates |= RAWR_AUDIODEVICE_RATES_KNOWN;
+    mn_atomic_store(&dev->rates, rates);
+
+    return rates;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 rawr_AudioDevice *rawr_AudioDevice_DefaultInput(void)
 {
@@ -239,6 +477,7 @@ const char *rawr_AudioDevice_Name(rawr_AudioDevice *dev)
 {
     RAWR_ASSERT(dev);
     rawr_AudioDevicePriv *priv = rawr_AudioDevice_Priv(dev);
+    if (!priv->deviceInfo) return "file";
     return priv->deviceInfo->name;
 }
 
@@ -253,13 +492,18 @@ rawr_AudioDeviceProps rawr_AudioDevice_Props(rawr_AudioDevice *dev)
 rawr_AudioRateFlags rawr_AudioDevice_SampleRates(rawr_AudioDevice *dev)
 {
     RAWR_ASSERT(dev);
-    return dev->rates;
+
+    uint64_t rates = mn_atomic_load(&dev->rates);
+    if (!(rates & RAWR_AUDIODEVICE_RATES_KNOWN)) rates = rawr_AudioDevice_LoadRates(dev);
+
+    return (rawr_AudioRateFlags)(rates & ~RAWR_AUDIODEVICE_RATES_KNOWN);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 int rawr_AudioDevice_OutputChannels(rawr_AudioDevice *dev)
 {
     RAWR_ASSERT(dev);
+    if (!rawr_AudioDevice_Priv(dev)->deviceInfo) return RAWR_AUDIOFILE_CHANNELS_MAX;
     return rawr_AudioDevice_Priv(dev)->deviceInfo->maxOutputChannels;
 }
 
@@ -267,6 +511,7 @@ int rawr_AudioDevice_OutputChannels(rawr_AudioDevice *dev)
 int rawr_AudioDevice_InputChannels(rawr_AudioDevice *dev)
 {
     RAWR_ASSERT(dev);
+    if (!rawr_AudioDevice_Priv(dev)->deviceInfo) return RAWR_AUDIOFILE_CHANNELS_MAX;
     return rawr_AudioDevice_Priv(dev)->deviceInfo->maxInputChannels;
 }
 
@@ -277,6 +522,140 @@ rawr_AudioStreamPriv *rawr_AudioStream_Priv(rawr_AudioStream *stream)
     return (rawr_AudioStreamPriv *)stream->priv;
 }
 
+/* fills frames by holding the last frame played and fading it out, so a short queue does not click */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_Conceal(rawr_AudioStream *stream, rawr_AudioSample *buffer, int frames)
+{
+    for (int f = 0; f < frames; f++) {
+        for (int c = 0; c < stream->channelCount; c++) {
+            stream->concealSamples[c] = stream->concealSamples[c] * RAWR_AUDIOSTREAM_CONCEAL_DECAY / 16;
+            buffer[f * stream->channelCount + c] = (rawr_AudioSample)stream->concealSamples[c];
+        }
+    }
+}
+
+/*
+ * plays whatever part of frames is queued and conceals the rest, the device buffer being smaller than a codec frame
+ * means the queue is often part way through one
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_Pull(rawr_AudioStream *stream, rawr_AudioSample *buffer, int frames)
+{
+    rawr_RingBuffer *rb = &rawr_AudioStream_Priv(stream)->rbToDevice;
+    int queued = (int)(rawr_RingBuffer_GetReadAvailable(rb) / stream->channelCount);
+
+    if (queued > frames) queued = frames;
+    if (queued) {
+        rawr_RingBuffer_Read(rb, buffer, queued * stream->channelCount);
+        for (int c = 0; c < stream->channelCount; c++) {
+            stream->concealSamples[c] = buffer[(queued - 1) * stream->channelCount + c];
+        }
+    }
+
+    if (queued == frames) return;
+
+    rawr_AudioStream_Conceal(stream, buffer + queued * stream->channelCount, frames - queued);
+    mn_atomic_fetch_add(&stream->outputUnderflows, 1);
+}
+
+/*
+ * queues what was just captured and as much of what was just played alongside it, so the two queues fill and empty
+ * together and the reference read with a captured frame is what the speaker was playing while it was recorded. any
+ * part of the capture with nothing played against it, or all of it when there is no output, is matched with silence.
+ * the reader empties the reference first, so there is always room in it for what fits in the capture queue
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_Capture(rawr_AudioStream *stream, const rawr_AudioSample *captured, int capturedSamples, const rawr_AudioSample *played, int playedSamples)
+{
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    const size_t room = rawr_RingBuffer_GetWriteAvailable(&priv->rbFromDevice);
+    void *data[2];
+    size_t size[2];
+    int copied = 0, n;
+
+    if (!played) playedSamples = 0;
+    if ((size_t)capturedSamples > room) capturedSamples = (int)room;
+
+    rawr_RingBuffer_GetWriteRegions(&priv->rbReference, capturedSamples, &data[0], &size[0], &data[1], &size[1]);
+    for (int r = 0; r < 2; r++) {
+        n = copied < playedSamples ? playedSamples - copied : 0;
+        if (n > (int)size[r]) n = (int)size[r];
+        if (n) memcpy(data[r], played + copied, n * sizeof(rawr_AudioSample));
+        if (n < (int)size[r]) memset((rawr_AudioSample *)data[r] + n, 0, (size[r] - n) * sizeof(rawr_AudioSample));
+        copied += (int)size[r];
+    }
+
+    rawr_RingBuffer_AdvanceWriteIndex(&priv->rbReference, capturedSamples);
+    rawr_RingBuffer_Write(&priv->rbFromDevice, captured, capturedSamples);
+}
+
+/* one device buffer each way, from the PortAudio callback or the file backend's clock */
+// private ------------------------------------------------------------------------------------------------------
+void rawr_AudioStream_Process(const rawr_AudioSample *inputBuffer, rawr_AudioSample *outputBuffer, int framesPerBuffer, void *userData)
+{
+    rawr_AudioStream *stream = (rawr_AudioStream *)userData;
+    RAWR_ASSERT(stream);
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    const rawr_AudioSample *played = outputBuffer;
+    int playedSamples = framesPerBuffer * stream->channelCount;
+
+    if (outputBuffer) {
+        if (stream->playbackResampler) {
+            int needed;
+
+            if (stream->driftCompensation) {
+                const int queued = (int)(rawr_RingBuffer_GetReadAvailable(&priv->rbToDevice) / stream->channelCount);
+                const int frames = (int)((int64_t)framesPerBuffer * stream->sampleRate / stream->deviceRate);
+                rawr_Resampler_SetTrim(stream->playbackResampler, rawr_Drift_Update(&stream->drift, queued, frames));
+            }
+
+            /* pull exactly what converts to one device buffer, concealing whatever is not there yet */
+            needed = rawr_Resampler_InputFor(stream->playbackResampler, framesPerBuffer);
+            rawr_AudioStream_Pull(stream, stream->playbackScratch, needed);
+            rawr_Resampler_Process(stream->playbackResampler, stream->playbackScratch, needed, outputBuffer, framesPerBuffer);
+
+            /* at the stream's own rate the device buffer is exactly what was heard alongside the capture */
+            if (stream->deviceRate != stream->sampleRate) {
+                played = stream->playbackScratch;
+                playedSamples = needed * stream->channelCount;
+            }
+        } else {
+            rawr_AudioStream_Pull(stream, outputBuffer, framesPerBuffer);
+        }
+
+        /* metered once filled, so the level is what is being played now */
+        rawr_LevelMeter_Record(&stream->outputMeter, outputBuffer, framesPerBuffer * stream->channelCount);
+    }
+
+    if (inputBuffer) {
+        rawr_LevelMeter_Record(&stream->inputMeter, inputBuffer, framesPerBuffer * stream->channelCount);
+
+        if (stream->captureResampler) {
+            const int converted = rawr_Resampler_Process(stream->captureResampler, inputBuffer, framesPerBuffer, stream->captureScratch, stream->captureScratchFrames);
+            rawr_AudioStream_Capture(stream, stream->captureScratch, converted * stream->channelCount, played, playedSamples);
+        } else {
+            rawr_AudioStream_Capture(stream, inputBuffer, framesPerBuffer * stream->channelCount, played, playedSamples);
+        }
+
+        /* wake the reader once a full codec frame is waiting */
+        if (rawr_RingBuffer_GetReadAvailable(&priv->rbFromDevice) >= stream->sampleCount) {
+            rawr_Semaphore_Post(priv->readSignal);
+        }
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_Backlog(void *userData)
+{
+    rawr_AudioStream *stream = (rawr_AudioStream *)userData;
+    RAWR_ASSERT(stream);
+    const int64_t samples = rawr_RingBuffer_GetReadAvailable(&rawr_AudioStream_Priv(stream)->rbFromDevice);
+    const int64_t frames = samples / stream->sampleCount * stream->sampleCount / stream->channelCount;
+
+    /* only whole codec frames count, the reader cannot take less, and the file clock counts in device frames */
+    return (int)(frames * stream->deviceRate / stream->sampleRate);
+}
+
 // private ------------------------------------------------------------------------------------------------------
 int rawr_AudioStream_AudioCallback(const void *inputBuffer, void *outputBuffer, unsigned long framesPerBuffer, const PaStreamCallbackTimeInfo *timeInfo, PaStreamCallbackFlags statusFlags, void *userData)
 {
@@ -300,52 +679,105 @@ int rawr_AudioStream_AudioCallback(const void *inputBuffer, void *outputBuffer,
         mn_log_info("paOutputOverflow");
     }
 
-    rawr_AudioStream *stream = (rawr_AudioStream *)userData;
-    RAWR_ASSERT(stream);
-    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    rawr_AudioStream_Process((const rawr_AudioSample *)inputBuffer, (rawr_AudioSample *)outputBuffer, (int)framesPerBuffer, userData);
+
+    return paContinue;
+}
+
+/* the stream's own rate if every device has it, else a whole multiple of it, else the nearest above, else below */
+// private ------------------------------------------------------------------------------------------------------
+static rawr_AudioRate rawr_AudioStream_PickDeviceRate(rawr_AudioStream *stream)
+{
+    unsigned rates = ~0u;
+    int r;
 
-    double inputRms, inputDb, inputLevel, outputRms, outputDb, outputLevel;
-    double weight = 1.0 / (double)framesPerBuffer;
-    double inverse = 1.0 / 32767.0;
-    rawr_AudioSample *inputSamples = (rawr_AudioSample *)inputBuffer;
-    rawr_AudioSample *outputSamples = (rawr_AudioSample *)outputBuffer;
+    if (stream->deviceRateWanted) return stream->deviceRateWanted;
 
-    inputRms = outputRms = 0.0;
-    for (int i = 0; i < framesPerBuffer; i++) {
-        inputRms += abs(*(inputSamples + i)) * inverse * weight;
-        outputRms += abs(*(outputSamples + i)) * inverse * weight;
+    if (stream->inDevice) rates &= rawr_AudioDevice_SampleRates(stream->inDevice);
+    if (stream->outDevice) rates &= rawr_AudioDevice_SampleRates(stream->outDevice);
+
+    for (r = 0; rawr_AudioRateList[r] > 0.0; r++) {
+        if ((rates & (1u << r)) && (int)rawr_AudioRateList[r] == (int)stream->sampleRate) return stream->sampleRate;
     }
 
-    /* approx -230 to -10 is what you can expect to see here */
-    inputDb = 20 * log(inputRms);
-    outputDb = 20 * log(outputRms);
+    for (r = 0; rawr_AudioRateList[r] > 0.0; r++) {
+        if ((rates & (1u << r)) && (int)rawr_AudioRateList[r] % (int)stream->sampleRate == 0) return (rawr_AudioRate)rawr_AudioRateList[r];
+    }
 
-    /* drop the lowest range to make the level look stable */
-    inputLevel = fmax(20.0, fmin(200.0, inputDb * -1.0)) - 20.0;
-    inputLevel = 1.0 - (inputLevel / 180.0);
+    for (r = 0; rawr_AudioRateList[r] > 0.0; r++) {
+        if ((rates & (1u << r)) && (int)rawr_AudioRateList[r] > (int)stream->sampleRate) return (rawr_AudioRate)rawr_AudioRateList[r];
+    }
 
-    outputLevel = fmax(20.0, fmin(200.0, outputDb * -1.0)) - 20.0;
-    outputLevel = 1.0 - (outputLevel / 180.0);
+    while (--r >= 0) {
+        if (rates & (1u << r)) return (rawr_AudioRate)rawr_AudioRateList[r];
+    }
 
-    /* store in atomics for frontend retrival */
-    mn_atomic_store(&stream->inputLevel, inputLevel * RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER);
-    mn_atomic_store(&stream->outputLevel, outputLevel * RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER);
+    /* nothing in common, let the device turn it down */
+    return stream->sampleRate;
+}
 
-    if (outputBuffer) {
-        size_t avail = rawr_RingBuffer_GetReadAvailable(&priv->rbToDevice);
-        if (avail < framesPerBuffer) {
-            /* emit silence */
-            memset(outputBuffer, 0, framesPerBuffer * sizeof(rawr_AudioSample));
-        } else {
-            rawr_RingBuffer_Read(&priv->rbToDevice, outputBuffer, framesPerBuffer);
-        }
+/* true when either device's rates came from the cache, in which case they have now been probed instead */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioStream_ReprobeRates(rawr_AudioStream *stream)
+{
+    rawr_AudioDevice *devices[2] = {stream->inDevice, stream->outDevice};
+    int reprobed = 0;
+
+    for (int d = 0; d < 2; d++) {
+        if (!devices[d] || !rawr_AudioDevice_Priv(devices[d])->ratesCached) continue;
+        rawr_AudioDevice_LoadRates(devices[d]);
+        reprobed = 1;
     }
 
-    if (inputBuffer) {
-        rawr_RingBuffer_Write(&priv->rbFromDevice, inputBuffer, framesPerBuffer);
+    return reprobed;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_CleanupResamplers(rawr_AudioStream *stream)
+{
+    if (stream->captureResampler) rawr_Resampler_Cleanup(stream->captureResampler);
+    if (stream->playbackResampler) rawr_Resampler_Cleanup(stream->playbackResampler);
+    MN_MEM_RELEASE(stream->captureScratch);
+    MN_MEM_RELEASE(stream->playbackScratch);
+
+    stream->captureResampler = NULL;
+    stream->playbackResampler = NULL;
+    stream->captureScratch = NULL;
+    stream->playbackScratch = NULL;
+}
+
+/* the converters are sized for one device buffer, which is picked here along with them */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioStream_SetupResamplers(rawr_AudioStream *stream)
+{
+    int playbackFrames;
+
+    rawr_AudioStream_CleanupResamplers(stream);
+
+    stream->deviceFrames = stream->deviceFramesWanted;
+    if (!stream->deviceFrames) stream->deviceFrames = stream->deviceRate * RAWR_AUDIOSTREAM_DEVICE_MS / 1000;
+    rawr_Drift_Reset(&stream->drift, stream->sampleRate);
+
+    if (stream->deviceRate != stream->sampleRate) {
+        RAWR_GUARD_CLEANUP(rawr_Resampler_Setup(&stream->captureResampler, stream->deviceRate, stream->sampleRate, stream->channelCount, stream->deviceFrames));
+        stream->captureScratchFrames = rawr_Resampler_OutputMax(stream->captureResampler, stream->deviceFrames);
+        RAWR_GUARD_NULL_CLEANUP(stream->captureScratch = MN_MEM_ACQUIRE(stream->captureScratchFrames * stream->channelCount * sizeof(rawr_AudioSample)));
+
+        mn_log_info("converting between %d Hz on the device and %d Hz on the stream", stream->deviceRate, stream->sampleRate);
+    } else if (!stream->driftCompensation) {
+        return rawr_Success;
     }
 
-    return paContinue;
+    playbackFrames = (int)((double)stream->deviceFrames * stream->sampleRate / stream->deviceRate * (1.0 + RAWR_RESAMPLER_TRIM_MAX)) + 2;
+    RAWR_GUARD_CLEANUP(rawr_Resampler_Setup(&stream->playbackResampler, stream->sampleRate, stream->deviceRate, stream->channelCount, playbackFrames));
+    RAWR_ASSERT(rawr_Resampler_InputMax(stream->playbackResampler, stream->deviceFrames) <= playbackFrames);
+    RAWR_GUARD_NULL_CLEANUP(stream->playbackScratch = MN_MEM_ACQUIRE(playbackFrames * stream->channelCount * sizeof(rawr_AudioSample)));
+
+    return rawr_Success;
+
+cleanup:
+    rawr_AudioStream_CleanupResamplers(stream);
+    return rawr_Error;
 }
 
 // --------------------------------------------------------------------------------------------------------------
@@ -356,12 +788,24 @@ int rawr_AudioStream_Setup(rawr_AudioStream **out_stream, rawr_AudioRate sampleR
     rawr_AudioStreamPriv *priv = NULL;
     uint32_t numBytes, numSamples;
 
+    RAWR_GUARD(channelCount < 1 || channelCount > RAWR_RESAMPLER_CHANNELS_MAX);
+
     RAWR_GUARD_NULL(*out_stream = MN_MEM_ACQUIRE(sizeof(**out_stream)));
+    memset(*out_stream, 0, sizeof(**out_stream));
     (*out_stream)->outDevice = NULL;
     (*out_stream)->inDevice = NULL;
     (*out_stream)->sampleRate = sampleRate;
     (*out_stream)->channelCount = channelCount;
     (*out_stream)->sampleCount = sampleCount;
+    (*out_stream)->deviceRateWanted = 0;
+    (*out_stream)->deviceRate = sampleRate;
+    (*out_stream)->deviceFramesWanted = 0;
+    (*out_stream)->deviceFrames = sampleCount;
+    (*out_stream)->captureResampler = NULL;
+    (*out_stream)->playbackResampler = NULL;
+    (*out_stream)->captureScratch = NULL;
+    (*out_stream)->playbackScratch = NULL;
+    (*out_stream)->driftCompensation = 1;
     numSamples = rawr_Util_NextPowerOf2((unsigned)((*out_stream)->sampleCount * 10));
     (*out_stream)->sampleCapacity = numSamples;
 
@@ -373,18 +817,29 @@ int rawr_AudioStream_Setup(rawr_AudioStream **out_stream, rawr_AudioRate sampleR
     numBytes = numSamples * sizeof(rawr_AudioSample);
     priv->ringBufferDataTo = MN_MEM_ACQUIRE(numBytes);
     priv->ringBufferDataFrom = MN_MEM_ACQUIRE(numBytes);
+    RAWR_GUARD_NULL_CLEANUP(priv->ringBufferDataReference = MN_MEM_ACQUIRE(numBytes));
+    RAWR_GUARD_NULL_CLEANUP(priv->readBounce = MN_MEM_ACQUIRE(sampleCount * sizeof(rawr_AudioSample)));
+    RAWR_GUARD_NULL_CLEANUP(priv->writeBounce = MN_MEM_ACQUIRE(sampleCount * sizeof(rawr_AudioSample)));
 
     RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&priv->rbToDevice, sizeof(rawr_AudioSample), numSamples, priv->ringBufferDataTo));
     RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&priv->rbFromDevice, sizeof(rawr_AudioSample), numSamples, priv->ringBufferDataFrom));
+    RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&priv->rbReference, sizeof(rawr_AudioSample), numSamples, priv->ringBufferDataReference));
 
-    mn_atomic_store(&(*out_stream)->inputLevel, 0);
-    mn_atomic_store(&(*out_stream)->outputLevel, 0);
+    RAWR_GUARD_CLEANUP(rawr_Semaphore_Setup(&priv->readSignal));
+
+    rawr_LevelMeter_Reset(&(*out_stream)->inputMeter);
+    rawr_LevelMeter_Reset(&(*out_stream)->outputMeter);
+    mn_atomic_store(&(*out_stream)->outputUnderflows, 0);
+    mn_atomic_store(&(*out_stream)->outputOverflows, 0);
 
     return rawr_Success;
 
 cleanup:
     MN_MEM_RELEASE(priv->ringBufferDataTo);
     MN_MEM_RELEASE(priv->ringBufferDataFrom);
+    MN_MEM_RELEASE(priv->ringBufferDataReference);
+    MN_MEM_RELEASE(priv->readBounce);
+    MN_MEM_RELEASE(priv->writeBounce);
     MN_MEM_RELEASE(priv);
     MN_MEM_RELEASE(*out_stream);
 
@@ -397,8 +852,15 @@ void rawr_AudioStream_Cleanup(rawr_AudioStream *stream)
     RAWR_ASSERT(stream);
 
     rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    if (priv->file) rawr_AudioFile_Cleanup(priv->file);
+    rawr_AudioStream_CleanupResamplers(stream);
+    if (stream->latency) rawr_Latency_Cleanup(stream->latency);
+    rawr_Semaphore_Cleanup(priv->readSignal);
     MN_MEM_RELEASE(priv->ringBufferDataTo);
     MN_MEM_RELEASE(priv->ringBufferDataFrom);
+    MN_MEM_RELEASE(priv->ringBufferDataReference);
+    MN_MEM_RELEASE(priv->readBounce);
+    MN_MEM_RELEASE(priv->writeBounce);
     MN_MEM_RELEASE(priv);
     MN_MEM_RELEASE(stream);
 }
@@ -429,6 +891,104 @@ int rawr_AudioStream_AddDevice(rawr_AudioStream *stream, rawr_AudioDevice *dev)
     return rawr_Success;
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetDeviceRate(rawr_AudioStream *stream, rawr_AudioRate deviceRate)
+{
+    RAWR_ASSERT(stream);
+
+    RAWR_GUARD(deviceRate < 0);
+    stream->deviceRateWanted = deviceRate;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+rawr_AudioRate rawr_AudioStream_DeviceRate(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return stream->deviceRate;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetDeviceFrames(rawr_AudioStream *stream, int deviceFrames)
+{
+    RAWR_ASSERT(stream);
+
+    RAWR_GUARD(deviceFrames < 0);
+    stream->deviceFramesWanted = deviceFrames;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_DeviceFrames(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return stream->deviceFrames;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetDriftCompensation(rawr_AudioStream *stream, int enabled)
+{
+    RAWR_ASSERT(stream);
+
+    stream->driftCompensation = enabled ? 1 : 0;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_OutputDriftPpm(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return rawr_Drift_Ppm(&stream->drift);
+}
+
+/* a target sizes the playback queue to hold at least twice its most and a stretched frame, otherwise it is as set up */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetLatencyTarget(rawr_AudioStream *stream, int minMs, int maxMs)
+{
+    RAWR_ASSERT(stream);
+
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    rawr_Latency *latency = NULL;
+    rawr_AudioSample *data = NULL;
+    uint32_t numSamples = (uint32_t)stream->sampleCapacity;
+
+    /* the queue is swapped out from under whatever is reading it, so only before Start */
+    RAWR_GUARD(priv->started);
+    RAWR_GUARD(minMs < 0 || maxMs < minMs);
+
+    if (maxMs) {
+        RAWR_GUARD(stream->channelCount != 1);
+        RAWR_GUARD(rawr_Latency_Setup(&latency, stream->sampleRate, stream->sampleCount, minMs, maxMs));
+        numSamples = rawr_Util_NextPowerOf2((unsigned)(2 * maxMs * stream->sampleRate / 1000 + rawr_Latency_OutputMax(latency)));
+    }
+
+    RAWR_GUARD_NULL_CLEANUP(data = MN_MEM_ACQUIRE(numSamples * sizeof(rawr_AudioSample)));
+    RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&priv->rbToDevice, sizeof(rawr_AudioSample), numSamples, data));
+
+    MN_MEM_RELEASE(priv->ringBufferDataTo);
+    priv->ringBufferDataTo = data;
+    if (stream->latency) rawr_Latency_Cleanup(stream->latency);
+    stream->latency = latency;
+
+    return rawr_Success;
+
+cleanup:
+    if (latency) rawr_Latency_Cleanup(latency);
+    MN_MEM_RELEASE(data);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_LatencyTarget(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return stream->latency ? rawr_Latency_Target(stream->latency) : 0;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 int rawr_AudioStream_Start(rawr_AudioStream *stream)
 {
@@ -438,6 +998,20 @@ int rawr_AudioStream_Start(rawr_AudioStream *stream)
     int errCode;
     rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
 
+    stream->deviceRate = rawr_AudioStream_PickDeviceRate(stream);
+    RAWR_GUARD(rawr_AudioStream_SetupResamplers(stream));
+
+    if (audio_priv.backend == rawr_AudioBackend_File) {
+        RAWR_GUARD(rawr_AudioFile_Setup(&priv->file, stream->deviceRate, stream->channelCount, stream->deviceFrames, rawr_AudioStream_Process, rawr_AudioStream_Backlog, stream));
+        if (rawr_AudioFile_Start(priv->file)) {
+            rawr_AudioFile_Cleanup(priv->file);
+            priv->file = NULL;
+            return rawr_Error;
+        }
+        priv->started = 1;
+        return rawr_Success;
+    }
+
     PaStreamParameters *pInParams = NULL;
     if (stream->inDevice) {
         pInParams = &priv->inParameters;
@@ -463,15 +1037,23 @@ int rawr_AudioStream_Start(rawr_AudioStream *stream)
         &priv->pa_stream,
         pInParams,
         pOutParams,
-        (double)stream->sampleRate,
-        stream->sampleCount,
+        (double)stream->deviceRate,
+        stream->deviceFrames,
         paClipOff,
         rawr_AudioStream_AudioCallback,
         stream);
+
+    /* a cached rate the device no longer takes, ask the devices themselves and try again */
+    if (err != paNoError && rawr_AudioStream_ReprobeRates(stream)) {
+        stream->deviceRate = rawr_AudioStream_PickDeviceRate(stream);
+        RAWR_GUARD(rawr_AudioStream_SetupResamplers(stream));
+        err = Pa_OpenStream(&priv->pa_stream, pInParams, pOutParams, (double)stream->deviceRate, stream->deviceFrames, paClipOff, rawr_AudioStream_AudioCallback, stream);
+    }
     RAWR_GUARD_CLEANUP(err);
 
     errCode = -2;
     RAWR_GUARD_CLEANUP(Pa_StartStream(priv->pa_stream));
+    priv->started = 1;
 
     return rawr_Success;
 
@@ -485,7 +1067,19 @@ cleanup:
 int rawr_AudioStream_Stop(rawr_AudioStream *stream)
 {
     RAWR_ASSERT(stream);
-    return Pa_StopStream(rawr_AudioStream_Priv(stream)->pa_stream);
+
+    int ret;
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+
+    /* both wait for the callback to finish */
+    priv->started = 0;
+    if (!priv->file) return Pa_StopStream(priv->pa_stream);
+
+    ret = rawr_AudioFile_Stop(priv->file);
+    rawr_AudioFile_Cleanup(priv->file);
+    priv->file = NULL;
+
+    return ret;
 }
 
 // --------------------------------------------------------------------------------------------------------------
@@ -493,12 +1087,39 @@ int rawr_AudioStream_Read(rawr_AudioStream *stream, void *buffer)
 {
     RAWR_ASSERT(stream);
 
-    rawr_RingBuffer *rb = &rawr_AudioStream_Priv(stream)->rbFromDevice;
-    if (rawr_RingBuffer_GetReadAvailable(rb) < stream->sampleCount) {
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    int sampleCount;
+
+    if (rawr_RingBuffer_GetReadAvailable(&priv->rbFromDevice) < stream->sampleCount) {
         return 0;
     }
 
-    return rawr_RingBuffer_Read(rb, buffer, stream->sampleCount);
+    rawr_RingBuffer_AdvanceReadIndex(&priv->rbReference, stream->sampleCount);
+    sampleCount = rawr_RingBuffer_Read(&priv->rbFromDevice, buffer, stream->sampleCount);
+    if (stream->captureChain) rawr_DspChain_Process(stream->captureChain, (rawr_AudioSample *)buffer);
+
+    return sampleCount;
+}
+
+/* times a write against the latency target and decides whether its frame is stretched on the way into the queue */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioStream_PlanWrite(rawr_AudioStream *stream)
+{
+    rawr_RingBuffer *rb = &rawr_AudioStream_Priv(stream)->rbToDevice;
+    const int deviceFrames = (int)((int64_t)stream->deviceFrames * stream->sampleRate / stream->deviceRate);
+
+    return rawr_Latency_Plan(stream->latency, (int)rawr_RingBuffer_GetReadAvailable(rb), (int)rawr_RingBuffer_GetWriteAvailable(rb), deviceFrames);
+}
+
+/* queues a frame that went through the latency target's stretching, which moved the queue from under the drift */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_WriteStretched(rawr_AudioStream *stream, const rawr_AudioSample *frame)
+{
+    const rawr_AudioSample *samples;
+    const int sampleCount = rawr_Latency_Apply(stream->latency, frame, &samples);
+
+    rawr_RingBuffer_Write(&rawr_AudioStream_Priv(stream)->rbToDevice, samples, sampleCount);
+    if (sampleCount != stream->sampleCount) rawr_Drift_Retarget(&stream->drift);
 }
 
 // --------------------------------------------------------------------------------------------------------------
@@ -507,21 +1128,232 @@ int rawr_AudioStream_Write(rawr_AudioStream *stream, void *buffer)
     RAWR_ASSERT(stream);
 
     rawr_RingBuffer *rb = &rawr_AudioStream_Priv(stream)->rbToDevice;
+    const int stretching = stream->latency ? rawr_AudioStream_PlanWrite(stream) : 0;
+
     if (rawr_RingBuffer_GetWriteAvailable(rb) < stream->sampleCount) {
+        mn_atomic_fetch_add(&stream->outputOverflows, 1);
         return 0;
     }
 
+    if (stretching) {
+        rawr_AudioStream_WriteStretched(stream, (const rawr_AudioSample *)buffer);
+        return stream->sampleCount;
+    }
+
     return rawr_RingBuffer_Write(rb, buffer, stream->sampleCount);
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_BeginRead(rawr_AudioStream *stream, rawr_AudioSample **samples)
+{
+    RAWR_ASSERT(stream && samples);
+
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    void *data1, *data2;
+    size_t size1, size2;
+
+    /* begun again before it was ended, the frame has been through the chain already */
+    if (priv->readFrame) {
+        *samples = priv->readFrame;
+        return stream->sampleCount;
+    }
+
+    if (rawr_RingBuffer_GetReadRegions(&priv->rbFromDevice, stream->sampleCount, &data1, &size1, &data2, &size2) < (size_t)stream->sampleCount) {
+        return 0;
+    }
+
+    *samples = (rawr_AudioSample *)data1;
+    if (size2) {
+        /* the frame wraps, which is the one time it is copied */
+        memcpy(priv->readBounce, data1, size1 * sizeof(rawr_AudioSample));
+        memcpy(priv->readBounce + size1, data2, size2 * sizeof(rawr_AudioSample));
+        *samples = priv->readBounce;
+    }
+
+    if (stream->captureChain) rawr_DspChain_Process(stream->captureChain, *samples);
+    priv->readFrame = *samples;
+
+    return stream->sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_AudioStream_EndRead(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    rawr_RingBuffer_AdvanceReadIndex(&priv->rbReference, stream->sampleCount);
+    rawr_RingBuffer_AdvanceReadIndex(&priv->rbFromDevice, stream->sampleCount);
+    priv->readFrame = NULL;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_ReadReference(rawr_AudioStream *stream, rawr_AudioSample *buffer)
+{
+    RAWR_ASSERT(stream && buffer);
+
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    void *data1, *data2;
+    size_t size1, size2;
+
+    if (rawr_RingBuffer_GetReadRegions(&priv->rbReference, stream->sampleCount, &data1, &size1, &data2, &size2) < (size_t)stream->sampleCount) {
+        return 0;
+    }
+
+    memcpy(buffer, data1, size1 * sizeof(rawr_AudioSample));
+    if (size2) memcpy(buffer + size1, data2, size2 * sizeof(rawr_AudioSample));
+
+    return stream->sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_BeginWrite(rawr_AudioStream *stream, rawr_AudioSample **samples)
+{
+    RAWR_ASSERT(stream && samples);
+
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    void *data1, *data2;
+    size_t size1, size2;
+
+    priv->writeStretching = stream->latency ? rawr_AudioStream_PlanWrite(stream) : 0;
+
+    if (rawr_RingBuffer_GetWriteRegions(&priv->rbToDevice, stream->sampleCount, &data1, &size1, &data2, &size2) < (size_t)stream->sampleCount) {
+        mn_atomic_fetch_add(&stream->outputOverflows, 1);
+        return 0;
+    }
+
+    /* a frame to be stretched is written to the queue at EndWrite, once it is there to stretch */
+    *samples = size2 || priv->writeStretching ? priv->writeBounce : (rawr_AudioSample *)data1;
+    return stream->sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_AudioStream_EndWrite(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+
+    rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    void *data1, *data2;
+    size_t size1, size2;
+
+    if (priv->writeStretching) {
+        rawr_AudioStream_WriteStretched(stream, priv->writeBounce);
+        return;
+    }
+
+    /* the write index has not moved since BeginWrite, so the frame splits the same way it did then */
+    rawr_RingBuffer_GetWriteRegions(&priv->rbToDevice, stream->sampleCount, &data1, &size1, &data2, &size2);
+    if (size2) {
+        memcpy(data1, priv->writeBounce, size1 * sizeof(rawr_AudioSample));
+        memcpy(data2, priv->writeBounce + size1, size2 * sizeof(rawr_AudioSample));
+    }
+
+    rawr_RingBuffer_AdvanceWriteIndex(&priv->rbToDevice, stream->sampleCount);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_WaitRead(rawr_AudioStream *stream, void *buffer, int timeoutMs)
+{
+    RAWR_ASSERT(stream);
+
+    int sampleCount, ret;
+    const uint64_t deadline = mn_tstamp() + mn_tstamp_convert(timeoutMs, MN_TSTAMP_MS, MN_TSTAMP_NS);
+
+    while ((sampleCount = rawr_AudioStream_Read(stream, buffer)) == 0) {
+        const uint64_t now = mn_tstamp();
+        if (now >= deadline) break;
+
+        const int remainingMs = (int)mn_tstamp_convert(deadline - now, MN_TSTAMP_NS, MN_TSTAMP_MS);
+        RAWR_GUARD((ret = rawr_Semaphore_Wait(rawr_AudioStream_Priv(stream)->readSignal, remainingMs)) < 0);
+        if (ret == RAWR_SEMAPHORE_TIMEOUT) break;
+    }
+
+    return sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_WaitBeginRead(rawr_AudioStream *stream, rawr_AudioSample **samples, int timeoutMs)
+{
+    RAWR_ASSERT(stream);
+
+    int sampleCount, ret;
+    const uint64_t deadline = mn_tstamp() + mn_tstamp_convert(timeoutMs, MN_TSTAMP_MS, MN_TSTAMP_NS);
+
+    while ((sampleCount = rawr_AudioStream_BeginRead(stream, samples)) == 0) {
+        const uint64_t now = mn_tstamp();
+        if (now >= deadline) break;
+
+        const int remainingMs = (int)mn_tstamp_convert(deadline - now, MN_TSTAMP_NS, MN_TSTAMP_MS);
+        RAWR_GUARD((ret = rawr_Semaphore_Wait(rawr_AudioStream_Priv(stream)->readSignal, remainingMs)) < 0);
+        if (ret == RAWR_SEMAPHORE_TIMEOUT) break;
+    }
+
+    return sampleCount;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 double rawr_AudioStream_InputLevel(rawr_AudioStream *stream)
 {
-    return (double)mn_atomic_load(&stream->inputLevel) / RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER;
+    return rawr_LevelMeter_Rms(&stream->inputMeter);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 double rawr_AudioStream_OutputLevel(rawr_AudioStream *stream)
 {
-    return (double)mn_atomic_load(&stream->outputLevel) / RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER;
+    return rawr_LevelMeter_Rms(&stream->outputMeter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_InputPeak(rawr_AudioStream *stream)
+{
+    return rawr_LevelMeter_Peak(&stream->inputMeter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_OutputPeak(rawr_AudioStream *stream)
+{
+    return rawr_LevelMeter_Peak(&stream->outputMeter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_OutputQueued(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return (int)rawr_RingBuffer_GetReadAvailable(&rawr_AudioStream_Priv(stream)->rbToDevice);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_AudioStream_OutputUnderflows(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return mn_atomic_load(&stream->outputUnderflows);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_OutputBufferedMs(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+
+    const size_t queued = rawr_RingBuffer_GetReadAvailable(&rawr_AudioStream_Priv(stream)->rbToDevice);
+
+    return (double)queued / stream->channelCount * 1000.0 / stream->sampleRate;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_AudioStream_OutputOverflows(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return mn_atomic_load(&stream->outputOverflows);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetCaptureChain(rawr_AudioStream *stream, rawr_DspChain *chain)
+{
+    RAWR_ASSERT(stream);
+
+    RAWR_GUARD(chain && stream->channelCount != 1);
+    RAWR_GUARD(chain && (rawr_DspChain_SampleRate(chain) != (int)stream->sampleRate || rawr_DspChain_FrameSize(chain) != stream->sampleCount));
+    stream->captureChain = chain;
+
+    return rawr_Success;
 }
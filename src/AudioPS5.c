@@ -1,13 +1,20 @@
 #include "rawr/Audio.h"
+#include "rawr/Drift.h"
+#include "rawr/Dsp.h"
+#include "rawr/Latency.h"
+#include "rawr/Resampler.h"
 #include "rawr/RingBuffer.h"
+#include "rawr/Semaphore.h"
 #include "rawr/Util.h"
 #include "rawr/Error.h"
+#include "rawr/Level.h"
 #include "rawr/Platform.h"
 
 #include "mn/allocator.h"
 #include "mn/atomic.h"
 #include "mn/error.h"
 #include "mn/log.h"
+#include "mn/time.h"
 
 #include <audioin.h>
 #include <audioout.h>
@@ -15,6 +22,9 @@
 #include <math.h>
 #include <stdint.h>
 
+/* concealment keeps this many sixteenths of the held sample each frame, gone within about 3 ms at 48 kHz */
+#define RAWR_AUDIOSTREAM_CONCEAL_DECAY 15
+
 const double rawr_AudioRateList[] = {
     8000.0,
     9600.0,
@@ -70,19 +80,62 @@ typedef struct rawr_AudioStream {
 
     rawr_AudioSample *ringBufferDataFrom;
     rawr_RingBuffer rbFromDevice;
+    rawr_Semaphore *readSignal;
+
+    /* what was played alongside each captured sample, in step with rbFromDevice */
+    rawr_AudioSample *ringBufferDataReference;
+    rawr_RingBuffer rbReference;
+
+    /* frames that wrap around the end of a queue, for BeginRead and BeginWrite */
+    rawr_AudioSample *readBounce;
+    rawr_AudioSample *readFrame; /* the frame between BeginRead and EndRead, already through the capture chain */
+    rawr_AudioSample *writeBounce;
+    int writeStretching; /* the frame between BeginWrite and EndWrite is in writeBounce to be stretched */
 
     size_t sampleCapacity;
     int channelCount;
     int sampleCount;
 
-    mn_atomic_t inputLevel;
-    mn_atomic_t outputLevel;
+    /* the console runs at 48 kHz, other stream rates are converted on the audio thread */
+    rawr_AudioRate deviceRate;
+    rawr_Resampler *captureResampler;
+    rawr_Resampler *playbackResampler;
+    rawr_AudioSample *captureScratch;
+    rawr_AudioSample *playbackScratch;
+    int captureScratchFrames;
+
+    /* trims the playback converter, which runs even at the device's own rate while compensating */
+    int driftCompensation;
+    rawr_Drift drift;
+
+    /* holds the playback queue at a target depth by stretching frames as they are written, NULL when off */
+    rawr_Latency *latency;
+
+    /* the last sample played, which concealment fades out when the queue runs dry mid grain */
+    int concealSample;
+
+    rawr_LevelMeter inputMeter;
+    rawr_LevelMeter outputMeter;
+    mn_atomic_t outputUnderflows;
+    mn_atomic_t outputOverflows;
+
+    rawr_DspChain *captureChain;
 
     mn_thread_t audioThread;
+    int started; /* the audio thread owns the playback queue from Start on, Stop does not join it */
 } rawr_AudioStream;
 
 // --------------------------------------------------------------------------------------------------------------
 int rawr_Audio_Setup(void)
+{
+    /* the console always has its own audio, the file backend is not wired up here */
+    RAWR_GUARD(rawr_Audio_Backend() != rawr_AudioBackend_Device);
+    return rawr_Success;
+}
+
+/* the console's rates are fixed, there is nothing to probe or cache */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Audio_SetRateCache(const char *path)
 {
     return rawr_Success;
 }
@@ -169,6 +222,54 @@ rawr_AudioStreamPriv *rawr_AudioStream_Priv(rawr_AudioStream *stream)
     return (rawr_AudioStreamPriv *)stream->priv;
 }
 
+/* plays whatever part of frames is queued and fills the rest by fading out the last sample played */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_Pull(rawr_AudioStream *stream, rawr_AudioSample *buffer, int frames)
+{
+    int queued = (int)rawr_RingBuffer_GetReadAvailable(&stream->rbToDevice);
+
+    if (queued > frames) queued = frames;
+    if (queued) {
+        rawr_RingBuffer_Read(&stream->rbToDevice, buffer, queued);
+        stream->concealSample = buffer[queued - 1];
+    }
+
+    if (queued == frames) return;
+
+    for (int f = queued; f < frames; f++) {
+        stream->concealSample = stream->concealSample * RAWR_AUDIOSTREAM_CONCEAL_DECAY / 16;
+        buffer[f] = (rawr_AudioSample)stream->concealSample;
+    }
+    mn_atomic_fetch_add(&stream->outputUnderflows, 1);
+}
+
+/*
+ * queues what was just captured and as much of what was just played alongside it, so the two queues fill and empty
+ * together. the reader empties the reference first, so there is always room in it for what fits in the capture queue
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_Capture(rawr_AudioStream *stream, const rawr_AudioSample *captured, int capturedSamples, const rawr_AudioSample *played, int playedSamples)
+{
+    const size_t room = rawr_RingBuffer_GetWriteAvailable(&stream->rbFromDevice);
+    void *data[2];
+    size_t size[2];
+    int copied = 0, n;
+
+    if ((size_t)capturedSamples > room) capturedSamples = (int)room;
+
+    rawr_RingBuffer_GetWriteRegions(&stream->rbReference, capturedSamples, &data[0], &size[0], &data[1], &size[1]);
+    for (int r = 0; r < 2; r++) {
+        n = copied < playedSamples ? playedSamples - copied : 0;
+        if (n > (int)size[r]) n = (int)size[r];
+        if (n) memcpy(data[r], played + copied, n * sizeof(rawr_AudioSample));
+        if (n < (int)size[r]) memset((rawr_AudioSample *)data[r] + n, 0, (size[r] - n) * sizeof(rawr_AudioSample));
+        copied += (int)size[r];
+    }
+
+    rawr_RingBuffer_AdvanceWriteIndex(&stream->rbReference, capturedSamples);
+    rawr_RingBuffer_Write(&stream->rbFromDevice, captured, capturedSamples);
+}
+
 // private ------------------------------------------------------------------------------------------------------
 void rawr_AudioStream_AudioThread(void *arg)
 {
@@ -176,7 +277,8 @@ void rawr_AudioStream_AudioThread(void *arg)
     RAWR_ASSERT(stream);
     rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
 
-    int ret;
+    int ret, playedSamples;
+    const rawr_AudioSample *played;
     rawr_AudioSample inputSamples[SCE_AUDIO_IN_GRAIN_256] = {0};
     rawr_AudioSample outputSamples[SCE_AUDIO_IN_GRAIN_256] = {0};
     int32_t outvol[8];
@@ -205,12 +307,26 @@ void rawr_AudioStream_AudioThread(void *arg)
     RAWR_GUARD_CLEANUP(priv->inHandle < 0);
 
     while (1) {
-        size_t avail = rawr_RingBuffer_GetReadAvailable(&stream->rbToDevice);
-        if (avail < SCE_AUDIO_IN_GRAIN_256) {
-            /* emit silence */
-            memset(outputSamples, 0, SCE_AUDIO_IN_GRAIN_256 * sizeof(rawr_AudioSample));
+        if (stream->playbackResampler) {
+            int needed;
+
+            if (stream->driftCompensation) {
+                const int queued = (int)rawr_RingBuffer_GetReadAvailable(&stream->rbToDevice);
+                const int frames = SCE_AUDIO_IN_GRAIN_256 * stream->sampleRate / stream->deviceRate;
+                rawr_Resampler_SetTrim(stream->playbackResampler, rawr_Drift_Update(&stream->drift, queued, frames));
+            }
+
+            needed = rawr_Resampler_InputFor(stream->playbackResampler, SCE_AUDIO_IN_GRAIN_256);
+            rawr_AudioStream_Pull(stream, stream->playbackScratch, needed);
+            rawr_Resampler_Process(stream->playbackResampler, stream->playbackScratch, needed, outputSamples, SCE_AUDIO_IN_GRAIN_256);
+
+            /* at the stream's own rate the device grain is exactly what was heard alongside the capture */
+            played = stream->deviceRate != stream->sampleRate ? stream->playbackScratch : outputSamples;
+            playedSamples = stream->deviceRate != stream->sampleRate ? needed : SCE_AUDIO_IN_GRAIN_256;
         } else {
-            rawr_RingBuffer_Read(&stream->rbToDevice, outputSamples, SCE_AUDIO_IN_GRAIN_256);
+            rawr_AudioStream_Pull(stream, outputSamples, SCE_AUDIO_IN_GRAIN_256);
+            played = outputSamples;
+            playedSamples = SCE_AUDIO_IN_GRAIN_256;
         }
 
         RAWR_GUARD_CLEANUP((ret = sceAudioOutOutput(priv->outHandle, outputSamples)) < 0);
@@ -219,38 +335,69 @@ void rawr_AudioStream_AudioThread(void *arg)
         RAWR_GUARD_CLEANUP((ret = sceAudioInInput(priv->inHandle, inputSamples)) < 0);
         RAWR_ASSERT(ret == SCE_AUDIO_IN_GRAIN_256);
 
-        double inputRms, inputDb, inputLevel, outputRms, outputDb, outputLevel;
-        double weight = 1.0 / (double)SCE_AUDIO_IN_GRAIN_256;
-        double inverse = 1.0 / 32767.0;
+        /* the output block is the one just handed to the device */
+        rawr_LevelMeter_Record(&stream->inputMeter, inputSamples, SCE_AUDIO_IN_GRAIN_256);
+        rawr_LevelMeter_Record(&stream->outputMeter, outputSamples, SCE_AUDIO_IN_GRAIN_256);
 
-        inputRms = outputRms = 0.0;
-        for (int i = 0; i < SCE_AUDIO_IN_GRAIN_256; i++) {
-            inputRms += abs(*(inputSamples + i)) * inverse * weight;
-            outputRms += abs(*(outputSamples + i)) * inverse * weight;
+        if (stream->captureResampler) {
+            const int converted = rawr_Resampler_Process(stream->captureResampler, inputSamples, SCE_AUDIO_IN_GRAIN_256, stream->captureScratch, stream->captureScratchFrames);
+            rawr_AudioStream_Capture(stream, stream->captureScratch, converted, played, playedSamples);
+        } else {
+            rawr_AudioStream_Capture(stream, inputSamples, SCE_AUDIO_IN_GRAIN_256, played, playedSamples);
         }
 
-        /* approx -230 to -10 is what you can expect to see here */
-        inputDb = 20 * log(inputRms);
-        outputDb = 20 * log(outputRms);
+        /* wake the reader once a full codec frame is waiting */
+        if (rawr_RingBuffer_GetReadAvailable(&stream->rbFromDevice) >= stream->sampleCount) {
+            rawr_Semaphore_Post(stream->readSignal);
+        }
+    }
 
-        /* drop the lowest range to make the level look stable */
-        inputLevel = fmax(20.0, fmin(200.0, inputDb * -1.0)) - 20.0;
-        inputLevel = 1.0 - (inputLevel / 180.0);
+    return;
 
-        outputLevel = fmax(20.0, fmin(200.0, outputDb * -1.0)) - 20.0;
-        outputLevel = 1.0 - (outputLevel / 180.0);
+cleanup:
+    mn_log_error("error");
+}
 
-        /* store in atomics for frontend retrival */
-        mn_atomic_store(&stream->inputLevel, inputLevel * RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER);
-        mn_atomic_store(&stream->outputLevel, outputLevel * RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER);
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_CleanupResamplers(rawr_AudioStream *stream)
+{
+    if (stream->captureResampler) rawr_Resampler_Cleanup(stream->captureResampler);
+    if (stream->playbackResampler) rawr_Resampler_Cleanup(stream->playbackResampler);
+    MN_MEM_RELEASE(stream->captureScratch);
+    MN_MEM_RELEASE(stream->playbackScratch);
+
+    stream->captureResampler = NULL;
+    stream->playbackResampler = NULL;
+    stream->captureScratch = NULL;
+    stream->playbackScratch = NULL;
+}
+
+/* sized for one grain of the console's fixed 48 kHz mono audio */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioStream_SetupResamplers(rawr_AudioStream *stream)
+{
+    int playbackFrames;
 
-        rawr_RingBuffer_Write(&stream->rbFromDevice, inputSamples, SCE_AUDIO_IN_GRAIN_256);
+    rawr_AudioStream_CleanupResamplers(stream);
+    rawr_Drift_Reset(&stream->drift, stream->sampleRate);
+
+    if (stream->deviceRate != stream->sampleRate) {
+        RAWR_GUARD_CLEANUP(rawr_Resampler_Setup(&stream->captureResampler, stream->deviceRate, stream->sampleRate, 1, SCE_AUDIO_IN_GRAIN_256));
+        stream->captureScratchFrames = rawr_Resampler_OutputMax(stream->captureResampler, SCE_AUDIO_IN_GRAIN_256);
+        RAWR_GUARD_NULL_CLEANUP(stream->captureScratch = MN_MEM_ACQUIRE(stream->captureScratchFrames * sizeof(rawr_AudioSample)));
+    } else if (!stream->driftCompensation) {
+        return rawr_Success;
     }
 
-    return;
+    playbackFrames = (int)((double)SCE_AUDIO_IN_GRAIN_256 * stream->sampleRate / stream->deviceRate * (1.0 + RAWR_RESAMPLER_TRIM_MAX)) + 2;
+    RAWR_GUARD_CLEANUP(rawr_Resampler_Setup(&stream->playbackResampler, stream->sampleRate, stream->deviceRate, 1, playbackFrames));
+    RAWR_GUARD_NULL_CLEANUP(stream->playbackScratch = MN_MEM_ACQUIRE(playbackFrames * sizeof(rawr_AudioSample)));
+
+    return rawr_Success;
 
 cleanup:
-    mn_log_error("error");
+    rawr_AudioStream_CleanupResamplers(stream);
+    return rawr_Error;
 }
 
 // --------------------------------------------------------------------------------------------------------------
@@ -273,18 +420,41 @@ int rawr_AudioStream_Setup(rawr_AudioStream **out_stream, rawr_AudioRate sampleR
     stream->channelCount = channelCount;
     stream->sampleCount = sampleCount;
     stream->sampleCapacity = numSamples;
+    stream->deviceRate = rawr_AudioRate_48000;
+    stream->concealSample = 0;
+    stream->captureResampler = NULL;
+    stream->playbackResampler = NULL;
+    stream->captureScratch = NULL;
+    stream->playbackScratch = NULL;
+    stream->driftCompensation = 1;
+    rawr_Drift_Reset(&stream->drift, sampleRate);
+    stream->latency = NULL;
+    stream->readSignal = NULL;
+    stream->readFrame = NULL;
+    stream->writeStretching = 0;
+    stream->captureChain = NULL;
+    stream->started = 0;
     stream->ringBufferDataTo = MN_MEM_ACQUIRE(numBytes);
     stream->ringBufferDataFrom = MN_MEM_ACQUIRE(numBytes);
+    stream->ringBufferDataReference = MN_MEM_ACQUIRE(numBytes);
+    stream->readBounce = MN_MEM_ACQUIRE(sampleCount * sizeof(rawr_AudioSample));
+    stream->writeBounce = MN_MEM_ACQUIRE(sampleCount * sizeof(rawr_AudioSample));
+    RAWR_GUARD_NULL_CLEANUP(stream->ringBufferDataReference && stream->readBounce && stream->writeBounce);
 
     RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&stream->rbToDevice, sizeof(rawr_AudioSample), numSamples, stream->ringBufferDataTo));
     RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&stream->rbFromDevice, sizeof(rawr_AudioSample), numSamples, stream->ringBufferDataFrom));
+    RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&stream->rbReference, sizeof(rawr_AudioSample), numSamples, stream->ringBufferDataReference));
+
+    RAWR_GUARD_CLEANUP(rawr_Semaphore_Setup(&stream->readSignal));
 
     RAWR_GUARD_NULL(priv = MN_MEM_ACQUIRE(sizeof(*priv)));
     memset(priv, 0, sizeof(*priv));
     stream->priv = priv;
 
-    mn_atomic_store(&stream->inputLevel, 0);
-    mn_atomic_store(&stream->outputLevel, 0);
+    rawr_LevelMeter_Reset(&stream->inputMeter);
+    rawr_LevelMeter_Reset(&stream->outputMeter);
+    mn_atomic_store(&stream->outputUnderflows, 0);
+    mn_atomic_store(&stream->outputOverflows, 0);
 
     mn_thread_setup(&stream->audioThread);
 
@@ -298,9 +468,13 @@ int rawr_AudioStream_Setup(rawr_AudioStream **out_stream, rawr_AudioRate sampleR
     return rawr_Success;
 
 cleanup:
+    if (stream->readSignal) rawr_Semaphore_Cleanup(stream->readSignal);
     MN_MEM_RELEASE(priv);
     MN_MEM_RELEASE(stream->ringBufferDataTo);
     MN_MEM_RELEASE(stream->ringBufferDataFrom);
+    MN_MEM_RELEASE(stream->ringBufferDataReference);
+    MN_MEM_RELEASE(stream->readBounce);
+    MN_MEM_RELEASE(stream->writeBounce);
     MN_MEM_RELEASE(stream);
 
     return rawr_Error;
@@ -314,9 +488,15 @@ void rawr_AudioStream_Cleanup(rawr_AudioStream *stream)
     sceUserServiceTerminate();
 
     rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
+    rawr_AudioStream_CleanupResamplers(stream);
+    if (stream->latency) rawr_Latency_Cleanup(stream->latency);
+    rawr_Semaphore_Cleanup(stream->readSignal);
     MN_MEM_RELEASE(priv);
     MN_MEM_RELEASE(stream->ringBufferDataTo);
     MN_MEM_RELEASE(stream->ringBufferDataFrom);
+    MN_MEM_RELEASE(stream->ringBufferDataReference);
+    MN_MEM_RELEASE(stream->readBounce);
+    MN_MEM_RELEASE(stream->writeBounce);
     MN_MEM_RELEASE(stream);
 }
 
@@ -327,13 +507,108 @@ int rawr_AudioStream_AddDevice(rawr_AudioStream *stream, rawr_AudioDevice *dev)
     return rawr_Success;
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetDeviceRate(rawr_AudioStream *stream, rawr_AudioRate deviceRate)
+{
+    RAWR_ASSERT(stream);
+    RAWR_GUARD(deviceRate && deviceRate != rawr_AudioRate_48000);
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+rawr_AudioRate rawr_AudioStream_DeviceRate(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return stream->deviceRate;
+}
+
+/* the console hands out fixed grains */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetDeviceFrames(rawr_AudioStream *stream, int deviceFrames)
+{
+    RAWR_ASSERT(stream);
+    RAWR_GUARD(deviceFrames && deviceFrames != SCE_AUDIO_IN_GRAIN_256);
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_DeviceFrames(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return SCE_AUDIO_IN_GRAIN_256;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetDriftCompensation(rawr_AudioStream *stream, int enabled)
+{
+    RAWR_ASSERT(stream);
+
+    stream->driftCompensation = enabled ? 1 : 0;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_OutputDriftPpm(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return rawr_Drift_Ppm(&stream->drift);
+}
+
+/* a target sizes the playback queue to hold at least twice its most and a stretched frame, otherwise it is as set up */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetLatencyTarget(rawr_AudioStream *stream, int minMs, int maxMs)
+{
+    RAWR_ASSERT(stream);
+
+    rawr_Latency *latency = NULL;
+    rawr_AudioSample *data = NULL;
+    uint32_t numSamples = (uint32_t)stream->sampleCapacity;
+
+    /* the queue is swapped out from under whatever is reading it, so only before Start */
+    RAWR_GUARD(stream->started);
+    RAWR_GUARD(minMs < 0 || maxMs < minMs);
+
+    if (maxMs) {
+        RAWR_GUARD(stream->channelCount != 1);
+        RAWR_GUARD(rawr_Latency_Setup(&latency, stream->sampleRate, stream->sampleCount, minMs, maxMs));
+        numSamples = rawr_Util_NextPowerOf2((unsigned)(2 * maxMs * stream->sampleRate / 1000 + rawr_Latency_OutputMax(latency)));
+    }
+
+    RAWR_GUARD_NULL_CLEANUP(data = MN_MEM_ACQUIRE(numSamples * sizeof(rawr_AudioSample)));
+    RAWR_GUARD_CLEANUP(rawr_RingBuffer_Initialize(&stream->rbToDevice, sizeof(rawr_AudioSample), numSamples, data));
+
+    MN_MEM_RELEASE(stream->ringBufferDataTo);
+    stream->ringBufferDataTo = data;
+    if (stream->latency) rawr_Latency_Cleanup(stream->latency);
+    stream->latency = latency;
+
+    return rawr_Success;
+
+cleanup:
+    if (latency) rawr_Latency_Cleanup(latency);
+    MN_MEM_RELEASE(data);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_LatencyTarget(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return stream->latency ? rawr_Latency_Target(stream->latency) : 0;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 int rawr_AudioStream_Start(rawr_AudioStream *stream)
 {
     RAWR_ASSERT(stream);
     //rawr_AudioStreamPriv *priv = rawr_AudioStream_Priv(stream);
 
+    RAWR_GUARD(rawr_AudioStream_SetupResamplers(stream));
+
     RAWR_GUARD_CLEANUP(mn_thread_launch(&stream->audioThread, rawr_AudioStream_AudioThread, stream));
+    stream->started = 1;
 
     return rawr_Success;
 
@@ -368,12 +643,38 @@ int rawr_AudioStream_Read(rawr_AudioStream *stream, void *buffer)
 {
     RAWR_ASSERT(stream);
 
-    rawr_RingBuffer *rb = &stream->rbFromDevice;
-    if (rawr_RingBuffer_GetReadAvailable(rb) < stream->sampleCount) {
+    int sampleCount;
+
+    if (rawr_RingBuffer_GetReadAvailable(&stream->rbFromDevice) < stream->sampleCount) {
         return 0;
     }
 
-    return rawr_RingBuffer_Read(rb, buffer, stream->sampleCount);
+    rawr_RingBuffer_AdvanceReadIndex(&stream->rbReference, stream->sampleCount);
+    sampleCount = rawr_RingBuffer_Read(&stream->rbFromDevice, buffer, stream->sampleCount);
+    if (stream->captureChain) rawr_DspChain_Process(stream->captureChain, (rawr_AudioSample *)buffer);
+
+    return sampleCount;
+}
+
+/* times a write against the latency target and decides whether its frame is stretched on the way into the queue */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_AudioStream_PlanWrite(rawr_AudioStream *stream)
+{
+    rawr_RingBuffer *rb = &stream->rbToDevice;
+    const int deviceFrames = (int)((int64_t)SCE_AUDIO_IN_GRAIN_256 * stream->sampleRate / stream->deviceRate);
+
+    return rawr_Latency_Plan(stream->latency, (int)rawr_RingBuffer_GetReadAvailable(rb), (int)rawr_RingBuffer_GetWriteAvailable(rb), deviceFrames);
+}
+
+/* queues a frame that went through the latency target's stretching, which moved the queue from under the drift */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_AudioStream_WriteStretched(rawr_AudioStream *stream, const rawr_AudioSample *frame)
+{
+    const rawr_AudioSample *samples;
+    const int sampleCount = rawr_Latency_Apply(stream->latency, frame, &samples);
+
+    rawr_RingBuffer_Write(&stream->rbToDevice, samples, sampleCount);
+    if (sampleCount != stream->sampleCount) rawr_Drift_Retarget(&stream->drift);
 }
 
 // --------------------------------------------------------------------------------------------------------------
@@ -382,21 +683,224 @@ int rawr_AudioStream_Write(rawr_AudioStream *stream, void *buffer)
     RAWR_ASSERT(stream);
 
     rawr_RingBuffer *rb = &stream->rbToDevice;
+    const int stretching = stream->latency ? rawr_AudioStream_PlanWrite(stream) : 0;
+
     if (rawr_RingBuffer_GetWriteAvailable(rb) < stream->sampleCount) {
+        mn_atomic_fetch_add(&stream->outputOverflows, 1);
         return 0;
     }
 
+    if (stretching) {
+        rawr_AudioStream_WriteStretched(stream, (const rawr_AudioSample *)buffer);
+        return stream->sampleCount;
+    }
+
     return rawr_RingBuffer_Write(rb, buffer, stream->sampleCount);
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_BeginRead(rawr_AudioStream *stream, rawr_AudioSample **samples)
+{
+    RAWR_ASSERT(stream && samples);
+
+    void *data1, *data2;
+    size_t size1, size2;
+
+    /* begun again before it was ended, the frame has been through the chain already */
+    if (stream->readFrame) {
+        *samples = stream->readFrame;
+        return stream->sampleCount;
+    }
+
+    if (rawr_RingBuffer_GetReadRegions(&stream->rbFromDevice, stream->sampleCount, &data1, &size1, &data2, &size2) < (size_t)stream->sampleCount) {
+        return 0;
+    }
+
+    *samples = (rawr_AudioSample *)data1;
+    if (size2) {
+        memcpy(stream->readBounce, data1, size1 * sizeof(rawr_AudioSample));
+        memcpy(stream->readBounce + size1, data2, size2 * sizeof(rawr_AudioSample));
+        *samples = stream->readBounce;
+    }
+
+    if (stream->captureChain) rawr_DspChain_Process(stream->captureChain, *samples);
+    stream->readFrame = *samples;
+
+    return stream->sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_AudioStream_EndRead(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    rawr_RingBuffer_AdvanceReadIndex(&stream->rbReference, stream->sampleCount);
+    rawr_RingBuffer_AdvanceReadIndex(&stream->rbFromDevice, stream->sampleCount);
+    stream->readFrame = NULL;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_ReadReference(rawr_AudioStream *stream, rawr_AudioSample *buffer)
+{
+    RAWR_ASSERT(stream && buffer);
+
+    void *data1, *data2;
+    size_t size1, size2;
+
+    if (rawr_RingBuffer_GetReadRegions(&stream->rbReference, stream->sampleCount, &data1, &size1, &data2, &size2) < (size_t)stream->sampleCount) {
+        return 0;
+    }
+
+    memcpy(buffer, data1, size1 * sizeof(rawr_AudioSample));
+    if (size2) memcpy(buffer + size1, data2, size2 * sizeof(rawr_AudioSample));
+
+    return stream->sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_BeginWrite(rawr_AudioStream *stream, rawr_AudioSample **samples)
+{
+    RAWR_ASSERT(stream && samples);
+
+    void *data1, *data2;
+    size_t size1, size2;
+
+    stream->writeStretching = stream->latency ? rawr_AudioStream_PlanWrite(stream) : 0;
+
+    if (rawr_RingBuffer_GetWriteRegions(&stream->rbToDevice, stream->sampleCount, &data1, &size1, &data2, &size2) < (size_t)stream->sampleCount) {
+        mn_atomic_fetch_add(&stream->outputOverflows, 1);
+        return 0;
+    }
+
+    /* a frame to be stretched is written to the queue at EndWrite, once it is there to stretch */
+    *samples = size2 || stream->writeStretching ? stream->writeBounce : (rawr_AudioSample *)data1;
+    return stream->sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_AudioStream_EndWrite(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+
+    void *data1, *data2;
+    size_t size1, size2;
+
+    if (stream->writeStretching) {
+        rawr_AudioStream_WriteStretched(stream, stream->writeBounce);
+        return;
+    }
+
+    rawr_RingBuffer_GetWriteRegions(&stream->rbToDevice, stream->sampleCount, &data1, &size1, &data2, &size2);
+    if (size2) {
+        memcpy(data1, stream->writeBounce, size1 * sizeof(rawr_AudioSample));
+        memcpy(data2, stream->writeBounce + size1, size2 * sizeof(rawr_AudioSample));
+    }
+
+    rawr_RingBuffer_AdvanceWriteIndex(&stream->rbToDevice, stream->sampleCount);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_WaitRead(rawr_AudioStream *stream, void *buffer, int timeoutMs)
+{
+    RAWR_ASSERT(stream);
+
+    int sampleCount, ret;
+    const uint64_t deadline = mn_tstamp() + mn_tstamp_convert(timeoutMs, MN_TSTAMP_MS, MN_TSTAMP_NS);
+
+    while ((sampleCount = rawr_AudioStream_Read(stream, buffer)) == 0) {
+        const uint64_t now = mn_tstamp();
+        if (now >= deadline) break;
+
+        const int remainingMs = (int)mn_tstamp_convert(deadline - now, MN_TSTAMP_NS, MN_TSTAMP_MS);
+        RAWR_GUARD((ret = rawr_Semaphore_Wait(stream->readSignal, remainingMs)) < 0);
+        if (ret == RAWR_SEMAPHORE_TIMEOUT) break;
+    }
+
+    return sampleCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_WaitBeginRead(rawr_AudioStream *stream, rawr_AudioSample **samples, int timeoutMs)
+{
+    RAWR_ASSERT(stream);
+
+    int sampleCount, ret;
+    const uint64_t deadline = mn_tstamp() + mn_tstamp_convert(timeoutMs, MN_TSTAMP_MS, MN_TSTAMP_NS);
+
+    while ((sampleCount = rawr_AudioStream_BeginRead(stream, samples)) == 0) {
+        const uint64_t now = mn_tstamp();
+        if (now >= deadline) break;
+
+        const int remainingMs = (int)mn_tstamp_convert(deadline - now, MN_TSTAMP_NS, MN_TSTAMP_MS);
+        RAWR_GUARD((ret = rawr_Semaphore_Wait(stream->readSignal, remainingMs)) < 0);
+        if (ret == RAWR_SEMAPHORE_TIMEOUT) break;
+    }
+
+    return sampleCount;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 double rawr_AudioStream_InputLevel(rawr_AudioStream *stream)
 {
-    return (double)mn_atomic_load(&stream->inputLevel) / RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER;
+    return rawr_LevelMeter_Rms(&stream->inputMeter);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 double rawr_AudioStream_OutputLevel(rawr_AudioStream *stream)
 {
-    return (double)mn_atomic_load(&stream->outputLevel) / RAWR_AUDIOSTREAM_LEVEL_MULTIPLIER;
+    return rawr_LevelMeter_Rms(&stream->outputMeter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_InputPeak(rawr_AudioStream *stream)
+{
+    return rawr_LevelMeter_Peak(&stream->inputMeter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_OutputPeak(rawr_AudioStream *stream)
+{
+    return rawr_LevelMeter_Peak(&stream->outputMeter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_OutputQueued(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return (int)rawr_RingBuffer_GetReadAvailable(&stream->rbToDevice);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_AudioStream_OutputUnderflows(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return mn_atomic_load(&stream->outputUnderflows);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_AudioStream_OutputBufferedMs(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+
+    const size_t queued = rawr_RingBuffer_GetReadAvailable(&stream->rbToDevice);
+
+    return (double)queued / stream->channelCount * 1000.0 / stream->sampleRate;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_AudioStream_OutputOverflows(rawr_AudioStream *stream)
+{
+    RAWR_ASSERT(stream);
+    return mn_atomic_load(&stream->outputOverflows);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_AudioStream_SetCaptureChain(rawr_AudioStream *stream, rawr_DspChain *chain)
+{
+    RAWR_ASSERT(stream);
+
+    RAWR_GUARD(chain && stream->channelCount != 1);
+    RAWR_GUARD(chain && (rawr_DspChain_SampleRate(chain) != (int)stream->sampleRate || rawr_DspChain_FrameSize(chain) != stream->sampleCount));
+    stream->captureChain = chain;
+
+    return rawr_Success;
 }
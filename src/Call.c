@@ -2,35 +2,104 @@
 #include "rawr/Audio.h"
 #include "rawr/Endpoint.h"
 #include "rawr/Error.h"
+#include "rawr/Histogram.h"
 #include "rawr/Codec.h"
+#include "rawr/CallEngine.h"
+#include "rawr/Echo.h"
+#include "rawr/JitterBuffer.h"
+#include "rawr/RateControl.h"
+#include "rawr/Rtcp.h"
+#include "rawr/Semaphore.h"
+#include "rawr/Stretch.h"
 
 #include "mn/allocator.h"
 #include "mn/atomic.h"
+#include "mn/error.h"
 #include "mn/log.h"
+#include "mn/queue_spsc.h"
 #include "mn/thread.h"
 
 #include "re.h"
 
+#include <math.h>
+
 #define RAWR_CALL_USE_SRTP 1
 #define RAWR_CALL_SIPARG_MAX 255
 #define RAWR_CALL_UDP_OVERHEAD_BYTES 54
+#define RAWR_CALL_JITTER_MIN_MS 20
+#define RAWR_CALL_JITTER_MAX_MS 300
+#define RAWR_CALL_RECV_WAIT_MS 100
+#define RAWR_CALL_RECV_QUEUE_SIZE 64
+#define RAWR_CALL_RTP_PACKET_MAX 1500
+#define RAWR_CALL_RTP_SSRC 0xdead1ee7
+#define RAWR_CALL_RTP_PORT_TRIES 64
+
+/* opus returns a frame this short when DTX has nothing worth sending, only its periodic updates go out */
+#define RAWR_CALL_DTX_FRAME_BYTES 2
+#define RAWR_CALL_STOP_POLL_MS 5
+
+/*
+ * playout is stretched while what it has buffered, smoothed over this many frames, is more than a frame off the
+ * jitter buffer's target. buffered is measured as each frame is played, so it runs from a frame under the target
+ * up to the target when nothing needs doing
+ */
+#define RAWR_CALL_PLAYOUT_SMOOTH 8.0
 
-#define RAWR_CALL_SRTP_SUITE SRTP_AES_CM_128_HMAC_SHA1_80
+/* a send thread held up longer than this starts its playout deadline over instead of playing out a backlog */
+#define RAWR_CALL_PLAYOUT_SLIP_MS 200
+
+/* master key plus salt, AES-256 with a 112 bit salt being the largest */
+#define RAWR_CALL_SRTP_KEY_MAX 46
+#define RAWR_CALL_SRTP_KEY_B64_MAX 64
 
 #if RAWR_CALL_USE_SRTP
 #   define RAWR_CALL_MEDIA_PROTO "RTP/SAVP"
-#   define RAWR_CALL_SRTP_KEY_LEN 16
-#   define RAWR_CALL_SRTP_SALT_LEN 14
-#   define RAWR_CALL_SRTP_TAG_LEN 10
 #else
 #   define RAWR_CALL_MEDIA_PROTO "RTP/AVP"
 #endif
 
+static const rawr_SrtpSuite rawr_Call_DefaultSrtpSuites[] = {
+    rawr_SrtpSuite_AesGcm128,
+    rawr_SrtpSuite_AesCm128HmacSha1_80,
+};
+
+/* one of our SDES crypto lines */
+typedef struct rawr_CallCrypto {
+    int tag;
+    rawr_SrtpSuite suite;
+    size_t keyLen;
+    uint8_t key[RAWR_CALL_SRTP_KEY_MAX];
+} rawr_CallCrypto;
+
+typedef struct rawr_CallPacket {
+    struct sa src;
+    int rtcp;
+    uint64_t arrival;
+    size_t len;
+    uint8_t data[RAWR_CALL_RTP_PACKET_MAX];
+} rawr_CallPacket;
+
 typedef struct rawr_Call {
     rawr_CallError error;
+    rawr_Engine *engine;
+    int engineWorker;
+    struct sa enginePeers[2]; /* where the worker heard the peer's RTP and RTCP from, only read on the worker */
+    int enginePeersLatched[2];
+    rawr_Conference *conference; /* only changed while stopped, the worker reads it every tick */
     rawr_Codec *encoder;
     rawr_Codec *decoder;
+    rawr_CodecRate codecRate;
     rawr_AudioStream *stream;
+    int echoBudgetUs;
+    int latencyMinMs; /* the bounds on the playback ring's latency target, 0 leaving it off */
+    int latencyMaxMs;
+    rawr_Echo *echo; /* owned by whichever thread encodes, NULL with echo cancellation off */
+    rawr_DspChain *captureChain;
+
+    /* stand in for the device on engine hosted calls */
+    rawr_CallAudioHandler captureHandler;
+    rawr_CallAudioHandler playbackHandler;
+    void *audioHandlerArg;
 
     mn_atomic_t state;
     mn_thread_t sipThread;
@@ -38,6 +107,7 @@ typedef struct rawr_Call {
 
     struct sip *reSip;
     struct udp_sock *reRtpSock;
+    struct udp_sock *reRtcpSock;
     struct sipreg *reSipReg;
     struct sipsess *reSipSess;
     struct sdp_media *reSdpMedia;
@@ -55,6 +125,14 @@ typedef struct rawr_Call {
     int rtpReceiver;
 
     mn_thread_t rtpThread;
+    struct mbuf *rtpSendBuffer;
+    struct mbuf *rtcpSendBuffer;
+    uint16_t rtpSeq;
+    uint64_t rtpSendTime;
+    int rtpSuppressed; /* the last frame was DTX and not sent, the next one sent starts a talk spurt */
+    mn_atomic_t dtxFrames;
+    uint64_t rtpRecvCountLast;
+    uint64_t rtpRecvStasis;
     size_t rtpBytesSend;
     size_t rtpBytesRecv;
     mn_atomic_t rtpSendTotal;
@@ -66,12 +144,77 @@ typedef struct rawr_Call {
     mn_atomic_t rtpRecvCount;
     uint64_t rtpLastRecvTime;
 
+    mn_thread_t rtpRecvThread;
+    struct mbuf *rtpRecvBuffer;
+    rawr_CallPacket *rtpPackets;
+    mn_queue_spsc_t rtpRecvQueue; /* sip thread -> media receive thread */
+    mn_queue_spsc_t rtpFreeQueue; /* media receive thread -> sip thread */
+    rawr_Semaphore *rtpRecvSignal;
+    mn_atomic_t rtpRecvDropped;
+    mn_atomic_t playoutDropped;
+
+    rawr_Rtcp *rtcp;
+
+    /* owned by whichever thread encodes, the atomics are what the rate controller last applied */
+    rawr_RateControl *rateControl;
+    uint64_t rateReports;
+    mn_atomic_t rateBitrate;
+    mn_atomic_t rateFec;
+    mn_atomic_t rateLossPerc;
+
+    /* written lock-free from the media threads, live as long as the call so GetMetrics never races teardown */
+    rawr_Histogram *encodeTime;
+    rawr_Histogram *decodeTime;
+    rawr_Histogram *srtpTime;
+    rawr_Histogram *arrivalJitter;
+    rawr_Histogram *outputQueued;
+    rawr_Histogram *echoTime;
+    mn_atomic_t jitterUnderflows;
+    mn_atomic_t outputUnderflows;
+    mn_atomic_t outputDriftPpm; /* hundredths of a ppm */
+    mn_atomic_t outputBufferedMs; /* hundredths of a ms */
+    mn_atomic_t outputTargetMs;
+    mn_atomic_t latePackets;
+    mn_atomic_t decodeErrors;
+    uint64_t arrivalLast;
+    uint32_t arrivalLastTs;
+    mn_atomic_t echoDelayMs;
+    mn_atomic_t echoErle; /* hundredths of a dB */
+    mn_atomic_t echoOverBudget;
+
+    rawr_JitterBuffer *jitterBuffer;
+    int playoutStarted;
+    mn_atomic_t jitterDelay;
+    mn_atomic_t jitterTarget;
+    uint8_t playoutPayload[RAWR_JITTERBUFFER_PAYLOAD_MAX];
+
+    /* owned by whichever thread plays out, decoded audio passes through the carry while it is being stretched */
+    rawr_Stretch *stretch;
+    int playoutFrame; /* the last frame decoded was one that arrived, not one concealed */
+    double playoutLevel; /* ms, negative until the first frame plays */
+    int playoutCarried;
+    mn_atomic_t playoutAccelerated; /* samples taken out and put in */
+    mn_atomic_t playoutExpanded;
+    rawr_AudioSample playoutDecoded[RAWR_CODEC_INPUT_SAMPLES_MAX];
+    rawr_AudioSample playoutCarry[2 * RAWR_CODEC_INPUT_SAMPLES_MAX];
+
     rawr_AudioSample inputSamples[RAWR_CODEC_OUTPUT_SAMPLES_MAX];
     rawr_AudioSample outputSamples[RAWR_CODEC_INPUT_SAMPLES_MAX];
+    rawr_AudioSample referenceSamples[RAWR_CODEC_INPUT_SAMPLES_MAX];
 
-    enum srtp_suite srtpSuite;
-    struct srtp *srtpTransmitContext;
-    struct srtp *srtpReceiveContext;
+    rawr_SrtpSuite srtpSuites[RAWR_CALL_SRTP_SUITES_MAX];
+    int srtpSuiteCount;
+    rawr_CallCrypto srtpLocal[RAWR_CALL_SRTP_SUITES_MAX];
+    int srtpLocalCount;
+    int srtpAnswering;
+    mn_atomic_t srtpSuite;
+
+    /*
+     * struct srtp *, published by the sip thread once negotiated and freed only after the media threads are done with
+     * the session. the media threads see NULL until then and drop what they would have sent or received
+     */
+    mn_atomic_t srtpTransmitContext;
+    mn_atomic_t srtpReceiveContext;
 } rawr_Call;
 
 static size_t get_keylen(enum srtp_suite suite)
@@ -113,7 +256,32 @@ static size_t get_taglen(enum srtp_suite suite)
     }
 }
 
+static enum srtp_suite rawr_Call_ReSrtpSuite(rawr_SrtpSuite suite)
+{
+    switch (suite) {
+    case rawr_SrtpSuite_AesCm128HmacSha1_32: return SRTP_AES_CM_128_HMAC_SHA1_32;
+    case rawr_SrtpSuite_AesCm128HmacSha1_80: return SRTP_AES_CM_128_HMAC_SHA1_80;
+    case rawr_SrtpSuite_Aes256CmHmacSha1_32: return SRTP_AES_256_CM_HMAC_SHA1_32;
+    case rawr_SrtpSuite_Aes256CmHmacSha1_80: return SRTP_AES_256_CM_HMAC_SHA1_80;
+    case rawr_SrtpSuite_AesGcm128:           return SRTP_AES_128_GCM;
+    case rawr_SrtpSuite_AesGcm256:           return SRTP_AES_256_GCM;
+    default: RAWR_ASSERT(0); return SRTP_AES_CM_128_HMAC_SHA1_80;
+    }
+}
+
+/* rawr_SrtpSuite_None for names we do not know */
+static rawr_SrtpSuite rawr_Call_SrtpSuiteByName(const char *name)
+{
+    for (int suite = rawr_SrtpSuite_AesCm128HmacSha1_32; suite <= rawr_SrtpSuite_AesGcm256; suite++) {
+        if (!strcmp(name, srtp_suite_name(rawr_Call_ReSrtpSuite((rawr_SrtpSuite)suite)))) return (rawr_SrtpSuite)suite;
+    }
+
+    return rawr_SrtpSuite_None;
+}
+
 static void rawr_Call_Terminate(rawr_Call *call);
+void rawr_Call_StartMedia(rawr_Call *call);
+void rawr_Call_EngineFinish(rawr_Call *call);
 void rawr_Call_SetState(rawr_Call *call, rawr_CallState callState);
 rawr_CallState rawr_Call_State(rawr_Call *call);
 void rawr_Call_SetExiting(rawr_Call *call);
@@ -132,6 +300,8 @@ void rawr_Call_Reset(rawr_Call *call)
     call->rtpBytesSend = 0;
     call->rtpBytesRecv = 0;
     call->rtpTime = 0;
+    call->rtpSuppressed = 0;
+    mn_atomic_store(&call->dtxFrames, 0);
 
     mn_atomic_store(&call->rtpSendTotal, 0);
     mn_atomic_store(&call->rtpRecvTotal, 0);
@@ -141,129 +311,546 @@ void rawr_Call_Reset(rawr_Call *call)
     mn_atomic_store(&call->rtpRecvCount, 0);
     call->rtpLastRecvTime = 0;
 
+    mn_atomic_store(&call->rtpRecvDropped, 0);
+    mn_atomic_store(&call->playoutDropped, 0);
+
+    rawr_Rtcp_Reset(call->rtcp);
+
+    rawr_RateControl_Reset(call->rateControl);
+    call->rateReports = 0;
+    mn_atomic_store(&call->rateBitrate, 0);
+    mn_atomic_store(&call->rateFec, 0);
+    mn_atomic_store(&call->rateLossPerc, 0);
+
+    rawr_Histogram_Reset(call->encodeTime);
+    rawr_Histogram_Reset(call->decodeTime);
+    rawr_Histogram_Reset(call->srtpTime);
+    rawr_Histogram_Reset(call->arrivalJitter);
+    rawr_Histogram_Reset(call->outputQueued);
+    rawr_Histogram_Reset(call->echoTime);
+    mn_atomic_store(&call->jitterUnderflows, 0);
+    mn_atomic_store(&call->outputUnderflows, 0);
+    mn_atomic_store(&call->outputDriftPpm, 0);
+    mn_atomic_store(&call->outputBufferedMs, 0);
+    mn_atomic_store(&call->outputTargetMs, 0);
+    mn_atomic_store(&call->latePackets, 0);
+    mn_atomic_store(&call->decodeErrors, 0);
+    call->arrivalLast = 0;
+    call->arrivalLastTs = 0;
+    mn_atomic_store(&call->echoDelayMs, (uint64_t)-1);
+    mn_atomic_store(&call->echoErle, 0);
+    mn_atomic_store(&call->echoOverBudget, 0);
+
+    call->playoutStarted = 0;
+    mn_atomic_store(&call->jitterDelay, 0);
+    mn_atomic_store(&call->jitterTarget, 0);
+
+    call->playoutFrame = 0;
+    call->playoutLevel = -1.0;
+    call->playoutCarried = 0;
+    mn_atomic_store(&call->playoutAccelerated, 0);
+    mn_atomic_store(&call->playoutExpanded, 0);
+
     memset(call->inputSamples, 0, sizeof(call->inputSamples));
     memset(call->outputSamples, 0, sizeof(call->outputSamples));
 }
 
+/*
+ * pull the frame due for playout from the jitter buffer and decode it into samples, returning the sample count or
+ * 0 while nothing has played yet. each call is a playout deadline: once audio has started, a missing frame is
+ * rebuilt from the next packet's FEC or concealed so the device ring never runs dry
+ */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_Decode(rawr_Call *call, rawr_AudioSample *samples)
+{
+    RAWR_ASSERT(call && call->jitterBuffer && samples);
+
+    int byteLen, sampleCount;
+    rawr_JitterBufferResult result;
+    rawr_JitterBufferStats jbStats;
+    uint64_t tstamp;
 
-// private thread -----------------------------------------------------------------------------------------------
-void rawr_Call_RtpSendThread(void *arg)
+    result = rawr_JitterBuffer_Get(call->jitterBuffer, call->playoutPayload, &byteLen);
+
+    mn_atomic_store(&call->jitterDelay, rawr_JitterBuffer_Delay(call->jitterBuffer));
+    mn_atomic_store(&call->jitterTarget, rawr_JitterBuffer_TargetDelay(call->jitterBuffer));
+
+    rawr_JitterBuffer_Stats(call->jitterBuffer, &jbStats);
+    mn_atomic_store(&call->jitterUnderflows, jbStats.underflow);
+    mn_atomic_store(&call->latePackets, jbStats.late);
+
+    tstamp = mn_tstamp();
+
+    switch (result) {
+    case rawr_JitterBufferResult_Frame:
+        sampleCount = rawr_Codec_Decode(call->decoder, call->playoutPayload, byteLen, samples);
+        call->playoutStarted = 1;
+        break;
+    case rawr_JitterBufferResult_Lost:
+        if (byteLen > 0) {
+            sampleCount = rawr_Codec_DecodeFec(call->decoder, call->playoutPayload, byteLen, samples);
+        } else {
+            sampleCount = rawr_Codec_DecodeLost(call->decoder, samples);
+        }
+        break;
+    case rawr_JitterBufferResult_Silence:
+        /* after a DTX update frame the decoder's concealment is comfort noise */
+        sampleCount = rawr_Codec_DecodeLost(call->decoder, samples);
+        break;
+    case rawr_JitterBufferResult_Buffering:
+    case rawr_JitterBufferResult_Empty:
+        /* nothing to conceal until the first frame has played */
+        if (!call->playoutStarted) return 0;
+        sampleCount = rawr_Codec_DecodeLost(call->decoder, samples);
+        break;
+    default:
+        return rawr_Error;
+    }
+
+    if (sampleCount < 0) {
+        /* a packet opus cannot make sense of costs one concealed frame, not the call */
+        mn_atomic_fetch_add(&call->decodeErrors, 1);
+        RAWR_GUARD((sampleCount = rawr_Codec_DecodeLost(call->decoder, samples)) < 0);
+    }
+
+    rawr_Histogram_Record(call->decodeTime, mn_tstamp() - tstamp);
+    call->playoutFrame = result == rawr_JitterBufferResult_Frame;
+
+    return sampleCount;
+}
+
+/* what is buffered ahead of playout, the jitter buffer as of the frame just played and whatever is carried */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Call_PlayoutLevel(rawr_Call *call)
 {
-    int err = 0;
-    struct mbuf *re_mb;
-    int len, sampleCount;
+    /* gaps and concealment say nothing about how deep the buffer runs while frames are arriving */
+    if (!call->playoutFrame) return;
+
+    const double buffered = (double)mn_atomic_load(&call->jitterDelay) + call->playoutCarried * 1000.0 / call->codecRate;
+
+    if (call->playoutLevel < 0.0) call->playoutLevel = buffered;
+    call->playoutLevel += (buffered - call->playoutLevel) / RAWR_CALL_PLAYOUT_SMOOTH;
+}
+
+/*
+ * one frame for playout, time-stretched NetEq style to bring the jitter buffer to its target without dropping or
+ * concealing a frame for it. running deep a pitch period is cut from each frame that can spare one and running
+ * shallow one is repeated, and what comes out goes through the carry so playout still takes a frame a tick. a carry
+ * left short decodes a second frame, which is how cutting drains the jitter buffer, and a carry holding a whole frame
+ * plays it without decoding, which is how repeating fills it. with nothing carried or to do frames decode in place
+ */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_PlayoutFrame(rawr_Call *call, rawr_AudioSample *samples)
+{
+    RAWR_ASSERT(call && call->stretch && samples);
+
+    const int frameSize = rawr_Codec_FrameSize(call->codecRate, rawr_CodecTiming_20ms);
+    const int frameMs = rawr_CodecTiming_20ms;
+    int sampleCount, delay, target, stretch;
+    double buffered;
+    rawr_AudioSample *carry;
+
+    while (call->playoutCarried < frameSize) {
+        delay = (int)mn_atomic_load(&call->jitterDelay);
+        target = (int)mn_atomic_load(&call->jitterTarget);
+        buffered = delay + call->playoutCarried * 1000.0 / call->codecRate;
+
+        /*
+         * the level has to agree with what is buffered right now, as it lags a burst arriving after a gap. cutting
+         * needs a frame behind this one to decode into the room it leaves
+         */
+        stretch = 0;
+        if (call->playoutLevel > target + frameMs && buffered > target + frameMs && delay >= frameMs) stretch = 1;
+        if (call->playoutLevel >= 0.0 && call->playoutLevel < target - frameMs && buffered < target - frameMs) stretch = -1;
+
+        if (!stretch && !call->playoutCarried) {
+            RAWR_GUARD((sampleCount = rawr_Call_Decode(call, samples)) < 0);
+            rawr_Call_PlayoutLevel(call);
+            return sampleCount;
+        }
+
+        RAWR_GUARD((sampleCount = rawr_Call_Decode(call, call->playoutDecoded)) < 0);
+        if (!sampleCount) break;
+
+        /* concealment is left alone, it is already a guess at what should be there */
+        if (!call->playoutFrame || sampleCount != frameSize) stretch = 0;
+
+        carry = call->playoutCarry + call->playoutCarried;
+        if (stretch > 0) {
+            sampleCount = rawr_Stretch_Accelerate(call->stretch, call->playoutDecoded, carry);
+            mn_atomic_fetch_add(&call->playoutAccelerated, frameSize - sampleCount);
+        } else if (stretch < 0) {
+            sampleCount = rawr_Stretch_Expand(call->stretch, call->playoutDecoded, carry);
+            mn_atomic_fetch_add(&call->playoutExpanded, sampleCount - frameSize);
+        } else {
+            memcpy(carry, call->playoutDecoded, sampleCount * sizeof(rawr_AudioSample));
+        }
+        call->playoutCarried += sampleCount;
+    }
+
+    /* only concealment follows a frame once playout has started, so a carry is never left short but guard it anyway */
+    if (!call->playoutCarried) return 0;
+    if (call->playoutCarried < frameSize) {
+        memset(call->playoutCarry + call->playoutCarried, 0, (frameSize - call->playoutCarried) * sizeof(rawr_AudioSample));
+        call->playoutCarried = frameSize;
+    }
+
+    memcpy(samples, call->playoutCarry, frameSize * sizeof(rawr_AudioSample));
+    call->playoutCarried -= frameSize;
+    memmove(call->playoutCarry, call->playoutCarry + frameSize, call->playoutCarried * sizeof(rawr_AudioSample));
+    rawr_Call_PlayoutLevel(call);
+
+    return frameSize;
+}
+
+/* play the frame due out through the device, or the playback handler on engine hosted calls */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_Playout(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    int sampleCount, queued = 0;
+    rawr_AudioSample *samples = call->outputSamples;
+
+    /* decode straight into the playback queue, a full one still runs the decoder but into outputSamples */
+    if (call->stream) queued = rawr_AudioStream_BeginWrite(call->stream, &samples);
+
+    RAWR_GUARD((sampleCount = rawr_Call_PlayoutFrame(call, samples)) < 0);
+    if (!sampleCount) return rawr_Success;
+
+    /* engine hosted calls play to the playback handler if there is one, and what it was given is the echo's far end */
+    if (!call->stream) {
+        if (call->playbackHandler) call->playbackHandler(call, call->outputSamples, sampleCount, call->audioHandlerArg);
+        if (call->echo) rawr_Echo_Render(call->echo, call->outputSamples, sampleCount);
+        return rawr_Success;
+    }
+
+    if (queued) {
+        rawr_AudioStream_EndWrite(call->stream);
+    } else {
+        /* never wait on the device, a full ring means we are already holding more audio than we want */
+        mn_atomic_fetch_add(&call->playoutDropped, 1);
+    }
+
+    rawr_Histogram_Record(call->outputQueued, rawr_AudioStream_OutputQueued(call->stream));
+    mn_atomic_store(&call->outputUnderflows, rawr_AudioStream_OutputUnderflows(call->stream));
+    mn_atomic_store(&call->outputDriftPpm, (uint64_t)(int64_t)llround(rawr_AudioStream_OutputDriftPpm(call->stream) * 100.0));
+    mn_atomic_store(&call->outputBufferedMs, (uint64_t)llround(rawr_AudioStream_OutputBufferedMs(call->stream) * 100.0));
+    mn_atomic_store(&call->outputTargetMs, rawr_AudioStream_LatencyTarget(call->stream));
+
+    return rawr_Success;
+}
+
+/* standalone calls own their sockets, engine calls queue on their worker's batch which goes out at the end of the tick */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_Transmit(rawr_Call *call, int rtcp, const struct sa *dst, struct mbuf *re_mb)
+{
+    if (call->engine) {
+        /* a peer heard from somewhere other than its SDP address, behind a NAT say, is answered where it was heard */
+        if (call->enginePeersLatched[rtcp]) dst = &call->enginePeers[rtcp];
+        return rawr_Engine_Send(call->engine, call->engineWorker, rtcp, dst, mbuf_buf(re_mb), mbuf_get_left(re_mb));
+    }
+
+    return udp_send(rtcp ? call->reRtcpSock : call->reRtpSock, dst, re_mb) ? rawr_Error : rawr_Success;
+}
+
+/* sent from the media send thread so the SRTP transmit context is only ever used by one thread */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SendRtcp(rawr_Call *call, struct mbuf *re_mb)
+{
+    struct sa raddr;
+
+    mbuf_rewind(re_mb);
+    RAWR_GUARD(rawr_Rtcp_Encode(call->rtcp, re_mb));
+    re_mb->pos = 0;
+
+#if RAWR_CALL_USE_SRTP
+    RAWR_GUARD(srtcp_encrypt(mn_atomic_load_ptr_explicit(&call->srtpTransmitContext, MN_ATOMIC_ACQUIRE), re_mb));
+#endif
+
+    sdp_media_raddr_rtcp(call->reSdpMedia, &raddr);
+    if (rawr_Call_Transmit(call, 1, &raddr, re_mb)) {
+        /* a lost report only costs us one sample of the stats */
+        mn_log_warning("could not send RTCP report");
+    }
+
+    return rawr_Success;
+}
+
+/* retune the encoder whenever a new reception report about our stream has come in */
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_UpdateRate(rawr_Call *call)
+{
+    RAWR_ASSERT(call && call->encoder);
+
+    rawr_RtcpStats stats;
+    rawr_RateControlTarget target;
+
+    rawr_Rtcp_Stats(call->rtcp, &stats);
+    if (stats.reportsReceived == call->rateReports) return;
+    call->rateReports = stats.reportsReceived;
+
+    if (!rawr_RateControl_Update(call->rateControl, stats.remoteFractionLost, stats.rttMs, stats.remoteJitterMs)) return;
+    rawr_RateControl_Target(call->rateControl, &target);
+
+    if (rawr_Codec_Control(call->encoder, target.bitrate, target.inbandFec, target.packetLossPerc)) {
+        mn_log_warning("could not retune the encoder to %d bps", target.bitrate);
+        return;
+    }
+
+    mn_atomic_store(&call->rateBitrate, target.bitrate);
+    mn_atomic_store(&call->rateFec, target.inbandFec);
+    mn_atomic_store(&call->rateLossPerc, target.packetLossPerc);
+}
+
+/* send the len byte payload sitting behind the header in rtpSendBuffer, along with an RTCP report when one is due */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_SendEncoded(rawr_Call *call, int len)
+{
+    RAWR_ASSERT(call && len >= 0);
+
+    struct rtp_header hdr;
+    struct mbuf *re_mb = call->rtpSendBuffer;
     char marker;
-    rawr_Call *call = (rawr_Call *)arg;
+    /* RFC 7587 keeps the RTP clock at 48 kHz whatever rate opus runs at */
     int frame_size = rawr_Codec_FrameSize(rawr_CodecRate_48k, rawr_CodecTiming_20ms);
-    uint64_t rtp_wait_ns, tstamp, tstamp_last, recv_count, last_recv_count, recv_stasis;
-    uint32_t rtpSeq, rtpSsrc;
+    uint64_t rtp_wait_ns, tstamp, recv_count;
     uint8_t rtp_type = 0x74;
     if (call->rtpReceiver) rtp_type = 0x66;
 
-    // set up buffer for rtmp packets
-    re_mb = mbuf_alloc(RAWR_CODEC_OUTPUT_BYTES_MAX);
+    rtp_wait_ns = mn_tstamp_convert(1, MN_TSTAMP_S, MN_TSTAMP_NS);
+
+    call->rtpTime += frame_size;
 
-    recv_stasis = 0;
-    last_recv_count = recv_count = mn_atomic_load(&call->rtpRecvCount);
+    if (len <= RAWR_CALL_DTX_FRAME_BYTES) {
+        /* the timestamp keeps running through the gap but the sequence does not, so the peer sees no loss */
+        call->rtpSuppressed = 1;
+        mn_atomic_fetch_add(&call->dtxFrames, 1);
+        goto rtcp;
+    }
 
-    tstamp_last = mn_tstamp();
-    rtp_wait_ns = mn_tstamp_convert(1, MN_TSTAMP_S, MN_TSTAMP_NS);
+    /* RFC 3551 section 4.1, the first packet of each talk spurt carries the marker */
+    marker = call->rtpSuppressed || call->rtpTime == frame_size;
+    call->rtpSuppressed = 0;
 
-    call->rtpBytesSend = 0;
-    mn_atomic_store(&call->rtpSendTotal, 0);
-    mn_atomic_store(&call->rtpSendRate, 0);
+    re_mb->end = RTP_HEADER_SIZE + len;
+    re_mb->pos = 0;
 
-    rtpSeq = 1024;
-    rtpSsrc = 0xdead1ee7;
+    hdr.ver = RTP_VERSION;
+    hdr.pad = false;
+    hdr.ext = 0;
+    hdr.cc = 0;
+    hdr.m = marker ? 1 : 0;
+    hdr.pt = rtp_type;
+    hdr.seq = call->rtpSeq++;
+    hdr.ts = call->rtpTime;
+    hdr.ssrc = RAWR_CALL_RTP_SSRC;
 
-    while (!rawr_Call_Exiting(call)) {
-        struct rtp_header hdr;
+    RAWR_GUARD(rtp_hdr_encode(re_mb, &hdr));
+    re_mb->pos = 0;
+
+    call->rtpBytesSend += len;
+    call->rtpBytesSend += RAWR_CALL_UDP_OVERHEAD_BYTES;
 
-        RAWR_ASSERT(re_mb->size == RAWR_CODEC_OUTPUT_BYTES_MAX);
+#if RAWR_CALL_USE_SRTP
+    tstamp = mn_tstamp();
+    RAWR_GUARD(srtp_encrypt(mn_atomic_load_ptr_explicit(&call->srtpTransmitContext, MN_ATOMIC_ACQUIRE), re_mb));
+    rawr_Histogram_Record(call->srtpTime, mn_tstamp() - tstamp);
+#endif
 
-        marker = 0;
-        call->rtpTime += frame_size;
-        if (call->rtpTime == frame_size) marker = 1;
+    RAWR_GUARD(rawr_Call_Transmit(call, 0, sdp_media_raddr(call->reSdpMedia), re_mb));
 
-        mbuf_rewind(re_mb);
+    rawr_Rtcp_OnSend(call->rtcp, hdr.ts, len);
 
-        hdr.ver = RTP_VERSION;
-        hdr.pad = false;
-        hdr.ext = 0;
-        hdr.cc = 0;
-        hdr.m = marker ? 1 : 0;
-        hdr.pt = rtp_type;
-        hdr.seq = rtpSeq++;
-        hdr.ts = call->rtpTime;
-        hdr.ssrc = rtpSsrc;
+rtcp:
+    if (rawr_Rtcp_Due(call->rtcp)) {
+        RAWR_GUARD(rawr_Call_SendRtcp(call, call->rtcpSendBuffer));
+    }
 
-        RAWR_GUARD_CLEANUP(rtp_hdr_encode(re_mb, &hdr));
+    tstamp = mn_tstamp();
+    if ((tstamp - call->rtpSendTime) > rtp_wait_ns) {
+        mn_atomic_store_fetch_add(&call->rtpSendTotal, call->rtpBytesSend, MN_ATOMIC_ACQ_REL);
+        mn_atomic_store(&call->rtpSendRate, call->rtpBytesSend);
+
+        call->rtpSendTime += rtp_wait_ns;
+        call->rtpBytesSend = 0;
+
+        recv_count = mn_atomic_load(&call->rtpRecvCount);
+        if (recv_count == call->rtpRecvCountLast) {
+            call->rtpRecvStasis++;
+        } else {
+            call->rtpRecvCountLast = recv_count;
+            call->rtpRecvStasis = 0;
+        }
 
-        sampleCount = 0;
-        while ((sampleCount = rawr_AudioStream_Read(call->stream, call->inputSamples)) == 0) {
-            mn_thread_sleep_ms(5);
+        if (call->rtpRecvStasis >= 3) {
+            mn_log_warning("RTP recv stasis: %d", call->rtpRecvStasis);
+            //break;
         }
-        RAWR_GUARD_CLEANUP(sampleCount < 0);
+    }
+
+    return rawr_Success;
+}
 
-        RAWR_GUARD_CLEANUP((len = rawr_Codec_Encode(call->encoder, call->inputSamples, mbuf_buf(re_mb))) < 0);
+/* encode a captured frame and send it */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SendFrame(rawr_Call *call, rawr_AudioSample *samples)
+{
+    RAWR_ASSERT(call && samples);
 
-        re_mb->end = re_mb->pos + len;
-        re_mb->pos = 0;
+    struct mbuf *re_mb = call->rtpSendBuffer;
+    uint64_t tstamp;
+    int len;
 
-        call->rtpBytesSend += len;
-        call->rtpBytesSend += RAWR_CALL_UDP_OVERHEAD_BYTES;
+    RAWR_ASSERT(re_mb->size == RAWR_CODEC_OUTPUT_BYTES_MAX);
 
 #if RAWR_CALL_USE_SRTP
-        RAWR_GUARD_CLEANUP(srtp_encrypt(call->srtpTransmitContext, re_mb));
+    /* no transmit context until the peer has agreed on a suite */
+    if (!mn_atomic_load_ptr_explicit(&call->srtpTransmitContext, MN_ATOMIC_ACQUIRE)) return rawr_Success;
 #endif
 
-        RAWR_GUARD_CLEANUP(udp_send(call->reRtpSock, sdp_media_raddr(call->reSdpMedia), re_mb) < 0);
+    /* encode behind the header first, whether there is a packet at all depends on what opus made of the frame */
+    mbuf_rewind(re_mb);
+    re_mb->pos = RTP_HEADER_SIZE;
 
-        tstamp = mn_tstamp();
-        if ((tstamp - tstamp_last) > rtp_wait_ns) {
-            mn_atomic_store_fetch_add(&call->rtpSendTotal, call->rtpBytesSend, MN_ATOMIC_ACQ_REL);
-            mn_atomic_store(&call->rtpSendRate, call->rtpBytesSend);
+    rawr_Call_UpdateRate(call);
 
-            tstamp_last += rtp_wait_ns;
-            call->rtpBytesSend = 0;
+    tstamp = mn_tstamp();
+    RAWR_GUARD((len = rawr_Codec_Encode(call->encoder, samples, mbuf_buf(re_mb))) < 0);
+    rawr_Histogram_Record(call->encodeTime, mn_tstamp() - tstamp);
 
-            recv_count = mn_atomic_load(&call->rtpRecvCount);
-            if (recv_count == last_recv_count) {
-                recv_stasis++;
-            } else {
-                last_recv_count = recv_count;
-                recv_stasis = 0;
-            }
+    return rawr_Call_SendEncoded(call, len);
+}
 
-            if (recv_stasis >= 3) {
-                mn_log_warning("RTP recv stasis: %d", recv_stasis);
-                //break;
-            }
-        }
+/* send a payload encoded elsewhere, a conference shares one encode of its mix between everyone listening to it */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SendPayload(rawr_Call *call, const uint8_t *payload, int len)
+{
+    RAWR_ASSERT(call && payload && len >= 0 && len <= RAWR_CODEC_OUTPUT_BYTES_MAX - RTP_HEADER_SIZE);
+
+    struct mbuf *re_mb = call->rtpSendBuffer;
+
+#if RAWR_CALL_USE_SRTP
+    if (!mn_atomic_load_ptr_explicit(&call->srtpTransmitContext, MN_ATOMIC_ACQUIRE)) return rawr_Success;
+#endif
+
+    mbuf_rewind(re_mb);
+    memcpy(re_mb->buf + RTP_HEADER_SIZE, payload, len);
+
+    return rawr_Call_SendEncoded(call, len);
+}
+
+/*
+ * take the far end's echo out of a captured frame in place. a device call's far end is what the stream played while
+ * the frame was captured, an engine call's was rendered as its playback handler was given it
+ */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_CancelEcho(rawr_Call *call, rawr_AudioSample *samples)
+{
+    RAWR_ASSERT(call && samples);
+
+    rawr_EchoStats stats;
+    uint64_t tstamp;
+    int sampleCount;
+
+    if (!call->echo) return rawr_Success;
+
+    tstamp = mn_tstamp();
+
+    if (call->stream) {
+        RAWR_GUARD((sampleCount = rawr_AudioStream_ReadReference(call->stream, call->referenceSamples)) <= 0);
+        rawr_Echo_Render(call->echo, call->referenceSamples, sampleCount);
     }
+    rawr_Echo_Process(call->echo, samples);
+
+    rawr_Histogram_Record(call->echoTime, mn_tstamp() - tstamp);
+
+    rawr_Echo_Stats(call->echo, &stats);
+    mn_atomic_store(&call->echoDelayMs, (uint64_t)(int64_t)stats.delayMs);
+    mn_atomic_store(&call->echoErle, (uint64_t)(stats.erleDb > 0.0 ? stats.erleDb * 100.0 : 0.0));
+    mn_atomic_store(&call->echoOverBudget, stats.adaptSkipped + stats.bypassed);
+
+    return rawr_Success;
+}
+
+// private thread -----------------------------------------------------------------------------------------------
+void rawr_Call_RtpSendThread(void *arg)
+{
+    int sampleCount;
+    rawr_AudioSample *samples;
+    rawr_Call *call = (rawr_Call *)arg;
+    const uint64_t frameNs = mn_tstamp_convert(rawr_CodecTiming_20ms, MN_TSTAMP_MS, MN_TSTAMP_NS);
+    uint64_t now, playoutDue = mn_tstamp();
+
+    while (!rawr_Call_Exiting(call)) {
+        /*
+         * playout keeps a 20 ms deadline of its own, so what is received plays whether capture is running or not.
+         * the drift compensation on the playback queue takes up the difference between this clock and the device's
+         */
+        now = mn_tstamp();
+        if (now >= playoutDue) {
+            RAWR_GUARD_CLEANUP(rawr_Call_Playout(call));
+            playoutDue += frameNs;
+            if (now > playoutDue + mn_tstamp_convert(RAWR_CALL_PLAYOUT_SLIP_MS, MN_TSTAMP_MS, MN_TSTAMP_NS)) playoutDue = now + frameNs;
+            continue;
+        }
+
+        /* sleep until the device has captured a full frame or the next frame is due out, whichever is first */
+        RAWR_GUARD_CLEANUP((sampleCount = rawr_AudioStream_WaitBeginRead(call->stream, &samples, (int)mn_tstamp_convert(playoutDue - now, MN_TSTAMP_NS, MN_TSTAMP_MS) + 1)) < 0);
+        if (sampleCount == 0) continue;
 
-    mem_deref(re_mb);
+        /* opus encodes the frame where the device left it, it goes back to the device once the packet is out */
+        RAWR_GUARD_CLEANUP(rawr_Call_CancelEcho(call, samples));
+        if (call->captureChain) rawr_DspChain_Process(call->captureChain, samples);
+        RAWR_GUARD_CLEANUP(rawr_Call_SendFrame(call, samples));
+        rawr_AudioStream_EndRead(call->stream);
+    }
 
     return;
 
 cleanup:
 
-    mem_deref(re_mb);
-
     mn_log_error("error in sending thread");
 }
 
-// private handler ----------------------------------------------------------------------------------------------
-static void rawr_Call_OnRtp(const struct sa *src, const struct rtp_header *hdr, struct mbuf *mb, void *arg)
+/* RFC 3550 A.8 transit difference of each packet against the one before, unsmoothed so the tail shows */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Call_RecordArrival(rawr_Call *call, uint32_t ts, uint64_t arrival)
 {
-    (void)hdr;
+    int64_t d;
+
+    if (call->arrivalLast) {
+        d = (int64_t)(arrival - call->arrivalLast) - ((int64_t)(int32_t)(ts - call->arrivalLastTs) * MN_TSTAMP_NS) / rawr_CodecRate_48k;
+        rawr_Histogram_Record(call->arrivalJitter, (uint64_t)(d < 0 ? -d : d) / 1000);
+    }
 
+    call->arrivalLast = arrival;
+    call->arrivalLastTs = ts;
+}
+
+/* returns rawr_Error, quietly, for a packet that does not authenticate as the call's peer */
+// private handler ----------------------------------------------------------------------------------------------
+static int rawr_Call_OnRtp(const struct sa *src, const struct rtp_header *hdr, struct mbuf *mb, uint64_t arrival, void *arg)
+{
     RAWR_ASSERT(arg);
     rawr_Call *call = (rawr_Call *)arg;
 
+    const size_t len = mbuf_get_left(mb);
     uint64_t tstamp;
     uint64_t rtp_wait_ns;
 
+#if RAWR_CALL_USE_SRTP
+    /* no receive context until the peer's key has been negotiated, nothing before then can be authenticated */
+    struct srtp *srtp = mn_atomic_load_ptr_explicit(&call->srtpReceiveContext, MN_ATOMIC_ACQUIRE);
+    if (!srtp) return rawr_Error;
+
+    mb->pos = 0;
+    tstamp = mn_tstamp();
+    if (srtp_decrypt(srtp, mb)) return rawr_Error;
+    rawr_Histogram_Record(call->srtpTime, mn_tstamp() - tstamp);
+    mb->pos = 12;
+#endif
+
     if (!call->rtpHandlerIntialized) {
         call->rtpHandlerIntialized = 1;
         call->rtpBytesRecv = 0;
@@ -272,7 +859,7 @@ static void rawr_Call_OnRtp(const struct sa *src, const struct rtp_header *hdr,
         call->rtpLastRecvTime = mn_tstamp();
     }
 
-    call->rtpBytesRecv += mbuf_get_left(mb) + RAWR_CALL_UDP_OVERHEAD_BYTES;
+    call->rtpBytesRecv += len + RAWR_CALL_UDP_OVERHEAD_BYTES;
     tstamp = mn_tstamp();
     rtp_wait_ns = mn_tstamp_convert(1, MN_TSTAMP_S, MN_TSTAMP_NS);
     if ((tstamp - call->rtpLastRecvTime) > rtp_wait_ns) {
@@ -282,33 +869,31 @@ static void rawr_Call_OnRtp(const struct sa *src, const struct rtp_header *hdr,
         call->rtpBytesRecv = 0;
     }
 
-#if RAWR_CALL_USE_SRTP
-    mb->pos = 0;
-    RAWR_GUARD_CLEANUP(srtp_decrypt(call->srtpReceiveContext, mb));
-    mb->pos = 12;
-#endif
-    RAWR_GUARD_CLEANUP(rawr_Codec_Decode(call->decoder, mbuf_buf(mb), mbuf_get_left(mb), &call->outputSamples) < 0);
+    /* counted only once the packet has authenticated, so forged or replayed headers never reach the reports or metrics */
+    rawr_Rtcp_OnReceive(call->rtcp, hdr->ssrc, hdr->seq, hdr->ts, arrival);
+    rawr_Call_RecordArrival(call, hdr->ts, arrival);
 
-    int sampleCount = 0;
-    while ((sampleCount = rawr_AudioStream_Write(call->stream, &call->outputSamples)) == 0) {}
-    RAWR_GUARD_CLEANUP(sampleCount < 0);
+    /* authenticated, so it is still the peer's even if the jitter buffer turns it away */
+    if (rawr_JitterBuffer_Put(call->jitterBuffer, hdr->seq, hdr->ts, mbuf_buf(mb), (int)mbuf_get_left(mb))) {
+        mn_log_error("error during recv");
+        return rawr_Success;
+    }
 
     mn_atomic_store_fetch_add(&call->rtpRecvCount, 1, MN_ATOMIC_ACQ_REL);
 
-    return;
-
-cleanup:
-    mn_log_error("error during recv");
+    return rawr_Success;
 }
 
 /* called for every received RTCP packet */
 // private handler ----------------------------------------------------------------------------------------------
 static void rawr_Call_OnRtcp(const struct sa *src, struct rtcp_msg *msg, void *arg)
 {
+    RAWR_ASSERT(arg);
+    rawr_Call *call = (rawr_Call *)arg;
     (void)src;
-    (void)msg;
-    (void)arg;
+
     //mn_log_info("rtcp: recv %s from %J", rtcp_type_name(msg->hdr.pt), src);
+    rawr_Rtcp_Handle(call->rtcp, msg);
 }
 
 /* called when challenged for credentials */
@@ -327,72 +912,128 @@ static int rawr_Call_OnAuth(char **user, char **pass, const char *realm, void *a
     return err;
 }
 
+/* fresh master key and salt for one of our crypto lines */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Call_CryptoGenerate(rawr_CallCrypto *crypto, int tag, rawr_SrtpSuite suite)
+{
+    const enum srtp_suite reSuite = rawr_Call_ReSrtpSuite(suite);
+
+    crypto->tag = tag;
+    crypto->suite = suite;
+    crypto->keyLen = get_keylen(reSuite) + get_saltlen(reSuite);
+    rand_bytes(crypto->key, crypto->keyLen);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_CryptoAdvertise(rawr_Call *call, const rawr_CallCrypto *crypto, bool replace)
+{
+    char key[RAWR_CALL_SRTP_KEY_B64_MAX + 1];
+    size_t keyLen = RAWR_CALL_SRTP_KEY_B64_MAX;
+    int err;
+
+    err = base64_encode(crypto->key, crypto->keyLen, key, &keyLen);
+    if (err) return err;
+    key[keyLen] = 0;
+
+    return sdp_media_set_lattr(call->reSdpMedia, replace, "crypto", "%d %s inline:%s", crypto->tag, srtp_suite_name(rawr_Call_ReSrtpSuite(crypto->suite)), key);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_SrtpSuiteAllowed(rawr_Call *call, rawr_SrtpSuite suite)
+{
+    for (int i = 0; i < call->srtpSuiteCount; i++) {
+        if (call->srtpSuites[i] == suite) return 1;
+    }
+
+    return 0;
+}
+
+/*
+ * as answerer take the first line of the offer we support, the offer being in the peer's order of preference,
+ * as offerer take the line the peer picked out of ours
+ */
 // private handler ----------------------------------------------------------------------------------------------
 static bool rawr_Call_CryptoAttribHandler(const char *name, const char *value, void *arg)
 {
     rawr_Call *call = (rawr_Call *)arg;
+    rawr_CallCrypto *local = NULL;
+    rawr_SrtpSuite suite;
+    char suiteName[64];
+    char remoteKeyStr[RAWR_CALL_SRTP_KEY_B64_MAX + 1];
+    uint8_t remoteKey[RAWR_CALL_SRTP_KEY_MAX];
+    size_t remoteKeyLen = RAWR_CALL_SRTP_KEY_MAX;
+    struct srtp *receive = NULL, *transmit = NULL;
+    int tag;
+
+    (void)name;
+
+    if (!value || mn_atomic_load_ptr(&call->srtpReceiveContext)) return false;
 
-    if (value && !call->srtpReceiveContext) {
-        mn_log_debug("SDP crypto: %s", value);
-
-        const char delim[] = " ";
-        char *crypto_line = strdup(value);
-        char *token = strtok(crypto_line, delim);
-        int i = 0;
-        const int i_tag = 0, i_suite = 1, i_key = 2;
-        while (token != NULL) {
-            if (i == i_tag) {
-                /* tag */
-            } else if (i == i_suite) {
-                /* suite */
-                const char *suite_name = srtp_suite_name(call->srtpSuite);
-                if (strcmp(token, suite_name)) {
-                    mn_log_error("Cipher suite mismatch: %s vs %s", token, suite_name);
-                    return false;
-                }
-            } else if (i == i_key) {
-                /* key */
-                char *inline_key = strchr(token, ':');
-                if (inline_key) {
-                    inline_key++;
-                    mn_log_debug("SDP remote crypto key: %s", inline_key);
-
-                    int err = 0;
-                    uint8_t rx_key[RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN];
-                    size_t rx_key_len = RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN;
-                    err = base64_decode(inline_key, strlen(inline_key), rx_key, &rx_key_len);
-                    if (err) {
-                        mn_log_error("SDP could not b64 decode crypto key");
-                        return false;
-                    }
-
-                    err = srtp_alloc(&call->srtpReceiveContext, call->srtpSuite, rx_key, RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN, 0);
-                    if (err) {
-                        mn_log_error("SDP could not initialize crypto rx context");
-                        return false;
-                    }
-
-                    return true;
-                } else {
-                    mn_log_error("SDP could not parse remote key");
-                    return false;
-                }
-            }
-
-            i++;
-            token = strtok(NULL, delim);
+    mn_log_debug("SDP crypto: %s", value);
+
+    /* tag suite inline:key[|lifetime][|mki], session parameters are ignored */
+    if (sscanf(value, "%d %63s inline:%64[^| ]", &tag, suiteName, remoteKeyStr) != 3) {
+        mn_log_error("SDP could not parse crypto line");
+        return false;
+    }
+
+    suite = rawr_Call_SrtpSuiteByName(suiteName);
+    if (!rawr_Call_SrtpSuiteAllowed(call, suite)) {
+        mn_log_debug("SDP skipping crypto suite %s", suiteName);
+        return false;
+    }
+
+    if (call->srtpAnswering) {
+        /* answer under the offer's tag with a key of our own, the lines we had ready to offer are dropped below */
+        local = call->srtpLocal;
+        rawr_Call_CryptoGenerate(local, tag, suite);
+    } else {
+        for (int i = 0; i < call->srtpLocalCount; i++) {
+            if (call->srtpLocal[i].tag == tag && call->srtpLocal[i].suite == suite) local = call->srtpLocal + i;
+        }
+
+        if (!local) {
+            mn_log_error("SDP answer picked crypto %d %s, which we never offered", tag, suiteName);
+            return false;
         }
     }
-    return false;
+
+    if (base64_decode(remoteKeyStr, strlen(remoteKeyStr), remoteKey, &remoteKeyLen) || remoteKeyLen != local->keyLen) {
+        mn_log_error("SDP could not decode %s key", suiteName);
+        return false;
+    }
+
+    /* both are built before either is published, a context the media threads have seen is never freed under them */
+    if (srtp_alloc(&receive, rawr_Call_ReSrtpSuite(suite), remoteKey, remoteKeyLen, 0) ||
+        srtp_alloc(&transmit, rawr_Call_ReSrtpSuite(suite), local->key, local->keyLen, 0)) {
+        mn_log_error("SDP could not initialize %s contexts", suiteName);
+        mem_deref(receive);
+        mem_deref(transmit);
+        return false;
+    }
+
+    mn_atomic_store_ptr_explicit(&call->srtpTransmitContext, transmit, MN_ATOMIC_RELEASE);
+    mn_atomic_store_ptr_explicit(&call->srtpReceiveContext, receive, MN_ATOMIC_RELEASE);
+
+    /* from here on, re-offers included, only the line in use is advertised */
+    call->srtpLocal[0] = *local;
+    call->srtpLocalCount = 1;
+    if (rawr_Call_CryptoAdvertise(call, call->srtpLocal, true)) {
+        mn_log_error("SDP could not set crypto attribute");
+    }
+
+    mn_atomic_store(&call->srtpSuite, suite);
+    mn_log_info("SRTP suite: %s", suiteName);
+
+    return true;
 }
 
 /* print SDP status */
 // private handler ----------------------------------------------------------------------------------------------
-static void rawr_Call_UpdateMedia(void *arg)
+static void rawr_Call_UpdateMedia(rawr_Call *call, bool offer)
 {
     const struct sdp_format *fmt;
     char re_remote_ip[32];
-    rawr_Call *call = (rawr_Call *)arg;
 
     const struct sa *raddr = sdp_media_raddr(call->reSdpMedia);
     inet_ntop(sa_af(raddr), &raddr->u.in.sin_addr, re_remote_ip, raddr->len);
@@ -408,8 +1049,11 @@ static void rawr_Call_UpdateMedia(void *arg)
 
 #if RAWR_CALL_USE_SRTP
     /* if we have crypto lines in SDP and no receiving context, we need to parse the correct key */
-    if (!call->srtpReceiveContext) {
-        sdp_media_rattr_apply(call->reSdpMedia, "crypto", rawr_Call_CryptoAttribHandler, call);
+    if (!mn_atomic_load_ptr(&call->srtpReceiveContext)) {
+        call->srtpAnswering = offer;
+        if (!sdp_media_rattr_apply(call->reSdpMedia, "crypto", rawr_Call_CryptoAttribHandler, call)) {
+            mn_log_error("SDP has no crypto suite in common with the peer");
+        }
     }
 #endif
 }
@@ -437,7 +1081,7 @@ static int rawr_Call_OnOffer(struct mbuf **mbp, const struct sip_msg *msg, void
 
         mn_log_info("SDP offer received");
         call->rtpReceiver = 0;
-        rawr_Call_UpdateMedia(call);
+        rawr_Call_UpdateMedia(call, true);
     } else {
         mn_log_info("sending SDP offer");
     }
@@ -463,7 +1107,7 @@ static int rawr_Call_OnAnswer(const struct sip_msg *msg, void *arg)
     }
 
     call->rtpReceiver = 0;
-    rawr_Call_UpdateMedia(call);
+    rawr_Call_UpdateMedia(call, false);
 
     return 0;
 }
@@ -488,7 +1132,7 @@ static void rawr_Call_OnEstablish(const struct sip_msg *msg, void *arg)
     RAWR_ASSERT(arg);
     rawr_Call *call = (rawr_Call *)arg;
 
-    mn_thread_launch(&call->rtpThread, rawr_Call_RtpSendThread, call);
+    rawr_Call_StartMedia(call);
 
     mn_log_info("session established");
 }
@@ -539,7 +1183,7 @@ static void rawr_Call_OnConnect(const struct sip_msg *msg, void *arg)
         }
 
         call->rtpReceiver = 1;
-        rawr_Call_UpdateMedia(call);
+        rawr_Call_UpdateMedia(call, true);
     }
 
     /* Encode SDP */
@@ -582,7 +1226,7 @@ cleanup:
         (void)sip_treply(NULL, call->reSip, msg, 500, strerror(err));
     } else {
         mn_log_info("accepting incoming call");
-        mn_thread_launch(&call->rtpThread, rawr_Call_RtpSendThread, call);
+        rawr_Call_StartMedia(call);
     }
 }
 
@@ -625,6 +1269,12 @@ static void rawr_Call_OnSignal(int sig)
 // private ------------------------------------------------------------------------------------------------------
 static void rawr_Call_Terminate(rawr_Call *call)
 {
+    /* the sip stack belongs to the engine, only this call goes away */
+    if (call->engine) {
+        rawr_Call_EngineFinish(call);
+        return;
+    }
+
     mn_log_warning("terminating");
 
     /* terminate session */
@@ -669,172 +1319,340 @@ int rawr_Call_Exiting(rawr_Call *call)
     return (int)mn_atomic_load(&call->threadExiting);
 }
 
-
-void rawr_Call_OnUdpRecv(const struct sa *src, struct mbuf *mb, void *arg)
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SetupRecvQueue(rawr_Call *call)
 {
-    rawr_Call *call = (rawr_Call *)arg;
-    struct rtp_header hdr = {0};
-    int err;
+    RAWR_ASSERT(call);
 
-    err = rtp_hdr_decode(&hdr, mb);
-    if (err) {
-        mn_log_error("rtp_hdr_decode err");
-    }
+    RAWR_GUARD_NULL(call->rtpPackets = MN_MEM_ACQUIRE(RAWR_CALL_RECV_QUEUE_SIZE * sizeof(*call->rtpPackets)));
+    RAWR_GUARD(mn_queue_spsc_setup(&call->rtpRecvQueue, RAWR_CALL_RECV_QUEUE_SIZE));
+    RAWR_GUARD(mn_queue_spsc_setup(&call->rtpFreeQueue, RAWR_CALL_RECV_QUEUE_SIZE));
+    RAWR_GUARD(rawr_Semaphore_Setup(&call->rtpRecvSignal));
 
-    if (RTP_VERSION != hdr.ver) {
-        mn_log_error("RTP_VERSION err");
+    for (int i = 0; i < RAWR_CALL_RECV_QUEUE_SIZE; i++) {
+        RAWR_GUARD(mn_queue_spsc_push(&call->rtpFreeQueue, call->rtpPackets + i));
     }
 
-    rawr_Call_OnRtp(src, &hdr, mb, (void *)call);
+    return rawr_Success;
 }
 
-// private thread -----------------------------------------------------------------------------------------------
-void rawr_Call_SipThread(void *arg)
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_CleanupRecvQueue(rawr_Call *call)
 {
-    RAWR_ASSERT(arg);
+    RAWR_ASSERT(call);
 
-    struct sa nsv[16];
-    struct dnsc *dnsClient = NULL;
-    struct mbuf *mb;
-    struct sa localSipSA;
-    struct sa localRtpSA;
-    uint32_t nameServerCount;
-    int err;
-    rawr_Call *call = (rawr_Call *)arg;
+    rawr_Semaphore_Cleanup(call->rtpRecvSignal);
+    mn_queue_spsc_cleanup(&call->rtpFreeQueue);
+    mn_queue_spsc_cleanup(&call->rtpRecvQueue);
+    MN_MEM_RELEASE(call->rtpPackets);
+    call->rtpRecvSignal = NULL;
+    call->rtpPackets = NULL;
+}
 
-    rawr_Call_SetState(call, rawr_CallState_Started);
+/* runs on the sip thread, so only hand the datagram over and get back to signalling */
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_Enqueue(rawr_Call *call, const struct sa *src, struct mbuf *mb, int rtcp)
+{
+    rawr_CallPacket *pkt;
+    const size_t len = mbuf_get_left(mb);
 
-    if (rawr_AudioStream_Setup(&call->stream, rawr_AudioRate_48000, 1, rawr_Codec_FrameSize(rawr_CodecRate_48k, rawr_CodecTiming_20ms))) {
-        mn_log_error("rawr_AudioStream_Setup failed");
+    if (len > RAWR_CALL_RTP_PACKET_MAX || mn_queue_spsc_pop_back(&call->rtpFreeQueue, (void **)&pkt)) {
+        /* media thread is a full queue behind, anything we add now would only play late */
+        mn_atomic_fetch_add(&call->rtpRecvDropped, 1);
+        return;
     }
 
-    if (rawr_AudioStream_AddDevice(call->stream, rawr_AudioDevice_DefaultInput())) {
-        mn_log_error("rawr_AudioStream_AddDevice failed on input");
-    }
+    pkt->src = *src;
+    pkt->rtcp = rtcp;
+    pkt->arrival = mn_tstamp();
+    pkt->len = len;
+    memcpy(pkt->data, mbuf_buf(mb), len);
 
-    if (rawr_AudioStream_AddDevice(call->stream, rawr_AudioDevice_DefaultOutput())) {
-        mn_log_error("rawr_AudioStream_AddDevice failed on output");
-    }
+    /* cannot be full, there are only as many packets as queue slots */
+    mn_queue_spsc_push(&call->rtpRecvQueue, pkt);
+    rawr_Semaphore_Post(call->rtpRecvSignal);
+}
 
-    RAWR_GUARD_CLEANUP(rawr_Codec_Setup(&call->encoder, rawr_CodecType_Encoder, rawr_CodecRate_48k, rawr_CodecTiming_20ms));
-    RAWR_GUARD_CLEANUP(rawr_Codec_Setup(&call->decoder, rawr_CodecType_Decoder, rawr_CodecRate_48k, rawr_CodecTiming_20ms));
+// private handler ----------------------------------------------------------------------------------------------
+void rawr_Call_OnUdpRecv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+    rawr_Call_Enqueue((rawr_Call *)arg, src, mb, 0);
+}
 
-    RAWR_GUARD_CLEANUP(rawr_AudioStream_Start(call->stream));
+// private handler ----------------------------------------------------------------------------------------------
+void rawr_Call_OnRtcpUdpRecv(const struct sa *src, struct mbuf *mb, void *arg)
+{
+    rawr_Call_Enqueue((rawr_Call *)arg, src, mb, 1);
+}
 
-    nameServerCount = ARRAY_SIZE(nsv);
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_RecvPacket(rawr_Call *call, const struct sa *src, struct mbuf *mb, uint64_t arrival)
+{
+    struct rtp_header hdr = {0};
+    int err;
 
-    /* fetch list of DNS server IP addresses */
-    err = dns_srv_get(NULL, 0, nsv, &nameServerCount);
+    /* an undecodable packet stops here, it never reaches the stats or the jitter buffer */
+    err = rtp_hdr_decode(&hdr, mb);
     if (err) {
-        mn_log_error("unable to get dns servers: %s", strerror(err));
-        goto cleanup;
+        mn_log_error("rtp_hdr_decode err");
+        return rawr_Error;
     }
 
-    /* create DNS client */
-    err = dnsc_alloc(&dnsClient, NULL, nsv, nameServerCount);
-    if (err) {
-        mn_log_error("unable to create dns client: %s", strerror(err));
-        goto cleanup;
+    if (RTP_VERSION != hdr.ver) {
+        mn_log_error("RTP_VERSION err");
+        return rawr_Error;
     }
 
-    /* create SIP stack instance */
-    err = sip_alloc(&call->reSip, dnsClient, 32, 32, 32, "RAWR v0.9.1", rawr_Call_OnExit, call);
-    if (err) {
-        mn_log_error("sip error: %s", strerror(err));
-        goto cleanup;
+    return rawr_Call_OnRtp(src, &hdr, mb, arrival, (void *)call);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_RecvRtcp(rawr_Call *call, const struct sa *src, struct mbuf *mb)
+{
+    struct rtcp_msg *msg;
+
+#if RAWR_CALL_USE_SRTP
+    /* no receive context until the peer's key has been negotiated */
+    struct srtp *srtp = mn_atomic_load_ptr_explicit(&call->srtpReceiveContext, MN_ATOMIC_ACQUIRE);
+    if (!srtp || srtcp_decrypt(srtp, mb)) return rawr_Error;
+#endif
+
+    /* a compound packet carries several messages back to back */
+    while (mbuf_get_left(mb) && rtcp_decode(&msg, mb) == 0) {
+        rawr_Call_OnRtcp(src, msg, (void *)call);
+        mem_deref(msg);
     }
 
-    /* fetch local IP address */
-    err = net_default_source_addr_get(AF_INET, &localSipSA);
-    if (err) {
-        mn_log_error("local address error: %s", strerror(err));
-        goto cleanup;
+    return rawr_Success;
+}
+
+/* decrypt and process one datagram, runs on whichever thread owns the call's media */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_MediaRecv(rawr_Call *call, int rtcp, const struct sa *src, const uint8_t *data, size_t len, uint64_t arrival)
+{
+    RAWR_ASSERT(call && src && data);
+
+    struct mbuf *re_mb = call->rtpRecvBuffer;
+
+    /* decrypt works in place, so on our own copy */
+    mbuf_rewind(re_mb);
+    RAWR_GUARD(mbuf_write_mem(re_mb, data, len));
+    re_mb->pos = 0;
+
+    return rtcp ? rawr_Call_RecvRtcp(call, src, re_mb) : rawr_Call_RecvPacket(call, src, re_mb, arrival);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_MediaLatch(rawr_Call *call, int rtcp, const struct sa *src)
+{
+    RAWR_ASSERT(call && src && call->engine);
+
+    call->enginePeers[rtcp ? 1 : 0] = *src;
+    call->enginePeersLatched[rtcp ? 1 : 0] = 1;
+}
+
+/* process everything the sip thread has queued up since the last call */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_DrainRecv(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    rawr_CallPacket *pkt;
+
+    while (mn_queue_spsc_pop_back(&call->rtpRecvQueue, (void **)&pkt) == MN_SUCCESS) {
+        (void)rawr_Call_MediaRecv(call, pkt->rtcp, &pkt->src, pkt->data, pkt->len, pkt->arrival);
+        mn_queue_spsc_push(&call->rtpFreeQueue, pkt);
     }
 
-    sa_set_port(&localSipSA, 0);
+    return rawr_Success;
+}
 
-    /* add supported SIP transports */
-    struct tls *sip_tls = NULL;
-    err = tls_alloc(&sip_tls, TLS_METHOD_SSLV23, "client.pem", "");
-    if (err) {
-        re_fprintf(stderr, "tls_alloc error: %s\n", strerror(err));
-        goto cleanup;
+// private thread -----------------------------------------------------------------------------------------------
+void rawr_Call_RtpRecvThread(void *arg)
+{
+    RAWR_ASSERT(arg);
+
+    int ret;
+    rawr_Call *call = (rawr_Call *)arg;
+
+    while (!rawr_Call_Exiting(call)) {
+        RAWR_GUARD_CLEANUP((ret = rawr_Semaphore_Wait(call->rtpRecvSignal, RAWR_CALL_RECV_WAIT_MS)) < 0);
+        RAWR_GUARD_CLEANUP(rawr_Call_DrainRecv(call));
     }
 
-    err = sip_transp_add(call->reSip, SIP_TRANSP_TLS, &localSipSA, sip_tls);
-    //err = sip_transp_add(call->reSip, SIP_TRANSP_UDP, &localSipSA);
-    if (err) {
-        mn_log_error("transport error: %s", strerror(err));
-        goto cleanup;
+    return;
+
+cleanup:
+
+    mn_log_error("error in receiving thread");
+}
+
+/* codecs, jitter buffer and the buffers the media path works in, everything except the audio device */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SetupMedia(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    RAWR_GUARD(call->captureChain && rawr_DspChain_SampleRate(call->captureChain) != (int)call->codecRate);
+    RAWR_GUARD(call->captureChain && rawr_DspChain_FrameSize(call->captureChain) != rawr_Codec_FrameSize(call->codecRate, rawr_CodecTiming_20ms));
+    RAWR_GUARD(rawr_Codec_Setup(&call->encoder, rawr_CodecType_Encoder, call->codecRate, rawr_CodecTiming_20ms));
+    RAWR_GUARD(rawr_Codec_Setup(&call->decoder, rawr_CodecType_Decoder, call->codecRate, rawr_CodecTiming_20ms));
+    if (!call->engine) RAWR_GUARD(rawr_Call_SetupRecvQueue(call));
+    RAWR_GUARD(rawr_JitterBuffer_Setup(&call->jitterBuffer, rawr_CodecRate_48k, rawr_Codec_FrameSize(rawr_CodecRate_48k, rawr_CodecTiming_20ms), RAWR_CALL_JITTER_MIN_MS, RAWR_CALL_JITTER_MAX_MS));
+    RAWR_GUARD(rawr_Stretch_Setup(&call->stretch, call->codecRate, rawr_Codec_FrameSize(call->codecRate, rawr_CodecTiming_20ms)));
+
+    RAWR_GUARD_NULL(call->rtpSendBuffer = mbuf_alloc(RAWR_CODEC_OUTPUT_BYTES_MAX));
+    RAWR_GUARD_NULL(call->rtcpSendBuffer = mbuf_alloc(RAWR_RTCP_PACKET_MAX));
+    RAWR_GUARD_NULL(call->rtpRecvBuffer = mbuf_alloc(RAWR_CALL_RTP_PACKET_MAX));
+
+    if (call->echoBudgetUs) {
+        RAWR_GUARD(rawr_Echo_Setup(&call->echo, call->codecRate, rawr_Codec_FrameSize(call->codecRate, rawr_CodecTiming_20ms)));
+        rawr_Echo_SetBudget(call->echo, (uint64_t)call->echoBudgetUs * 1000);
     }
 
-    /* create SIP session socket */
-    err = sipsess_listen(&call->reSipSessSock, call->reSip, 32, rawr_Call_OnConnect, call);
-    if (err) {
-        mn_log_error("session listen error: %s", strerror(err));
-        goto cleanup;
+    return rawr_Success;
+}
+
+/* safe on a partially set up call */
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_CleanupMedia(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    if (call->encoder) rawr_Codec_Cleanup(call->encoder);
+    if (call->decoder) rawr_Codec_Cleanup(call->decoder);
+    if (call->jitterBuffer) rawr_JitterBuffer_Cleanup(call->jitterBuffer);
+    if (call->rtpPackets) rawr_Call_CleanupRecvQueue(call);
+    if (call->echo) rawr_Echo_Cleanup(call->echo);
+    if (call->stretch) rawr_Stretch_Cleanup(call->stretch);
+
+    call->encoder = NULL;
+    call->echo = NULL;
+    call->decoder = NULL;
+    call->jitterBuffer = NULL;
+    call->stretch = NULL;
+    call->rtpSendBuffer = mem_deref(call->rtpSendBuffer);
+    call->rtcpSendBuffer = mem_deref(call->rtcpSendBuffer);
+    call->rtpRecvBuffer = mem_deref(call->rtpRecvBuffer);
+}
+
+/* RTP/RTCP sockets, SDP session and the local SRTP key, must run on the thread that owns the re loop */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SetupSession(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    struct sa localRtpSA;
+    struct sa localRtcpSA;
+    uint16_t localRtpPort = 0;
+    int err = 0;
+
+    /* engine calls share their worker's sockets */
+    if (call->engine) {
+        rawr_Engine_LocalAddress(call->engine, call->engineWorker, &localRtpSA);
+        localRtpPort = sa_port(&localRtpSA);
+    } else {
+        net_default_source_addr_get(AF_INET, &localRtpSA);
     }
 
-    /* create the RTP/RTCP socket */
-    const uint16_t localRtpPort = (rand_u16() % 16383) + 16384;
-    net_default_source_addr_get(AF_INET, &localRtpSA);
-    sa_set_port(&localRtpSA, localRtpPort);
+    /* create the RTP/RTCP sockets, RTCP goes on the odd port above RTP */
+    for (int i = 0; !call->engine && i < RAWR_CALL_RTP_PORT_TRIES; i++) {
+        localRtpPort = ((rand_u16() % 16383) + 16384) & 0xfffe;
+        sa_set_port(&localRtpSA, localRtpPort);
+        localRtcpSA = localRtpSA;
+        sa_set_port(&localRtcpSA, localRtpPort + 1);
 
-    re_printf("local SIP address: %J\n", &localSipSA);
-    re_printf("local RTP address: %J\n", &localRtpSA);
+        err = udp_listen(&call->reRtpSock, &localRtpSA, rawr_Call_OnUdpRecv, (void *)call);
+        if (err) continue;
+
+        err = udp_listen(&call->reRtcpSock, &localRtcpSA, rawr_Call_OnRtcpUdpRecv, (void *)call);
+        if (!err) break;
+
+        call->reRtpSock = mem_deref(call->reRtpSock);
+    }
 
-    err = udp_listen(&call->reRtpSock, &localRtpSA, rawr_Call_OnUdpRecv, (void *)call);
     if (err) {
         mn_log_error("rtp udp_listen error: %m", err);
-        goto cleanup;
+        return err;
     }
 
+    re_printf("local RTP address: %J\n", &localRtpSA);
+
     /* create SDP session */
     err = sdp_session_alloc(&call->reSdpSess, &localRtpSA);
     if (err) {
         mn_log_error("sdp session error: %s", strerror(err));
-        goto cleanup;
+        return err;
     }
 
     /* add audio sdp media, using port from RTP socket */
     err = sdp_media_add(&call->reSdpMedia, call->reSdpSess, "audio", localRtpPort, RAWR_CALL_MEDIA_PROTO);
     if (err) {
         mn_log_error("sdp media error: %s", strerror(err));
-        goto cleanup;
+        return err;
     }
 
+    sdp_media_set_lport_rtcp(call->reSdpMedia, localRtpPort + 1);
+
 #if RAWR_CALL_USE_SRTP
-    /* set up transmit key for SRTP */
-    uint8_t tx_key[RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN];
-    rand_bytes(tx_key, RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN);
-    size_t tx_key_strlen = 255;
-    char tx_key_str[256] = "";
-    base64_encode(tx_key, RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN, tx_key_str, &tx_key_strlen);
-
-    mn_log_debug("Generated SRTP transmit key: %s", tx_key_str);
-    err = srtp_alloc(&call->srtpTransmitContext, call->srtpSuite, tx_key, RAWR_CALL_SRTP_KEY_LEN + RAWR_CALL_SRTP_SALT_LEN, 0);
-    if (err) {
-        mn_log_error("SDP could not initialize crypto tx context");
+    /* a crypto line per suite we are willing to use, the contexts are created once the peer has picked one */
+    call->srtpLocalCount = call->srtpSuiteCount;
+    for (int i = 0; i < call->srtpSuiteCount; i++) {
+        rawr_Call_CryptoGenerate(call->srtpLocal + i, i + 1, call->srtpSuites[i]);
+        err |= rawr_Call_CryptoAdvertise(call, call->srtpLocal + i, i == 0);
     }
 
-    char sdp_crypto_buf[4096];
-    snprintf(sdp_crypto_buf, 4095, "1 %s inline:%s", srtp_suite_name(call->srtpSuite), tx_key_str);
-    err =  sdp_media_set_lattr(call->reSdpMedia, true, "crypto", sdp_crypto_buf);
     err |= sdp_media_set_lattr(call->reSdpMedia, true, "encryption", "required");
+    if (err) {
+        mn_log_error("sdp crypto error: %s", strerror(err));
+        return err;
+    }
 #endif
 
     /* add opus sdp media format */
     err = sdp_format_add(NULL, call->reSdpMedia, false, "116", "opus", 48000, 2, NULL, NULL, NULL, false, NULL);
     if (err) {
         mn_log_error("sdp format error: %s", strerror(err));
-        goto cleanup;
+        return err;
     }
 
+    return 0;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_CleanupSession(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    call->reSdpSess = mem_deref(call->reSdpSess); /* will also free sdp_media */
+    call->reSdpMedia = NULL;
+    call->reRtpSock = mem_deref(call->reRtpSock);
+    call->reRtcpSock = mem_deref(call->reRtcpSock);
+    /* the media threads have been joined or the call detached from its worker by now */
+    mem_deref(mn_atomic_load_ptr(&call->srtpTransmitContext));
+    mem_deref(mn_atomic_load_ptr(&call->srtpReceiveContext));
+    mn_atomic_store_ptr(&call->srtpTransmitContext, NULL);
+    mn_atomic_store_ptr(&call->srtpReceiveContext, NULL);
+
+    memset(call->srtpLocal, 0, sizeof(call->srtpLocal));
+    call->srtpLocalCount = 0;
+    mn_atomic_store(&call->srtpSuite, rawr_SrtpSuite_None);
+}
+
+/* send the INVITE with our SDP offer */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_Connect(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    struct mbuf *mb;
+    int err;
+
     /* create SDP offer */
     err = sdp_encode(&mb, call->reSdpSess, true);
     if (err) {
         mn_log_error("sdp encode error: %s", strerror(err));
-        goto cleanup;
+        return err;
     }
 
     err = sipsess_connect(
@@ -889,39 +1707,316 @@ void rawr_Call_SipThread(void *arg)
     mem_deref(mb); /* free SDP buffer */
     if (err) {
         mn_log_error("session connect error: %s", strerror(err));
-        goto cleanup;
+        return err;
     }
 
     mn_log_info("inviting <%s>...", call->sipInviteURI);
 
-    /* execute sip signalling until complete */
-    err = re_main(rawr_Call_OnSignal);
-    if (err) {
-        mn_log_error("re_main exited with error: %s", strerror(err));
+    return 0;
+}
+
+/* once the session is up, hand the media path to a thread of its own or to one of the engine's workers */
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_StartMedia(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    call->rtpSeq = 1024;
+    call->rtpSendTime = mn_tstamp();
+    call->rtpRecvCountLast = mn_atomic_load(&call->rtpRecvCount);
+    call->rtpRecvStasis = 0;
+
+    call->rtpBytesSend = 0;
+    mn_atomic_store(&call->rtpSendTotal, 0);
+    mn_atomic_store(&call->rtpSendRate, 0);
+
+    if (!call->engine) {
+        mn_thread_launch(&call->rtpThread, rawr_Call_RtpSendThread, call);
+        return;
+    }
+
+    struct sa rtcpPeer;
+    sdp_media_raddr_rtcp(call->reSdpMedia, &rtcpPeer);
+
+    if (rawr_Engine_Activate(call->engine, call, call->engineWorker, sdp_media_raddr(call->reSdpMedia), &rtcpPeer)) {
+        mn_log_error("could not hand the call to its media worker");
+        rawr_Call_EngineFinish(call);
+    }
+}
+
+// private thread -----------------------------------------------------------------------------------------------
+void rawr_Call_SipThread(void *arg)
+{
+    RAWR_ASSERT(arg);
+
+    struct sa nsv[16];
+    struct dnsc *dnsClient = NULL;
+    struct sa localSipSA;
+    uint32_t nameServerCount;
+    int err;
+    rawr_Call *call = (rawr_Call *)arg;
+
+    rawr_Call_SetState(call, rawr_CallState_Started);
+
+    /* the stream runs at the codec's rate and converts to whatever the device can do */
+    if (rawr_AudioStream_Setup(&call->stream, (rawr_AudioRate)call->codecRate, 1, rawr_Codec_FrameSize(call->codecRate, rawr_CodecTiming_20ms))) {
+        mn_log_error("rawr_AudioStream_Setup failed");
+        call->stream = NULL;
         goto cleanup;
     }
 
+    if (rawr_AudioStream_AddDevice(call->stream, rawr_AudioDevice_DefaultInput())) {
+        mn_log_error("rawr_AudioStream_AddDevice failed on input");
+    }
+
+    if (rawr_AudioStream_AddDevice(call->stream, rawr_AudioDevice_DefaultOutput())) {
+        mn_log_error("rawr_AudioStream_AddDevice failed on output");
+    }
+
+    if (call->latencyMaxMs && rawr_AudioStream_SetLatencyTarget(call->stream, call->latencyMinMs, call->latencyMaxMs)) {
+        mn_log_error("rawr_AudioStream_SetLatencyTarget failed");
+    }
+
+    RAWR_GUARD_CLEANUP(rawr_Call_SetupMedia(call));
+
+    RAWR_GUARD_CLEANUP(rawr_AudioStream_Start(call->stream));
+
+    nameServerCount = ARRAY_SIZE(nsv);
+
+    /* fetch list of DNS server IP addresses */
+    err = dns_srv_get(NULL, 0, nsv, &nameServerCount);
+    if (err) {
+        mn_log_error("unable to get dns servers: %s", strerror(err));
+        goto stop;
+    }
+
+    /* create DNS client */
+    err = dnsc_alloc(&dnsClient, NULL, nsv, nameServerCount);
+    if (err) {
+        mn_log_error("unable to create dns client: %s", strerror(err));
+        goto stop;
+    }
+
+    /* create SIP stack instance */
+    err = sip_alloc(&call->reSip, dnsClient, 32, 32, 32, "RAWR v0.9.1", rawr_Call_OnExit, call);
+    if (err) {
+        mn_log_error("sip error: %s", strerror(err));
+        goto stop;
+    }
+
+    /* fetch local IP address */
+    err = net_default_source_addr_get(AF_INET, &localSipSA);
+    if (err) {
+        mn_log_error("local address error: %s", strerror(err));
+        goto stop;
+    }
+
+    sa_set_port(&localSipSA, 0);
+
+    /* add supported SIP transports */
+    struct tls *sip_tls = NULL;
+    err = tls_alloc(&sip_tls, TLS_METHOD_SSLV23, "client.pem", "");
+    if (err) {
+        re_fprintf(stderr, "tls_alloc error: %s\n", strerror(err));
+        goto stop;
+    }
+
+    err = sip_transp_add(call->reSip, SIP_TRANSP_TLS, &localSipSA, sip_tls);
+    //err = sip_transp_add(call->reSip, SIP_TRANSP_UDP, &localSipSA);
+    if (err) {
+        mn_log_error("transport error: %s", strerror(err));
+        goto stop;
+    }
+
+    /* create SIP session socket */
+    err = sipsess_listen(&call->reSipSessSock, call->reSip, 32, rawr_Call_OnConnect, call);
+    if (err) {
+        mn_log_error("session listen error: %s", strerror(err));
+        goto stop;
+    }
+
+    re_printf("local SIP address: %J\n", &localSipSA);
+
+    if (rawr_Call_SetupSession(call)) goto stop;
+
+    err = mn_thread_launch(&call->rtpRecvThread, rawr_Call_RtpRecvThread, call);
+    if (err) {
+        mn_log_error("could not launch media receive thread");
+        goto stop;
+    }
+
+    if (rawr_Call_Connect(call)) goto stop;
+
+    /* execute sip signalling until complete */
+    err = re_main(rawr_Call_OnSignal);
+    if (err) mn_log_error("re_main exited with error: %s", strerror(err));
+
+stop:
+    /* every way out once the stream is running comes through here, nothing may touch the session past the joins */
     rawr_Call_SetExiting(call);
     rawr_Call_SetState(call, rawr_CallState_Stopping);
 
     mn_thread_join(&call->rtpThread);
+    mn_thread_join(&call->rtpRecvThread);
 
-    RAWR_GUARD_CLEANUP(rawr_AudioStream_Stop(call->stream));
+    if (rawr_AudioStream_Stop(call->stream)) mn_log_error("rawr_AudioStream_Stop failed");
 
-    rawr_AudioStream_Cleanup(call->stream);
+cleanup:
+    rawr_Call_CleanupSession(call);
 
-    rawr_Codec_Cleanup(call->encoder);
-    rawr_Codec_Cleanup(call->decoder);
+    if (call->stream) rawr_AudioStream_Cleanup(call->stream);
+    call->stream = NULL;
 
-cleanup:
+    rawr_Call_CleanupMedia(call);
 
-    mem_deref(call->reSdpSess); /* will also free sdp_media */
-    mem_deref(call->reRtpSock);
     mem_deref(call->reSipSessSock);
     mem_deref(call->reSip);
     mem_deref(dnsClient);
 }
 
+/*
+ * engine hosted calls share the engine's sip stack and have no audio device. these run on the engine's re
+ * thread, except rawr_Call_MediaTick which a media worker calls once per frame for every established call
+ */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_EngineStart(rawr_Call *call)
+{
+    RAWR_ASSERT(call && call->engine);
+
+    rawr_Call_SetState(call, rawr_CallState_Started);
+
+    call->reSip = rawr_Engine_Sip(call->engine);
+    call->reSipSessSock = rawr_Engine_SipSessSock(call->engine);
+    call->enginePeersLatched[0] = call->enginePeersLatched[1] = 0;
+
+    RAWR_GUARD_CLEANUP(rawr_Call_SetupMedia(call));
+    RAWR_GUARD_CLEANUP((call->engineWorker = rawr_Engine_Attach(call->engine, call)) < 0);
+    RAWR_GUARD_CLEANUP(rawr_Call_SetupSession(call));
+    RAWR_GUARD_CLEANUP(rawr_Call_Connect(call));
+
+    return rawr_Success;
+
+cleanup:
+    rawr_Call_EngineFinish(call);
+    return rawr_Error;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_EngineStop(rawr_Call *call)
+{
+    RAWR_ASSERT(call && call->engine);
+
+    mn_log_warning("terminating");
+
+    /* dropping the session sends the BYE */
+    rawr_Call_EngineFinish(call);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+void rawr_Call_EngineFinish(rawr_Call *call)
+{
+    RAWR_ASSERT(call && call->engine);
+
+    if (rawr_Call_State(call) == rawr_CallState_Stopped) return;
+
+    rawr_Call_SetExiting(call);
+    rawr_Call_SetState(call, rawr_CallState_Stopping);
+
+    /* once detached no worker will touch the call again */
+    if (call->engineWorker >= 0) {
+        rawr_Engine_Detach(call->engine, call, call->engineWorker);
+        call->engineWorker = -1;
+    }
+
+    call->reSipSess = mem_deref(call->reSipSess);
+
+    rawr_Call_CleanupSession(call);
+    rawr_Call_CleanupMedia(call);
+
+    call->reSip = NULL;
+    call->reSipSessSock = NULL;
+
+    rawr_Engine_Remove(call->engine, call);
+    rawr_Call_SetState(call, rawr_CallState_Stopped);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_MediaTick(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+
+    /* there is no capture device, inputSamples stays silent unless a capture handler fills it */
+    if (call->captureHandler) {
+        call->captureHandler(call, call->inputSamples, rawr_Codec_FrameSize(call->codecRate, rawr_CodecTiming_20ms), call->audioHandlerArg);
+    }
+
+    RAWR_GUARD(rawr_Call_CancelEcho(call, call->inputSamples));
+    if (call->captureChain) rawr_DspChain_Process(call->captureChain, call->inputSamples);
+    RAWR_GUARD(rawr_Call_SendFrame(call, call->inputSamples));
+    RAWR_GUARD(rawr_Call_Playout(call));
+
+    return rawr_Success;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+rawr_Conference *rawr_Call_Conference(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+    return call->conference;
+}
+
+/* the worker is only told which conference a call mixes on when the call attaches, so this waits for it to stop */
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_SetConference(rawr_Call *call, rawr_Conference *conference, rawr_Engine *engine)
+{
+    RAWR_ASSERT(call);
+
+    rawr_CallState state = rawr_Call_State(call);
+
+    RAWR_GUARD(call->engine != engine);
+    RAWR_GUARD(state != rawr_CallState_None && state != rawr_CallState_Stopped);
+    RAWR_GUARD(conference && call->conference);
+
+    /* members are mixed at the rate the conference encodes at */
+    if (conference) call->codecRate = rawr_CodecRate_48k;
+    call->conference = conference;
+
+    return rawr_Success;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+int rawr_Call_MediaDecode(rawr_Call *call, rawr_AudioSample **out_samples)
+{
+    RAWR_ASSERT(call && out_samples);
+
+    *out_samples = call->outputSamples;
+    return rawr_Call_PlayoutFrame(call, call->outputSamples);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Call_SetupMetrics(rawr_Call *call)
+{
+    RAWR_GUARD(rawr_Histogram_Setup(&call->encodeTime));
+    RAWR_GUARD(rawr_Histogram_Setup(&call->decodeTime));
+    RAWR_GUARD(rawr_Histogram_Setup(&call->srtpTime));
+    RAWR_GUARD(rawr_Histogram_Setup(&call->arrivalJitter));
+    RAWR_GUARD(rawr_Histogram_Setup(&call->outputQueued));
+    RAWR_GUARD(rawr_Histogram_Setup(&call->echoTime));
+
+    return rawr_Success;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Call_CleanupMetrics(rawr_Call *call)
+{
+    if (call->encodeTime) rawr_Histogram_Cleanup(call->encodeTime);
+    if (call->decodeTime) rawr_Histogram_Cleanup(call->decodeTime);
+    if (call->srtpTime) rawr_Histogram_Cleanup(call->srtpTime);
+    if (call->arrivalJitter) rawr_Histogram_Cleanup(call->arrivalJitter);
+    if (call->outputQueued) rawr_Histogram_Cleanup(call->outputQueued);
+    if (call->echoTime) rawr_Histogram_Cleanup(call->echoTime);
+}
+
 // --------------------------------------------------------------------------------------------------------------
 int rawr_Call_Setup(rawr_Call **out_call, const char *sipRegistrar, const char *sipURI, const char *sipName, const char *sipUsername, const char *sipPassword)
 {
@@ -936,18 +2031,54 @@ int rawr_Call_Setup(rawr_Call **out_call, const char *sipRegistrar, const char *
     snprintf((*out_call)->sipUsername, RAWR_CALL_SIPARG_MAX, "%s", sipUsername);
     snprintf((*out_call)->sipPassword, RAWR_CALL_SIPARG_MAX, "%s", sipPassword);
 
-    (*out_call)->srtpSuite = RAWR_CALL_SRTP_SUITE;
+    (*out_call)->engineWorker = -1;
+    (*out_call)->codecRate = rawr_CodecRate_48k;
+    (*out_call)->echoBudgetUs = RAWR_CALL_ECHO_BUDGET_US;
+    RAWR_GUARD(rawr_Call_SetSrtpSuites(*out_call, rawr_Call_DefaultSrtpSuites, ARRAY_SIZE(rawr_Call_DefaultSrtpSuites)));
 
+    /* lives as long as the call object so stats stay readable between and after calls */
+    RAWR_GUARD(rawr_Rtcp_Setup(&(*out_call)->rtcp, RAWR_CALL_RTP_SSRC, rawr_CodecRate_48k));
+    RAWR_GUARD(rawr_RateControl_Setup(&(*out_call)->rateControl, RAWR_RATECONTROL_BITRATE_MIN, RAWR_RATECONTROL_BITRATE_MAX));
+    RAWR_GUARD(rawr_Call_SetupMetrics(*out_call));
     RAWR_GUARD(mn_thread_setup(&(*out_call)->sipThread));
 
     return rawr_Success;
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetupEngine(rawr_Call **out_call, rawr_Engine *engine, const char *sipURI, const char *sipName, const char *sipUsername, const char *sipPassword)
+{
+    RAWR_ASSERT(out_call && engine);
+
+    RAWR_GUARD_NULL(*out_call = MN_MEM_ACQUIRE(sizeof(**out_call)));
+    memset(*out_call, 0, sizeof(**out_call));
+
+    snprintf((*out_call)->sipURI, RAWR_CALL_SIPARG_MAX, "%s", sipURI);
+    snprintf((*out_call)->sipName, RAWR_CALL_SIPARG_MAX, "%s", sipName);
+    snprintf((*out_call)->sipUsername, RAWR_CALL_SIPARG_MAX, "%s", sipUsername);
+    snprintf((*out_call)->sipPassword, RAWR_CALL_SIPARG_MAX, "%s", sipPassword);
+
+    (*out_call)->engine = engine;
+    (*out_call)->engineWorker = -1;
+    (*out_call)->codecRate = rawr_CodecRate_48k;
+    RAWR_GUARD(rawr_Call_SetSrtpSuites(*out_call, rawr_Call_DefaultSrtpSuites, ARRAY_SIZE(rawr_Call_DefaultSrtpSuites)));
+
+    RAWR_GUARD(rawr_Rtcp_Setup(&(*out_call)->rtcp, RAWR_CALL_RTP_SSRC, rawr_CodecRate_48k));
+    RAWR_GUARD(rawr_RateControl_Setup(&(*out_call)->rateControl, RAWR_RATECONTROL_BITRATE_MIN, RAWR_RATECONTROL_BITRATE_MAX));
+    RAWR_GUARD(rawr_Call_SetupMetrics(*out_call));
+
+    return rawr_Success;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 void rawr_Call_Cleanup(rawr_Call *call)
 {
     RAWR_ASSERT(call);
-    mn_thread_cleanup(&call->sipThread);
+    if (!call->engine) mn_thread_cleanup(&call->sipThread);
+    rawr_Rtcp_Cleanup(call->rtcp);
+    rawr_RateControl_Cleanup(call->rateControl);
+    rawr_Call_CleanupMetrics(call);
+    MN_MEM_RELEASE(call);
 }
 
 // --------------------------------------------------------------------------------------------------------------
@@ -960,6 +2091,12 @@ int rawr_Call_Start(rawr_Call *call, const char *sipInviteURI)
     snprintf(call->sipInviteURI, RAWR_CALL_SIPARG_MAX, "%s", sipInviteURI);
 
     rawr_Call_SetState(call, rawr_CallState_Starting);
+
+    if (call->engine) {
+        RAWR_GUARD(rawr_Engine_Post(call->engine, rawr_EngineMsg_CallStart, call));
+        return rawr_Success;
+    }
+
     RAWR_GUARD(mn_thread_launch(&call->sipThread, rawr_Call_SipThread, (void*)call));
 
     return rawr_Success;
@@ -970,6 +2107,17 @@ int rawr_Call_Stop(rawr_Call *call)
 {
     RAWR_ASSERT(call);
 
+    if (call->engine) {
+        RAWR_GUARD(rawr_Engine_Post(call->engine, rawr_EngineMsg_CallStop, call));
+
+        /* teardown happens on the engine thread, the call is ours again once it reports stopped */
+        while (rawr_Call_State(call) != rawr_CallState_Stopped) {
+            mn_thread_sleep_ms(RAWR_CALL_STOP_POLL_MS);
+        }
+
+        return rawr_Success;
+    }
+
     rawr_Call_Terminate(call);
 
     mn_thread_join(&call->sipThread);
@@ -1007,16 +2155,184 @@ int rawr_Call_BlockOnCall(rawr_Call *call)
     return rawr_Success;
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetAudioHandlers(rawr_Call *call, rawr_CallAudioHandler capture, rawr_CallAudioHandler playback, void *arg)
+{
+    RAWR_ASSERT(call);
+
+    /* a standalone call has its devices */
+    RAWR_GUARD(!call->engine);
+
+    call->captureHandler = capture;
+    call->playbackHandler = playback;
+    call->audioHandlerArg = arg;
+
+    return rawr_Success;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 double rawr_Call_InputLevel(rawr_Call *call)
 {
-    RAWR_ASSERT(call && call->stream);
+    RAWR_ASSERT(call);
+    if (!call->stream) return 0;
     return rawr_AudioStream_InputLevel(call->stream);
 }
 
 // --------------------------------------------------------------------------------------------------------------
 double rawr_Call_OutputLevel(rawr_Call *call)
 {
-    RAWR_ASSERT(call && call->stream);
+    RAWR_ASSERT(call);
+    if (!call->stream) return 0;
     return rawr_AudioStream_OutputLevel(call->stream);
 }
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_JitterDelay(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+    return (int)mn_atomic_load(&call->jitterDelay);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_JitterTargetDelay(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+    return (int)mn_atomic_load(&call->jitterTarget);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_Call_DroppedFrames(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+    return mn_atomic_load(&call->rtpRecvDropped) + mn_atomic_load(&call->playoutDropped);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_GetStats(rawr_Call *call, rawr_CallStats *out_stats)
+{
+    RAWR_ASSERT(call && out_stats);
+
+    rawr_RtcpStats rtcpStats;
+
+    rawr_Rtcp_Stats(call->rtcp, &rtcpStats);
+
+    out_stats->packetsSent = rtcpStats.packetsSent;
+    out_stats->bytesSent = rtcpStats.bytesSent;
+    out_stats->packetsReceived = rtcpStats.packetsReceived;
+    out_stats->reportsSent = rtcpStats.reportsSent;
+    out_stats->reportsReceived = rtcpStats.reportsReceived;
+    out_stats->packetsLost = rtcpStats.packetsLost;
+    out_stats->fractionLost = rtcpStats.fractionLost;
+    out_stats->jitterMs = rtcpStats.jitterMs;
+    out_stats->remotePacketsLost = rtcpStats.remotePacketsLost;
+    out_stats->remoteFractionLost = rtcpStats.remoteFractionLost;
+    out_stats->remoteJitterMs = rtcpStats.remoteJitterMs;
+    out_stats->rttMs = rtcpStats.rttMs;
+
+    out_stats->dtxFrames = mn_atomic_load(&call->dtxFrames);
+
+    out_stats->bitrate = (int)mn_atomic_load(&call->rateBitrate);
+    out_stats->inbandFec = (int)mn_atomic_load(&call->rateFec);
+    out_stats->packetLossPerc = (int)mn_atomic_load(&call->rateLossPerc);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_GetMetrics(rawr_Call *call, rawr_CallMetrics *out_metrics)
+{
+    RAWR_ASSERT(call && out_metrics);
+
+    rawr_Histogram_Snapshot(call->encodeTime, &out_metrics->encodeNs);
+    rawr_Histogram_Snapshot(call->decodeTime, &out_metrics->decodeNs);
+    rawr_Histogram_Snapshot(call->srtpTime, &out_metrics->srtpNs);
+    rawr_Histogram_Snapshot(call->arrivalJitter, &out_metrics->jitterUs);
+    rawr_Histogram_Snapshot(call->outputQueued, &out_metrics->outputQueued);
+    rawr_Histogram_Snapshot(call->echoTime, &out_metrics->echoNs);
+
+    out_metrics->underflows = mn_atomic_load(&call->jitterUnderflows);
+    out_metrics->outputUnderflows = mn_atomic_load(&call->outputUnderflows);
+    out_metrics->overflows = mn_atomic_load(&call->playoutDropped);
+    out_metrics->receiveDropped = mn_atomic_load(&call->rtpRecvDropped);
+    out_metrics->latePackets = mn_atomic_load(&call->latePackets);
+    out_metrics->decodeErrors = mn_atomic_load(&call->decodeErrors);
+    out_metrics->echoDelayMs = (int)(int64_t)mn_atomic_load(&call->echoDelayMs);
+    out_metrics->echoReturnLossDb = (double)mn_atomic_load(&call->echoErle) / 100.0;
+    out_metrics->echoOverBudget = mn_atomic_load(&call->echoOverBudget);
+    out_metrics->outputDriftPpm = (double)(int64_t)mn_atomic_load(&call->outputDriftPpm) / 100.0;
+    out_metrics->acceleratedMs = mn_atomic_load(&call->playoutAccelerated) * 1000 / call->codecRate;
+    out_metrics->expandedMs = mn_atomic_load(&call->playoutExpanded) * 1000 / call->codecRate;
+    out_metrics->outputBufferedMs = (double)mn_atomic_load(&call->outputBufferedMs) / 100.0;
+    out_metrics->outputTargetMs = (int)mn_atomic_load(&call->outputTargetMs);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetSrtpSuites(rawr_Call *call, const rawr_SrtpSuite *suites, int count)
+{
+    RAWR_ASSERT(call && suites);
+
+    RAWR_GUARD(count < 1 || count > RAWR_CALL_SRTP_SUITES_MAX);
+
+    for (int i = 0; i < count; i++) {
+        RAWR_GUARD(suites[i] <= rawr_SrtpSuite_None || suites[i] > rawr_SrtpSuite_AesGcm256);
+        call->srtpSuites[i] = suites[i];
+    }
+
+    call->srtpSuiteCount = count;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetCodecRate(rawr_Call *call, rawr_CodecRate rate)
+{
+    RAWR_ASSERT(call);
+
+    RAWR_GUARD(rate != rawr_CodecRate_8k && rate != rawr_CodecRate_16k && rate != rawr_CodecRate_24k && rate != rawr_CodecRate_48k);
+    RAWR_GUARD(call->conference && rate != rawr_CodecRate_48k);
+    call->codecRate = rate;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetEchoCancellation(rawr_Call *call, int budgetUs)
+{
+    RAWR_ASSERT(call);
+
+    RAWR_GUARD(budgetUs < 0);
+    call->echoBudgetUs = budgetUs;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetLatencyTarget(rawr_Call *call, int minMs, int maxMs)
+{
+    RAWR_ASSERT(call);
+
+    RAWR_GUARD(minMs < 0 || maxMs < minMs);
+    call->latencyMinMs = minMs;
+    call->latencyMaxMs = maxMs;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Call_SetCaptureChain(rawr_Call *call, rawr_DspChain *chain)
+{
+    RAWR_ASSERT(call);
+
+    call->captureChain = chain;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+rawr_SrtpSuite rawr_Call_SrtpSuite(rawr_Call *call)
+{
+    RAWR_ASSERT(call);
+    return (rawr_SrtpSuite)mn_atomic_load(&call->srtpSuite);
+}
@@ -17,7 +17,7 @@ static rawr_CodecConfig codecConfig = {
     .complexity = 5,
     .max_bw = OPUS_BANDWIDTH_FULLBAND,
     .sig = OPUS_SIGNAL_VOICE,
-    .inband_fec = 0,
+    .inband_fec = 1,
     .pkt_loss = 5,
     .lsb_depth = 8,
     .pred_disabled = 0,
@@ -57,8 +57,10 @@ int rawr_Codec_Setup(rawr_Codec **out_codec, rawr_CodecType type, rawr_CodecRate
 
     RAWR_GUARD_NULL(codec = MN_MEM_ACQUIRE(sizeof(**out_codec)));
     *out_codec = codec;
+    codec->config = codecConfig;
     codec->type = type;
     codec->sampleRate = sampleRate;
+    codec->timing = timing;
     codec->frameSize = rawr_Codec_FrameSize(sampleRate, timing);
     codec->frameSizeCode = rawr_Codec_FrameSizeCode(sampleRate, codec->frameSize);
     
@@ -68,26 +70,26 @@ int rawr_Codec_Setup(rawr_Codec **out_codec, rawr_CodecType type, rawr_CodecRate
     priv->opus_enc = NULL;
 
     if (codec->type == rawr_CodecType_Encoder) {
-        priv->opus_enc = opus_encoder_create(sampleRate, codecConfig.force_channel, codecConfig.application, &err);
+        priv->opus_enc = opus_encoder_create(sampleRate, codec->config.force_channel, codec->config.application, &err);
         RAWR_GUARD_CLEANUP(err != OPUS_OK || priv->opus_enc == NULL);
 
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_BITRATE(codecConfig.bitrate)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_FORCE_CHANNELS(codecConfig.force_channel)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_VBR(codecConfig.vbr)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_VBR_CONSTRAINT(codecConfig.vbr_constraint)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_COMPLEXITY(codecConfig.complexity)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_MAX_BANDWIDTH(codecConfig.max_bw)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_SIGNAL(codecConfig.sig)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_INBAND_FEC(codecConfig.inband_fec)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_PACKET_LOSS_PERC(codecConfig.pkt_loss)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_LSB_DEPTH(codecConfig.lsb_depth)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_PREDICTION_DISABLED(codecConfig.pred_disabled)) != OPUS_OK);
-        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_DTX(codecConfig.dtx)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_BITRATE(codec->config.bitrate)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_FORCE_CHANNELS(codec->config.force_channel)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_VBR(codec->config.vbr)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_VBR_CONSTRAINT(codec->config.vbr_constraint)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_COMPLEXITY(codec->config.complexity)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_MAX_BANDWIDTH(codec->config.max_bw)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_SIGNAL(codec->config.sig)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_INBAND_FEC(codec->config.inband_fec)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_PACKET_LOSS_PERC(codec->config.pkt_loss)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_LSB_DEPTH(codec->config.lsb_depth)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_PREDICTION_DISABLED(codec->config.pred_disabled)) != OPUS_OK);
+        RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_DTX(codec->config.dtx)) != OPUS_OK);
         RAWR_GUARD_CLEANUP(opus_encoder_ctl(priv->opus_enc, OPUS_SET_EXPERT_FRAME_DURATION(codec->frameSizeCode)) != OPUS_OK);
 
         return rawr_Success;
     } else if (codec->type == rawr_CodecType_Decoder) {
-        priv->opus_dec = opus_decoder_create(sampleRate, codecConfig.force_channel, &err);
+        priv->opus_dec = opus_decoder_create(sampleRate, codec->config.force_channel, &err);
         RAWR_GUARD_CLEANUP(err != OPUS_OK || priv->opus_dec == NULL);
 
         return rawr_Success;
@@ -136,12 +138,80 @@ int rawr_Codec_Decode(rawr_Codec *codec, void *inBuffer, int byteLen, void *outB
     rawr_CodecPriv *priv = rawr_Codec_Priv(codec);
     RAWR_ASSERT(priv && priv->opus_dec);
 
-    int out_samples = opus_decode(priv->opus_dec, inBuffer, byteLen, outBuffer, RAWR_CODEC_INPUT_BYTES_MAX, codecConfig.inband_fec);
-    RAWR_ASSERT(out_samples == codec->frameSize);
+    /* outBuffer may be a frame's room in a playback queue, a longer packet fails rather than writing past it */
+    int out_samples = opus_decode(priv->opus_dec, inBuffer, byteLen, outBuffer, codec->frameSize, 0);
+    RAWR_ASSERT(out_samples < 0 || out_samples == codec->frameSize);
 
     return out_samples;
 }
 
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Codec_DecodeFec(rawr_Codec *codec, void *inBuffer, int byteLen, void *outBuffer)
+{
+    RAWR_ASSERT(codec);
+
+    rawr_CodecPriv *priv = rawr_Codec_Priv(codec);
+    RAWR_ASSERT(priv && priv->opus_dec);
+
+    /* frame_size must be exactly the duration of the missing frame for FEC decoding */
+    int out_samples = opus_decode(priv->opus_dec, inBuffer, byteLen, outBuffer, codec->frameSize, 1);
+    RAWR_ASSERT(out_samples < 0 || out_samples == codec->frameSize);
+
+    return out_samples;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Codec_DecodeLost(rawr_Codec *codec, void *outBuffer)
+{
+    RAWR_ASSERT(codec);
+
+    rawr_CodecPriv *priv = rawr_Codec_Priv(codec);
+    RAWR_ASSERT(priv && priv->opus_dec);
+
+    int out_samples = opus_decode(priv->opus_dec, NULL, 0, outBuffer, codec->frameSize, 0);
+    RAWR_ASSERT(out_samples < 0 || out_samples == codec->frameSize);
+
+    return out_samples;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Codec_Control(rawr_Codec *codec, int bitrate, int inbandFec, int packetLossPerc)
+{
+    RAWR_ASSERT(codec);
+
+    rawr_CodecPriv *priv = rawr_Codec_Priv(codec);
+    RAWR_ASSERT(priv);
+
+    RAWR_GUARD(!priv->opus_enc);
+    RAWR_GUARD(packetLossPerc < 0 || packetLossPerc > 100);
+
+    inbandFec = inbandFec ? 1 : 0;
+
+    if (bitrate != codec->config.bitrate) {
+        RAWR_GUARD(opus_encoder_ctl(priv->opus_enc, OPUS_SET_BITRATE(bitrate)) != OPUS_OK);
+        codec->config.bitrate = bitrate;
+    }
+
+    if (inbandFec != codec->config.inband_fec) {
+        RAWR_GUARD(opus_encoder_ctl(priv->opus_enc, OPUS_SET_INBAND_FEC(inbandFec)) != OPUS_OK);
+        codec->config.inband_fec = inbandFec;
+    }
+
+    if (packetLossPerc != codec->config.pkt_loss) {
+        RAWR_GUARD(opus_encoder_ctl(priv->opus_enc, OPUS_SET_PACKET_LOSS_PERC(packetLossPerc)) != OPUS_OK);
+        codec->config.pkt_loss = packetLossPerc;
+    }
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Codec_Config(rawr_Codec *codec, rawr_CodecConfig *out_config)
+{
+    RAWR_ASSERT(codec && out_config);
+    *out_config = codec->config;
+}
+
 // --------------------------------------------------------------------------------------------------------------
 int rawr_Codec_FrameSize(rawr_CodecRate sampleRate, rawr_CodecTiming timing)
 {
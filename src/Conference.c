@@ -0,0 +1,265 @@
+#include "rawr/Conference.h"
+#include "rawr/CallEngine.h"
+#include "rawr/Codec.h"
+#include "rawr/Error.h"
+#include "rawr/Level.h"
+#include "rawr/Mix.h"
+
+#include "mn/allocator.h"
+#include "mn/atomic.h"
+#include "mn/log.h"
+
+#include <string.h>
+
+/* rms a member has to reach to be mixed at all, about 50 dB below full scale */
+#define RAWR_CONFERENCE_SPEECH_FLOOR 100
+
+/* one member's frame for the tick being mixed */
+typedef struct rawr_ConferenceMember {
+    rawr_Call *call;
+    rawr_AudioSample *samples; /* NULL when the member had nothing to play yet */
+    uint64_t sumSquares;
+    int speaking;
+} rawr_ConferenceMember;
+
+typedef struct rawr_Conference {
+    rawr_Engine *engine;
+    int worker;
+    int frameSize;
+    int memberMax;
+    mn_atomic_t joined;
+
+    /* worker only, filled by Collect as the worker ticks its calls and emptied by Tick */
+    rawr_MixKernels mix;
+    rawr_Codec *encoder;
+    rawr_ConferenceMember *members;
+    int memberCount;
+    int32_t *sums;
+    rawr_AudioSample *mixSamples;
+    uint8_t payload[RAWR_CODEC_OUTPUT_BYTES_MAX];
+
+    mn_atomic_t ticks;
+    mn_atomic_t framesSent;
+    mn_atomic_t encodes;
+    mn_atomic_t lastMembers;
+    mn_atomic_t lastSpeakers;
+} rawr_Conference;
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_Setup(rawr_Conference **out_conference, rawr_Engine *engine, int memberMax)
+{
+    RAWR_ASSERT(out_conference && engine);
+
+    rawr_Conference *conference;
+
+    RAWR_GUARD(memberMax < 1);
+
+    RAWR_GUARD_NULL(conference = MN_MEM_ACQUIRE(sizeof(*conference)));
+    memset(conference, 0, sizeof(*conference));
+
+    conference->engine = engine;
+    conference->worker = -1;
+    conference->memberMax = memberMax;
+    conference->frameSize = rawr_Codec_FrameSize(rawr_CodecRate_48k, rawr_CodecTiming_20ms);
+    rawr_Mix_Kernels(&conference->mix);
+
+    RAWR_GUARD_CLEANUP(rawr_Codec_Setup(&conference->encoder, rawr_CodecType_Encoder, rawr_CodecRate_48k, rawr_CodecTiming_20ms));
+    RAWR_GUARD_NULL_CLEANUP(conference->members = MN_MEM_ACQUIRE(memberMax * sizeof(*conference->members)));
+    RAWR_GUARD_NULL_CLEANUP(conference->sums = MN_MEM_ACQUIRE(conference->frameSize * sizeof(*conference->sums)));
+    RAWR_GUARD_NULL_CLEANUP(conference->mixSamples = MN_MEM_ACQUIRE(conference->frameSize * sizeof(*conference->mixSamples)));
+
+    /* last, from here on the worker ticks us */
+    RAWR_GUARD_CLEANUP((conference->worker = rawr_Engine_AddConference(engine, conference)) < 0);
+
+    *out_conference = conference;
+
+    return rawr_Success;
+
+cleanup:
+    if (conference->encoder) rawr_Codec_Cleanup(conference->encoder);
+    MN_MEM_RELEASE(conference->members);
+    MN_MEM_RELEASE(conference->sums);
+    MN_MEM_RELEASE(conference->mixSamples);
+    MN_MEM_RELEASE(conference);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Conference_Cleanup(rawr_Conference *conference)
+{
+    RAWR_ASSERT(conference);
+
+    /* a member still points at us and its worker would collect it into freed memory, better leaked than that */
+    if (mn_atomic_load(&conference->joined)) {
+        mn_log_error("conference still has %d members, leaving it in place", (int)mn_atomic_load(&conference->joined));
+        return;
+    }
+
+    /* returns once the worker is between ticks, and it never sees us again */
+    rawr_Engine_RemoveConference(conference->engine, conference, conference->worker);
+
+    rawr_Codec_Cleanup(conference->encoder);
+    MN_MEM_RELEASE(conference->members);
+    MN_MEM_RELEASE(conference->sums);
+    MN_MEM_RELEASE(conference->mixSamples);
+    MN_MEM_RELEASE(conference);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_Join(rawr_Conference *conference, rawr_Call *call)
+{
+    RAWR_ASSERT(conference && call);
+
+    /* the slot is taken before anything else, so concurrent joins can never take more than memberMax between them */
+    RAWR_GUARD_CLEANUP(mn_atomic_fetch_add(&conference->joined, 1) >= (uint64_t)conference->memberMax);
+    RAWR_GUARD_CLEANUP(rawr_Call_SetConference(call, conference, conference->engine));
+
+    return rawr_Success;
+
+cleanup:
+    mn_atomic_fetch_add(&conference->joined, (uint64_t)-1);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_Leave(rawr_Conference *conference, rawr_Call *call)
+{
+    RAWR_ASSERT(conference && call);
+
+    RAWR_GUARD(rawr_Call_Conference(call) != conference);
+    RAWR_GUARD(rawr_Call_SetConference(call, NULL, conference->engine));
+    mn_atomic_fetch_add(&conference->joined, (uint64_t)-1);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_GetStats(rawr_Conference *conference, rawr_ConferenceStats *out_stats)
+{
+    RAWR_ASSERT(conference && out_stats);
+
+    out_stats->ticks = mn_atomic_load(&conference->ticks);
+    out_stats->framesSent = mn_atomic_load(&conference->framesSent);
+    out_stats->encodes = mn_atomic_load(&conference->encodes);
+    out_stats->members = (int)mn_atomic_load(&conference->lastMembers);
+    out_stats->speakers = (int)mn_atomic_load(&conference->lastSpeakers);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_Worker(rawr_Conference *conference)
+{
+    RAWR_ASSERT(conference);
+    return conference->worker;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_Collect(rawr_Conference *conference, rawr_Call *call)
+{
+    RAWR_ASSERT(conference && call);
+
+    rawr_ConferenceMember *member;
+    int sampleCount, peak;
+
+    RAWR_GUARD(conference->memberCount == conference->memberMax);
+    member = conference->members + conference->memberCount++;
+
+    member->call = call;
+    member->samples = NULL;
+    member->sumSquares = 0;
+    member->speaking = 0;
+
+    RAWR_GUARD((sampleCount = rawr_Call_MediaDecode(call, &member->samples)) < 0);
+    if (!sampleCount) {
+        member->samples = NULL;
+        return rawr_Success;
+    }
+
+    RAWR_ASSERT(sampleCount == conference->frameSize);
+    rawr_Level_Measure(member->samples, sampleCount, &member->sumSquares, &peak);
+
+    return rawr_Success;
+}
+
+/* the loudest members over the floor, at most RAWR_CONFERENCE_SPEAKERS_MAX of them */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Conference_PickSpeakers(rawr_Conference *conference, int *speakers)
+{
+    const uint64_t floor = (uint64_t)RAWR_CONFERENCE_SPEECH_FLOOR * RAWR_CONFERENCE_SPEECH_FLOOR * conference->frameSize;
+    int count = 0, s;
+
+    for (int m = 0; m < conference->memberCount; m++) {
+        const uint64_t sumSquares = conference->members[m].sumSquares;
+        if (sumSquares < floor) continue;
+        if (count == RAWR_CONFERENCE_SPEAKERS_MAX && sumSquares <= conference->members[speakers[count - 1]].sumSquares) continue;
+
+        /* insertion into a list this short beats sorting the members, the quietest falls off the end */
+        s = (count < RAWR_CONFERENCE_SPEAKERS_MAX) ? count++ : count - 1;
+        for (; s > 0 && conference->members[speakers[s - 1]].sumSquares < sumSquares; s--) {
+            speakers[s] = speakers[s - 1];
+        }
+        speakers[s] = m;
+    }
+
+    return count;
+}
+
+/*
+ * mix what Collect gathered this tick and send every member its frame. the sums hold every speaker, so a speaker's
+ * mix-minus is one pass over them taking their own frame back out, and the full mix everyone else hears goes
+ * through the conference's encoder once and out to each of them under their own RTP header and SRTP context
+ */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Conference_Tick(rawr_Conference *conference)
+{
+    RAWR_ASSERT(conference);
+
+    rawr_ConferenceMember *member;
+    int speakers[RAWR_CONFERENCE_SPEAKERS_MAX];
+    int speakerCount, len = 0, encoded = 0, ret = rawr_Success;
+    uint64_t framesSent = 0, encodes = 0;
+
+    if (!conference->memberCount) return rawr_Success;
+
+    speakerCount = rawr_Conference_PickSpeakers(conference, speakers);
+
+    memset(conference->sums, 0, conference->frameSize * sizeof(*conference->sums));
+    for (int s = 0; s < speakerCount; s++) {
+        member = conference->members + speakers[s];
+        member->speaking = 1;
+        conference->mix.add(conference->sums, member->samples, conference->frameSize);
+    }
+
+    for (int m = 0; m < conference->memberCount; m++) {
+        member = conference->members + m;
+
+        if (member->speaking) {
+            conference->mix.out(conference->mixSamples, conference->sums, member->samples, conference->frameSize);
+            if (rawr_Call_SendFrame(member->call, conference->mixSamples)) ret = rawr_Error;
+            encodes++;
+        } else {
+            if (!encoded) {
+                conference->mix.out(conference->mixSamples, conference->sums, NULL, conference->frameSize);
+                len = rawr_Codec_Encode(conference->encoder, conference->mixSamples, conference->payload);
+                encoded = 1;
+                encodes++;
+            }
+            if (len < 0 || rawr_Call_SendPayload(member->call, conference->payload, len)) ret = rawr_Error;
+        }
+
+        framesSent++;
+    }
+
+    mn_atomic_fetch_add(&conference->ticks, 1);
+    mn_atomic_fetch_add(&conference->framesSent, framesSent);
+    mn_atomic_fetch_add(&conference->encodes, encodes);
+    mn_atomic_store(&conference->lastMembers, conference->memberCount);
+    mn_atomic_store(&conference->lastSpeakers, speakerCount);
+
+    /* the calls are only ours until the end of the tick, the worker may detach them after it */
+    conference->memberCount = 0;
+
+    return ret;
+}
@@ -0,0 +1,93 @@
+#include "rawr/Drift.h"
+#include "rawr/Error.h"
+
+#include <math.h>
+
+/* seconds the depth is smoothed over, and played before the depth it has settled at becomes the target */
+#define RAWR_DRIFT_SMOOTH_S 10.0
+#define RAWR_DRIFT_SETTLE_S 20.0
+
+/*
+ * the proportional term alone would take this many seconds to close a gap, and the integral's time is four times
+ * that, which damps the loop critically. both are long enough that the trim moves far slower than anyone could hear
+ */
+#define RAWR_DRIFT_CORRECT_S 60.0
+#define RAWR_DRIFT_INTEGRAL_S (4.0 * RAWR_DRIFT_CORRECT_S)
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Drift_Reset(rawr_Drift *drift, int sampleRate)
+{
+    RAWR_ASSERT(drift && sampleRate > 0);
+
+    drift->sampleRate = sampleRate;
+    drift->level = 0.0;
+    drift->target = -1.0;
+    drift->settled = 0.0;
+    drift->integral = 0.0;
+    drift->trim = 0.0;
+    drift->idle = 1;
+    mn_atomic_store(&drift->ppm, 0);
+    mn_atomic_store(&drift->retargets, 0);
+    drift->retargeted = 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_Drift_Update(rawr_Drift *drift, int queued, int frames)
+{
+    RAWR_ASSERT(drift);
+
+    const double max = RAWR_DRIFT_PPM_MAX * 1e-6, elapsed = (double)frames / drift->sampleRate;
+    double error, trim;
+
+    if (queued <= 0) {
+        drift->idle = 1;
+        return drift->trim;
+    }
+
+    /* coming back from idle the queue starts over, and the smoothing with it */
+    if (drift->idle) {
+        drift->level = queued;
+        drift->idle = 0;
+    }
+    drift->level += (queued - drift->level) * elapsed / (RAWR_DRIFT_SMOOTH_S + elapsed);
+
+    /* a queue moved on purpose keeps only the integral's share of the trim, the drift, until the target is taken again */
+    if (drift->retargeted != mn_atomic_load(&drift->retargets)) {
+        drift->retargeted = mn_atomic_load(&drift->retargets);
+        drift->target = -1.0;
+        drift->settled = 0.0;
+        trim = drift->integral / RAWR_DRIFT_INTEGRAL_S / RAWR_DRIFT_CORRECT_S;
+        drift->trim = trim > max ? max : (trim < -max ? -max : trim);
+        mn_atomic_store(&drift->ppm, (uint64_t)(int64_t)llround(drift->trim * 1e8));
+    }
+
+    if (drift->target < 0.0) {
+        drift->settled += elapsed;
+        if (drift->settled >= RAWR_DRIFT_SETTLE_S) drift->target = drift->level;
+        return drift->trim;
+    }
+
+    /* seconds of audio too many queued, and the integral stops winding up while the trim is pinned */
+    error = (drift->level - drift->target) / drift->sampleRate;
+    trim = (error + (drift->integral + error * elapsed) / RAWR_DRIFT_INTEGRAL_S) / RAWR_DRIFT_CORRECT_S;
+    if (fabs(trim) < max) drift->integral += error * elapsed;
+
+    drift->trim = trim > max ? max : (trim < -max ? -max : trim);
+    mn_atomic_store(&drift->ppm, (uint64_t)(int64_t)llround(drift->trim * 1e8));
+
+    return drift->trim;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Drift_Retarget(rawr_Drift *drift)
+{
+    RAWR_ASSERT(drift);
+    mn_atomic_fetch_add(&drift->retargets, 1);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_Drift_Ppm(rawr_Drift *drift)
+{
+    RAWR_ASSERT(drift);
+    return (double)(int64_t)mn_atomic_load(&drift->ppm) / 100.0;
+}
@@ -0,0 +1,712 @@
+#include "rawr/Dsp.h"
+#include "rawr/Error.h"
+#include "rawr/Level.h"
+#include "rawr/Simd.h"
+
+#include "mn/allocator.h"
+#include "mn/time.h"
+
+#include <math.h>
+#include <string.h>
+
+#if RAWR_SIMD_X86
+#    include <immintrin.h>
+#elif RAWR_SIMD_NEON
+#    include <arm_neon.h>
+#endif
+
+/* the limiter works in blocks of this many samples and looks one ahead, frames are a multiple of it */
+#define RAWR_DSP_BLOCK 16
+
+#define RAWR_DSP_FULL_SCALE 32768.0f
+
+/* the AGC holds its gain through anything quieter than this rms, about -50 dBFS, and moves it this many dB a second */
+#define RAWR_DSP_AGC_FLOOR 100.0f
+#define RAWR_DSP_AGC_RISE_DB 6.0f
+#define RAWR_DSP_AGC_FALL_DB 40.0f
+
+/* the gate opens this far above its noise floor in power, about 9 dB, and the floor climbs back this many dB a second */
+#define RAWR_DSP_GATE_OPEN 8.0f
+#define RAWR_DSP_GATE_FLOOR_RISE_DB 3.0f
+
+/* once open the gate stays so through this much quiet, then closes this many dB a second */
+#define RAWR_DSP_GATE_HOLD_MS 200
+#define RAWR_DSP_GATE_RELEASE_DB 60.0f
+
+#define RAWR_DSP_LIMITER_RELEASE_MS 50
+
+/* gain ramping from gain by step a sample, and a first-order high-pass whose state is the last input and output */
+typedef void (*rawr_DspGainKernel)(rawr_AudioSample *samples, int count, float gain, float step);
+typedef void (*rawr_DspHighPassKernel)(rawr_AudioSample *samples, int count, float coef, float *state);
+
+typedef struct rawr_DspKernels {
+    rawr_DspGainKernel gain;
+    rawr_DspHighPassKernel highPass;
+} rawr_DspKernels;
+
+typedef struct rawr_DspChain {
+    rawr_DspKernels kernels;
+    int sampleRate;
+    int frameSize;
+    int stageCount;
+    rawr_DspProcessor stages[RAWR_DSP_STAGES_MAX];
+    rawr_Histogram *timings[RAWR_DSP_STAGES_MAX];
+} rawr_DspChain;
+
+typedef struct rawr_DspHighPass {
+    const rawr_DspKernels *kernels;
+    float coef;
+    float state[2];
+} rawr_DspHighPass;
+
+typedef struct rawr_DspAgc {
+    const rawr_DspKernels *kernels;
+    float target;
+    float gainMin;
+    float gainMax;
+    float rise; /* factors the gain may move by in a frame */
+    float fall;
+    float gain;
+} rawr_DspAgc;
+
+typedef struct rawr_DspGate {
+    const rawr_DspKernels *kernels;
+    float threshold; /* mean square */
+    float closed;
+    float floor;
+    float floorRise;
+    float release;
+    int holdFrames;
+    int hold;
+    float gain;
+} rawr_DspGate;
+
+typedef struct rawr_DspLimiter {
+    const rawr_DspKernels *kernels;
+    float ceiling;
+    float release; /* fraction of the way back to unity a block */
+    float gain;
+    int peak; /* of the block in delay */
+    int *peaks;
+    rawr_AudioSample delay[RAWR_DSP_BLOCK];
+    rawr_AudioSample ahead[RAWR_DSP_BLOCK];
+} rawr_DspLimiter;
+
+// private ------------------------------------------------------------------------------------------------------
+static rawr_AudioSample rawr_Dsp_Saturate(float v)
+{
+    return (rawr_AudioSample)(v >= INT16_MAX ? INT16_MAX : (v <= INT16_MIN ? INT16_MIN : lrintf(v)));
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_GainScalar(rawr_AudioSample *samples, int count, float gain, float step)
+{
+    for (int i = 0; i < count; i++) {
+        samples[i] = rawr_Dsp_Saturate(samples[i] * (gain + step * i));
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_HighPassScalar(rawr_AudioSample *samples, int count, float coef, float *state)
+{
+    float x, last = state[0], y = state[1];
+
+    for (int i = 0; i < count; i++) {
+        x = samples[i];
+        y = coef * (y + x - last);
+        last = x;
+        samples[i] = rawr_Dsp_Saturate(y);
+    }
+
+    state[0] = last;
+    state[1] = y;
+}
+
+/*
+ * the high-pass is y[n] = a * y[n - 1] + u[n] with u[n] = a * (x[n] - x[n - 1]), a recurrence the vector kernels
+ * solve a vector at a time as a prefix scan. adding a * u shifted one lane, then a^2 times that shifted two and so
+ * on leaves each lane k with the sum of u back to the vector's first lane, and the previous vector's last output
+ * comes in times a^(k + 1)
+ */
+#if RAWR_SIMD_X86
+// private ------------------------------------------------------------------------------------------------------
+static __m128 rawr_Dsp_ScanSse(__m128 x, __m128 *last, __m128 *carry, __m128 a, __m128 a2, __m128 powers)
+{
+    __m128 prev, t, y;
+
+    prev = _mm_move_ss(_mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(x), 4)), *last);
+    t = _mm_mul_ps(a, _mm_sub_ps(x, prev));
+    t = _mm_add_ps(t, _mm_mul_ps(a, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(t), 4))));
+    t = _mm_add_ps(t, _mm_mul_ps(a2, _mm_castsi128_ps(_mm_slli_si128(_mm_castps_si128(t), 8))));
+    y = _mm_add_ps(t, _mm_mul_ps(powers, *carry));
+
+    *last = _mm_shuffle_ps(x, x, 0xff);
+    *carry = _mm_shuffle_ps(y, y, 0xff);
+
+    return y;
+}
+
+/* converts round to nearest like lrintf and packs saturates */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_GainSse(rawr_AudioSample *samples, int count, float gain, float step)
+{
+    const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), g = _mm_set1_ps(gain), s = _mm_set1_ps(step);
+    __m128i v, lo, hi;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(samples + i));
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        lo = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(lo), _mm_add_ps(g, _mm_mul_ps(s, _mm_add_ps(_mm_set1_ps((float)i), lanes)))));
+        hi = _mm_cvtps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(hi), _mm_add_ps(g, _mm_mul_ps(s, _mm_add_ps(_mm_set1_ps((float)(i + 4)), lanes)))));
+        _mm_storeu_si128((__m128i *)(samples + i), _mm_packs_epi32(lo, hi));
+    }
+
+    rawr_Dsp_GainScalar(samples + i, count - i, gain + step * i, step);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_HighPassSse(rawr_AudioSample *samples, int count, float coef, float *state)
+{
+    const float a2 = coef * coef;
+    const __m128 a = _mm_set1_ps(coef), powers = _mm_set_ps(a2 * a2, a2 * coef, a2, coef);
+    __m128 last = _mm_set1_ps(state[0]), carry = _mm_set1_ps(state[1]);
+    __m128i v, lo, hi;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(samples + i));
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        lo = _mm_cvtps_epi32(rawr_Dsp_ScanSse(_mm_cvtepi32_ps(lo), &last, &carry, a, _mm_set1_ps(a2), powers));
+        hi = _mm_cvtps_epi32(rawr_Dsp_ScanSse(_mm_cvtepi32_ps(hi), &last, &carry, a, _mm_set1_ps(a2), powers));
+        _mm_storeu_si128((__m128i *)(samples + i), _mm_packs_epi32(lo, hi));
+    }
+
+    state[0] = _mm_cvtss_f32(last);
+    state[1] = _mm_cvtss_f32(carry);
+    rawr_Dsp_HighPassScalar(samples + i, count - i, coef, state);
+}
+
+/* shifting across the 128 bit lanes takes a permute, and a blend puts zeros or the carry in behind it */
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static __m256 rawr_Dsp_ScanAvx2(__m256 x, __m256 *last, __m256 *carry, float coef, __m256 powers)
+{
+    const __m256 zero = _mm256_setzero_ps(), a = _mm256_set1_ps(coef), a2 = _mm256_set1_ps(coef * coef), a4 = _mm256_set1_ps(coef * coef * coef * coef);
+    const __m256i top = _mm256_set1_epi32(7);
+    __m256 prev, t, y;
+
+    prev = _mm256_blend_ps(_mm256_permutevar8x32_ps(x, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)), *last, 0x01);
+    t = _mm256_mul_ps(a, _mm256_sub_ps(x, prev));
+    t = _mm256_fmadd_ps(a, _mm256_blend_ps(_mm256_permutevar8x32_ps(t, _mm256_setr_epi32(0, 0, 1, 2, 3, 4, 5, 6)), zero, 0x01), t);
+    t = _mm256_fmadd_ps(a2, _mm256_blend_ps(_mm256_permutevar8x32_ps(t, _mm256_setr_epi32(0, 0, 0, 1, 2, 3, 4, 5)), zero, 0x03), t);
+    t = _mm256_fmadd_ps(a4, _mm256_blend_ps(_mm256_permutevar8x32_ps(t, _mm256_setr_epi32(0, 0, 0, 0, 0, 1, 2, 3)), zero, 0x0f), t);
+    y = _mm256_fmadd_ps(powers, *carry, t);
+
+    *last = _mm256_permutevar8x32_ps(x, top);
+    *carry = _mm256_permutevar8x32_ps(y, top);
+
+    return y;
+}
+
+/* packs works within each 128 bit lane, the permute puts the four quarters back in order */
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Dsp_GainAvx2(rawr_AudioSample *samples, int count, float gain, float step)
+{
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f), g = _mm256_set1_ps(gain), s = _mm256_set1_ps(step);
+    __m256i lo, hi;
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i)));
+        hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i + 8)));
+        lo = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(lo), _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_set1_ps((float)i), lanes), g)));
+        hi = _mm256_cvtps_epi32(_mm256_mul_ps(_mm256_cvtepi32_ps(hi), _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_set1_ps((float)(i + 8)), lanes), g)));
+        _mm256_storeu_si256((__m256i *)(samples + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+    }
+
+    _mm256_zeroupper();
+    rawr_Dsp_GainScalar(samples + i, count - i, gain + step * i, step);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Dsp_HighPassAvx2(rawr_AudioSample *samples, int count, float coef, float *state)
+{
+    float power[8];
+    __m256 powers, last = _mm256_set1_ps(state[0]), carry = _mm256_set1_ps(state[1]);
+    __m256i lo, hi;
+    int i;
+
+    power[0] = coef;
+    for (int k = 1; k < 8; k++) {
+        power[k] = power[k - 1] * coef;
+    }
+    powers = _mm256_loadu_ps(power);
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i)));
+        hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i + 8)));
+        lo = _mm256_cvtps_epi32(rawr_Dsp_ScanAvx2(_mm256_cvtepi32_ps(lo), &last, &carry, coef, powers));
+        hi = _mm256_cvtps_epi32(rawr_Dsp_ScanAvx2(_mm256_cvtepi32_ps(hi), &last, &carry, coef, powers));
+        _mm256_storeu_si256((__m256i *)(samples + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+    }
+
+    state[0] = _mm_cvtss_f32(_mm256_castps256_ps128(last));
+    state[1] = _mm_cvtss_f32(_mm256_castps256_ps128(carry));
+
+    _mm256_zeroupper();
+    rawr_Dsp_HighPassScalar(samples + i, count - i, coef, state);
+}
+#elif RAWR_SIMD_NEON
+/* round to nearest, which 32 bit ARM has no single instruction for */
+#    if defined(__aarch64__) || defined(_M_ARM64)
+#        define RAWR_DSP_NEON_ROUND(v) vcvtnq_s32_f32(v)
+#    else
+#        define RAWR_DSP_NEON_ROUND(v) vcvtq_s32_f32(vaddq_f32((v), vbslq_f32(vcltq_f32((v), vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))))
+#    endif
+
+/* last is the previous vector of input itself, vext takes its top lane */
+// private ------------------------------------------------------------------------------------------------------
+static float32x4_t rawr_Dsp_ScanNeon(float32x4_t x, float32x4_t *last, float32x4_t *carry, float coef, float32x4_t powers)
+{
+    const float32x4_t zero = vdupq_n_f32(0.0f);
+    float32x4_t t, y;
+
+    t = vmulq_n_f32(vsubq_f32(x, vextq_f32(*last, x, 3)), coef);
+    t = vmlaq_n_f32(t, vextq_f32(zero, t, 3), coef);
+    t = vmlaq_n_f32(t, vextq_f32(zero, t, 2), coef * coef);
+    y = vmlaq_f32(t, powers, *carry);
+
+    *last = x;
+    *carry = vdupq_n_f32(vgetq_lane_f32(y, 3));
+
+    return y;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_GainNeon(rawr_AudioSample *samples, int count, float gain, float step)
+{
+    static const float laneSteps[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    const float32x4_t lanes = vld1q_f32(laneSteps), g = vdupq_n_f32(gain);
+    float32x4_t lo, hi;
+    int16x8_t v;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = vld1q_s16(samples + i);
+        lo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(v)));
+        hi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(v)));
+        lo = vmulq_f32(lo, vmlaq_n_f32(g, vaddq_f32(vdupq_n_f32((float)i), lanes), step));
+        hi = vmulq_f32(hi, vmlaq_n_f32(g, vaddq_f32(vdupq_n_f32((float)(i + 4)), lanes), step));
+        vst1q_s16(samples + i, vcombine_s16(vqmovn_s32(RAWR_DSP_NEON_ROUND(lo)), vqmovn_s32(RAWR_DSP_NEON_ROUND(hi))));
+    }
+
+    rawr_Dsp_GainScalar(samples + i, count - i, gain + step * i, step);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_HighPassNeon(rawr_AudioSample *samples, int count, float coef, float *state)
+{
+    const float power[4] = {coef, coef * coef, coef * coef * coef, coef * coef * coef * coef};
+    const float32x4_t powers = vld1q_f32(power);
+    float32x4_t lo, hi, last = vdupq_n_f32(state[0]), carry = vdupq_n_f32(state[1]);
+    int16x8_t v;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = vld1q_s16(samples + i);
+        lo = rawr_Dsp_ScanNeon(vcvtq_f32_s32(vmovl_s16(vget_low_s16(v))), &last, &carry, coef, powers);
+        hi = rawr_Dsp_ScanNeon(vcvtq_f32_s32(vmovl_s16(vget_high_s16(v))), &last, &carry, coef, powers);
+        vst1q_s16(samples + i, vcombine_s16(vqmovn_s32(RAWR_DSP_NEON_ROUND(lo)), vqmovn_s32(RAWR_DSP_NEON_ROUND(hi))));
+    }
+
+    state[0] = vgetq_lane_f32(last, 3);
+    state[1] = vgetq_lane_f32(carry, 0);
+    rawr_Dsp_HighPassScalar(samples + i, count - i, coef, state);
+}
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_Kernels(rawr_DspKernels *kernels)
+{
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    (void)features;
+
+    kernels->gain = rawr_Dsp_GainScalar;
+    kernels->highPass = rawr_Dsp_HighPassScalar;
+
+#if RAWR_SIMD_X86
+    if (features & rawr_SimdFeatures_AVX2) {
+        kernels->gain = rawr_Dsp_GainAvx2;
+        kernels->highPass = rawr_Dsp_HighPassAvx2;
+    } else if (features & rawr_SimdFeatures_SSE2) {
+        kernels->gain = rawr_Dsp_GainSse;
+        kernels->highPass = rawr_Dsp_HighPassSse;
+    }
+#elif RAWR_SIMD_NEON
+    if (features & rawr_SimdFeatures_NEON) {
+        kernels->gain = rawr_Dsp_GainNeon;
+        kernels->highPass = rawr_Dsp_HighPassNeon;
+    }
+#endif
+}
+
+/* a gain of dB spread over a second, per frame */
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Dsp_PerFrame(rawr_DspChain *chain, float dbPerSecond)
+{
+    return powf(10.0f, dbPerSecond * chain->frameSize / chain->sampleRate / 20.0f);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_Release(void *state)
+{
+    MN_MEM_RELEASE(state);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_HighPassProcess(void *state, rawr_AudioSample *samples, int sampleCount)
+{
+    rawr_DspHighPass *highPass = (rawr_DspHighPass *)state;
+
+    highPass->kernels->highPass(samples, sampleCount, highPass->coef, highPass->state);
+
+    /* the output decays towards zero through silence, stop it before it is denormal and slow */
+    if (fabsf(highPass->state[1]) < 1e-3f) highPass->state[1] = 0.0f;
+}
+
+/* the gain this frame's level wants comes in over the frame, as fast as rise and fall allow */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_AgcProcess(void *state, rawr_AudioSample *samples, int sampleCount)
+{
+    rawr_DspAgc *agc = (rawr_DspAgc *)state;
+    float rms, wanted, next = agc->gain;
+    uint64_t sumSquares;
+    int peak;
+
+    rawr_Level_Measure(samples, sampleCount, &sumSquares, &peak);
+    rms = sqrtf((float)sumSquares / sampleCount);
+
+    if (rms >= RAWR_DSP_AGC_FLOOR) {
+        wanted = agc->target / rms;
+        if (wanted > RAWR_DSP_FULL_SCALE / peak) wanted = RAWR_DSP_FULL_SCALE / peak;
+        if (wanted > agc->gainMax) wanted = agc->gainMax;
+        if (wanted < agc->gainMin) wanted = agc->gainMin;
+
+        if (wanted > agc->gain) {
+            next = (agc->gain * agc->rise < wanted) ? agc->gain * agc->rise : wanted;
+        } else {
+            next = (agc->gain / agc->fall > wanted) ? agc->gain / agc->fall : wanted;
+        }
+    }
+
+    agc->kernels->gain(samples, sampleCount, agc->gain, (next - agc->gain) / sampleCount);
+    agc->gain = next;
+}
+
+/* opens within the frame that is loud enough and closes slowly once the hold has run out */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_GateProcess(void *state, rawr_AudioSample *samples, int sampleCount)
+{
+    rawr_DspGate *gate = (rawr_DspGate *)state;
+    float power, next;
+    uint64_t sumSquares;
+    int peak;
+
+    rawr_Level_Measure(samples, sampleCount, &sumSquares, &peak);
+    power = (float)sumSquares / sampleCount;
+
+    /* the floor drops straight to anything quieter and creeps back up, so it settles on the quiet between words */
+    if (power < gate->floor) {
+        gate->floor = power > 1.0f ? power : 1.0f;
+    } else {
+        gate->floor *= gate->floorRise;
+    }
+
+    if (power > gate->floor * RAWR_DSP_GATE_OPEN && power > gate->threshold) {
+        gate->hold = gate->holdFrames;
+        next = 1.0f;
+    } else if (gate->hold > 0) {
+        gate->hold--;
+        next = 1.0f;
+    } else {
+        next = (gate->gain * gate->release > gate->closed) ? gate->gain * gate->release : gate->closed;
+    }
+
+    if (next == gate->gain && next == 1.0f) return;
+    gate->kernels->gain(samples, sampleCount, gate->gain, (next - gate->gain) / sampleCount);
+    gate->gain = next;
+}
+
+/*
+ * the audio goes out a block late, and each block's gain ramps to where it keeps both it and the block after it under
+ * the ceiling. a ramp between two gains that each keep a block under stays under across the block, so no sample
+ * is ever over, and the gain comes back up a fraction of the way each block after
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_LimiterProcess(void *state, rawr_AudioSample *samples, int sampleCount)
+{
+    rawr_DspLimiter *limiter = (rawr_DspLimiter *)state;
+    const int blocks = sampleCount / RAWR_DSP_BLOCK;
+    float next;
+    uint64_t sumSquares;
+    int peak = limiter->peak, loudest;
+
+    for (int b = 0; b < blocks; b++) {
+        rawr_Level_Measure(samples + b * RAWR_DSP_BLOCK, RAWR_DSP_BLOCK, &sumSquares, limiter->peaks + b);
+    }
+
+    memcpy(limiter->ahead, samples + sampleCount - RAWR_DSP_BLOCK, sizeof(limiter->ahead));
+    memmove(samples + RAWR_DSP_BLOCK, samples, (sampleCount - RAWR_DSP_BLOCK) * sizeof(rawr_AudioSample));
+    memcpy(samples, limiter->delay, sizeof(limiter->delay));
+    memcpy(limiter->delay, limiter->ahead, sizeof(limiter->delay));
+
+    for (int b = 0; b < blocks; b++) {
+        loudest = peak > limiter->peaks[b] ? peak : limiter->peaks[b];
+        next = limiter->gain + (1.0f - limiter->gain) * limiter->release;
+        if (loudest * next > limiter->ceiling) next = limiter->ceiling / loudest;
+
+        if (next != 1.0f || limiter->gain != 1.0f) {
+            limiter->kernels->gain(samples + b * RAWR_DSP_BLOCK, RAWR_DSP_BLOCK, limiter->gain, (next - limiter->gain) / RAWR_DSP_BLOCK);
+        }
+        limiter->gain = next;
+        peak = limiter->peaks[b];
+    }
+
+    limiter->peak = peak;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Dsp_LimiterCleanup(void *state)
+{
+    rawr_DspLimiter *limiter = (rawr_DspLimiter *)state;
+
+    MN_MEM_RELEASE(limiter->peaks);
+    MN_MEM_RELEASE(limiter);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_Setup(rawr_DspChain **out_chain, int sampleRate, int frameSize)
+{
+    RAWR_ASSERT(out_chain);
+
+    rawr_DspChain *chain;
+
+    RAWR_GUARD(sampleRate <= 0 || frameSize <= 0 || frameSize % RAWR_DSP_BLOCK);
+
+    RAWR_GUARD_NULL(chain = MN_MEM_ACQUIRE(sizeof(*chain)));
+    memset(chain, 0, sizeof(*chain));
+
+    chain->sampleRate = sampleRate;
+    chain->frameSize = frameSize;
+    rawr_Dsp_Kernels(&chain->kernels);
+
+    *out_chain = chain;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_DspChain_Cleanup(rawr_DspChain *chain)
+{
+    RAWR_ASSERT(chain);
+
+    for (int s = 0; s < chain->stageCount; s++) {
+        if (chain->stages[s].cleanup) chain->stages[s].cleanup(chain->stages[s].state);
+        rawr_Histogram_Cleanup(chain->timings[s]);
+    }
+
+    MN_MEM_RELEASE(chain);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_SampleRate(rawr_DspChain *chain)
+{
+    RAWR_ASSERT(chain);
+    return chain->sampleRate;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_FrameSize(rawr_DspChain *chain)
+{
+    RAWR_ASSERT(chain);
+    return chain->frameSize;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_Add(rawr_DspChain *chain, const rawr_DspProcessor *processor)
+{
+    RAWR_ASSERT(chain && processor && processor->process);
+
+    RAWR_GUARD_CLEANUP(chain->stageCount == RAWR_DSP_STAGES_MAX);
+    RAWR_GUARD_CLEANUP(rawr_Histogram_Setup(&chain->timings[chain->stageCount]));
+
+    chain->stages[chain->stageCount++] = *processor;
+
+    return rawr_Success;
+
+cleanup:
+    if (processor->cleanup) processor->cleanup(processor->state);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_AddHighPass(rawr_DspChain *chain, int cutoffHz)
+{
+    RAWR_ASSERT(chain);
+
+    rawr_DspHighPass *highPass;
+    rawr_DspProcessor processor;
+
+    RAWR_GUARD(cutoffHz <= 0 || cutoffHz * 2 >= chain->sampleRate);
+
+    RAWR_GUARD_NULL(highPass = MN_MEM_ACQUIRE(sizeof(*highPass)));
+    memset(highPass, 0, sizeof(*highPass));
+
+    highPass->kernels = &chain->kernels;
+    highPass->coef = (float)(1.0 / (1.0 + 2.0 * M_PI * cutoffHz / chain->sampleRate));
+
+    processor.name = "highpass";
+    processor.process = rawr_Dsp_HighPassProcess;
+    processor.cleanup = rawr_Dsp_Release;
+    processor.state = highPass;
+
+    return rawr_DspChain_Add(chain, &processor);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_AddAgc(rawr_DspChain *chain, double targetDbfs, double maxGainDb)
+{
+    RAWR_ASSERT(chain);
+
+    rawr_DspAgc *agc;
+    rawr_DspProcessor processor;
+
+    /* past 60 dB of gain the float to int conversion in the kernels could overflow */
+    RAWR_GUARD(targetDbfs > 0.0 || maxGainDb < 0.0 || maxGainDb > 60.0);
+
+    RAWR_GUARD_NULL(agc = MN_MEM_ACQUIRE(sizeof(*agc)));
+    memset(agc, 0, sizeof(*agc));
+
+    agc->kernels = &chain->kernels;
+    agc->target = RAWR_DSP_FULL_SCALE * (float)pow(10.0, targetDbfs / 20.0);
+    agc->gainMax = (float)pow(10.0, maxGainDb / 20.0);
+    agc->gainMin = 1.0f / agc->gainMax;
+    agc->rise = rawr_Dsp_PerFrame(chain, RAWR_DSP_AGC_RISE_DB);
+    agc->fall = rawr_Dsp_PerFrame(chain, RAWR_DSP_AGC_FALL_DB);
+    agc->gain = 1.0f;
+
+    processor.name = "agc";
+    processor.process = rawr_Dsp_AgcProcess;
+    processor.cleanup = rawr_Dsp_Release;
+    processor.state = agc;
+
+    return rawr_DspChain_Add(chain, &processor);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_AddGate(rawr_DspChain *chain, double thresholdDbfs, double attenuationDb)
+{
+    RAWR_ASSERT(chain);
+
+    rawr_DspGate *gate;
+    rawr_DspProcessor processor;
+
+    RAWR_GUARD(thresholdDbfs > 0.0 || attenuationDb < 0.0);
+
+    RAWR_GUARD_NULL(gate = MN_MEM_ACQUIRE(sizeof(*gate)));
+    memset(gate, 0, sizeof(*gate));
+
+    gate->kernels = &chain->kernels;
+    gate->threshold = RAWR_DSP_FULL_SCALE * RAWR_DSP_FULL_SCALE * (float)pow(10.0, thresholdDbfs / 10.0);
+    gate->closed = (float)pow(10.0, -attenuationDb / 20.0);
+    gate->floor = RAWR_DSP_FULL_SCALE * RAWR_DSP_FULL_SCALE;
+    gate->floorRise = rawr_Dsp_PerFrame(chain, 2.0f * RAWR_DSP_GATE_FLOOR_RISE_DB);
+    gate->release = 1.0f / rawr_Dsp_PerFrame(chain, RAWR_DSP_GATE_RELEASE_DB);
+    gate->holdFrames = (int)((int64_t)RAWR_DSP_GATE_HOLD_MS * chain->sampleRate / 1000 / chain->frameSize);
+    gate->gain = 1.0f;
+
+    processor.name = "gate";
+    processor.process = rawr_Dsp_GateProcess;
+    processor.cleanup = rawr_Dsp_Release;
+    processor.state = gate;
+
+    return rawr_DspChain_Add(chain, &processor);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_AddLimiter(rawr_DspChain *chain, double ceilingDbfs)
+{
+    RAWR_ASSERT(chain);
+
+    rawr_DspLimiter *limiter;
+    rawr_DspProcessor processor;
+
+    RAWR_GUARD(ceilingDbfs > 0.0);
+
+    RAWR_GUARD_NULL(limiter = MN_MEM_ACQUIRE(sizeof(*limiter)));
+    memset(limiter, 0, sizeof(*limiter));
+    RAWR_GUARD_NULL_CLEANUP(limiter->peaks = MN_MEM_ACQUIRE(chain->frameSize / RAWR_DSP_BLOCK * sizeof(*limiter->peaks)));
+
+    limiter->kernels = &chain->kernels;
+    limiter->ceiling = RAWR_DSP_FULL_SCALE * (float)pow(10.0, ceilingDbfs / 20.0);
+    limiter->release = 1.0f - expf(-(float)RAWR_DSP_BLOCK * 1000 / RAWR_DSP_LIMITER_RELEASE_MS / chain->sampleRate);
+    limiter->gain = 1.0f;
+
+    processor.name = "limiter";
+    processor.process = rawr_Dsp_LimiterProcess;
+    processor.cleanup = rawr_Dsp_LimiterCleanup;
+    processor.state = limiter;
+
+    return rawr_DspChain_Add(chain, &processor);
+
+cleanup:
+    MN_MEM_RELEASE(limiter);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_DspChain_Process(rawr_DspChain *chain, rawr_AudioSample *samples)
+{
+    RAWR_ASSERT(chain && samples);
+
+    uint64_t tstamp = mn_tstamp(), now;
+
+    for (int s = 0; s < chain->stageCount; s++) {
+        chain->stages[s].process(chain->stages[s].state, samples, chain->frameSize);
+
+        now = mn_tstamp();
+        rawr_Histogram_Record(chain->timings[s], now - tstamp);
+        tstamp = now;
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_StageCount(rawr_DspChain *chain)
+{
+    RAWR_ASSERT(chain);
+    return chain->stageCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+const char *rawr_DspChain_StageName(rawr_DspChain *chain, int stage)
+{
+    RAWR_ASSERT(chain);
+
+    if (stage < 0 || stage >= chain->stageCount) return NULL;
+    return chain->stages[stage].name;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_DspChain_StageTiming(rawr_DspChain *chain, int stage, rawr_HistogramSnapshot *out_snapshot)
+{
+    RAWR_ASSERT(chain && out_snapshot);
+
+    RAWR_GUARD(stage < 0 || stage >= chain->stageCount);
+    rawr_Histogram_Snapshot(chain->timings[stage], out_snapshot);
+
+    return rawr_Success;
+}
@@ -0,0 +1,910 @@
+#include "rawr/Echo.h"
+#include "rawr/Error.h"
+#include "rawr/Simd.h"
+#include "rawr/Util.h"
+
+#include "mn/allocator.h"
+#include "mn/time.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if RAWR_SIMD_X86
+#    include <immintrin.h>
+#elif RAWR_SIMD_NEON
+#    include <arm_neon.h>
+#endif
+
+/* a block is the largest power of two that divides the frame, up to this, and the filter's FFTs are twice that */
+#define RAWR_ECHO_BLOCK_MAX 64
+#define RAWR_ECHO_BLOCK_MIN 16
+
+/* spectra are padded to a multiple of this many bins, so the kernels never need a scalar tail */
+#define RAWR_ECHO_LANES 8
+
+/* NLMS step, each bin normalised by the far end's power across every partition */
+#define RAWR_ECHO_STEP 0.5f
+
+/* mean square of the far end, about -60 dBFS, below which there is nothing worth adapting to */
+#define RAWR_ECHO_FAR_ACTIVE 1e-6f
+
+/* the delay search averages envelopes over about this long, and leaves the filter this much before the peak */
+#define RAWR_ECHO_DELAY_SMOOTH_MS 1000
+#define RAWR_ECHO_DELAY_HEADROOM_MS 8
+
+/* a new peak has to win this many frames in a row, and stand this far above any other, before the filter moves */
+#define RAWR_ECHO_DELAY_FRAMES 10
+#define RAWR_ECHO_DELAY_PEAK 1.25f
+
+/* running mean absolute level of the far end, about -60 dBFS, below which its envelope says nothing about the delay */
+#define RAWR_ECHO_DELAY_FLOOR 1e-3f
+
+#define RAWR_ECHO_ERLE_SMOOTH 0.02f
+
+/* the costs the budget plans with follow each block's timing this slowly, a timing counting for at most double */
+#define RAWR_ECHO_COST_SMOOTH 8
+#define RAWR_ECHO_COST_SPIKE 2
+#define RAWR_ECHO_FULL_SCALE 32768.0f
+
+/* one radix-2 pass over n points, pairs half apart, and complex multiply-accumulates over split spectra */
+typedef void (*rawr_EchoPassKernel)(float *re, float *im, const float *twRe, const float *twIm, int n, int half);
+typedef void (*rawr_EchoMacKernel)(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count);
+
+typedef struct rawr_EchoKernels {
+    rawr_EchoPassKernel pass;
+    rawr_EchoMacKernel mac;     /* out += a * b */
+    rawr_EchoMacKernel macConj; /* out += conj(a) * b */
+} rawr_EchoKernels;
+
+typedef struct rawr_Echo {
+    rawr_EchoKernels kernels;
+    int sampleRate;
+    int frameSize;
+    int block;
+    int bins;   /* block + 1, the real FFT of 2 * block samples */
+    int stride; /* bins padded for the kernels */
+    int partitions;
+    int lags;
+    int headroom;
+    uint64_t budgetNs;
+
+    /* everything below lives in one allocation */
+    float *memory;
+    int *bitrev;
+
+    /* the far end as rendered, historyHead being one past the newest sample */
+    float *history;
+    uint64_t historyMask;
+    uint64_t historyHead;
+
+    /* twiddles for each pass of the complex FFT of block points at [half, 2 * half), then for the real FFT on top */
+    float *twRe, *twIm;
+    float *rtRe, *rtIm;
+    float *zRe, *zIm;
+    float *window;
+
+    /* the filter's partitions and the far end spectra they multiply, newest at spectrumHead */
+    float *wRe, *wIm;
+    float *xRe, *xIm;
+    float *power; /* per bin, summed over the spectra held */
+    float *yRe, *yIm;
+    int spectrumHead;
+    int constrainNext;
+    int delay; /* in blocks, -1 until the far end has been found in the capture */
+
+    /* delay search, envelopes mirrored so every lag reads in a row from envelopeHead */
+    float *envelope;
+    float *corr;
+    int envelopeHead;
+    float envelopeStep;
+    float farMean;
+    float farLast;
+    float nearLast;
+    int candidate;
+    int candidateFrames;
+
+    float nearPower;
+    float errorPower;
+    int64_t filterNs; /* what a block has been costing to filter, and on top of that to adapt */
+    int64_t adaptNs;
+    uint64_t adaptSkipped;
+    uint64_t bypassed;
+} rawr_Echo;
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_PassScalar(float *re, float *im, const float *twRe, const float *twIm, int n, int half)
+{
+    float tr, ti;
+    int a, b;
+
+    for (int g = 0; g < n; g += 2 * half) {
+        for (int k = 0; k < half; k++) {
+            a = g + k;
+            b = a + half;
+            tr = re[b] * twRe[k] - im[b] * twIm[k];
+            ti = re[b] * twIm[k] + im[b] * twRe[k];
+            re[b] = re[a] - tr;
+            im[b] = im[a] - ti;
+            re[a] += tr;
+            im[a] += ti;
+        }
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_MacScalar(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    for (int i = 0; i < count; i++) {
+        outRe[i] += aRe[i] * bRe[i] - aIm[i] * bIm[i];
+        outIm[i] += aRe[i] * bIm[i] + aIm[i] * bRe[i];
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_MacConjScalar(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    for (int i = 0; i < count; i++) {
+        outRe[i] += aRe[i] * bRe[i] + aIm[i] * bIm[i];
+        outIm[i] += aRe[i] * bIm[i] - aIm[i] * bRe[i];
+    }
+}
+
+#if RAWR_SIMD_X86
+/* the first passes pair neighbours closer than a vector is wide, those stay scalar */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_PassSse(float *re, float *im, const float *twRe, const float *twIm, int n, int half)
+{
+    __m128 wr, wi, ar, ai, br, bi, tr, ti;
+    int a, b;
+
+    if (half < 4) {
+        rawr_Echo_PassScalar(re, im, twRe, twIm, n, half);
+        return;
+    }
+
+    for (int g = 0; g < n; g += 2 * half) {
+        for (int k = 0; k < half; k += 4) {
+            a = g + k;
+            b = a + half;
+            wr = _mm_loadu_ps(twRe + k);
+            wi = _mm_loadu_ps(twIm + k);
+            br = _mm_loadu_ps(re + b);
+            bi = _mm_loadu_ps(im + b);
+            tr = _mm_sub_ps(_mm_mul_ps(br, wr), _mm_mul_ps(bi, wi));
+            ti = _mm_add_ps(_mm_mul_ps(br, wi), _mm_mul_ps(bi, wr));
+            ar = _mm_loadu_ps(re + a);
+            ai = _mm_loadu_ps(im + a);
+            _mm_storeu_ps(re + b, _mm_sub_ps(ar, tr));
+            _mm_storeu_ps(im + b, _mm_sub_ps(ai, ti));
+            _mm_storeu_ps(re + a, _mm_add_ps(ar, tr));
+            _mm_storeu_ps(im + a, _mm_add_ps(ai, ti));
+        }
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_MacSse(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    __m128 ar, ai, br, bi;
+
+    for (int i = 0; i < count; i += 4) {
+        ar = _mm_loadu_ps(aRe + i);
+        ai = _mm_loadu_ps(aIm + i);
+        br = _mm_loadu_ps(bRe + i);
+        bi = _mm_loadu_ps(bIm + i);
+        _mm_storeu_ps(outRe + i, _mm_add_ps(_mm_loadu_ps(outRe + i), _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+        _mm_storeu_ps(outIm + i, _mm_add_ps(_mm_loadu_ps(outIm + i), _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_MacConjSse(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    __m128 ar, ai, br, bi;
+
+    for (int i = 0; i < count; i += 4) {
+        ar = _mm_loadu_ps(aRe + i);
+        ai = _mm_loadu_ps(aIm + i);
+        br = _mm_loadu_ps(bRe + i);
+        bi = _mm_loadu_ps(bIm + i);
+        _mm_storeu_ps(outRe + i, _mm_add_ps(_mm_loadu_ps(outRe + i), _mm_add_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi))));
+        _mm_storeu_ps(outIm + i, _mm_add_ps(_mm_loadu_ps(outIm + i), _mm_sub_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br))));
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Echo_PassAvx2(float *re, float *im, const float *twRe, const float *twIm, int n, int half)
+{
+    __m256 wr, wi, ar, ai, br, bi, tr, ti;
+    int a, b;
+
+    if (half < 8) {
+        rawr_Echo_PassSse(re, im, twRe, twIm, n, half);
+        return;
+    }
+
+    for (int g = 0; g < n; g += 2 * half) {
+        for (int k = 0; k < half; k += 8) {
+            a = g + k;
+            b = a + half;
+            wr = _mm256_loadu_ps(twRe + k);
+            wi = _mm256_loadu_ps(twIm + k);
+            br = _mm256_loadu_ps(re + b);
+            bi = _mm256_loadu_ps(im + b);
+            tr = _mm256_fmsub_ps(br, wr, _mm256_mul_ps(bi, wi));
+            ti = _mm256_fmadd_ps(br, wi, _mm256_mul_ps(bi, wr));
+            ar = _mm256_loadu_ps(re + a);
+            ai = _mm256_loadu_ps(im + a);
+            _mm256_storeu_ps(re + b, _mm256_sub_ps(ar, tr));
+            _mm256_storeu_ps(im + b, _mm256_sub_ps(ai, ti));
+            _mm256_storeu_ps(re + a, _mm256_add_ps(ar, tr));
+            _mm256_storeu_ps(im + a, _mm256_add_ps(ai, ti));
+        }
+    }
+
+    _mm256_zeroupper();
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Echo_MacAvx2(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    __m256 ar, ai, br, bi, re, im;
+
+    for (int i = 0; i < count; i += 8) {
+        ar = _mm256_loadu_ps(aRe + i);
+        ai = _mm256_loadu_ps(aIm + i);
+        br = _mm256_loadu_ps(bRe + i);
+        bi = _mm256_loadu_ps(bIm + i);
+        re = _mm256_fmadd_ps(ar, br, _mm256_loadu_ps(outRe + i));
+        im = _mm256_fmadd_ps(ar, bi, _mm256_loadu_ps(outIm + i));
+        _mm256_storeu_ps(outRe + i, _mm256_fnmadd_ps(ai, bi, re));
+        _mm256_storeu_ps(outIm + i, _mm256_fmadd_ps(ai, br, im));
+    }
+
+    _mm256_zeroupper();
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Echo_MacConjAvx2(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    __m256 ar, ai, br, bi, re, im;
+
+    for (int i = 0; i < count; i += 8) {
+        ar = _mm256_loadu_ps(aRe + i);
+        ai = _mm256_loadu_ps(aIm + i);
+        br = _mm256_loadu_ps(bRe + i);
+        bi = _mm256_loadu_ps(bIm + i);
+        re = _mm256_fmadd_ps(ar, br, _mm256_loadu_ps(outRe + i));
+        im = _mm256_fmadd_ps(ar, bi, _mm256_loadu_ps(outIm + i));
+        _mm256_storeu_ps(outRe + i, _mm256_fmadd_ps(ai, bi, re));
+        _mm256_storeu_ps(outIm + i, _mm256_fnmadd_ps(ai, br, im));
+    }
+
+    _mm256_zeroupper();
+}
+#elif RAWR_SIMD_NEON
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_PassNeon(float *re, float *im, const float *twRe, const float *twIm, int n, int half)
+{
+    float32x4_t wr, wi, ar, ai, br, bi, tr, ti;
+    int a, b;
+
+    if (half < 4) {
+        rawr_Echo_PassScalar(re, im, twRe, twIm, n, half);
+        return;
+    }
+
+    for (int g = 0; g < n; g += 2 * half) {
+        for (int k = 0; k < half; k += 4) {
+            a = g + k;
+            b = a + half;
+            wr = vld1q_f32(twRe + k);
+            wi = vld1q_f32(twIm + k);
+            br = vld1q_f32(re + b);
+            bi = vld1q_f32(im + b);
+            tr = vmlsq_f32(vmulq_f32(br, wr), bi, wi);
+            ti = vmlaq_f32(vmulq_f32(br, wi), bi, wr);
+            ar = vld1q_f32(re + a);
+            ai = vld1q_f32(im + a);
+            vst1q_f32(re + b, vsubq_f32(ar, tr));
+            vst1q_f32(im + b, vsubq_f32(ai, ti));
+            vst1q_f32(re + a, vaddq_f32(ar, tr));
+            vst1q_f32(im + a, vaddq_f32(ai, ti));
+        }
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_MacNeon(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    float32x4_t ar, ai, br, bi;
+
+    for (int i = 0; i < count; i += 4) {
+        ar = vld1q_f32(aRe + i);
+        ai = vld1q_f32(aIm + i);
+        br = vld1q_f32(bRe + i);
+        bi = vld1q_f32(bIm + i);
+        vst1q_f32(outRe + i, vmlsq_f32(vmlaq_f32(vld1q_f32(outRe + i), ar, br), ai, bi));
+        vst1q_f32(outIm + i, vmlaq_f32(vmlaq_f32(vld1q_f32(outIm + i), ar, bi), ai, br));
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_MacConjNeon(float *outRe, float *outIm, const float *aRe, const float *aIm, const float *bRe, const float *bIm, int count)
+{
+    float32x4_t ar, ai, br, bi;
+
+    for (int i = 0; i < count; i += 4) {
+        ar = vld1q_f32(aRe + i);
+        ai = vld1q_f32(aIm + i);
+        br = vld1q_f32(bRe + i);
+        bi = vld1q_f32(bIm + i);
+        vst1q_f32(outRe + i, vmlaq_f32(vmlaq_f32(vld1q_f32(outRe + i), ar, br), ai, bi));
+        vst1q_f32(outIm + i, vmlsq_f32(vmlaq_f32(vld1q_f32(outIm + i), ar, bi), ai, br));
+    }
+}
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Kernels(rawr_EchoKernels *kernels)
+{
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    (void)features;
+
+    kernels->pass = rawr_Echo_PassScalar;
+    kernels->mac = rawr_Echo_MacScalar;
+    kernels->macConj = rawr_Echo_MacConjScalar;
+
+#if RAWR_SIMD_X86
+    if (features & rawr_SimdFeatures_AVX2) {
+        kernels->pass = rawr_Echo_PassAvx2;
+        kernels->mac = rawr_Echo_MacAvx2;
+        kernels->macConj = rawr_Echo_MacConjAvx2;
+    } else if (features & rawr_SimdFeatures_SSE2) {
+        kernels->pass = rawr_Echo_PassSse;
+        kernels->mac = rawr_Echo_MacSse;
+        kernels->macConj = rawr_Echo_MacConjSse;
+    }
+#elif RAWR_SIMD_NEON
+    if (features & rawr_SimdFeatures_NEON) {
+        kernels->pass = rawr_Echo_PassNeon;
+        kernels->mac = rawr_Echo_MacNeon;
+        kernels->macConj = rawr_Echo_MacConjNeon;
+    }
+#endif
+}
+
+/* in place complex FFT of block points */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Fft(rawr_Echo *echo, float *re, float *im)
+{
+    const int n = echo->block;
+    float t;
+    int j;
+
+    for (int i = 0; i < n; i++) {
+        if ((j = echo->bitrev[i]) <= i) continue;
+        t = re[i];
+        re[i] = re[j];
+        re[j] = t;
+        t = im[i];
+        im[i] = im[j];
+        im[j] = t;
+    }
+
+    for (int half = 1; half < n; half *= 2) {
+        echo->kernels.pass(re, im, echo->twRe + half, echo->twIm + half, n, half);
+    }
+}
+
+/*
+ * 2 * block real samples to block + 1 bins. the even samples go in as the real part and the odd ones as the
+ * imaginary part of a complex FFT half the size, and the two halves' spectra are pulled apart and combined after
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Forward(rawr_Echo *echo, const float *time, float *outRe, float *outIm)
+{
+    const int n = echo->block;
+    float *zr = echo->zRe, *zi = echo->zIm;
+    float ar, ai, br, bi, er, ei, or, oi;
+    int k1, k2;
+
+    for (int j = 0; j < n; j++) {
+        zr[j] = time[2 * j];
+        zi[j] = time[2 * j + 1];
+    }
+
+    rawr_Echo_Fft(echo, zr, zi);
+
+    for (int k = 0; k <= n; k++) {
+        k1 = k & (n - 1);
+        k2 = (n - k) & (n - 1);
+        ar = zr[k1];
+        ai = zi[k1];
+        br = zr[k2];
+        bi = -zi[k2];
+        er = 0.5f * (ar + br);
+        ei = 0.5f * (ai + bi);
+        or = 0.5f * (ai - bi);
+        oi = -0.5f * (ar - br);
+        outRe[k] = er + echo->rtRe[k] * or - echo->rtIm[k] * oi;
+        outIm[k] = ei + echo->rtRe[k] * oi + echo->rtIm[k] * or;
+    }
+}
+
+/* block + 1 bins back to 2 * block real samples, the forward steps run backwards through a conjugated FFT */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Inverse(rawr_Echo *echo, const float *re, const float *im, float *time)
+{
+    const int n = echo->block;
+    const float scale = 1.0f / (2 * n);
+    float *zr = echo->zRe, *zi = echo->zIm;
+    float ar, ai, br, bi, dr, di, or, oi;
+
+    for (int k = 0; k < n; k++) {
+        ar = re[k];
+        ai = im[k];
+        br = re[n - k];
+        bi = -im[n - k];
+        dr = ar - br;
+        di = ai - bi;
+        or = dr * echo->rtRe[k] + di * echo->rtIm[k];
+        oi = di * echo->rtRe[k] - dr * echo->rtIm[k];
+        zr[k] = (ar + br) - oi;
+        zi[k] = -((ai + bi) + or);
+    }
+
+    rawr_Echo_Fft(echo, zr, zi);
+
+    for (int j = 0; j < n; j++) {
+        time[2 * j] = zr[j] * scale;
+        time[2 * j + 1] = -zi[j] * scale;
+    }
+}
+
+/* the far end window ending at end into echo->window, returning the mean square of its newer half */
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Echo_Window(rawr_Echo *echo, uint64_t end)
+{
+    const int size = 2 * echo->block;
+    const uint64_t start = end - size;
+    float sum = 0.0f, v;
+
+    for (int i = 0; i < size; i++) {
+        v = echo->history[(start + i) & echo->historyMask];
+        echo->window[i] = v;
+        if (i >= echo->block) sum += v * v;
+    }
+
+    return sum / echo->block;
+}
+
+/* the far end spectrum for the block ending at end takes the oldest one's place, returning the block's mean square */
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Echo_Push(rawr_Echo *echo, uint64_t end)
+{
+    const float farPower = rawr_Echo_Window(echo, end);
+    float *xRe, *xIm;
+
+    echo->spectrumHead = (echo->spectrumHead + echo->partitions - 1) % echo->partitions;
+    xRe = echo->xRe + echo->spectrumHead * echo->stride;
+    xIm = echo->xIm + echo->spectrumHead * echo->stride;
+
+    for (int f = 0; f < echo->bins; f++) {
+        echo->power[f] -= xRe[f] * xRe[f] + xIm[f] * xIm[f];
+    }
+
+    rawr_Echo_Forward(echo, echo->window, xRe, xIm);
+
+    /* a running sum drifts, and a power below zero would turn the step around */
+    for (int f = 0; f < echo->bins; f++) {
+        echo->power[f] += xRe[f] * xRe[f] + xIm[f] * xIm[f];
+        if (echo->power[f] < 0.0f) echo->power[f] = 0.0f;
+    }
+
+    return farPower;
+}
+
+/* point the filter at a new delay, its spectra rebuilt from the history and what it had learned thrown away */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Move(rawr_Echo *echo, int delay)
+{
+    const size_t spectra = (size_t)echo->partitions * echo->stride;
+    const uint64_t end = echo->historyHead - (uint64_t)delay * echo->block;
+
+    echo->delay = delay;
+    memset(echo->wRe, 0, spectra * sizeof(float));
+    memset(echo->wIm, 0, spectra * sizeof(float));
+    memset(echo->xRe, 0, spectra * sizeof(float));
+    memset(echo->xIm, 0, spectra * sizeof(float));
+    memset(echo->power, 0, echo->stride * sizeof(float));
+    echo->constrainNext = 0;
+
+    for (int p = echo->partitions - 1; p >= 0; p--) {
+        rawr_Echo_Push(echo, end - (uint64_t)p * echo->block);
+    }
+}
+
+/*
+ * correlate the capture's envelope against the far end's at every lag, block by block. the envelopes go in as the
+ * change from one block to the next, which is far less alike from lag to lag than a level is, so the peak is sharp
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Track(rawr_Echo *echo, const rawr_AudioSample *samples, uint64_t end)
+{
+    const int block = echo->block;
+    const float keep = 1.0f - echo->envelopeStep;
+    float far = 0.0f, near = 0.0f, c;
+    const float *envelope;
+
+    for (int i = 0; i < block; i++) {
+        far += fabsf(echo->history[(end - block + i) & echo->historyMask]);
+        near += (float)abs(samples[i]);
+    }
+    far /= block;
+    near /= block * RAWR_ECHO_FULL_SCALE;
+
+    echo->farMean += echo->envelopeStep * (far - echo->farMean);
+
+    echo->envelopeHead = (echo->envelopeHead + echo->lags - 1) % echo->lags;
+    echo->envelope[echo->envelopeHead] = far - echo->farLast;
+    echo->envelope[echo->envelopeHead + echo->lags] = far - echo->farLast;
+    echo->farLast = far;
+
+    c = (near - echo->nearLast) * echo->envelopeStep;
+    echo->nearLast = near;
+
+    if (echo->farMean < RAWR_ECHO_DELAY_FLOOR) return;
+
+    envelope = echo->envelope + echo->envelopeHead;
+    for (int l = 0; l < echo->lags; l++) {
+        echo->corr[l] = echo->corr[l] * keep + c * envelope[l];
+    }
+}
+
+/* once a frame, move the filter when a clear peak has held somewhere it does not already cover */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Locate(rawr_Echo *echo)
+{
+    int best = 0, delay;
+    float runnerUp = 0.0f;
+
+    for (int l = 1; l < echo->lags; l++) {
+        if (echo->corr[l] > echo->corr[best]) best = l;
+    }
+    if (echo->corr[best] <= 0.0f) return;
+
+    for (int l = 0; l < echo->lags; l++) {
+        if (abs(l - best) <= 2) continue;
+        if (echo->corr[l] > runnerUp) runnerUp = echo->corr[l];
+    }
+    if (echo->corr[best] < runnerUp * RAWR_ECHO_DELAY_PEAK) {
+        echo->candidateFrames = 0;
+        return;
+    }
+
+    if (abs(best - echo->candidate) > 1) {
+        echo->candidate = best;
+        echo->candidateFrames = 0;
+    }
+    if (++echo->candidateFrames < RAWR_ECHO_DELAY_FRAMES) return;
+
+    /* a peak the filter already spans is left to the filter, moving it throws away what it has learned */
+    if (echo->delay >= 0 && best > echo->delay && best <= echo->delay + 2 * echo->headroom) return;
+
+    delay = best > echo->headroom ? best - echo->headroom : 0;
+    if (delay != echo->delay) rawr_Echo_Move(echo, delay);
+}
+
+/*
+ * fold one timing into a running cost. a block the thread was preempted in can move it only so far, or one slow
+ * block would have the budget skipping work for a long time after
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Cost(int64_t *cost, uint64_t ns)
+{
+    int64_t sample = (int64_t)ns;
+
+    if (*cost && sample > RAWR_ECHO_COST_SPIKE * *cost) sample = RAWR_ECHO_COST_SPIKE * *cost;
+    *cost += (sample - *cost) / RAWR_ECHO_COST_SMOOTH;
+}
+
+/*
+ * filter one block of capture, whose far end spectrum was just pushed, leaving what is left of it in error. the
+ * filter's output is the newer half of the inverse FFT (overlap-save)
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Filter(rawr_Echo *echo, rawr_AudioSample *samples, float *error, float farPower)
+{
+    const int block = echo->block, stride = echo->stride;
+    float nearPower = 0.0f, errorPower = 0.0f, near, v;
+    int slot;
+
+    memset(echo->yRe, 0, stride * sizeof(float));
+    memset(echo->yIm, 0, stride * sizeof(float));
+    for (int p = 0; p < echo->partitions; p++) {
+        slot = (echo->spectrumHead + p) % echo->partitions;
+        echo->kernels.mac(echo->yRe, echo->yIm, echo->wRe + p * stride, echo->wIm + p * stride, echo->xRe + slot * stride, echo->xIm + slot * stride, stride);
+    }
+    rawr_Echo_Inverse(echo, echo->yRe, echo->yIm, echo->window);
+
+    for (int i = 0; i < block; i++) {
+        near = samples[i] * (1.0f / RAWR_ECHO_FULL_SCALE);
+        error[i] = near - echo->window[block + i];
+        nearPower += near * near;
+        errorPower += error[i] * error[i];
+    }
+
+    /* a filter adding more than it takes away has not converged or is hearing the near end talk, so it is not heard */
+    if (errorPower <= nearPower) {
+        for (int i = 0; i < block; i++) {
+            v = error[i] * RAWR_ECHO_FULL_SCALE;
+            samples[i] = (rawr_AudioSample)(v >= INT16_MAX ? INT16_MAX : (v <= INT16_MIN ? INT16_MIN : lrintf(v)));
+        }
+    }
+
+    if (farPower <= RAWR_ECHO_FAR_ACTIVE) return;
+
+    echo->nearPower += RAWR_ECHO_ERLE_SMOOTH * (nearPower - echo->nearPower);
+    echo->errorPower += RAWR_ECHO_ERLE_SMOOTH * ((errorPower < nearPower ? errorPower : nearPower) - echo->errorPower);
+}
+
+/*
+ * step every partition towards taking error out, each bin normalised by the far end's power in it. one partition a
+ * block has its time domain tail cut off again, which keeps the circular wrap out of the filter for a fraction of
+ * the cost of constraining them all
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Echo_Adapt(rawr_Echo *echo, const float *error)
+{
+    const int block = echo->block, stride = echo->stride;
+    const float regularization = 2.0f * block * echo->partitions * RAWR_ECHO_FAR_ACTIVE;
+    float *wRe, *wIm, g;
+    int slot, c;
+
+    memset(echo->window, 0, block * sizeof(float));
+    memcpy(echo->window + block, error, block * sizeof(float));
+    rawr_Echo_Forward(echo, echo->window, echo->yRe, echo->yIm);
+
+    for (int f = 0; f < echo->bins; f++) {
+        g = RAWR_ECHO_STEP / (echo->power[f] + regularization);
+        echo->yRe[f] *= g;
+        echo->yIm[f] *= g;
+    }
+
+    for (int p = 0; p < echo->partitions; p++) {
+        slot = (echo->spectrumHead + p) % echo->partitions;
+        echo->kernels.macConj(echo->wRe + p * stride, echo->wIm + p * stride, echo->xRe + slot * stride, echo->xIm + slot * stride, echo->yRe, echo->yIm, stride);
+    }
+
+    c = echo->constrainNext;
+    echo->constrainNext = (c + 1) % echo->partitions;
+    wRe = echo->wRe + c * stride;
+    wIm = echo->wIm + c * stride;
+    rawr_Echo_Inverse(echo, wRe, wIm, echo->window);
+    memset(echo->window + block, 0, block * sizeof(float));
+    rawr_Echo_Forward(echo, echo->window, wRe, wIm);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Echo_Setup(rawr_Echo **out_echo, int sampleRate, int frameSize)
+{
+    RAWR_ASSERT(out_echo);
+
+    rawr_Echo *echo;
+    size_t spectra, floats;
+    unsigned historySize;
+    int block, bits = 0;
+    float *m;
+
+    RAWR_GUARD(sampleRate <= 0 || frameSize < RAWR_ECHO_BLOCK_MIN || frameSize % RAWR_ECHO_BLOCK_MIN);
+
+    RAWR_GUARD_NULL(echo = MN_MEM_ACQUIRE(sizeof(*echo)));
+    memset(echo, 0, sizeof(*echo));
+
+    block = frameSize & -frameSize;
+    if (block > RAWR_ECHO_BLOCK_MAX) block = RAWR_ECHO_BLOCK_MAX;
+    while ((1 << bits) < block) bits++;
+
+    echo->sampleRate = sampleRate;
+    echo->frameSize = frameSize;
+    echo->block = block;
+    echo->bins = block + 1;
+    echo->stride = (echo->bins + RAWR_ECHO_LANES - 1) / RAWR_ECHO_LANES * RAWR_ECHO_LANES;
+    echo->partitions = (sampleRate * RAWR_ECHO_TAIL_MS / 1000 + block - 1) / block;
+    echo->lags = (sampleRate * RAWR_ECHO_DELAY_MAX_MS / 1000 + block - 1) / block;
+    echo->headroom = (sampleRate * RAWR_ECHO_DELAY_HEADROOM_MS / 1000 + block - 1) / block;
+    echo->envelopeStep = (float)block * 1000.0f / ((float)sampleRate * RAWR_ECHO_DELAY_SMOOTH_MS);
+
+    /* enough for a rebuild at the longest delay, reaching back a whole filter behind the frame just processed */
+    historySize = rawr_Util_NextPowerOf2((unsigned)(frameSize + (echo->lags + echo->partitions + 2) * block));
+    echo->historyMask = historySize - 1;
+
+    spectra = (size_t)echo->partitions * echo->stride;
+    floats = historySize + 6 * block + 2 * (block + 1) + 4 * spectra + 3 * echo->stride + 3 * echo->lags;
+
+    RAWR_GUARD_NULL_CLEANUP(echo->memory = MN_MEM_ACQUIRE(floats * sizeof(float)));
+    RAWR_GUARD_NULL_CLEANUP(echo->bitrev = MN_MEM_ACQUIRE(block * sizeof(int)));
+
+    m = echo->memory;
+    echo->history = m, m += historySize;
+    echo->twRe = m, m += block;
+    echo->twIm = m, m += block;
+    echo->zRe = m, m += block;
+    echo->zIm = m, m += block;
+    echo->window = m, m += 2 * block;
+    echo->rtRe = m, m += block + 1;
+    echo->rtIm = m, m += block + 1;
+    echo->wRe = m, m += spectra;
+    echo->wIm = m, m += spectra;
+    echo->xRe = m, m += spectra;
+    echo->xIm = m, m += spectra;
+    echo->power = m, m += echo->stride;
+    echo->yRe = m, m += echo->stride;
+    echo->yIm = m, m += echo->stride;
+    echo->envelope = m, m += 2 * echo->lags;
+    echo->corr = m, m += echo->lags;
+    RAWR_ASSERT(m == echo->memory + floats);
+
+    for (int i = 0; i < block; i++) {
+        echo->bitrev[i] = 0;
+        for (int b = 0; b < bits; b++) {
+            if (i & (1 << b)) echo->bitrev[i] |= 1 << (bits - 1 - b);
+        }
+    }
+
+    for (int half = 1; half < block; half *= 2) {
+        for (int k = 0; k < half; k++) {
+            echo->twRe[half + k] = (float)cos(M_PI * k / half);
+            echo->twIm[half + k] = (float)-sin(M_PI * k / half);
+        }
+    }
+    echo->twRe[0] = echo->twIm[0] = 0.0f;
+
+    for (int k = 0; k <= block; k++) {
+        echo->rtRe[k] = (float)cos(M_PI * k / block);
+        echo->rtIm[k] = (float)-sin(M_PI * k / block);
+    }
+
+    rawr_Echo_Kernels(&echo->kernels);
+    rawr_Echo_Reset(echo);
+
+    *out_echo = echo;
+
+    return rawr_Success;
+
+cleanup:
+    MN_MEM_RELEASE(echo->memory);
+    MN_MEM_RELEASE(echo->bitrev);
+    MN_MEM_RELEASE(echo);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Echo_Cleanup(rawr_Echo *echo)
+{
+    RAWR_ASSERT(echo);
+
+    MN_MEM_RELEASE(echo->memory);
+    MN_MEM_RELEASE(echo->bitrev);
+    MN_MEM_RELEASE(echo);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Echo_Reset(rawr_Echo *echo)
+{
+    RAWR_ASSERT(echo);
+
+    const size_t spectra = (size_t)echo->partitions * echo->stride;
+
+    memset(echo->history, 0, (echo->historyMask + 1) * sizeof(float));
+    memset(echo->wRe, 0, spectra * sizeof(float));
+    memset(echo->wIm, 0, spectra * sizeof(float));
+    memset(echo->xRe, 0, spectra * sizeof(float));
+    memset(echo->xIm, 0, spectra * sizeof(float));
+    memset(echo->power, 0, echo->stride * sizeof(float));
+    memset(echo->yRe, 0, echo->stride * sizeof(float));
+    memset(echo->yIm, 0, echo->stride * sizeof(float));
+    memset(echo->envelope, 0, 2 * echo->lags * sizeof(float));
+    memset(echo->corr, 0, echo->lags * sizeof(float));
+
+    echo->historyHead = 0;
+    echo->spectrumHead = 0;
+    echo->constrainNext = 0;
+    echo->delay = -1;
+    echo->envelopeHead = 0;
+    echo->farMean = 0.0f;
+    echo->farLast = 0.0f;
+    echo->nearLast = 0.0f;
+    echo->candidate = -1;
+    echo->candidateFrames = 0;
+    echo->nearPower = 0.0f;
+    echo->errorPower = 0.0f;
+    echo->filterNs = 0;
+    echo->adaptNs = 0;
+    echo->adaptSkipped = 0;
+    echo->bypassed = 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Echo_SetBudget(rawr_Echo *echo, uint64_t budgetNs)
+{
+    RAWR_ASSERT(echo);
+    echo->budgetNs = budgetNs;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Echo_Render(rawr_Echo *echo, const rawr_AudioSample *samples, int count)
+{
+    RAWR_ASSERT(echo && samples);
+
+    for (int i = 0; i < count; i++) {
+        echo->history[(echo->historyHead + i) & echo->historyMask] = samples[i] * (1.0f / RAWR_ECHO_FULL_SCALE);
+    }
+    echo->historyHead += count;
+}
+
+/*
+ * the budget is kept block by block from what filtering and adapting have been costing. a block adapts only if that
+ * leaves enough to filter every block after it, filtering being what takes the echo out, and a block there is no
+ * longer time to filter goes through as it was captured
+ */
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Echo_Process(rawr_Echo *echo, rawr_AudioSample *samples)
+{
+    RAWR_ASSERT(echo && samples);
+
+    const int block = echo->block, blocks = echo->frameSize / echo->block;
+    const int64_t budget = (int64_t)echo->budgetNs;
+    const uint64_t start = budget ? mn_tstamp() : 0;
+    uint64_t end = echo->historyHead - echo->frameSize, filtering = 0, filtered = 0;
+    float error[RAWR_ECHO_BLOCK_MAX];
+    float farPower;
+
+    for (int b = 0; b < blocks; b++, samples += block) {
+        end += block;
+        rawr_Echo_Track(echo, samples, end);
+        if (echo->delay < 0) continue;
+
+        /* the spectra have to stay in step whatever happens to the block */
+        if (budget) filtering = mn_tstamp();
+        farPower = rawr_Echo_Push(echo, end - (uint64_t)echo->delay * block);
+
+        if (budget && (int64_t)(filtering - start) + echo->filterNs > budget) {
+            echo->bypassed++;
+            continue;
+        }
+
+        rawr_Echo_Filter(echo, samples, error, farPower);
+        if (budget) {
+            filtered = mn_tstamp();
+            rawr_Echo_Cost(&echo->filterNs, filtered - filtering);
+        }
+
+        if (farPower <= RAWR_ECHO_FAR_ACTIVE) continue;
+
+        if (budget && (int64_t)(filtered - start) + echo->adaptNs + echo->filterNs * (blocks - b - 1) > budget) {
+            echo->adaptSkipped++;
+            continue;
+        }
+
+        rawr_Echo_Adapt(echo, error);
+        if (budget) rawr_Echo_Cost(&echo->adaptNs, mn_tstamp() - filtered);
+    }
+
+    rawr_Echo_Locate(echo);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Echo_Stats(rawr_Echo *echo, rawr_EchoStats *out_stats)
+{
+    RAWR_ASSERT(echo && out_stats);
+
+    out_stats->delayMs = echo->delay < 0 ? -1 : echo->delay * echo->block * 1000 / echo->sampleRate;
+    out_stats->erleDb = 0.0;
+    if (echo->errorPower > 0.0f && echo->nearPower > 0.0f) out_stats->erleDb = 10.0 * log10(echo->nearPower / echo->errorPower);
+    out_stats->adaptSkipped = echo->adaptSkipped;
+    out_stats->bypassed = echo->bypassed;
+}
@@ -0,0 +1,743 @@
+#include "rawr/Engine.h"
+#include "rawr/CallEngine.h"
+#include "rawr/Error.h"
+#include "rawr/Semaphore.h"
+#include "rawr/UdpBatch.h"
+
+#include "mn/allocator.h"
+#include "mn/atomic.h"
+#include "mn/log.h"
+#include "mn/mutex.h"
+#include "mn/system.h"
+#include "mn/thread.h"
+#include "mn/time.h"
+
+#include "re.h"
+
+#define RAWR_ENGINE_WORKERS_MAX 64
+#define RAWR_ENGINE_WORKER_CALLS_MAX 1024
+#define RAWR_ENGINE_WORKER_CONFERENCES_MAX 64
+#define RAWR_ENGINE_TICK_MS 20
+#define RAWR_ENGINE_START_WAIT_MS 5000
+#define RAWR_ENGINE_PORT_TRIES 64
+#define RAWR_ENGINE_PEER_HASH_SIZE 256
+
+/* one RTP packet per call per tick plus the odd RTCP report, anything over goes out in a second sendmmsg */
+#define RAWR_ENGINE_SEND_BATCH 256
+#define RAWR_ENGINE_RECV_BATCH 64
+
+/* sized for thousands of dialogs rather than the handful a single call needs */
+#define RAWR_ENGINE_SIP_HASH_SIZE 1024
+
+/* RTP then RTCP, the peer addresses start out as the peer's SDP gave them and move if it is heard from elsewhere */
+typedef struct rawr_EngineCall {
+    struct le peerLe[2];
+    struct sa peers[2];
+    int latched[2];
+    rawr_Call *call;
+} rawr_EngineCall;
+
+typedef struct rawr_EngineWorker {
+    rawr_Engine *engine;
+    mn_thread_t thread;
+    mn_mutex_t mtx;
+    mn_atomic_t overruns;
+
+    /* calls assigned to the worker, including those still negotiating, only touched on the re thread */
+    int assigned;
+
+    /* calls being ticked and conferences mixed, guarded by mtx */
+    int callCount;
+    rawr_EngineCall *calls[RAWR_ENGINE_WORKER_CALLS_MAX];
+    int conferenceCount;
+    rawr_Conference *conferences[RAWR_ENGINE_WORKER_CONFERENCES_MAX];
+
+    /* every call on the worker shares one RTP/RTCP socket pair, incoming datagrams are routed by peer address */
+    RAWR_SOCK_TYPE fds[2];
+    int socketsOpen;
+    struct sa rtpAddr;
+    struct hash *peers[2];
+    rawr_UdpBatch *batch;
+} rawr_EngineWorker;
+
+typedef struct rawr_Engine {
+    mn_thread_t sipThread;
+    mn_atomic_t exiting;
+    mn_atomic_t callCount;
+    mn_atomic_t conferenceNext;
+    rawr_Semaphore *startSignal;
+    int startError;
+    int running;
+
+    struct dnsc *dnsClient;
+    struct tls *reTls;
+    struct sip *reSip;
+    struct sipsess_sock *reSipSessSock;
+    struct mqueue *reQueue;
+
+    /* every call the engine is hosting, only touched on the re thread */
+    rawr_Call **calls;
+    int callCapacity;
+
+    int workerCount;
+    int workersLaunched; /* a Start that failed partway only launched the first few */
+    rawr_EngineWorker *workers;
+} rawr_Engine;
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Engine_Exiting(rawr_Engine *engine)
+{
+    return (int)mn_atomic_load(&engine->exiting);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static bool rawr_Engine_RtpPeerCmp(struct le *le, void *arg)
+{
+    return sa_cmp(&((rawr_EngineCall *)le->data)->peers[0], (const struct sa *)arg, SA_ALL);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static bool rawr_Engine_RtcpPeerCmp(struct le *le, void *arg)
+{
+    return sa_cmp(&((rawr_EngineCall *)le->data)->peers[1], (const struct sa *)arg, SA_ALL);
+}
+
+/*
+ * a datagram from a peer address goes to that call. one from anywhere else is offered to each call yet to hear from
+ * its peer, and the call it authenticates for is latched to where it came from. an offer that fails costs an HMAC and
+ * can leave a stream behind in that call's SRTP context, which a datagram spoofing the peer's own address could do
+ * anyway, and once every call has heard from its peer nothing is offered at all
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Engine_Route(rawr_EngineWorker *worker, int rtcp, const struct sa *src, uint8_t *data, size_t len, uint64_t arrival)
+{
+    struct le *le = hash_lookup(worker->peers[rtcp], sa_hash(src, SA_ALL), rtcp ? rawr_Engine_RtcpPeerCmp : rawr_Engine_RtpPeerCmp, (void *)src);
+    rawr_EngineCall *engineCall;
+
+    if (le) {
+        engineCall = (rawr_EngineCall *)le->data;
+        if (rawr_Call_MediaRecv(engineCall->call, rtcp, src, data, len, arrival) == rawr_Success) engineCall->latched[rtcp] = 1;
+        return;
+    }
+
+    for (int i = 0; i < worker->callCount; i++) {
+        engineCall = worker->calls[i];
+        if (engineCall->latched[rtcp] || rawr_Call_MediaRecv(engineCall->call, rtcp, src, data, len, arrival)) continue;
+
+        re_printf("latched %s peer to %J\n", rtcp ? "RTCP" : "RTP", src);
+        rawr_Call_MediaLatch(engineCall->call, rtcp, src);
+
+        hash_unlink(&engineCall->peerLe[rtcp]);
+        engineCall->peers[rtcp] = *src;
+        engineCall->latched[rtcp] = 1;
+        hash_append(worker->peers[rtcp], sa_hash(src, SA_ALL), &engineCall->peerLe[rtcp], engineCall);
+        return;
+    }
+}
+
+// private handler ----------------------------------------------------------------------------------------------
+static void rawr_Engine_OnRtpRecv(const struct sa *src, uint8_t *data, size_t len, uint64_t arrival, void *arg)
+{
+    rawr_Engine_Route((rawr_EngineWorker *)arg, 0, src, data, len, arrival);
+}
+
+// private handler ----------------------------------------------------------------------------------------------
+static void rawr_Engine_OnRtcpRecv(const struct sa *src, uint8_t *data, size_t len, uint64_t arrival, void *arg)
+{
+    rawr_Engine_Route((rawr_EngineWorker *)arg, 1, src, data, len, arrival);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Engine_OpenSockets(rawr_EngineWorker *worker)
+{
+    struct sa rtcpAddr;
+
+    RAWR_GUARD(net_default_source_addr_get(AF_INET, &worker->rtpAddr));
+
+    /* RTCP goes on the odd port above RTP, same as a standalone call */
+    for (int i = 0; i < RAWR_ENGINE_PORT_TRIES; i++) {
+        sa_set_port(&worker->rtpAddr, ((rand_u16() % 16383) + 16384) & 0xfffe);
+        rtcpAddr = worker->rtpAddr;
+        sa_set_port(&rtcpAddr, sa_port(&worker->rtpAddr) + 1);
+
+        if (rawr_UdpBatch_Open(&worker->fds[0], &worker->rtpAddr)) continue;
+        if (rawr_UdpBatch_Open(&worker->fds[1], &rtcpAddr) == rawr_Success) {
+            worker->socketsOpen = 1;
+            return rawr_Success;
+        }
+
+        rawr_UdpBatch_Close(worker->fds[0]);
+    }
+
+    mn_log_error("could not find a free RTP port pair for a media worker");
+
+    return rawr_Error;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Engine_CloseSockets(rawr_EngineWorker *worker)
+{
+    if (!worker->socketsOpen) return;
+
+    rawr_UdpBatch_Close(worker->fds[0]);
+    rawr_UdpBatch_Close(worker->fds[1]);
+    worker->socketsOpen = 0;
+}
+
+// private thread -----------------------------------------------------------------------------------------------
+void rawr_Engine_WorkerThread(void *arg)
+{
+    RAWR_ASSERT(arg);
+
+    rawr_EngineWorker *worker = (rawr_EngineWorker *)arg;
+    const uint64_t ms_ns = mn_tstamp_convert(1, MN_TSTAMP_MS, MN_TSTAMP_NS);
+    const uint64_t tick_ns = RAWR_ENGINE_TICK_MS * ms_ns;
+    uint64_t deadline = mn_tstamp() + tick_ns;
+    uint64_t tstamp;
+
+    while (!rawr_Engine_Exiting(worker->engine)) {
+        tstamp = mn_tstamp();
+
+        /* between ticks, drain whatever arrives on the shared sockets */
+        if (tstamp < deadline) {
+            if (rawr_UdpBatch_Wait(worker->fds, 2, (int)((deadline - tstamp + ms_ns - 1) / ms_ns)) > 0) {
+                mn_mutex_lock(&worker->mtx);
+                if (rawr_UdpBatch_Recv(worker->batch, worker->fds[0], rawr_Engine_OnRtpRecv, worker) < 0) mn_log_error("RTP recv failed");
+                if (rawr_UdpBatch_Recv(worker->batch, worker->fds[1], rawr_Engine_OnRtcpRecv, worker) < 0) mn_log_error("RTCP recv failed");
+                mn_mutex_unlock(&worker->mtx);
+            }
+            continue;
+        }
+
+        /*
+         * every call queues its frame, then they all leave in one flush before any call can be detached. conference
+         * members only have their frame decoded here, their conference sends to them once all of it is collected
+         */
+        mn_mutex_lock(&worker->mtx);
+        for (int i = 0; i < worker->callCount; i++) {
+            rawr_Call *call = worker->calls[i]->call;
+            rawr_Conference *conference = rawr_Call_Conference(call);
+
+            if (conference ? rawr_Conference_Collect(conference, call) : rawr_Call_MediaTick(call)) {
+                mn_log_error("media tick failed");
+            }
+        }
+        for (int i = 0; i < worker->conferenceCount; i++) {
+            if (rawr_Conference_Tick(worker->conferences[i])) {
+                mn_log_error("conference tick failed");
+            }
+        }
+        if (rawr_UdpBatch_Flush(worker->batch) < 0) mn_log_error("media send failed");
+        mn_mutex_unlock(&worker->mtx);
+
+        deadline += tick_ns;
+        tstamp = mn_tstamp();
+        if (deadline <= tstamp) {
+            /* fell a whole tick behind, start a fresh deadline rather than bursting frames to catch up */
+            mn_atomic_fetch_add(&worker->overruns, 1);
+            deadline = tstamp + tick_ns;
+        }
+    }
+}
+
+// private handler ----------------------------------------------------------------------------------------------
+static void rawr_Engine_OnConnect(const struct sip_msg *msg, void *arg)
+{
+    RAWR_ASSERT(arg);
+    rawr_Engine *engine = (rawr_Engine *)arg;
+
+    (void)sip_treply(NULL, engine->reSip, msg, 486, "Busy Here");
+}
+
+// private handler ----------------------------------------------------------------------------------------------
+static void rawr_Engine_OnExit(void *arg)
+{
+    (void)arg;
+
+    /* stop libre main loop */
+    re_cancel();
+}
+
+/* registers the call and starts it, or leaves it stopped when the engine is at capacity */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Engine_StartCall(rawr_Engine *engine, rawr_Call *call)
+{
+    const int callCount = (int)mn_atomic_load(&engine->callCount);
+
+    if (callCount == engine->callCapacity) {
+        mn_log_error("engine is hosting %d calls, no room for another", callCount);
+        rawr_Call_EngineStop(call);
+        return;
+    }
+
+    engine->calls[callCount] = call;
+    mn_atomic_store(&engine->callCount, callCount + 1);
+
+    rawr_Call_EngineStart(call);
+}
+
+// private handler ----------------------------------------------------------------------------------------------
+static void rawr_Engine_OnMessage(int id, void *data, void *arg)
+{
+    RAWR_ASSERT(arg);
+    rawr_Engine *engine = (rawr_Engine *)arg;
+    rawr_Call *call = (rawr_Call *)data;
+
+    switch ((rawr_EngineMsg)id) {
+    case rawr_EngineMsg_CallStart:
+        rawr_Engine_StartCall(engine, call);
+        break;
+    case rawr_EngineMsg_CallStop:
+        rawr_Call_EngineStop(call);
+        break;
+    case rawr_EngineMsg_Stop:
+        /* each call removes itself as it stops, so walk from the back */
+        for (int i = (int)mn_atomic_load(&engine->callCount) - 1; i >= 0; i--) {
+            rawr_Call_EngineStop(engine->calls[i]);
+        }
+
+        /* wait for pending transactions to finish, the exit handler then ends re_main */
+        sip_close(engine->reSip, false);
+        break;
+    }
+}
+
+// private thread -----------------------------------------------------------------------------------------------
+void rawr_Engine_SipThread(void *arg)
+{
+    RAWR_ASSERT(arg);
+
+    struct sa nsv[16];
+    struct sa localSipSA;
+    uint32_t nameServerCount;
+    int err;
+    int signalled = 0;
+    rawr_Engine *engine = (rawr_Engine *)arg;
+
+    /* a private re context, so standalone calls in the same process keep their own */
+    err = re_thread_init();
+    if (err == ENOSYS) {
+        /* no pthreads in this re build, share the global context instead */
+        err = 0;
+    } else if (err) {
+        mn_log_error("unable to set up re thread: %s", strerror(err));
+        goto cleanup;
+    }
+
+    nameServerCount = ARRAY_SIZE(nsv);
+
+    /* fetch list of DNS server IP addresses */
+    err = dns_srv_get(NULL, 0, nsv, &nameServerCount);
+    if (err) {
+        mn_log_error("unable to get dns servers: %s", strerror(err));
+        goto cleanup;
+    }
+
+    /* create DNS client */
+    err = dnsc_alloc(&engine->dnsClient, NULL, nsv, nameServerCount);
+    if (err) {
+        mn_log_error("unable to create dns client: %s", strerror(err));
+        goto cleanup;
+    }
+
+    /* create SIP stack instance */
+    err = sip_alloc(&engine->reSip, engine->dnsClient, RAWR_ENGINE_SIP_HASH_SIZE, RAWR_ENGINE_SIP_HASH_SIZE, RAWR_ENGINE_SIP_HASH_SIZE, "RAWR v0.9.1", rawr_Engine_OnExit, engine);
+    if (err) {
+        mn_log_error("sip error: %s", strerror(err));
+        goto cleanup;
+    }
+
+    /* fetch local IP address */
+    err = net_default_source_addr_get(AF_INET, &localSipSA);
+    if (err) {
+        mn_log_error("local address error: %s", strerror(err));
+        goto cleanup;
+    }
+
+    sa_set_port(&localSipSA, 0);
+
+    /* add supported SIP transports */
+    err = tls_alloc(&engine->reTls, TLS_METHOD_SSLV23, "client.pem", "");
+    if (err) {
+        /* the certificate is only offered to servers that ask, OpenSSL 3 refuses the SHA-1 signed one we ship */
+        mn_log_warning("client.pem unusable, connecting without a client certificate");
+        err = tls_alloc(&engine->reTls, TLS_METHOD_SSLV23, NULL, NULL);
+    }
+    if (err) {
+        mn_log_error("tls_alloc error: %s", strerror(err));
+        goto cleanup;
+    }
+
+    err = sip_transp_add(engine->reSip, SIP_TRANSP_TLS, &localSipSA, engine->reTls);
+    if (err) {
+        mn_log_error("transport error: %s", strerror(err));
+        goto cleanup;
+    }
+
+    /* create SIP session socket */
+    err = sipsess_listen(&engine->reSipSessSock, engine->reSip, RAWR_ENGINE_SIP_HASH_SIZE, rawr_Engine_OnConnect, engine);
+    if (err) {
+        mn_log_error("session listen error: %s", strerror(err));
+        goto cleanup;
+    }
+
+    /* the way other threads get work onto this one */
+    err = mqueue_alloc(&engine->reQueue, rawr_Engine_OnMessage, engine);
+    if (err) {
+        mn_log_error("mqueue error: %s", strerror(err));
+        goto cleanup;
+    }
+
+    re_printf("engine SIP address: %J\n", &localSipSA);
+
+    rawr_Semaphore_Post(engine->startSignal);
+    signalled = 1;
+
+    err = re_main(NULL);
+    if (err) {
+        mn_log_error("re_main exited with error: %s", strerror(err));
+    }
+
+cleanup:
+
+    if (!signalled) {
+        engine->startError = err;
+        rawr_Semaphore_Post(engine->startSignal);
+    }
+
+    engine->reQueue = mem_deref(engine->reQueue);
+    engine->reSipSessSock = mem_deref(engine->reSipSessSock);
+    engine->reSip = mem_deref(engine->reSip);
+    engine->reTls = mem_deref(engine->reTls);
+    engine->dnsClient = mem_deref(engine->dnsClient);
+
+    re_thread_close();
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Setup(rawr_Engine **out_engine, int workerCount)
+{
+    RAWR_ASSERT(out_engine && workerCount >= 0);
+
+    rawr_Engine *engine;
+    mn_system_t system;
+
+    RAWR_GUARD_NULL(engine = MN_MEM_ACQUIRE(sizeof(*engine)));
+    memset(engine, 0, sizeof(*engine));
+
+    if (!workerCount) {
+        RAWR_GUARD_CLEANUP(mn_system_setup(&system));
+        workerCount = (int)mn_system_cpu_count(&system);
+        mn_system_cleanup(&system);
+    }
+
+    if (workerCount < 1) workerCount = 1;
+    if (workerCount > RAWR_ENGINE_WORKERS_MAX) workerCount = RAWR_ENGINE_WORKERS_MAX;
+
+    engine->workerCount = workerCount;
+    engine->callCapacity = workerCount * RAWR_ENGINE_WORKER_CALLS_MAX;
+
+    RAWR_GUARD_NULL_CLEANUP(engine->workers = MN_MEM_ACQUIRE(workerCount * sizeof(*engine->workers)));
+    memset(engine->workers, 0, workerCount * sizeof(*engine->workers));
+
+    RAWR_GUARD_NULL_CLEANUP(engine->calls = MN_MEM_ACQUIRE(engine->callCapacity * sizeof(*engine->calls)));
+
+    for (int i = 0; i < workerCount; i++) {
+        rawr_EngineWorker *worker = engine->workers + i;
+
+        worker->engine = engine;
+        RAWR_GUARD_CLEANUP(mn_mutex_setup(&worker->mtx));
+        RAWR_GUARD_CLEANUP(hash_alloc(&worker->peers[0], RAWR_ENGINE_PEER_HASH_SIZE));
+        RAWR_GUARD_CLEANUP(hash_alloc(&worker->peers[1], RAWR_ENGINE_PEER_HASH_SIZE));
+        RAWR_GUARD_CLEANUP(rawr_UdpBatch_Setup(&worker->batch, RAWR_ENGINE_SEND_BATCH, RAWR_ENGINE_RECV_BATCH));
+    }
+
+    RAWR_GUARD_CLEANUP(rawr_Semaphore_Setup(&engine->startSignal));
+
+    *out_engine = engine;
+
+    return rawr_Success;
+
+cleanup:
+    if (engine->workers) {
+        for (int i = 0; i < workerCount; i++) {
+            engine->workers[i].peers[0] = mem_deref(engine->workers[i].peers[0]);
+            engine->workers[i].peers[1] = mem_deref(engine->workers[i].peers[1]);
+            if (engine->workers[i].batch) rawr_UdpBatch_Cleanup(engine->workers[i].batch);
+        }
+        MN_MEM_RELEASE(engine->workers);
+    }
+    if (engine->calls) MN_MEM_RELEASE(engine->calls);
+    MN_MEM_RELEASE(engine);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Engine_Cleanup(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine && !engine->running);
+
+    for (int i = 0; i < engine->workerCount; i++) {
+        rawr_EngineWorker *worker = engine->workers + i;
+
+        mn_mutex_cleanup(&worker->mtx);
+        worker->peers[0] = mem_deref(worker->peers[0]);
+        worker->peers[1] = mem_deref(worker->peers[1]);
+        rawr_UdpBatch_Cleanup(worker->batch);
+    }
+
+    rawr_Semaphore_Cleanup(engine->startSignal);
+    MN_MEM_RELEASE(engine->calls);
+    MN_MEM_RELEASE(engine->workers);
+    MN_MEM_RELEASE(engine);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Start(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine && !engine->running);
+
+    mn_atomic_store(&engine->exiting, 0);
+    engine->startError = 0;
+
+    RAWR_GUARD(mn_thread_launch(&engine->sipThread, rawr_Engine_SipThread, engine));
+
+    /* the sip thread signals once its stack is listening, or once it has given up */
+    if (rawr_Semaphore_Wait(engine->startSignal, RAWR_ENGINE_START_WAIT_MS) || engine->startError) {
+        mn_log_error("engine SIP thread failed to start");
+        if (engine->reQueue) mqueue_push(engine->reQueue, rawr_EngineMsg_Stop, NULL);
+        mn_thread_join(&engine->sipThread);
+        return rawr_Error;
+    }
+
+    engine->running = 1;
+    engine->workersLaunched = 0;
+
+    for (int i = 0; i < engine->workerCount; i++) {
+        RAWR_GUARD_CLEANUP(rawr_Engine_OpenSockets(engine->workers + i));
+        RAWR_GUARD_CLEANUP(mn_thread_launch(&engine->workers[i].thread, rawr_Engine_WorkerThread, engine->workers + i));
+        engine->workersLaunched++;
+    }
+
+    mn_log_info("engine started with %d media workers", engine->workerCount);
+
+    return rawr_Success;
+
+cleanup:
+    rawr_Engine_Stop(engine);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Stop(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine);
+
+    if (!engine->running) return rawr_Success;
+
+    RAWR_GUARD(rawr_Engine_Post(engine, rawr_EngineMsg_Stop, NULL));
+    mn_thread_join(&engine->sipThread);
+
+    mn_atomic_store(&engine->exiting, 1);
+    for (int i = 0; i < engine->workersLaunched; i++) {
+        mn_thread_join(&engine->workers[i].thread);
+    }
+    for (int i = 0; i < engine->workerCount; i++) {
+        rawr_Engine_CloseSockets(engine->workers + i);
+    }
+
+    engine->workersLaunched = 0;
+    engine->running = 0;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_WorkerCount(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine);
+    return engine->workerCount;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_CallCount(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine);
+    return (int)mn_atomic_load(&engine->callCount);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_Engine_Overruns(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine);
+
+    uint64_t overruns = 0;
+
+    for (int i = 0; i < engine->workerCount; i++) {
+        overruns += mn_atomic_load(&engine->workers[i].overruns);
+    }
+
+    return overruns;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+struct sip *rawr_Engine_Sip(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine);
+    return engine->reSip;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+struct sipsess_sock *rawr_Engine_SipSessSock(rawr_Engine *engine)
+{
+    RAWR_ASSERT(engine);
+    return engine->reSipSessSock;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Post(rawr_Engine *engine, rawr_EngineMsg msg, rawr_Call *call)
+{
+    RAWR_ASSERT(engine && engine->reQueue);
+    RAWR_GUARD(mqueue_push(engine->reQueue, (int)msg, call));
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Engine_Remove(rawr_Engine *engine, rawr_Call *call)
+{
+    RAWR_ASSERT(engine && call);
+
+    const int callCount = (int)mn_atomic_load(&engine->callCount);
+
+    for (int i = 0; i < callCount; i++) {
+        if (engine->calls[i] != call) continue;
+
+        engine->calls[i] = engine->calls[callCount - 1];
+        mn_atomic_store(&engine->callCount, callCount - 1);
+        return;
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Attach(rawr_Engine *engine, rawr_Call *call)
+{
+    RAWR_ASSERT(engine && call);
+
+    rawr_Conference *conference = rawr_Call_Conference(call);
+    int index = 0;
+
+    for (int i = 1; i < engine->workerCount; i++) {
+        if (engine->workers[i].assigned < engine->workers[index].assigned) index = i;
+    }
+
+    /* a conference mixes on one worker, so its members all run there */
+    if (conference) index = rawr_Conference_Worker(conference);
+
+    RAWR_GUARD(engine->workers[index].assigned == RAWR_ENGINE_WORKER_CALLS_MAX);
+    engine->workers[index].assigned++;
+
+    return index;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Engine_LocalAddress(rawr_Engine *engine, int index, struct sa *out_rtp)
+{
+    RAWR_ASSERT(engine && out_rtp && index >= 0 && index < engine->workerCount);
+    *out_rtp = engine->workers[index].rtpAddr;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Activate(rawr_Engine *engine, rawr_Call *call, int index, const struct sa *rtpPeer, const struct sa *rtcpPeer)
+{
+    RAWR_ASSERT(engine && call && rtpPeer && rtcpPeer && index >= 0 && index < engine->workerCount);
+
+    rawr_EngineWorker *worker = engine->workers + index;
+    rawr_EngineCall *engineCall;
+
+    RAWR_GUARD_NULL(engineCall = MN_MEM_ACQUIRE(sizeof(*engineCall)));
+    memset(engineCall, 0, sizeof(*engineCall));
+
+    engineCall->call = call;
+    engineCall->peers[0] = *rtpPeer;
+    engineCall->peers[1] = *rtcpPeer;
+
+    mn_mutex_lock(&worker->mtx);
+    worker->calls[worker->callCount++] = engineCall;
+    hash_append(worker->peers[0], sa_hash(rtpPeer, SA_ALL), &engineCall->peerLe[0], engineCall);
+    hash_append(worker->peers[1], sa_hash(rtcpPeer, SA_ALL), &engineCall->peerLe[1], engineCall);
+    mn_mutex_unlock(&worker->mtx);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Engine_Detach(rawr_Engine *engine, rawr_Call *call, int index)
+{
+    RAWR_ASSERT(engine && call && index >= 0 && index < engine->workerCount);
+
+    rawr_EngineWorker *worker = engine->workers + index;
+    rawr_EngineCall *engineCall = NULL;
+
+    mn_mutex_lock(&worker->mtx);
+    for (int i = 0; i < worker->callCount; i++) {
+        if (worker->calls[i]->call != call) continue;
+
+        engineCall = worker->calls[i];
+        hash_unlink(&engineCall->peerLe[0]);
+        hash_unlink(&engineCall->peerLe[1]);
+        worker->calls[i] = worker->calls[--worker->callCount];
+        break;
+    }
+    mn_mutex_unlock(&worker->mtx);
+
+    if (engineCall) MN_MEM_RELEASE(engineCall);
+    worker->assigned--;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_Send(rawr_Engine *engine, int index, int rtcp, const struct sa *dst, const uint8_t *data, size_t len)
+{
+    RAWR_ASSERT(engine && index >= 0 && index < engine->workerCount);
+
+    rawr_EngineWorker *worker = engine->workers + index;
+
+    return rawr_UdpBatch_Queue(worker->batch, worker->fds[rtcp ? 1 : 0], dst, data, len);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Engine_AddConference(rawr_Engine *engine, rawr_Conference *conference)
+{
+    RAWR_ASSERT(engine && conference);
+
+    /* conferences are set up from any thread, so they take turns rather than reading the re thread's counts */
+    const int index = (int)(mn_atomic_fetch_add(&engine->conferenceNext, 1) % engine->workerCount);
+    rawr_EngineWorker *worker = engine->workers + index;
+    int ret = rawr_Error;
+
+    mn_mutex_lock(&worker->mtx);
+    if (worker->conferenceCount < RAWR_ENGINE_WORKER_CONFERENCES_MAX) {
+        worker->conferences[worker->conferenceCount++] = conference;
+        ret = index;
+    }
+    mn_mutex_unlock(&worker->mtx);
+
+    return ret;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Engine_RemoveConference(rawr_Engine *engine, rawr_Conference *conference, int index)
+{
+    RAWR_ASSERT(engine && conference && index >= 0 && index < engine->workerCount);
+
+    rawr_EngineWorker *worker = engine->workers + index;
+
+    mn_mutex_lock(&worker->mtx);
+    for (int i = 0; i < worker->conferenceCount; i++) {
+        if (worker->conferences[i] != conference) continue;
+
+        worker->conferences[i] = worker->conferences[--worker->conferenceCount];
+        break;
+    }
+    mn_mutex_unlock(&worker->mtx);
+}
@@ -0,0 +1,144 @@
+#include "rawr/Histogram.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+#include "mn/atomic.h"
+
+#include <string.h>
+
+#if RAWR_C_MSC
+#    include <intrin.h>
+#endif
+
+typedef struct rawr_Histogram {
+    mn_atomic_t sum;
+    mn_atomic_t buckets[RAWR_HISTOGRAM_BUCKETS];
+} rawr_Histogram;
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Histogram_Msb(uint64_t value)
+{
+#if RAWR_C_MSC
+    unsigned long index;
+    _BitScanReverse64(&index, value);
+    return (int)index;
+#else
+    return 63 - __builtin_clzll(value);
+#endif
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Histogram_Index(uint64_t value)
+{
+    int msb, index;
+
+    if (value < RAWR_HISTOGRAM_LINEAR) return (int)value;
+
+    /* the top SUB_BITS + 1 bits pick the bucket, the leading one only ever selects the upper half */
+    msb = rawr_Histogram_Msb(value);
+    index = RAWR_HISTOGRAM_LINEAR + (msb - RAWR_HISTOGRAM_SUB_BITS - 1) * (1 << RAWR_HISTOGRAM_SUB_BITS);
+    index += (int)(value >> (msb - RAWR_HISTOGRAM_SUB_BITS)) - (1 << RAWR_HISTOGRAM_SUB_BITS);
+
+    return index < RAWR_HISTOGRAM_BUCKETS ? index : RAWR_HISTOGRAM_BUCKETS - 1;
+}
+
+/* the lowest value that lands in bucket index */
+// private ------------------------------------------------------------------------------------------------------
+static uint64_t rawr_Histogram_Lowest(int index)
+{
+    int magnitude, sub;
+
+    if (index < RAWR_HISTOGRAM_LINEAR) return (uint64_t)index;
+
+    magnitude = (index - RAWR_HISTOGRAM_LINEAR) >> RAWR_HISTOGRAM_SUB_BITS;
+    sub = (index - RAWR_HISTOGRAM_LINEAR) & ((1 << RAWR_HISTOGRAM_SUB_BITS) - 1);
+
+    return (uint64_t)((1 << RAWR_HISTOGRAM_SUB_BITS) + sub) << (magnitude + 1);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Histogram_Setup(rawr_Histogram **out_histogram)
+{
+    RAWR_ASSERT(out_histogram);
+
+    RAWR_GUARD_NULL(*out_histogram = MN_MEM_ACQUIRE(sizeof(**out_histogram)));
+    rawr_Histogram_Reset(*out_histogram);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Histogram_Cleanup(rawr_Histogram *histogram)
+{
+    RAWR_ASSERT(histogram);
+    MN_MEM_RELEASE(histogram);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Histogram_Reset(rawr_Histogram *histogram)
+{
+    RAWR_ASSERT(histogram);
+
+    mn_atomic_store(&histogram->sum, 0);
+    for (int i = 0; i < RAWR_HISTOGRAM_BUCKETS; i++) {
+        mn_atomic_store(&histogram->buckets[i], 0);
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Histogram_Record(rawr_Histogram *histogram, uint64_t value)
+{
+    RAWR_ASSERT(histogram);
+
+    mn_atomic_fetch_add(&histogram->buckets[rawr_Histogram_Index(value)], 1);
+    mn_atomic_fetch_add(&histogram->sum, value);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Histogram_Snapshot(rawr_Histogram *histogram, rawr_HistogramSnapshot *out_snapshot)
+{
+    RAWR_ASSERT(histogram && out_snapshot);
+
+    out_snapshot->count = 0;
+    out_snapshot->sum = mn_atomic_load_explicit(&histogram->sum, MN_ATOMIC_RELAXED);
+
+    for (int i = 0; i < RAWR_HISTOGRAM_BUCKETS; i++) {
+        out_snapshot->buckets[i] = mn_atomic_load_explicit(&histogram->buckets[i], MN_ATOMIC_RELAXED);
+        out_snapshot->count += out_snapshot->buckets[i];
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+uint64_t rawr_Histogram_Percentile(const rawr_HistogramSnapshot *snapshot, double percentile)
+{
+    RAWR_ASSERT(snapshot);
+
+    uint64_t rank, seen = 0;
+
+    if (!snapshot->count) return 0;
+
+    if (percentile < 0.0) percentile = 0.0;
+    if (percentile > 100.0) percentile = 100.0;
+
+    rank = (uint64_t)((percentile / 100.0) * snapshot->count + 0.5);
+    if (rank < 1) rank = 1;
+
+    for (int i = 0; i < RAWR_HISTOGRAM_BUCKETS; i++) {
+        seen += snapshot->buckets[i];
+        if (seen >= rank) {
+            if (i == RAWR_HISTOGRAM_BUCKETS - 1) return rawr_Histogram_Lowest(i);
+            return rawr_Histogram_Lowest(i + 1) - 1;
+        }
+    }
+
+    return rawr_Histogram_Lowest(RAWR_HISTOGRAM_BUCKETS - 1);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_Histogram_Mean(const rawr_HistogramSnapshot *snapshot)
+{
+    RAWR_ASSERT(snapshot);
+
+    if (!snapshot->count) return 0.0;
+    return (double)snapshot->sum / (double)snapshot->count;
+}
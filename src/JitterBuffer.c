@@ -0,0 +1,414 @@
+#include "rawr/JitterBuffer.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+#include "mn/mutex.h"
+#include "mn/time.h"
+
+#include <math.h>
+#include <string.h>
+
+#define RAWR_JITTERBUFFER_MASK (RAWR_JITTERBUFFER_SLOTS - 1)
+
+RAWR_STATIC_ASSERT((RAWR_JITTERBUFFER_SLOTS & RAWR_JITTERBUFFER_MASK) == 0);
+
+typedef struct rawr_JitterBufferSlot {
+    int used;
+    uint16_t seq;
+    uint32_t ts;
+    int byteLen;
+    uint8_t payload[RAWR_JITTERBUFFER_PAYLOAD_MAX];
+} rawr_JitterBufferSlot;
+
+typedef struct rawr_JitterBuffer {
+    mn_mutex_t mtx;
+    int clockRate;
+    int frameSamples;
+    int minDelay;
+    int maxDelay;
+
+    int started;
+    int playing;
+    int playedAny;
+    int count;
+
+    uint16_t playSeq;
+    uint32_t playTs;
+    uint16_t highSeq;
+    uint32_t highTs;
+
+    uint32_t lastTs;
+    uint64_t lastArrival;
+    double jitter;
+    double targetDelay;
+
+    rawr_JitterBufferStats stats;
+    rawr_JitterBufferSlot slots[RAWR_JITTERBUFFER_SLOTS];
+} rawr_JitterBuffer;
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_JitterBuffer_SeqLess(uint16_t x, uint16_t y)
+{
+    return ((int16_t)(x - y)) < 0;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_JitterBuffer_MsToClock(rawr_JitterBuffer *jb, int ms)
+{
+    return (int)(((int64_t)ms * jb->clockRate) / 1000);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_JitterBuffer_ClockToMs(rawr_JitterBuffer *jb, double clock)
+{
+    return (int)((clock * 1000.0) / jb->clockRate);
+}
+
+/* amount of audio held from the next frame due up to the end of the newest frame, in clock units */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_JitterBuffer_CurrentDelay(rawr_JitterBuffer *jb)
+{
+    if (!jb->count) return 0;
+    return (int32_t)(jb->highTs - jb->playTs) + jb->frameSamples;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_JitterBuffer_Clear(rawr_JitterBuffer *jb)
+{
+    for (int i = 0; i < RAWR_JITTERBUFFER_SLOTS; i++) {
+        jb->slots[i].used = 0;
+    }
+    jb->count = 0;
+    jb->playing = 0;
+}
+
+/* resume playout at the oldest frame we hold, so a gap in arrival does not become added latency */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_JitterBuffer_Resync(rawr_JitterBuffer *jb)
+{
+    rawr_JitterBufferSlot *oldest = NULL;
+
+    for (int i = 0; i < RAWR_JITTERBUFFER_SLOTS; i++) {
+        rawr_JitterBufferSlot *slot = &jb->slots[i];
+        if (!slot->used) continue;
+        if (!oldest || rawr_JitterBuffer_SeqLess(slot->seq, oldest->seq)) oldest = slot;
+    }
+
+    if (oldest) {
+        jb->playSeq = oldest->seq;
+        jb->playTs = oldest->ts;
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_JitterBuffer_UpdateJitter(rawr_JitterBuffer *jb, uint32_t ts)
+{
+    const uint64_t arrival = mn_tstamp();
+
+    if (jb->lastArrival) {
+        /* RFC 3550 A.8: D(i-1,i) = (Rj - Ri) - (Sj - Si), J += (|D| - J) / 16 */
+        double arrivalDelta = (double)(arrival - jb->lastArrival) * jb->clockRate / (double)MN_TSTAMP_NS;
+        double d = arrivalDelta - (double)(int32_t)(ts - jb->lastTs);
+        jb->jitter += (fabs(d) - jb->jitter) / 16.0;
+    }
+
+    jb->lastArrival = arrival;
+    jb->lastTs = ts;
+
+    /* grow at once when jitter rises, shrink slowly when it settles */
+    double desired = jb->frameSamples + RAWR_JITTERBUFFER_JITTER_FACTOR * jb->jitter;
+    if (desired > jb->targetDelay) {
+        jb->targetDelay = desired;
+    } else {
+        jb->targetDelay += (desired - jb->targetDelay) / 64.0;
+    }
+
+    if (jb->targetDelay < jb->minDelay) jb->targetDelay = jb->minDelay;
+    if (jb->targetDelay > jb->maxDelay) jb->targetDelay = jb->maxDelay;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_JitterBuffer_Setup(rawr_JitterBuffer **out_jb, int clockRate, int frameSamples, int minDelayMs, int maxDelayMs)
+{
+    RAWR_ASSERT(out_jb && clockRate > 0 && frameSamples > 0);
+    RAWR_ASSERT(minDelayMs <= maxDelayMs);
+
+    rawr_JitterBuffer *jb;
+
+    RAWR_GUARD_NULL(jb = MN_MEM_ACQUIRE(sizeof(*jb)));
+    memset(jb, 0, sizeof(*jb));
+
+    jb->clockRate = clockRate;
+    jb->frameSamples = frameSamples;
+    jb->minDelay = rawr_JitterBuffer_MsToClock(jb, minDelayMs);
+    jb->maxDelay = rawr_JitterBuffer_MsToClock(jb, maxDelayMs);
+
+    /* never target more audio than the slots can hold */
+    if (jb->maxDelay > frameSamples * (RAWR_JITTERBUFFER_SLOTS / 2)) jb->maxDelay = frameSamples * (RAWR_JITTERBUFFER_SLOTS / 2);
+    if (jb->minDelay < frameSamples) jb->minDelay = frameSamples;
+    if (jb->minDelay > jb->maxDelay) jb->minDelay = jb->maxDelay;
+    jb->targetDelay = jb->minDelay;
+
+    RAWR_GUARD_CLEANUP(mn_mutex_setup(&jb->mtx));
+
+    *out_jb = jb;
+
+    return rawr_Success;
+
+cleanup:
+    MN_MEM_RELEASE(jb);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_JitterBuffer_Cleanup(rawr_JitterBuffer *jb)
+{
+    RAWR_ASSERT(jb);
+
+    mn_mutex_cleanup(&jb->mtx);
+    MN_MEM_RELEASE(jb);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_JitterBuffer_Flush(rawr_JitterBuffer *jb)
+{
+    RAWR_ASSERT(jb);
+
+    mn_mutex_lock(&jb->mtx);
+    rawr_JitterBuffer_Clear(jb);
+    jb->started = 0;
+    jb->playedAny = 0;
+    jb->lastArrival = 0;
+    jb->jitter = 0.0;
+    jb->targetDelay = jb->minDelay;
+    mn_mutex_unlock(&jb->mtx);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_JitterBuffer_Put(rawr_JitterBuffer *jb, uint16_t seq, uint32_t ts, const void *payload, int byteLen)
+{
+    RAWR_ASSERT(jb && payload);
+
+    RAWR_GUARD(byteLen < 0 || byteLen > RAWR_JITTERBUFFER_PAYLOAD_MAX);
+
+    mn_mutex_lock(&jb->mtx);
+
+    if (!jb->started) {
+        jb->started = 1;
+        jb->playSeq = jb->highSeq = seq;
+        jb->playTs = jb->highTs = ts;
+    } else if (rawr_JitterBuffer_SeqLess(seq, jb->playSeq)) {
+        if (jb->playedAny || (uint16_t)(jb->playSeq - seq) >= RAWR_JITTERBUFFER_SLOTS / 2) {
+            jb->stats.late++;
+            goto out;
+        }
+
+        /* reordered ahead of the first packet before playout began, start from it instead */
+        jb->playSeq = seq;
+        jb->playTs = ts;
+    }
+
+    if (seq == (uint16_t)(jb->highSeq + 1) && (int32_t)(ts - jb->highTs) > jb->frameSamples) {
+        /*
+         * a sender in DTX lets the timestamp run on without spending sequence numbers. when this starts a new talk
+         * spurt while we are rebuffering, what is left of the last one was due long ago and would only add delay
+         */
+        jb->stats.spurts++;
+        if (jb->count && !jb->playing) {
+            rawr_JitterBuffer_Clear(jb);
+            jb->playSeq = jb->highSeq = seq;
+            jb->playTs = jb->highTs = ts;
+        }
+    }
+
+    if (jb->playing && !jb->count) {
+        /*
+         * the playout clock ran on while nothing was buffered. a frame still ahead of it ends a DTX gap and plays on
+         * time, one already behind it means we really ran dry and have to rebuffer
+         */
+        const int32_t ahead = (int32_t)(ts - jb->playTs);
+        if (ahead < 0) jb->stats.underflow++;
+        if (ahead < 0 || ahead > jb->maxDelay) jb->playing = 0;
+    }
+
+    if ((uint16_t)(seq - jb->playSeq) >= RAWR_JITTERBUFFER_SLOTS) {
+        /* too far ahead of playout to fit, the stream jumped so start over from here */
+        jb->stats.overflow++;
+        rawr_JitterBuffer_Clear(jb);
+        jb->playSeq = jb->highSeq = seq;
+        jb->playTs = jb->highTs = ts;
+    }
+
+    rawr_JitterBufferSlot *slot = &jb->slots[seq & RAWR_JITTERBUFFER_MASK];
+    if (slot->used) {
+        if (slot->seq == seq) {
+            jb->stats.duplicate++;
+            goto out;
+        }
+
+        /* stale frame left behind by a resync, the newer one wins */
+        slot->used = 0;
+        jb->count--;
+    }
+
+    slot->used = 1;
+    slot->seq = seq;
+    slot->ts = ts;
+    slot->byteLen = byteLen;
+    memcpy(slot->payload, payload, byteLen);
+    jb->count++;
+    jb->stats.put++;
+
+    if (jb->count == 1 || rawr_JitterBuffer_SeqLess(jb->highSeq, seq)) {
+        jb->highSeq = seq;
+        jb->highTs = ts;
+    }
+
+    rawr_JitterBuffer_UpdateJitter(jb, ts);
+
+out:
+    mn_mutex_unlock(&jb->mtx);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+rawr_JitterBufferResult rawr_JitterBuffer_Get(rawr_JitterBuffer *jb, void *payload, int *out_byteLen)
+{
+    RAWR_ASSERT(jb && payload && out_byteLen);
+
+    rawr_JitterBufferResult result;
+    rawr_JitterBufferSlot *slot;
+    int delay, target;
+
+    *out_byteLen = 0;
+
+    mn_mutex_lock(&jb->mtx);
+
+    delay = rawr_JitterBuffer_CurrentDelay(jb);
+    target = (int)jb->targetDelay;
+
+    if (!jb->playing) {
+        /* measure from the oldest frame held, playTs is stale after an underflow or a DTX gap */
+        rawr_JitterBuffer_Resync(jb);
+        delay = rawr_JitterBuffer_CurrentDelay(jb);
+
+        if (!jb->count || delay < target) {
+            result = rawr_JitterBufferResult_Buffering;
+            goto out;
+        }
+
+        jb->playing = 1;
+    }
+
+    if (!jb->count) {
+        /* keep the clock running, the next Put tells a DTX gap from an underflow */
+        jb->playTs += jb->frameSamples;
+        result = rawr_JitterBufferResult_Empty;
+        goto out;
+    }
+
+    if (delay < target / 2) {
+        /* jitter grew past what we hold, hold playout for a frame to deepen the buffer */
+        jb->stats.inserted++;
+        result = rawr_JitterBufferResult_Buffering;
+        goto out;
+    }
+
+    slot = &jb->slots[jb->playSeq & RAWR_JITTERBUFFER_MASK];
+
+    if (delay > 2 * target + 3 * jb->frameSamples) {
+        /* far more buffered than playout stretching could bring down in time, discard the oldest frame */
+        jb->stats.dropped++;
+        if (slot->used && slot->seq == jb->playSeq) {
+            slot->used = 0;
+            jb->count--;
+        }
+        jb->playSeq++;
+        jb->playTs += jb->frameSamples;
+        slot = &jb->slots[jb->playSeq & RAWR_JITTERBUFFER_MASK];
+    }
+
+    if (slot->used && slot->seq == jb->playSeq && (int32_t)(slot->ts - jb->playTs) >= jb->frameSamples) {
+        /* inside a DTX gap, hold the frame until its timestamp comes round */
+        jb->stats.silence++;
+        jb->playTs += jb->frameSamples;
+        result = rawr_JitterBufferResult_Silence;
+        goto out;
+    }
+
+    if (slot->used && slot->seq == jb->playSeq) {
+        jb->playTs = slot->ts;
+        memcpy(payload, slot->payload, slot->byteLen);
+        *out_byteLen = slot->byteLen;
+        slot->used = 0;
+        jb->count--;
+        result = rawr_JitterBufferResult_Frame;
+    } else {
+        jb->stats.lost++;
+        result = rawr_JitterBufferResult_Lost;
+
+        const uint16_t nextSeq = jb->playSeq + 1;
+        slot = &jb->slots[nextSeq & RAWR_JITTERBUFFER_MASK];
+        if (slot->used && slot->seq == nextSeq) {
+            jb->stats.recoverable++;
+            memcpy(payload, slot->payload, slot->byteLen);
+            *out_byteLen = slot->byteLen;
+        }
+    }
+
+    jb->playSeq++;
+    jb->playTs += jb->frameSamples;
+    jb->playedAny = 1;
+
+out:
+    mn_mutex_unlock(&jb->mtx);
+
+    return result;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_JitterBuffer_Delay(rawr_JitterBuffer *jb)
+{
+    RAWR_ASSERT(jb);
+
+    mn_mutex_lock(&jb->mtx);
+    int delay = rawr_JitterBuffer_ClockToMs(jb, rawr_JitterBuffer_CurrentDelay(jb));
+    mn_mutex_unlock(&jb->mtx);
+
+    return delay;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_JitterBuffer_TargetDelay(rawr_JitterBuffer *jb)
+{
+    RAWR_ASSERT(jb);
+
+    mn_mutex_lock(&jb->mtx);
+    int target = rawr_JitterBuffer_ClockToMs(jb, jb->targetDelay);
+    mn_mutex_unlock(&jb->mtx);
+
+    return target;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_JitterBuffer_Jitter(rawr_JitterBuffer *jb)
+{
+    RAWR_ASSERT(jb);
+
+    mn_mutex_lock(&jb->mtx);
+    int jitter = rawr_JitterBuffer_ClockToMs(jb, jb->jitter);
+    mn_mutex_unlock(&jb->mtx);
+
+    return jitter;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_JitterBuffer_Stats(rawr_JitterBuffer *jb, rawr_JitterBufferStats *out_stats)
+{
+    RAWR_ASSERT(jb && out_stats);
+
+    mn_mutex_lock(&jb->mtx);
+    *out_stats = jb->stats;
+    mn_mutex_unlock(&jb->mtx);
+}
@@ -0,0 +1,183 @@
+#include "rawr/Latency.h"
+#include "rawr/Stretch.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+#include "mn/atomic.h"
+#include "mn/time.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* writes the depth is smoothed over, so a frame's sawtooth and a late one here and there do not stretch anything */
+#define RAWR_LATENCY_SMOOTH 8.0
+
+typedef struct rawr_Latency {
+    rawr_Stretch *stretch;
+    rawr_AudioSample *stretched;
+    int sampleRate;
+    int frameSize;
+    int minMs;
+    int maxMs;
+    mn_atomic_t target; /* ms */
+
+    /* when the next write is due, and how late the last RAWR_LATENCY_WINDOW landed in microseconds */
+    uint64_t due;
+    int late[RAWR_LATENCY_WINDOW];
+    int sorted[RAWR_LATENCY_WINDOW];
+    int lateCount;
+    int lateNext;
+    int sinceUpdate;
+
+    double level; /* ms queued midway through a frame, smoothed, negative until the first write */
+    int stretching;
+} rawr_Latency;
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Latency_Compare(const void *a, const void *b)
+{
+    return *(const int *)a - *(const int *)b;
+}
+
+/* times a write against the schedule, taking the target again every RAWR_LATENCY_UPDATE writes */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Latency_Record(rawr_Latency *latency, int deviceFrames)
+{
+    const uint64_t now = mn_tstamp();
+    const int64_t frameNs = (int64_t)latency->frameSize * MN_TSTAMP_NS / latency->sampleRate;
+    int64_t late = (int64_t)(now - latency->due);
+    int target, p95, count;
+
+    /*
+     * a write earlier than any before it is where the schedule starts, and one far later is a writer coming back
+     * from a pause. the schedule creeps towards the writes, so a writer whose clock runs slow is not late forever
+     */
+    if (!latency->due || late > (int64_t)RAWR_LATENCY_RESTART_MS * 1000000) {
+        latency->due = now + frameNs;
+        return;
+    }
+    if (late < 0) {
+        latency->due = now;
+        late = 0;
+    }
+    latency->due += frameNs + late / RAWR_LATENCY_WINDOW;
+
+    if (late > (int64_t)latency->maxMs * 1000000) late = (int64_t)latency->maxMs * 1000000;
+    latency->late[latency->lateNext] = (int)(late / 1000);
+    latency->lateNext = (latency->lateNext + 1) % RAWR_LATENCY_WINDOW;
+    if (latency->lateCount < RAWR_LATENCY_WINDOW) latency->lateCount++;
+
+    if (++latency->sinceUpdate < RAWR_LATENCY_UPDATE) return;
+    latency->sinceUpdate = 0;
+
+    count = latency->lateCount;
+    memcpy(latency->sorted, latency->late, count * sizeof(int));
+    qsort(latency->sorted, count, sizeof(int), rawr_Latency_Compare);
+    p95 = latency->sorted[(count * 95) / 100];
+
+    /* late writes have to find the device a buffer's worth queued, and the depth is taken midway through a frame */
+    target = (p95 + 999) / 1000 + (deviceFrames * 1000 + latency->sampleRate - 1) / latency->sampleRate;
+    target += latency->frameSize * 500 / latency->sampleRate;
+
+    if (target < (int)mn_atomic_load(&latency->target) - 1) target = (int)mn_atomic_load(&latency->target) - 1;
+    if (target < latency->minMs) target = latency->minMs;
+    if (target > latency->maxMs) target = latency->maxMs;
+    mn_atomic_store(&latency->target, target);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Latency_Setup(rawr_Latency **out_latency, int sampleRate, int frameSize, int minMs, int maxMs)
+{
+    RAWR_ASSERT(out_latency);
+
+    rawr_Latency *latency;
+
+    RAWR_GUARD(minMs < 0 || maxMs < minMs || maxMs > RAWR_LATENCY_RESTART_MS);
+
+    RAWR_GUARD_NULL(latency = MN_MEM_ACQUIRE(sizeof(*latency)));
+    memset(latency, 0, sizeof(*latency));
+
+    latency->sampleRate = sampleRate;
+    latency->frameSize = frameSize;
+    latency->minMs = minMs;
+    latency->maxMs = maxMs;
+    latency->level = -1.0;
+    mn_atomic_store(&latency->target, minMs);
+
+    RAWR_GUARD_CLEANUP(rawr_Stretch_Setup(&latency->stretch, sampleRate, frameSize));
+    RAWR_GUARD_NULL_CLEANUP(latency->stretched = MN_MEM_ACQUIRE(rawr_Stretch_OutputMax(latency->stretch) * sizeof(rawr_AudioSample)));
+
+    *out_latency = latency;
+
+    return rawr_Success;
+
+cleanup:
+    if (latency->stretch) rawr_Stretch_Cleanup(latency->stretch);
+    MN_MEM_RELEASE(latency);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Latency_Cleanup(rawr_Latency *latency)
+{
+    RAWR_ASSERT(latency);
+
+    rawr_Stretch_Cleanup(latency->stretch);
+    MN_MEM_RELEASE(latency->stretched);
+    MN_MEM_RELEASE(latency);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Latency_OutputMax(rawr_Latency *latency)
+{
+    RAWR_ASSERT(latency);
+    return rawr_Stretch_OutputMax(latency->stretch);
+}
+
+/*
+ * stretches only while the smoothed depth and the depth right now agree, the smoothing lags a burst of writes. the
+ * band either side of the target is half a frame, wider than the longest period, so one stretch never overshoots
+ * into the other
+ */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Latency_Plan(rawr_Latency *latency, int queued, int room, int deviceFrames)
+{
+    RAWR_ASSERT(latency);
+
+    const double band = latency->frameSize * 500.0 / latency->sampleRate;
+    const double depth = (queued + latency->frameSize / 2) * 1000.0 / latency->sampleRate;
+    int target;
+
+    rawr_Latency_Record(latency, deviceFrames);
+    target = (int)mn_atomic_load(&latency->target);
+
+    if (latency->level < 0.0) latency->level = depth;
+    latency->level += (depth - latency->level) / RAWR_LATENCY_SMOOTH;
+
+    latency->stretching = 0;
+    if (latency->level > target + band && depth > target + band) latency->stretching = 1;
+    if (latency->level < target - band && depth < target - band && room >= rawr_Stretch_OutputMax(latency->stretch)) latency->stretching = -1;
+
+    return latency->stretching;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Latency_Apply(rawr_Latency *latency, const rawr_AudioSample *frame, const rawr_AudioSample **out)
+{
+    RAWR_ASSERT(latency && frame && out);
+
+    *out = latency->stretched;
+    if (latency->stretching > 0) return rawr_Stretch_Accelerate(latency->stretch, frame, latency->stretched);
+    if (latency->stretching < 0) return rawr_Stretch_Expand(latency->stretch, frame, latency->stretched);
+
+    *out = frame;
+    return latency->frameSize;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Latency_Target(rawr_Latency *latency)
+{
+    RAWR_ASSERT(latency);
+    return (int)mn_atomic_load(&latency->target);
+}
@@ -0,0 +1,242 @@
+#include "rawr/Level.h"
+#include "rawr/Error.h"
+#include "rawr/Simd.h"
+
+#include <math.h>
+
+#if RAWR_SIMD_X86
+#    include <immintrin.h>
+#elif RAWR_SIMD_NEON
+#    include <arm_neon.h>
+#endif
+
+/* a slot holds the block's mean square below the peak, and a bit that tells a recorded block from an empty slot */
+#define RAWR_LEVEL_PEAK_SHIFT 32
+#define RAWR_LEVEL_RECORDED (1ull << 48)
+#define RAWR_LEVEL_FULL_SCALE 32768.0
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Level_MeasureScalar(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak)
+{
+    uint64_t sum = 0;
+    int peak = 0, magnitude;
+
+    for (int i = 0; i < count; i++) {
+        magnitude = samples[i] < 0 ? -samples[i] : samples[i];
+        sum += (uint64_t)(magnitude * magnitude);
+        if (magnitude > peak) peak = magnitude;
+    }
+
+    *out_sumSquares = sum;
+    *out_peak = peak;
+}
+
+#if RAWR_SIMD_X86
+/*
+ * madd leaves each pair's sum of squares in 32 bits, which only -32768 twice can push past the sign bit, so the
+ * lanes are widened as unsigned. the largest magnitude is taken from the max and min at the end, since abs of
+ * -32768 does not fit 16 bits
+ */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Level_MeasureSse(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak)
+{
+    const __m128i zero = _mm_setzero_si128();
+    __m128i sum = zero, squares, v;
+    __m128i maxs = _mm_set1_epi16(INT16_MIN);
+    __m128i mins = _mm_set1_epi16(INT16_MAX);
+    uint64_t sums[2], tailSum;
+    int16_t highs[8], lows[8];
+    int i, peak = 0, tailPeak;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(samples + i));
+        squares = _mm_madd_epi16(v, v);
+        sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(squares, zero));
+        sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(squares, zero));
+        maxs = _mm_max_epi16(maxs, v);
+        mins = _mm_min_epi16(mins, v);
+    }
+
+    _mm_storeu_si128((__m128i *)sums, sum);
+    _mm_storeu_si128((__m128i *)highs, maxs);
+    _mm_storeu_si128((__m128i *)lows, mins);
+
+    for (int l = 0; l < 8; l++) {
+        if (highs[l] > peak) peak = highs[l];
+        if (-lows[l] > peak) peak = -lows[l];
+    }
+
+    rawr_Level_MeasureScalar(samples + i, count - i, &tailSum, &tailPeak);
+
+    *out_sumSquares = sums[0] + sums[1] + tailSum;
+    *out_peak = tailPeak > peak ? tailPeak : peak;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Level_MeasureAvx2(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i sum = zero, squares, v;
+    __m256i maxs = _mm256_set1_epi16(INT16_MIN);
+    __m256i mins = _mm256_set1_epi16(INT16_MAX);
+    uint64_t sums[4], tailSum;
+    int16_t highs[16], lows[16];
+    int i, peak = 0, tailPeak;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        v = _mm256_loadu_si256((const __m256i *)(samples + i));
+        squares = _mm256_madd_epi16(v, v);
+        sum = _mm256_add_epi64(sum, _mm256_unpacklo_epi32(squares, zero));
+        sum = _mm256_add_epi64(sum, _mm256_unpackhi_epi32(squares, zero));
+        maxs = _mm256_max_epi16(maxs, v);
+        mins = _mm256_min_epi16(mins, v);
+    }
+
+    _mm256_storeu_si256((__m256i *)sums, sum);
+    _mm256_storeu_si256((__m256i *)highs, maxs);
+    _mm256_storeu_si256((__m256i *)lows, mins);
+
+    for (int l = 0; l < 16; l++) {
+        if (highs[l] > peak) peak = highs[l];
+        if (-lows[l] > peak) peak = -lows[l];
+    }
+
+    /* the tail runs non-VEX code, which pays for every call if the upper halves are left dirty */
+    _mm256_zeroupper();
+    rawr_Level_MeasureScalar(samples + i, count - i, &tailSum, &tailPeak);
+
+    *out_sumSquares = sums[0] + sums[1] + sums[2] + sums[3] + tailSum;
+    *out_peak = tailPeak > peak ? tailPeak : peak;
+}
+#elif RAWR_SIMD_NEON
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Level_MeasureNeon(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak)
+{
+    int64x2_t sum = vdupq_n_s64(0);
+    int16x8_t maxs = vdupq_n_s16(INT16_MIN);
+    int16x8_t mins = vdupq_n_s16(INT16_MAX);
+    int16x8_t v;
+    int16_t highs[8], lows[8];
+    uint64_t tailSum;
+    int i, peak = 0, tailPeak;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = vld1q_s16(samples + i);
+        sum = vpadalq_s32(sum, vmull_s16(vget_low_s16(v), vget_low_s16(v)));
+        sum = vpadalq_s32(sum, vmull_s16(vget_high_s16(v), vget_high_s16(v)));
+        maxs = vmaxq_s16(maxs, v);
+        mins = vminq_s16(mins, v);
+    }
+
+    vst1q_s16(highs, maxs);
+    vst1q_s16(lows, mins);
+
+    for (int l = 0; l < 8; l++) {
+        if (highs[l] > peak) peak = highs[l];
+        if (-lows[l] > peak) peak = -lows[l];
+    }
+
+    rawr_Level_MeasureScalar(samples + i, count - i, &tailSum, &tailPeak);
+
+    *out_sumSquares = (uint64_t)(vgetq_lane_s64(sum, 0) + vgetq_lane_s64(sum, 1)) + tailSum;
+    *out_peak = tailPeak > peak ? tailPeak : peak;
+}
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static rawr_LevelKernel rawr_Level_Kernel(void)
+{
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    (void)features;
+
+#if RAWR_SIMD_X86
+    if (features & rawr_SimdFeatures_AVX2) return rawr_Level_MeasureAvx2;
+    if (features & rawr_SimdFeatures_SSE2) return rawr_Level_MeasureSse;
+#elif RAWR_SIMD_NEON
+    if (features & rawr_SimdFeatures_NEON) return rawr_Level_MeasureNeon;
+#endif
+
+    return rawr_Level_MeasureScalar;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static double rawr_Level_Scale(double db)
+{
+    return fmax(0.0, fmin(1.0, 1.0 + db / RAWR_LEVEL_RANGE_DB));
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Level_Measure(const rawr_AudioSample *samples, int count, uint64_t *out_sumSquares, int *out_peak)
+{
+    RAWR_ASSERT(samples && out_sumSquares && out_peak);
+    rawr_Level_Kernel()(samples, count, out_sumSquares, out_peak);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_LevelMeter_Reset(rawr_LevelMeter *meter)
+{
+    RAWR_ASSERT(meter);
+
+    meter->kernel = rawr_Level_Kernel();
+    mn_atomic_store(&meter->head, 0);
+    for (int b = 0; b < RAWR_LEVEL_BLOCKS; b++) {
+        mn_atomic_store(&meter->blocks[b], 0);
+    }
+}
+
+/* one writer per meter, the device callback or loop */
+// --------------------------------------------------------------------------------------------------------------
+void rawr_LevelMeter_Record(rawr_LevelMeter *meter, const rawr_AudioSample *samples, int count)
+{
+    RAWR_ASSERT(meter && samples);
+
+    uint64_t sumSquares, head;
+    int peak;
+
+    if (count <= 0) return;
+
+    meter->kernel(samples, count, &sumSquares, &peak);
+
+    head = mn_atomic_load_explicit(&meter->head, MN_ATOMIC_RELAXED);
+    mn_atomic_store_explicit(&meter->blocks[head % RAWR_LEVEL_BLOCKS], (sumSquares / count) | ((uint64_t)peak << RAWR_LEVEL_PEAK_SHIFT) | RAWR_LEVEL_RECORDED, MN_ATOMIC_RELEASE);
+    mn_atomic_store_explicit(&meter->head, head + 1, MN_ATOMIC_RELAXED);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_LevelMeter_Rms(rawr_LevelMeter *meter)
+{
+    RAWR_ASSERT(meter);
+
+    uint64_t block, meanSquares = 0;
+    int recorded = 0;
+
+    for (int b = 0; b < RAWR_LEVEL_BLOCKS; b++) {
+        block = mn_atomic_load_explicit(&meter->blocks[b], MN_ATOMIC_ACQUIRE);
+        if (!(block & RAWR_LEVEL_RECORDED)) continue;
+
+        meanSquares += block & 0xffffffffu;
+        recorded++;
+    }
+
+    if (!meanSquares) return 0.0;
+    return rawr_Level_Scale(10.0 * log10((double)meanSquares / recorded / (RAWR_LEVEL_FULL_SCALE * RAWR_LEVEL_FULL_SCALE)));
+}
+
+// --------------------------------------------------------------------------------------------------------------
+double rawr_LevelMeter_Peak(rawr_LevelMeter *meter)
+{
+    RAWR_ASSERT(meter);
+
+    uint64_t block;
+    int peak = 0;
+
+    for (int b = 0; b < RAWR_LEVEL_BLOCKS; b++) {
+        block = mn_atomic_load_explicit(&meter->blocks[b], MN_ATOMIC_ACQUIRE);
+        if (!(block & RAWR_LEVEL_RECORDED)) continue;
+
+        if ((int)((block >> RAWR_LEVEL_PEAK_SHIFT) & 0xffff) > peak) peak = (int)((block >> RAWR_LEVEL_PEAK_SHIFT) & 0xffff);
+    }
+
+    if (!peak) return 0.0;
+    return rawr_Level_Scale(20.0 * log10(peak / RAWR_LEVEL_FULL_SCALE));
+}
@@ -0,0 +1,170 @@
+#include "rawr/Mix.h"
+#include "rawr/Error.h"
+#include "rawr/Simd.h"
+
+#if RAWR_SIMD_X86
+#    include <immintrin.h>
+#elif RAWR_SIMD_NEON
+#    include <arm_neon.h>
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Mix_AddScalar(int32_t *sums, const rawr_AudioSample *samples, int count)
+{
+    for (int i = 0; i < count; i++) {
+        sums[i] += samples[i];
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Mix_OutScalar(rawr_AudioSample *out, const int32_t *sums, const rawr_AudioSample *minus, int count)
+{
+    int32_t v;
+
+    for (int i = 0; i < count; i++) {
+        v = minus ? sums[i] - minus[i] : sums[i];
+        out[i] = (rawr_AudioSample)(v > INT16_MAX ? INT16_MAX : (v < INT16_MIN ? INT16_MIN : v));
+    }
+}
+
+#if RAWR_SIMD_X86
+/* sign extension is an interleave with itself and an arithmetic shift, SSE2 has nothing more direct */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Mix_AddSse(int32_t *sums, const rawr_AudioSample *samples, int count)
+{
+    __m128i v, lo, hi;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = _mm_loadu_si128((const __m128i *)(samples + i));
+        lo = _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+        hi = _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16);
+        _mm_storeu_si128((__m128i *)(sums + i), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(sums + i)), lo));
+        _mm_storeu_si128((__m128i *)(sums + i + 4), _mm_add_epi32(_mm_loadu_si128((const __m128i *)(sums + i + 4)), hi));
+    }
+
+    rawr_Mix_AddScalar(sums + i, samples + i, count - i);
+}
+
+/* packs saturates, which is the clipping */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Mix_OutSse(rawr_AudioSample *out, const int32_t *sums, const rawr_AudioSample *minus, int count)
+{
+    __m128i v, lo, hi;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        lo = _mm_loadu_si128((const __m128i *)(sums + i));
+        hi = _mm_loadu_si128((const __m128i *)(sums + i + 4));
+        if (minus) {
+            v = _mm_loadu_si128((const __m128i *)(minus + i));
+            lo = _mm_sub_epi32(lo, _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16));
+            hi = _mm_sub_epi32(hi, _mm_srai_epi32(_mm_unpackhi_epi16(v, v), 16));
+        }
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(lo, hi));
+    }
+
+    rawr_Mix_OutScalar(out + i, sums + i, minus ? minus + i : NULL, count - i);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Mix_AddAvx2(int32_t *sums, const rawr_AudioSample *samples, int count)
+{
+    __m256i lo, hi;
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        lo = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i)));
+        hi = _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(samples + i + 8)));
+        _mm256_storeu_si256((__m256i *)(sums + i), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(sums + i)), lo));
+        _mm256_storeu_si256((__m256i *)(sums + i + 8), _mm256_add_epi32(_mm256_loadu_si256((const __m256i *)(sums + i + 8)), hi));
+    }
+
+    _mm256_zeroupper();
+    rawr_Mix_AddScalar(sums + i, samples + i, count - i);
+}
+
+/* packs works within each 128 bit lane, the permute puts the four quarters back in order */
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Mix_OutAvx2(rawr_AudioSample *out, const int32_t *sums, const rawr_AudioSample *minus, int count)
+{
+    __m256i lo, hi;
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        lo = _mm256_loadu_si256((const __m256i *)(sums + i));
+        hi = _mm256_loadu_si256((const __m256i *)(sums + i + 8));
+        if (minus) {
+            lo = _mm256_sub_epi32(lo, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(minus + i))));
+            hi = _mm256_sub_epi32(hi, _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(minus + i + 8))));
+        }
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi), 0xd8));
+    }
+
+    _mm256_zeroupper();
+    rawr_Mix_OutScalar(out + i, sums + i, minus ? minus + i : NULL, count - i);
+}
+#elif RAWR_SIMD_NEON
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Mix_AddNeon(int32_t *sums, const rawr_AudioSample *samples, int count)
+{
+    int16x8_t v;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        v = vld1q_s16(samples + i);
+        vst1q_s32(sums + i, vaddw_s16(vld1q_s32(sums + i), vget_low_s16(v)));
+        vst1q_s32(sums + i + 4, vaddw_s16(vld1q_s32(sums + i + 4), vget_high_s16(v)));
+    }
+
+    rawr_Mix_AddScalar(sums + i, samples + i, count - i);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Mix_OutNeon(rawr_AudioSample *out, const int32_t *sums, const rawr_AudioSample *minus, int count)
+{
+    int32x4_t lo, hi;
+    int16x8_t v;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        lo = vld1q_s32(sums + i);
+        hi = vld1q_s32(sums + i + 4);
+        if (minus) {
+            v = vld1q_s16(minus + i);
+            lo = vsubw_s16(lo, vget_low_s16(v));
+            hi = vsubw_s16(hi, vget_high_s16(v));
+        }
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(lo), vqmovn_s32(hi)));
+    }
+
+    rawr_Mix_OutScalar(out + i, sums + i, minus ? minus + i : NULL, count - i);
+}
+#endif
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Mix_Kernels(rawr_MixKernels *out_kernels)
+{
+    RAWR_ASSERT(out_kernels);
+
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    (void)features;
+
+    out_kernels->add = rawr_Mix_AddScalar;
+    out_kernels->out = rawr_Mix_OutScalar;
+
+#if RAWR_SIMD_X86
+    if (features & rawr_SimdFeatures_AVX2) {
+        out_kernels->add = rawr_Mix_AddAvx2;
+        out_kernels->out = rawr_Mix_OutAvx2;
+    } else if (features & rawr_SimdFeatures_SSE2) {
+        out_kernels->add = rawr_Mix_AddSse;
+        out_kernels->out = rawr_Mix_OutSse;
+    }
+#elif RAWR_SIMD_NEON
+    if (features & rawr_SimdFeatures_NEON) {
+        out_kernels->add = rawr_Mix_AddNeon;
+        out_kernels->out = rawr_Mix_OutNeon;
+    }
+#endif
+}
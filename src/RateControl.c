@@ -0,0 +1,149 @@
+#include "rawr/RateControl.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+
+#include <string.h>
+
+/* weight of the newest report in the smoothed loss the FEC decision follows */
+#define RAWR_RATECONTROL_LOSS_SMOOTHING 0.5
+
+#define RAWR_RATECONTROL_INCREASE 1.08
+#define RAWR_RATECONTROL_INCREASE_BPS 1000
+#define RAWR_RATECONTROL_DELAY_BACKOFF 0.85
+#define RAWR_RATECONTROL_BITRATE_STEP 500
+
+/* queueing shows up as round trip above the best we have seen, or as the peer's jitter estimate climbing */
+#define RAWR_RATECONTROL_RTT_MARGIN_MS 150.0
+#define RAWR_RATECONTROL_JITTER_HIGH_MS 60.0
+
+/* reports to sit out after a cut before growing again */
+#define RAWR_RATECONTROL_HOLD_REPORTS 2
+
+#define RAWR_RATECONTROL_FEC_ON 0.01
+#define RAWR_RATECONTROL_FEC_OFF 0.005
+#define RAWR_RATECONTROL_LOSS_PERC_MAX 25
+
+typedef struct rawr_RateControl {
+    int minBitrate;
+    int maxBitrate;
+
+    uint64_t reports;
+    double bitrate;
+    double loss;
+    double minRttMs;
+    int hold;
+
+    rawr_RateControlTarget target;
+} rawr_RateControl;
+
+// private ------------------------------------------------------------------------------------------------------
+static double rawr_RateControl_Clamp(double value, double min, double max)
+{
+    if (value < min) return min;
+    if (value > max) return max;
+    return value;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_RateControl_Setup(rawr_RateControl **out_rc, int minBitrate, int maxBitrate)
+{
+    RAWR_ASSERT(out_rc);
+
+    rawr_RateControl *rc;
+
+    RAWR_GUARD(minBitrate <= 0 || maxBitrate < minBitrate);
+    RAWR_GUARD_NULL(rc = MN_MEM_ACQUIRE(sizeof(*rc)));
+    *out_rc = rc;
+
+    rc->minBitrate = minBitrate;
+    rc->maxBitrate = maxBitrate;
+
+    rawr_RateControl_Reset(rc);
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_RateControl_Cleanup(rawr_RateControl *rc)
+{
+    RAWR_ASSERT(rc);
+    MN_MEM_RELEASE(rc);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_RateControl_Reset(rawr_RateControl *rc)
+{
+    RAWR_ASSERT(rc);
+
+    rc->reports = 0;
+    rc->bitrate = rawr_RateControl_Clamp(RAWR_RATECONTROL_BITRATE_START, rc->minBitrate, rc->maxBitrate);
+    rc->loss = 0;
+    rc->minRttMs = 0;
+    rc->hold = 0;
+
+    /* 0 until the first report, so that report always hands the encoder a target */
+    rc->target.bitrate = 0;
+    rc->target.inbandFec = 0;
+    rc->target.packetLossPerc = 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_RateControl_Update(rawr_RateControl *rc, double fractionLost, double rttMs, double jitterMs)
+{
+    RAWR_ASSERT(rc);
+
+    rawr_RateControlTarget next;
+    int delayed, lossPerc;
+
+    fractionLost = rawr_RateControl_Clamp(fractionLost, 0, 1);
+
+    if (!rc->reports++) {
+        rc->loss = fractionLost;
+    } else {
+        rc->loss += RAWR_RATECONTROL_LOSS_SMOOTHING * (fractionLost - rc->loss);
+    }
+
+    if (rttMs > 0 && (rc->minRttMs <= 0 || rttMs < rc->minRttMs)) rc->minRttMs = rttMs;
+    delayed = (rttMs > 0 && rttMs > rc->minRttMs + RAWR_RATECONTROL_RTT_MARGIN_MS) || jitterMs > RAWR_RATECONTROL_JITTER_HIGH_MS;
+
+    /* the loss based rule from draft-ietf-rmcat-gcc: cut in proportion above 10%, grow below 2%, hold between */
+    if (fractionLost > RAWR_RATECONTROL_LOSS_HIGH) {
+        rc->bitrate *= 1.0 - 0.5 * fractionLost;
+        rc->hold = RAWR_RATECONTROL_HOLD_REPORTS;
+    } else if (delayed) {
+        rc->bitrate *= RAWR_RATECONTROL_DELAY_BACKOFF;
+        rc->hold = RAWR_RATECONTROL_HOLD_REPORTS;
+    } else if (rc->hold) {
+        rc->hold--;
+    } else if (fractionLost < RAWR_RATECONTROL_LOSS_LOW) {
+        rc->bitrate = rc->bitrate * RAWR_RATECONTROL_INCREASE + RAWR_RATECONTROL_INCREASE_BPS;
+    }
+
+    rc->bitrate = rawr_RateControl_Clamp(rc->bitrate, rc->minBitrate, rc->maxBitrate);
+
+    /* quantized so a stable link does not retune the encoder on every report */
+    next.bitrate = ((int)rc->bitrate / RAWR_RATECONTROL_BITRATE_STEP) * RAWR_RATECONTROL_BITRATE_STEP;
+    if (next.bitrate < rc->minBitrate) next.bitrate = rc->minBitrate;
+
+    next.inbandFec = rc->target.inbandFec;
+    if (!next.inbandFec && rc->loss >= RAWR_RATECONTROL_FEC_ON) next.inbandFec = 1;
+    if (next.inbandFec && rc->loss < RAWR_RATECONTROL_FEC_OFF) next.inbandFec = 0;
+
+    lossPerc = (int)(rc->loss * 100.0 + 0.5);
+    if (lossPerc < 1) lossPerc = 1;
+    if (lossPerc > RAWR_RATECONTROL_LOSS_PERC_MAX) lossPerc = RAWR_RATECONTROL_LOSS_PERC_MAX;
+    next.packetLossPerc = next.inbandFec ? lossPerc : 0;
+
+    if (!memcmp(&next, &rc->target, sizeof(next))) return 0;
+
+    rc->target = next;
+    return 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_RateControl_Target(rawr_RateControl *rc, rawr_RateControlTarget *out_target)
+{
+    RAWR_ASSERT(rc && out_target);
+    *out_target = rc->target;
+}
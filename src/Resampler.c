@@ -0,0 +1,363 @@
+#include "rawr/Resampler.h"
+#include "rawr/Error.h"
+#include "rawr/Simd.h"
+
+#include "mn/allocator.h"
+
+#include <math.h>
+#include <string.h>
+
+#if RAWR_SIMD_X86
+#    include <immintrin.h>
+#elif RAWR_SIMD_NEON
+#    include <arm_neon.h>
+#endif
+
+/* passband edge as a fraction of the lower rate, this beta (about -70 dB) over the taps reaches stopband by Nyquist */
+#define RAWR_RESAMPLER_CUTOFF 0.465
+#define RAWR_RESAMPLER_KAISER_BETA 7.0
+
+#define RAWR_RESAMPLER_PI 3.14159265358979323846
+
+typedef float (*rawr_ResamplerDot)(const float *coefs, const float *window, int taps);
+
+typedef struct rawr_Resampler {
+    int up;
+    int down;
+    int phases; /* up, or a multiple of it with enough phases to interpolate between */
+    int taps;
+    int channelCount;
+    int blockMax;
+
+    /* where the next output frame falls in 1/phases input frames from the next input frame, 32 bits of fraction */
+    int64_t offset;
+    int64_t step;
+
+    /* phases + 1 phases of taps each, stored in the order they meet the input window, the last a frame on from the first */
+    float *coefs;
+
+    /* taps frames of history followed by room for blockMax new ones, per channel */
+    float *history[RAWR_RESAMPLER_CHANNELS_MAX];
+
+    rawr_ResamplerDot dot;
+} rawr_Resampler;
+
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Resampler_DotScalar(const float *coefs, const float *window, int taps)
+{
+    float sum = 0.0f;
+
+    for (int i = 0; i < taps; i++) {
+        sum += coefs[i] * window[i];
+    }
+
+    return sum;
+}
+
+#if RAWR_SIMD_X86
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Resampler_DotSse(const float *coefs, const float *window, int taps)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+
+    for (int i = 0; i < taps; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(coefs + i), _mm_loadu_ps(window + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(coefs + i + 4), _mm_loadu_ps(window + i + 4)));
+    }
+
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+
+    return _mm_cvtss_f32(acc0);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static float rawr_Resampler_DotAvx2(const float *coefs, const float *window, int taps)
+{
+    __m256 acc = _mm256_setzero_ps();
+    __m128 sum;
+
+    for (int i = 0; i < taps; i += 8) {
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(coefs + i), _mm256_loadu_ps(window + i), acc);
+    }
+
+    sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum);
+}
+#endif
+
+#if RAWR_SIMD_NEON
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Resampler_DotNeon(const float *coefs, const float *window, int taps)
+{
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+    for (int i = 0; i < taps; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(coefs + i), vld1q_f32(window + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(coefs + i + 4), vld1q_f32(window + i + 4));
+    }
+
+    acc0 = vaddq_f32(acc0, acc1);
+
+#    if defined(__aarch64__) || defined(_M_ARM64)
+    return vaddvq_f32(acc0);
+#    else
+    float32x2_t sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#    endif
+}
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Resampler_Gcd(int a, int b)
+{
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static double rawr_Resampler_BesselI0(double x)
+{
+    double sum = 1.0, term = 1.0;
+
+    for (int k = 1; k < 64; k++) {
+        term *= (x / (2.0 * k)) * (x / (2.0 * k));
+        sum += term;
+        if (term < sum * 1e-12) break;
+    }
+
+    return sum;
+}
+
+/* Kaiser windowed sinc at the upsampled rate, split into phases that each pass DC at unity */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Resampler_Design(rawr_Resampler *rs)
+{
+    const int length = rs->taps * rs->phases;
+    const double center = (length - 1) / 2.0;
+    const double cutoff = RAWR_RESAMPLER_CUTOFF / ((double)rs->phases / rs->up * (rs->up > rs->down ? rs->up : rs->down));
+    const double i0beta = rawr_Resampler_BesselI0(RAWR_RESAMPLER_KAISER_BETA);
+    double t, r, sinc, value, sum;
+    float *phase;
+
+    for (int p = 0; p <= rs->phases; p++) {
+        phase = rs->coefs + (size_t)p * rs->taps;
+        sum = 0.0;
+
+        for (int j = 0; j < rs->taps; j++) {
+            /* the newest input frame sits at the end of the window and meets the lowest tap of the phase */
+            t = (double)((rs->taps - 1 - j) * rs->phases + p) - center;
+            r = length > 1 ? 2.0 * t / (length - 1) : 0.0;
+
+            /* the extra phase's oldest tap falls just past the window */
+            sinc = t == 0.0 ? 2.0 * cutoff : sin(2.0 * RAWR_RESAMPLER_PI * cutoff * t) / (RAWR_RESAMPLER_PI * t);
+            value = r > 1.0 ? 0.0 : sinc * rawr_Resampler_BesselI0(RAWR_RESAMPLER_KAISER_BETA * sqrt(fmax(0.0, 1.0 - r * r))) / i0beta;
+
+            phase[j] = (float)value;
+            sum += value;
+        }
+
+        for (int j = 0; j < rs->taps; j++) {
+            phase[j] = (float)(phase[j] / sum);
+        }
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static rawr_AudioSample rawr_Resampler_Saturate(float value)
+{
+    if (value >= 32767.0f) return 32767;
+    if (value <= -32768.0f) return -32768;
+    return (rawr_AudioSample)lrintf(value);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Resampler_Setup(rawr_Resampler **out_rs, int inRate, int outRate, int channelCount, int blockMax)
+{
+    RAWR_ASSERT(out_rs);
+
+    rawr_Resampler *rs;
+    rawr_SimdFeatures features;
+    int gcd;
+
+    RAWR_GUARD(inRate <= 0 || outRate <= 0 || blockMax <= 0);
+    RAWR_GUARD(channelCount < 1 || channelCount > RAWR_RESAMPLER_CHANNELS_MAX);
+
+    RAWR_GUARD_NULL(rs = MN_MEM_ACQUIRE(sizeof(*rs)));
+    memset(rs, 0, sizeof(*rs));
+
+    gcd = rawr_Resampler_Gcd(inRate, outRate);
+    rs->up = outRate / gcd;
+    rs->down = inRate / gcd;
+    rs->channelCount = channelCount;
+    rs->blockMax = blockMax;
+    RAWR_GUARD_CLEANUP(rs->up > RAWR_RESAMPLER_PHASES_MAX);
+
+    /* every nominal output still lands exactly on a phase, the extra ones are only met while trimmed */
+    rs->phases = rs->up * ((RAWR_RESAMPLER_TRIM_PHASES + rs->up - 1) / rs->up);
+    rs->step = (int64_t)rs->down * (rs->phases / rs->up) << 32;
+
+    /* converting down the filter spans more input for the same cutoff, rounded to whole vectors for the kernels */
+    rs->taps = RAWR_RESAMPLER_TAPS;
+    if (rs->down > rs->up) rs->taps = (int)ceil((double)RAWR_RESAMPLER_TAPS * rs->down / rs->up);
+    rs->taps = (rs->taps + 7) & ~7;
+
+    RAWR_GUARD_NULL_CLEANUP(rs->coefs = MN_MEM_ACQUIRE((size_t)(rs->phases + 1) * rs->taps * sizeof(float)));
+    for (int c = 0; c < channelCount; c++) {
+        RAWR_GUARD_NULL_CLEANUP(rs->history[c] = MN_MEM_ACQUIRE((size_t)(rs->taps + blockMax) * sizeof(float)));
+    }
+
+    rawr_Resampler_Design(rs);
+
+    features = rawr_Simd_Features();
+    rs->dot = rawr_Resampler_DotScalar;
+#if RAWR_SIMD_X86
+    if (features & rawr_SimdFeatures_SSE2) rs->dot = rawr_Resampler_DotSse;
+    if (features & rawr_SimdFeatures_AVX2) rs->dot = rawr_Resampler_DotAvx2;
+#elif RAWR_SIMD_NEON
+    if (features & rawr_SimdFeatures_NEON) rs->dot = rawr_Resampler_DotNeon;
+#endif
+    (void)features;
+
+    rawr_Resampler_Reset(rs);
+
+    *out_rs = rs;
+    return rawr_Success;
+
+cleanup:
+    rawr_Resampler_Cleanup(rs);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Resampler_Cleanup(rawr_Resampler *rs)
+{
+    RAWR_ASSERT(rs);
+
+    for (int c = 0; c < RAWR_RESAMPLER_CHANNELS_MAX; c++) {
+        MN_MEM_RELEASE(rs->history[c]);
+    }
+    MN_MEM_RELEASE(rs->coefs);
+    MN_MEM_RELEASE(rs);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Resampler_Reset(rawr_Resampler *rs)
+{
+    RAWR_ASSERT(rs);
+
+    rs->offset = 0;
+    for (int c = 0; c < rs->channelCount; c++) {
+        memset(rs->history[c], 0, (size_t)(rs->taps + rs->blockMax) * sizeof(float));
+    }
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Resampler_OutputMax(rawr_Resampler *rs, int inCount)
+{
+    RAWR_ASSERT(rs);
+    return (int)(((double)inCount + 1) * rs->up / rs->down / (1.0 - RAWR_RESAMPLER_TRIM_MAX)) + 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Resampler_InputMax(rawr_Resampler *rs, int outCount)
+{
+    RAWR_ASSERT(rs);
+    return (int)((double)outCount * rs->down / rs->up * (1.0 + RAWR_RESAMPLER_TRIM_MAX)) + 2;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Resampler_InputFor(rawr_Resampler *rs, int outCount)
+{
+    RAWR_ASSERT(rs);
+
+    int64_t last;
+
+    if (outCount <= 0) return 0;
+
+    /* enough input that the last wanted frame lands on it, and no more */
+    last = (rs->offset + (int64_t)(outCount - 1) * rs->step) >> 32;
+    if (last < 0) return 0;
+
+    return (int)(last / rs->phases) + 1;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Resampler_Process(rawr_Resampler *rs, const rawr_AudioSample *in, int inCount, rawr_AudioSample *out, int outCapacity)
+{
+    RAWR_ASSERT(rs && in && out);
+    RAWR_ASSERT(inCount >= 0 && inCount <= rs->blockMax);
+
+    const int taps = rs->taps;
+    const int channels = rs->channelCount;
+    const float *coefs;
+    int64_t position, index;
+    float value, fraction;
+    int produced = 0;
+
+    for (int c = 0; c < channels; c++) {
+        float *newest = rs->history[c] + taps;
+        for (int j = 0; j < inCount; j++) {
+            newest[j] = (float)in[j * channels + c];
+        }
+    }
+
+    while (produced < outCapacity) {
+        /* a frame cut off by the last call's capacity can still sit one frame back in the history */
+        position = rs->offset >> 32;
+        index = position >= 0 ? position / rs->phases : -1;
+        if (index >= inCount) break;
+
+        /* between two phases the output is interpolated from both, which only happens while trimmed */
+        coefs = rs->coefs + (size_t)(position - index * rs->phases) * taps;
+        fraction = (float)(uint32_t)rs->offset * (1.0f / 4294967296.0f);
+        for (int c = 0; c < channels; c++) {
+            value = rs->dot(coefs, rs->history[c] + index + 1, taps);
+            if (fraction != 0.0f) value += (rs->dot(coefs + taps, rs->history[c] + index + 1, taps) - value) * fraction;
+            out[produced * channels + c] = rawr_Resampler_Saturate(value);
+        }
+
+        rs->offset += rs->step;
+        produced++;
+    }
+
+    rs->offset -= (int64_t)inCount * rs->phases << 32;
+    RAWR_ASSERT(rs->offset >= -((int64_t)rs->phases << 32));
+
+    for (int c = 0; c < channels; c++) {
+        memmove(rs->history[c], rs->history[c] + inCount, (size_t)taps * sizeof(float));
+    }
+
+    return produced;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Resampler_SetTrim(rawr_Resampler *rs, double trim)
+{
+    RAWR_ASSERT(rs);
+
+    const int64_t nominal = (int64_t)rs->down * (rs->phases / rs->up);
+
+    if (trim > RAWR_RESAMPLER_TRIM_MAX) trim = RAWR_RESAMPLER_TRIM_MAX;
+    if (trim < -RAWR_RESAMPLER_TRIM_MAX) trim = -RAWR_RESAMPLER_TRIM_MAX;
+
+    rs->step = (nominal << 32) + llround(ldexp((double)nominal * trim, 32));
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Resampler_Latency(rawr_Resampler *rs)
+{
+    RAWR_ASSERT(rs);
+    return rs->taps / 2;
+}
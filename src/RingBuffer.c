@@ -8,6 +8,7 @@
  * modified for SMP safety on Linux by Leland Lucius
  * also, allowed for const where possible
  * modified for multiple-byte-sized data elements by Sven Fischer 
+ * indices moved to acquire/release atomics on separate cache lines for rawr
  *
  * Note that this is safe only for a single-thread reader and a
  * single-thread writer.
@@ -53,11 +54,7 @@
 */
 
 #include "rawr/RingBuffer.h"
-#include "rawr/MemoryBarrier.h"
 
-#include <math.h>
-#include <stdio.h>
-#include <stdlib.h>
 #include <string.h>
 
 /***************************************************************************
@@ -80,37 +77,39 @@ size_t rawr_RingBuffer_Initialize(rawr_RingBuffer *rbuf, size_t elementSizeBytes
 ** Return number of elements available for reading. */
 size_t rawr_RingBuffer_GetReadAvailable(const rawr_RingBuffer *rbuf)
 {
-    return ((rbuf->writeIndex - rbuf->readIndex) & rbuf->bigMask);
+    /* the caller owns one of the two indices, so only the other moves while we look, and the clamp covers the rest */
+    size_t readIndex = (size_t)mn_atomic_load_explicit(&rbuf->readIndex, MN_ATOMIC_ACQUIRE);
+    size_t writeIndex = (size_t)mn_atomic_load_explicit(&rbuf->writeIndex, MN_ATOMIC_ACQUIRE);
+    size_t available = writeIndex - readIndex;
+    return (available > rbuf->bufferSize) ? rbuf->bufferSize : available;
 }
 /***************************************************************************
 ** Return number of elements available for writing. */
 size_t rawr_RingBuffer_GetWriteAvailable(const rawr_RingBuffer *rbuf)
 {
-    return (rbuf->bufferSize - rawr_RingBuffer_GetReadAvailable(rbuf));
+    size_t writeIndex = (size_t)mn_atomic_load_explicit(&rbuf->writeIndex, MN_ATOMIC_ACQUIRE);
+    size_t readIndex = (size_t)mn_atomic_load_explicit(&rbuf->readIndex, MN_ATOMIC_ACQUIRE);
+    size_t used = writeIndex - readIndex;
+    return (used > rbuf->bufferSize) ? 0 : rbuf->bufferSize - used;
 }
 
 /***************************************************************************
 ** Clear buffer. Should only be called when buffer is NOT being read or written. */
 void rawr_RingBuffer_Flush(rawr_RingBuffer *rbuf)
 {
-    rbuf->writeIndex = rbuf->readIndex = 0;
+    mn_atomic_store(&rbuf->writeIndex, 0);
+    mn_atomic_store(&rbuf->readIndex, 0);
+    rbuf->readIndexCache = 0;
+    rbuf->writeIndexCache = 0;
 }
 
 /***************************************************************************
-** Get address of region(s) to which we can write data.
-** If the region is contiguous, size2 will be zero.
-** If non-contiguous, size2 will be the size of second region.
-** Returns room available to be written or elementCount, whichever is smaller.
-*/
-size_t rawr_RingBuffer_GetWriteRegions(rawr_RingBuffer *rbuf, size_t elementCount, void **dataPtr1, size_t *sizePtr1, void **dataPtr2, size_t *sizePtr2)
+** Split elementCount elements starting at index into at most two regions. */
+static void rawr_RingBuffer_Regions(rawr_RingBuffer *rbuf, size_t index, size_t elementCount, void **dataPtr1, size_t *sizePtr1, void **dataPtr2, size_t *sizePtr2)
 {
-    size_t index;
-    size_t available = rawr_RingBuffer_GetWriteAvailable(rbuf);
-    if (elementCount > available) elementCount = available;
-    /* Check to see if write is not contiguous. */
-    index = rbuf->writeIndex & rbuf->smallMask;
+    index &= rbuf->smallMask;
     if ((index + elementCount) > rbuf->bufferSize) {
-        /* Write data in two blocks that wrap the buffer. */
+        /* Data in two blocks that wrap the buffer. */
         size_t firstHalf = rbuf->bufferSize - index;
         *dataPtr1 = &rbuf->buffer[index * rbuf->elementSizeBytes];
         *sizePtr1 = firstHalf;
@@ -122,10 +121,27 @@ size_t rawr_RingBuffer_GetWriteRegions(rawr_RingBuffer *rbuf, size_t elementCoun
         *dataPtr2 = NULL;
         *sizePtr2 = 0;
     }
+}
 
-    if (available)
-        rawr_MemoryBarrier_Full(); /* (write-after-read) => full barrier */
+/***************************************************************************
+** Get address of region(s) to which we can write data.
+** If the region is contiguous, size2 will be zero.
+** If non-contiguous, size2 will be the size of second region.
+** Returns room available to be written or elementCount, whichever is smaller.
+*/
+size_t rawr_RingBuffer_GetWriteRegions(rawr_RingBuffer *rbuf, size_t elementCount, void **dataPtr1, size_t *sizePtr1, void **dataPtr2, size_t *sizePtr2)
+{
+    size_t writeIndex = (size_t)mn_atomic_load_explicit(&rbuf->writeIndex, MN_ATOMIC_RELAXED);
+    size_t available = rbuf->bufferSize - (writeIndex - rbuf->readIndexCache);
+
+    if (elementCount > available) {
+        /* acquire pairs with the reader's release, so it is done with the elements it handed back */
+        rbuf->readIndexCache = (size_t)mn_atomic_load_explicit(&rbuf->readIndex, MN_ATOMIC_ACQUIRE);
+        available = rbuf->bufferSize - (writeIndex - rbuf->readIndexCache);
+        if (elementCount > available) elementCount = available;
+    }
 
+    rawr_RingBuffer_Regions(rbuf, writeIndex, elementCount, dataPtr1, sizePtr1, dataPtr2, sizePtr2);
     return elementCount;
 }
 
@@ -133,11 +149,10 @@ size_t rawr_RingBuffer_GetWriteRegions(rawr_RingBuffer *rbuf, size_t elementCoun
 */
 size_t rawr_RingBuffer_AdvanceWriteIndex(rawr_RingBuffer *rbuf, size_t elementCount)
 {
-    /* ensure that previous writes are seen before we update the write index 
-       (write after write)
-    */
-    rawr_MemoryBarrier_Write();
-    return rbuf->writeIndex = (rbuf->writeIndex + elementCount) & rbuf->bigMask;
+    /* release, so the elements are visible before the index that covers them */
+    size_t writeIndex = (size_t)mn_atomic_load_explicit(&rbuf->writeIndex, MN_ATOMIC_RELAXED) + elementCount;
+    mn_atomic_store_explicit(&rbuf->writeIndex, writeIndex, MN_ATOMIC_RELEASE);
+    return writeIndex & rbuf->bigMask;
 }
 
 /***************************************************************************
@@ -148,39 +163,27 @@ size_t rawr_RingBuffer_AdvanceWriteIndex(rawr_RingBuffer *rbuf, size_t elementCo
 */
 size_t rawr_RingBuffer_GetReadRegions(rawr_RingBuffer *rbuf, size_t elementCount, void **dataPtr1, size_t *sizePtr1, void **dataPtr2, size_t *sizePtr2)
 {
-    size_t index;
-    size_t available = rawr_RingBuffer_GetReadAvailable(rbuf); /* doesn't use memory barrier */
-    if (elementCount > available) elementCount = available;
-    /* Check to see if read is not contiguous. */
-    index = rbuf->readIndex & rbuf->smallMask;
-    if ((index + elementCount) > rbuf->bufferSize) {
-        /* Write data in two blocks that wrap the buffer. */
-        size_t firstHalf = rbuf->bufferSize - index;
-        *dataPtr1 = &rbuf->buffer[index * rbuf->elementSizeBytes];
-        *sizePtr1 = firstHalf;
-        *dataPtr2 = &rbuf->buffer[0];
-        *sizePtr2 = elementCount - firstHalf;
-    } else {
-        *dataPtr1 = &rbuf->buffer[index * rbuf->elementSizeBytes];
-        *sizePtr1 = elementCount;
-        *dataPtr2 = NULL;
-        *sizePtr2 = 0;
+    size_t readIndex = (size_t)mn_atomic_load_explicit(&rbuf->readIndex, MN_ATOMIC_RELAXED);
+    size_t available = rbuf->writeIndexCache - readIndex;
+
+    if (elementCount > available) {
+        /* acquire pairs with the writer's release, so the elements are there before we copy them out */
+        rbuf->writeIndexCache = (size_t)mn_atomic_load_explicit(&rbuf->writeIndex, MN_ATOMIC_ACQUIRE);
+        available = rbuf->writeIndexCache - readIndex;
+        if (elementCount > available) elementCount = available;
     }
 
-    if (available)
-        rawr_MemoryBarrier_Read(); /* (read-after-read) => read barrier */
-
+    rawr_RingBuffer_Regions(rbuf, readIndex, elementCount, dataPtr1, sizePtr1, dataPtr2, sizePtr2);
     return elementCount;
 }
 /***************************************************************************
 */
 size_t rawr_RingBuffer_AdvanceReadIndex(rawr_RingBuffer *rbuf, size_t elementCount)
 {
-    /* ensure that previous reads (copies out of the ring buffer) are always completed before updating (writing) the read index. 
-       (write-after-read) => full barrier
-    */
-    rawr_MemoryBarrier_Full();
-    return rbuf->readIndex = (rbuf->readIndex + elementCount) & rbuf->bigMask;
+    /* release, so the copies out are finished before the writer can reuse the space */
+    size_t readIndex = (size_t)mn_atomic_load_explicit(&rbuf->readIndex, MN_ATOMIC_RELAXED) + elementCount;
+    mn_atomic_store_explicit(&rbuf->readIndex, readIndex, MN_ATOMIC_RELEASE);
+    return readIndex & rbuf->bigMask;
 }
 
 /***************************************************************************
@@ -190,6 +193,7 @@ size_t rawr_RingBuffer_Write(rawr_RingBuffer *rbuf, const void *data, size_t ele
     size_t size1, size2, numWritten;
     void *data1, *data2;
     numWritten = rawr_RingBuffer_GetWriteRegions(rbuf, elementCount, &data1, &size1, &data2, &size2);
+    if (!numWritten) return 0;
     if (size2 > 0) {
 
         memcpy(data1, data, size1 * rbuf->elementSizeBytes);
@@ -209,6 +213,7 @@ size_t rawr_RingBuffer_Read(rawr_RingBuffer *rbuf, void *data, size_t elementCou
     size_t size1, size2, numRead;
     void *data1, *data2;
     numRead = rawr_RingBuffer_GetReadRegions(rbuf, elementCount, &data1, &size1, &data2, &size2);
+    if (!numRead) return 0;
     if (size2 > 0) {
         memcpy(data, data1, size1 * rbuf->elementSizeBytes);
         data = ((char *)data) + size1 * rbuf->elementSizeBytes;
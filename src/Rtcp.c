@@ -0,0 +1,486 @@
+#include "rawr/Rtcp.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+#include "mn/mutex.h"
+#include "mn/time.h"
+
+#include "re.h"
+
+#include <string.h>
+#include <time.h>
+
+#define RAWR_RTCP_MAX_DROPOUT 3000
+#define RAWR_RTCP_MAX_MISORDER 100
+#define RAWR_RTCP_SEQ_MOD (1 << 16)
+#define RAWR_RTCP_NTP_EPOCH_OFFSET 2208988800u
+#define RAWR_RTCP_CNAME_MAX 32
+
+/* per remote SSRC reception state, RFC 3550 appendix A.1 and A.8 */
+typedef struct rawr_RtcpSource {
+    int used;
+    uint32_t ssrc;
+
+    uint16_t maxSeq;
+    uint32_t cycles;
+    uint32_t baseSeq;
+    uint32_t badSeq;
+    uint64_t received;
+    uint32_t expectedPrior;
+    uint64_t receivedPrior;
+
+    int haveTransit;
+    int32_t transit;
+    uint32_t jitter; /* scaled by 16 */
+
+    uint8_t fraction;
+    int32_t lost;
+
+    uint32_t lastSr; /* middle 32 bits of the NTP timestamp in the last SR from this source */
+    uint64_t lastSrArrival;
+    uint64_t lastArrival;
+} rawr_RtcpSource;
+
+typedef struct rawr_Rtcp {
+    mn_mutex_t mtx;
+    uint32_t ssrc;
+    int clockRate;
+    char cname[RAWR_RTCP_CNAME_MAX];
+
+    uint64_t epochMono;
+    uint64_t epochNtpSec;
+
+    uint64_t nextReport;
+
+    uint32_t lastSentTs;
+    uint64_t lastSentTime;
+
+    rawr_RtcpStats stats;
+    rawr_RtcpSource sources[RAWR_RTCP_SOURCES_MAX];
+} rawr_Rtcp;
+
+/* wallclock as a 64 bit NTP timestamp, anchored once and advanced with the monotonic clock */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Rtcp_Ntp(rawr_Rtcp *rtcp, uint64_t now, uint32_t *out_sec, uint32_t *out_frac)
+{
+    const uint64_t elapsed = now - rtcp->epochMono;
+    const uint64_t ns = elapsed % MN_TSTAMP_NS;
+
+    *out_sec = (uint32_t)(rtcp->epochNtpSec + elapsed / MN_TSTAMP_NS);
+    *out_frac = (uint32_t)((ns << 32) / MN_TSTAMP_NS);
+}
+
+/* 16.16 fixed point seconds, the unit of LSR, DLSR and the RTT computed from them */
+// private ------------------------------------------------------------------------------------------------------
+static uint32_t rawr_Rtcp_Compact(uint32_t sec, uint32_t frac)
+{
+    return (sec << 16) | (frac >> 16);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static uint32_t rawr_Rtcp_NsToCompact(uint64_t ns)
+{
+    return (uint32_t)((ns << 16) / MN_TSTAMP_NS);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static double rawr_Rtcp_ClockToMs(rawr_Rtcp *rtcp, uint32_t clock)
+{
+    return ((double)clock * 1000.0) / rtcp->clockRate;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Rtcp_Schedule(rawr_Rtcp *rtcp, uint64_t now, uint32_t intervalMs)
+{
+    /* randomize over [0.5, 1.5] of the interval so peers do not synchronize */
+    const uint64_t ms = intervalMs / 2 + rand_u32() % (intervalMs + 1);
+    rtcp->nextReport = now + mn_tstamp_convert(ms, MN_TSTAMP_MS, MN_TSTAMP_NS);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Rtcp_InitSeq(rawr_RtcpSource *src, uint16_t seq)
+{
+    src->baseSeq = seq;
+    src->maxSeq = seq;
+    src->badSeq = RAWR_RTCP_SEQ_MOD + 1;
+    src->cycles = 0;
+    src->received = 0;
+    src->receivedPrior = 0;
+    src->expectedPrior = 0;
+}
+
+/* returns 0 when the packet is outside the window and should not be counted */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Rtcp_UpdateSeq(rawr_RtcpSource *src, uint16_t seq)
+{
+    const uint16_t udelta = seq - src->maxSeq;
+
+    if (udelta < RAWR_RTCP_MAX_DROPOUT) {
+        /* in order, with a permissible gap */
+        if (seq < src->maxSeq) src->cycles += RAWR_RTCP_SEQ_MOD;
+        src->maxSeq = seq;
+    } else if (udelta <= RAWR_RTCP_SEQ_MOD - RAWR_RTCP_MAX_MISORDER) {
+        /* a very large jump, only believe it if the next packet follows on from it */
+        if (seq == src->badSeq) {
+            rawr_Rtcp_InitSeq(src, seq);
+        } else {
+            src->badSeq = (seq + 1) & (RAWR_RTCP_SEQ_MOD - 1);
+            return 0;
+        }
+    }
+
+    src->received++;
+    return 1;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static uint32_t rawr_Rtcp_ExtendedMax(rawr_RtcpSource *src)
+{
+    return src->cycles + src->maxSeq;
+}
+
+/* cumulative and fractional loss since the previous report, RFC 3550 appendix A.3 */
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Rtcp_CalcLoss(rawr_RtcpSource *src)
+{
+    const uint32_t expected = rawr_Rtcp_ExtendedMax(src) - src->baseSeq + 1;
+    const uint32_t expectedInterval = expected - src->expectedPrior;
+    const uint64_t receivedInterval = src->received - src->receivedPrior;
+    const int64_t lostInterval = (int64_t)expectedInterval - (int64_t)receivedInterval;
+    int64_t lost = (int64_t)expected - (int64_t)src->received;
+
+    /* clamp to the signed 24 bit field of the report block */
+    if (lost > 0x7fffff) lost = 0x7fffff;
+    if (lost < -0x800000) lost = -0x800000;
+    src->lost = (int32_t)lost;
+
+    src->expectedPrior = expected;
+    src->receivedPrior = src->received;
+
+    if (expectedInterval == 0 || lostInterval <= 0) {
+        src->fraction = 0;
+    } else {
+        src->fraction = (uint8_t)((lostInterval << 8) / expectedInterval);
+    }
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static rawr_RtcpSource *rawr_Rtcp_FindSource(rawr_Rtcp *rtcp, uint32_t ssrc)
+{
+    for (int i = 0; i < RAWR_RTCP_SOURCES_MAX; i++) {
+        if (rtcp->sources[i].used && rtcp->sources[i].ssrc == ssrc) return rtcp->sources + i;
+    }
+    return NULL;
+}
+
+/* finds or adds ssrc, evicting whichever source we have heard from least recently */
+// private ------------------------------------------------------------------------------------------------------
+static rawr_RtcpSource *rawr_Rtcp_GetSource(rawr_Rtcp *rtcp, uint32_t ssrc)
+{
+    rawr_RtcpSource *src;
+
+    if ((src = rawr_Rtcp_FindSource(rtcp, ssrc))) return src;
+
+    src = rtcp->sources;
+    for (int i = 0; i < RAWR_RTCP_SOURCES_MAX; i++) {
+        if (!rtcp->sources[i].used) {
+            src = rtcp->sources + i;
+            break;
+        }
+        if (rtcp->sources[i].lastArrival < src->lastArrival) src = rtcp->sources + i;
+    }
+
+    memset(src, 0, sizeof(*src));
+    src->used = 1;
+    src->ssrc = ssrc;
+
+    return src;
+}
+
+/* the source whose media we are actually playing, or NULL before anything has arrived */
+// private ------------------------------------------------------------------------------------------------------
+static rawr_RtcpSource *rawr_Rtcp_ActiveSource(rawr_Rtcp *rtcp)
+{
+    rawr_RtcpSource *src = NULL;
+
+    for (int i = 0; i < RAWR_RTCP_SOURCES_MAX; i++) {
+        if (!rtcp->sources[i].used || !rtcp->sources[i].received) continue;
+        if (!src || rtcp->sources[i].lastArrival > src->lastArrival) src = rtcp->sources + i;
+    }
+
+    return src;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Rtcp_HandleBlock(rawr_Rtcp *rtcp, const struct rtcp_rr *rr, uint64_t now)
+{
+    uint32_t sec, frac, rtt;
+
+    /* blocks about other senders in a multi party session are of no use to us */
+    if (rr->ssrc != rtcp->ssrc) return;
+
+    rtcp->stats.remotePacketsLost = rr->lost;
+    rtcp->stats.remoteFractionLost = rr->fraction / 256.0;
+    rtcp->stats.remoteJitterMs = rawr_Rtcp_ClockToMs(rtcp, rr->jitter);
+
+    /* round trip as A - LSR - DLSR, a peer which has not seen our SR yet sends LSR 0 */
+    if (!rr->lsr) return;
+
+    rawr_Rtcp_Ntp(rtcp, now, &sec, &frac);
+    rtt = rawr_Rtcp_Compact(sec, frac) - rr->lsr - rr->dlsr;
+
+    /* a negative result means the peer's DLSR is off, ignore it rather than report garbage */
+    if (rtt & 0x80000000) return;
+
+    rtcp->stats.rttMs = (rtt * 1000.0) / 65536.0;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Rtcp_EncodeBlocks(struct mbuf *mb, void *arg)
+{
+    rawr_Rtcp *rtcp = (rawr_Rtcp *)arg;
+    const uint64_t now = mn_tstamp();
+    int err = 0;
+
+    for (int i = 0; i < RAWR_RTCP_SOURCES_MAX; i++) {
+        rawr_RtcpSource *src = rtcp->sources + i;
+        uint32_t dlsr = 0;
+
+        if (!src->used || !src->received) continue;
+
+        rawr_Rtcp_CalcLoss(src);
+        if (src->lastSr) dlsr = rawr_Rtcp_NsToCompact(now - src->lastSrArrival);
+
+        err |= mbuf_write_u32(mb, htonl(src->ssrc));
+        err |= mbuf_write_u32(mb, htonl(((uint32_t)src->fraction << 24) | ((uint32_t)src->lost & 0xffffff)));
+        err |= mbuf_write_u32(mb, htonl(rawr_Rtcp_ExtendedMax(src)));
+        err |= mbuf_write_u32(mb, htonl(src->jitter >> 4));
+        err |= mbuf_write_u32(mb, htonl(src->lastSr));
+        err |= mbuf_write_u32(mb, htonl(dlsr));
+    }
+
+    return err;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Rtcp_EncodeSdes(struct mbuf *mb, void *arg)
+{
+    rawr_Rtcp *rtcp = (rawr_Rtcp *)arg;
+    return rtcp_sdes_encode(mb, rtcp->ssrc, 1, RTCP_SDES_CNAME, rtcp->cname);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Rtcp_Setup(rawr_Rtcp **out_rtcp, uint32_t ssrc, int clockRate)
+{
+    RAWR_ASSERT(out_rtcp && clockRate > 0);
+
+    rawr_Rtcp *rtcp;
+
+    RAWR_GUARD_NULL(rtcp = MN_MEM_ACQUIRE(sizeof(*rtcp)));
+    memset(rtcp, 0, sizeof(*rtcp));
+
+    rtcp->ssrc = ssrc;
+    rtcp->clockRate = clockRate;
+    snprintf(rtcp->cname, RAWR_RTCP_CNAME_MAX, "rawr-%08x", ssrc);
+
+    RAWR_GUARD_CLEANUP(mn_mutex_setup(&rtcp->mtx));
+
+    rawr_Rtcp_Reset(rtcp);
+
+    *out_rtcp = rtcp;
+
+    return rawr_Success;
+
+cleanup:
+    MN_MEM_RELEASE(rtcp);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Rtcp_Cleanup(rawr_Rtcp *rtcp)
+{
+    if (!rtcp) return;
+    mn_mutex_cleanup(&rtcp->mtx);
+    MN_MEM_RELEASE(rtcp);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Rtcp_Reset(rawr_Rtcp *rtcp)
+{
+    RAWR_ASSERT(rtcp);
+
+    mn_mutex_lock(&rtcp->mtx);
+
+    rtcp->epochMono = mn_tstamp();
+    rtcp->epochNtpSec = (uint64_t)time(NULL) + RAWR_RTCP_NTP_EPOCH_OFFSET;
+
+    rtcp->lastSentTs = 0;
+    rtcp->lastSentTime = 0;
+
+    memset(&rtcp->stats, 0, sizeof(rtcp->stats));
+    memset(rtcp->sources, 0, sizeof(rtcp->sources));
+
+    /* the first report goes out after half an interval, RFC 3550 6.2 */
+    rawr_Rtcp_Schedule(rtcp, rtcp->epochMono, RAWR_RTCP_INTERVAL_MS / 2);
+
+    mn_mutex_unlock(&rtcp->mtx);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Rtcp_OnSend(rawr_Rtcp *rtcp, uint32_t ts, size_t payloadBytes)
+{
+    RAWR_ASSERT(rtcp);
+
+    mn_mutex_lock(&rtcp->mtx);
+
+    rtcp->stats.packetsSent++;
+    rtcp->stats.bytesSent += payloadBytes;
+    rtcp->lastSentTs = ts;
+    rtcp->lastSentTime = mn_tstamp();
+
+    mn_mutex_unlock(&rtcp->mtx);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Rtcp_OnReceive(rawr_Rtcp *rtcp, uint32_t ssrc, uint16_t seq, uint32_t ts, uint64_t arrival)
+{
+    RAWR_ASSERT(rtcp);
+
+    rawr_RtcpSource *src;
+    uint32_t arrivalTs;
+    int32_t transit, d;
+
+    mn_mutex_lock(&rtcp->mtx);
+
+    src = rawr_Rtcp_GetSource(rtcp, ssrc);
+    src->lastArrival = arrival;
+
+    if (!src->received && !src->haveTransit) {
+        rawr_Rtcp_InitSeq(src, seq);
+    }
+
+    if (!rawr_Rtcp_UpdateSeq(src, seq)) goto done;
+
+    rtcp->stats.packetsReceived++;
+
+    /* interarrival jitter in timestamp units, RFC 3550 appendix A.8 */
+    arrivalTs = (uint32_t)(mn_tstamp_convert(arrival - rtcp->epochMono, MN_TSTAMP_NS, MN_TSTAMP_US) * rtcp->clockRate / MN_TSTAMP_US);
+    transit = (int32_t)(arrivalTs - ts);
+
+    if (src->haveTransit) {
+        d = transit - src->transit;
+        if (d < 0) d = -d;
+        src->jitter += d - ((src->jitter + 8) >> 4);
+    }
+
+    src->transit = transit;
+    src->haveTransit = 1;
+
+done:
+    mn_mutex_unlock(&rtcp->mtx);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Rtcp_Handle(rawr_Rtcp *rtcp, const struct rtcp_msg *msg)
+{
+    RAWR_ASSERT(rtcp && msg);
+
+    rawr_RtcpSource *src;
+    const uint64_t now = mn_tstamp();
+
+    mn_mutex_lock(&rtcp->mtx);
+
+    switch (msg->hdr.pt) {
+    case RTCP_SR:
+        src = rawr_Rtcp_GetSource(rtcp, msg->r.sr.ssrc);
+        src->lastSr = rawr_Rtcp_Compact(msg->r.sr.ntp_sec, msg->r.sr.ntp_frac);
+        src->lastSrArrival = now;
+
+        for (uint32_t i = 0; i < msg->hdr.count; i++) {
+            rawr_Rtcp_HandleBlock(rtcp, msg->r.sr.rrv + i, now);
+        }
+        rtcp->stats.reportsReceived++;
+        break;
+    case RTCP_RR:
+        for (uint32_t i = 0; i < msg->hdr.count; i++) {
+            rawr_Rtcp_HandleBlock(rtcp, msg->r.rr.rrv + i, now);
+        }
+        rtcp->stats.reportsReceived++;
+        break;
+    default:
+        break;
+    }
+
+    mn_mutex_unlock(&rtcp->mtx);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Rtcp_Due(rawr_Rtcp *rtcp)
+{
+    RAWR_ASSERT(rtcp);
+
+    int due;
+
+    mn_mutex_lock(&rtcp->mtx);
+    due = (mn_tstamp() >= rtcp->nextReport);
+    mn_mutex_unlock(&rtcp->mtx);
+
+    return due;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Rtcp_Encode(rawr_Rtcp *rtcp, struct mbuf *mb)
+{
+    RAWR_ASSERT(rtcp && mb);
+
+    uint32_t sec, frac, rtpTs, count = 0;
+    const uint64_t now = mn_tstamp();
+    int err;
+
+    mn_mutex_lock(&rtcp->mtx);
+
+    for (int i = 0; i < RAWR_RTCP_SOURCES_MAX; i++) {
+        if (rtcp->sources[i].used && rtcp->sources[i].received) count++;
+    }
+
+    if (rtcp->stats.packetsSent) {
+        /* the RTP timestamp matching the NTP time below, extrapolated from the last packet we sent */
+        rawr_Rtcp_Ntp(rtcp, now, &sec, &frac);
+        rtpTs = rtcp->lastSentTs + (uint32_t)(mn_tstamp_convert(now - rtcp->lastSentTime, MN_TSTAMP_NS, MN_TSTAMP_US) * rtcp->clockRate / MN_TSTAMP_US);
+
+        err = rtcp_encode(mb, RTCP_SR, count, rtcp->ssrc, sec, frac, rtpTs, (uint32_t)rtcp->stats.packetsSent, (uint32_t)rtcp->stats.bytesSent, rawr_Rtcp_EncodeBlocks, rtcp);
+    } else {
+        err = rtcp_encode(mb, RTCP_RR, count, rtcp->ssrc, rawr_Rtcp_EncodeBlocks, rtcp);
+    }
+
+    err |= rtcp_encode(mb, RTCP_SDES, 1, rawr_Rtcp_EncodeSdes, rtcp);
+
+    rawr_Rtcp_Schedule(rtcp, now, RAWR_RTCP_INTERVAL_MS);
+    if (!err) rtcp->stats.reportsSent++;
+
+    mn_mutex_unlock(&rtcp->mtx);
+
+    return err ? rawr_Error : rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Rtcp_Stats(rawr_Rtcp *rtcp, rawr_RtcpStats *out_stats)
+{
+    RAWR_ASSERT(rtcp && out_stats);
+
+    rawr_RtcpSource *src;
+
+    mn_mutex_lock(&rtcp->mtx);
+
+    *out_stats = rtcp->stats;
+
+    if ((src = rawr_Rtcp_ActiveSource(rtcp))) {
+        const uint32_t expected = rawr_Rtcp_ExtendedMax(src) - src->baseSeq + 1;
+
+        out_stats->packetsLost = (int64_t)expected - (int64_t)src->received;
+        out_stats->fractionLost = src->fraction / 256.0;
+        out_stats->jitterMs = rawr_Rtcp_ClockToMs(rtcp, src->jitter >> 4);
+    }
+
+    mn_mutex_unlock(&rtcp->mtx);
+}
@@ -0,0 +1,113 @@
+#include "rawr/Semaphore.h"
+#include "rawr/Error.h"
+#include "rawr/Platform.h"
+
+#include "mn/allocator.h"
+
+#if RAWR_PLATFORM_WINDOWS
+#    include <windows.h>
+#elif RAWR_PLATFORM_OSX || RAWR_PLATFORM_IOS
+#    include <dispatch/dispatch.h>
+#else
+#    include <semaphore.h>
+#    include <time.h>
+#endif
+
+typedef struct rawr_Semaphore {
+#if RAWR_PLATFORM_WINDOWS
+    HANDLE handle;
+#elif RAWR_PLATFORM_OSX || RAWR_PLATFORM_IOS
+    dispatch_semaphore_t handle;
+#else
+    sem_t handle;
+#endif
+} rawr_Semaphore;
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Semaphore_Setup(rawr_Semaphore **out_sem)
+{
+    RAWR_ASSERT(out_sem);
+
+    rawr_Semaphore *sem;
+
+    RAWR_GUARD_NULL(sem = MN_MEM_ACQUIRE(sizeof(*sem)));
+
+#if RAWR_PLATFORM_WINDOWS
+    RAWR_GUARD_NULL_CLEANUP(sem->handle = CreateSemaphore(NULL, 0, LONG_MAX, NULL));
+#elif RAWR_PLATFORM_OSX || RAWR_PLATFORM_IOS
+    RAWR_GUARD_NULL_CLEANUP(sem->handle = dispatch_semaphore_create(0));
+#else
+    RAWR_GUARD_CLEANUP(sem_init(&sem->handle, 0, 0));
+#endif
+
+    *out_sem = sem;
+
+    return rawr_Success;
+
+cleanup:
+    MN_MEM_RELEASE(sem);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Semaphore_Cleanup(rawr_Semaphore *sem)
+{
+    RAWR_ASSERT(sem);
+
+#if RAWR_PLATFORM_WINDOWS
+    CloseHandle(sem->handle);
+#elif RAWR_PLATFORM_OSX || RAWR_PLATFORM_IOS
+    dispatch_release(sem->handle);
+#else
+    sem_destroy(&sem->handle);
+#endif
+
+    MN_MEM_RELEASE(sem);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Semaphore_Post(rawr_Semaphore *sem)
+{
+    RAWR_ASSERT(sem);
+
+#if RAWR_PLATFORM_WINDOWS
+    RAWR_GUARD(!ReleaseSemaphore(sem->handle, 1, NULL));
+#elif RAWR_PLATFORM_OSX || RAWR_PLATFORM_IOS
+    dispatch_semaphore_signal(sem->handle);
+#else
+    RAWR_GUARD(sem_post(&sem->handle));
+#endif
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Semaphore_Wait(rawr_Semaphore *sem, int timeoutMs)
+{
+    RAWR_ASSERT(sem && timeoutMs >= 0);
+
+#if RAWR_PLATFORM_WINDOWS
+    DWORD ret = WaitForSingleObject(sem->handle, (DWORD)timeoutMs);
+    if (ret == WAIT_TIMEOUT) return RAWR_SEMAPHORE_TIMEOUT;
+    RAWR_GUARD(ret != WAIT_OBJECT_0);
+#elif RAWR_PLATFORM_OSX || RAWR_PLATFORM_IOS
+    dispatch_time_t deadline = dispatch_time(DISPATCH_TIME_NOW, (int64_t)timeoutMs * NSEC_PER_MSEC);
+    if (dispatch_semaphore_wait(sem->handle, deadline)) return RAWR_SEMAPHORE_TIMEOUT;
+#else
+    struct timespec deadline;
+    RAWR_GUARD(clock_gettime(CLOCK_REALTIME, &deadline));
+    deadline.tv_sec += timeoutMs / 1000;
+    deadline.tv_nsec += (long)(timeoutMs % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    while (sem_timedwait(&sem->handle, &deadline)) {
+        if (errno == ETIMEDOUT) return RAWR_SEMAPHORE_TIMEOUT;
+        RAWR_GUARD(errno != EINTR);
+    }
+#endif
+
+    return rawr_Success;
+}
@@ -0,0 +1,59 @@
+#include "rawr/Simd.h"
+
+#if RAWR_SIMD_X86 && RAWR_C_MSC
+#    include <intrin.h>
+#endif
+
+static rawr_SimdFeatures simd_features = rawr_SimdFeatures_None;
+static rawr_SimdFeatures simd_limit = rawr_SimdFeatures_All;
+static int simd_probed = 0;
+
+// private ------------------------------------------------------------------------------------------------------
+static rawr_SimdFeatures rawr_Simd_Probe(void)
+{
+    rawr_SimdFeatures features = rawr_SimdFeatures_None;
+
+#if RAWR_SIMD_X86
+    /* SSE2 is part of x86-64 itself */
+    features |= rawr_SimdFeatures_SSE2;
+
+#    if RAWR_C_MSC
+    int info[4];
+
+    /* AVX2 is only usable when the OS saves the upper halves of the ymm registers */
+    __cpuid(info, 0);
+    if (info[0] >= 7) {
+        __cpuid(info, 1);
+        if ((info[2] & (1 << 12)) && (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6) {
+            __cpuidex(info, 7, 0);
+            if (info[1] & (1 << 5)) features |= rawr_SimdFeatures_AVX2;
+        }
+    }
+#    else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) features |= rawr_SimdFeatures_AVX2;
+#    endif
+#elif RAWR_SIMD_NEON
+    features |= rawr_SimdFeatures_NEON;
+#endif
+
+    return features;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+rawr_SimdFeatures rawr_Simd_Features(void)
+{
+    /* racing first callers all store the same answer */
+    if (!simd_probed) {
+        simd_features = rawr_Simd_Probe();
+        simd_probed = 1;
+    }
+
+    return simd_features & simd_limit;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Simd_Limit(rawr_SimdFeatures features)
+{
+    simd_limit = features;
+}
@@ -0,0 +1,412 @@
+#include "rawr/Stretch.h"
+#include "rawr/Error.h"
+#include "rawr/Simd.h"
+
+#include "mn/allocator.h"
+
+#include <math.h>
+#include <string.h>
+
+#if RAWR_SIMD_X86
+#    include <immintrin.h>
+#elif RAWR_SIMD_NEON
+#    include <arm_neon.h>
+#endif
+
+/* the coarse search runs on the frame averaged down to this rate */
+#define RAWR_STRETCH_SEARCH_RATE 4000
+
+/* correlation windows are a multiple of this, so the dot kernels never need a scalar tail */
+#define RAWR_STRETCH_LANES 8
+
+/* normalised correlation a period has to reach to be cut or repeated, and mean square below which a frame is quiet, about -50 dBFS */
+#define RAWR_STRETCH_VOICED 0.9f
+#define RAWR_STRETCH_QUIET (32768.0f * 32768.0f * 1e-5f)
+
+/* a frame within 6 dB in power of the noise floor is background and stretches wherever it correlates best */
+#define RAWR_STRETCH_BACKGROUND 4.0f
+#define RAWR_STRETCH_FLOOR_RISE_DB 3.0f
+
+typedef float (*rawr_StretchDotKernel)(const float *a, const float *b, int count);
+typedef void (*rawr_StretchFadeKernel)(rawr_AudioSample *out, const rawr_AudioSample *from, const rawr_AudioSample *to, int count, float weight, float step);
+
+typedef struct rawr_StretchKernels {
+    rawr_StretchDotKernel dot;
+    rawr_StretchFadeKernel fade; /* out = from + (to - from) * (weight + step * i) */
+} rawr_StretchKernels;
+
+typedef struct rawr_Stretch {
+    rawr_StretchKernels kernels;
+    int sampleRate;
+    int frameSize;
+    int decimation; /* frame samples per search sample */
+    int lagMin;
+    int lagMax;
+    int window;       /* correlated at every lag, the frame less the longest lag */
+    int coarseWindow;
+
+    /* mean square, and what it is multiplied by each frame it is not undercut */
+    float floor;
+    float floorRise;
+
+    /* the frame as floats and averaged down for the coarse search, in one allocation */
+    float *memory;
+    float *signal;
+    float *coarse;
+} rawr_Stretch;
+
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Stretch_DotScalar(const float *a, const float *b, int count)
+{
+    float sum = 0.0f;
+
+    for (int i = 0; i < count; i++) {
+        sum += a[i] * b[i];
+    }
+
+    return sum;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Stretch_FadeScalar(rawr_AudioSample *out, const rawr_AudioSample *from, const rawr_AudioSample *to, int count, float weight, float step)
+{
+    for (int i = 0; i < count; i++) {
+        out[i] = (rawr_AudioSample)lrintf(from[i] + (to[i] - from[i]) * (weight + step * i));
+    }
+}
+
+#if RAWR_SIMD_X86
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Stretch_DotSse(const float *a, const float *b, int count)
+{
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+
+    for (int i = 0; i < count; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+
+    acc0 = _mm_add_ps(acc0, acc1);
+    acc0 = _mm_add_ps(acc0, _mm_movehl_ps(acc0, acc0));
+    acc0 = _mm_add_ss(acc0, _mm_shuffle_ps(acc0, acc0, 1));
+
+    return _mm_cvtss_f32(acc0);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Stretch_FadeSse(rawr_AudioSample *out, const rawr_AudioSample *from, const rawr_AudioSample *to, int count, float weight, float step)
+{
+    const __m128 lanes = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f), w = _mm_set1_ps(weight), s = _mm_set1_ps(step);
+    __m128i f, t;
+    __m128 flo, fhi, tlo, thi;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        f = _mm_loadu_si128((const __m128i *)(from + i));
+        t = _mm_loadu_si128((const __m128i *)(to + i));
+        flo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(f, f), 16));
+        fhi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(f, f), 16));
+        tlo = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(t, t), 16));
+        thi = _mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(t, t), 16));
+        flo = _mm_add_ps(flo, _mm_mul_ps(_mm_sub_ps(tlo, flo), _mm_add_ps(w, _mm_mul_ps(s, _mm_add_ps(_mm_set1_ps((float)i), lanes)))));
+        fhi = _mm_add_ps(fhi, _mm_mul_ps(_mm_sub_ps(thi, fhi), _mm_add_ps(w, _mm_mul_ps(s, _mm_add_ps(_mm_set1_ps((float)(i + 4)), lanes)))));
+        _mm_storeu_si128((__m128i *)(out + i), _mm_packs_epi32(_mm_cvtps_epi32(flo), _mm_cvtps_epi32(fhi)));
+    }
+
+    rawr_Stretch_FadeScalar(out + i, from + i, to + i, count - i, weight + step * i, step);
+}
+
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static float rawr_Stretch_DotAvx2(const float *a, const float *b, int count)
+{
+    __m256 acc = _mm256_setzero_ps();
+    __m128 sum;
+
+    for (int i = 0; i < count; i += 8) {
+        acc = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc);
+    }
+
+    sum = _mm_add_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+
+    return _mm_cvtss_f32(sum);
+}
+
+/* packs works within each 128 bit lane, the permute puts the four quarters back in order */
+// private ------------------------------------------------------------------------------------------------------
+RAWR_SIMD_TARGET_AVX2 static void rawr_Stretch_FadeAvx2(rawr_AudioSample *out, const rawr_AudioSample *from, const rawr_AudioSample *to, int count, float weight, float step)
+{
+    const __m256 lanes = _mm256_setr_ps(0.0f, 1.0f, 2.0f, 3.0f, 4.0f, 5.0f, 6.0f, 7.0f), w = _mm256_set1_ps(weight), s = _mm256_set1_ps(step);
+    __m256 flo, fhi, tlo, thi;
+    int i;
+
+    for (i = 0; i + 16 <= count; i += 16) {
+        flo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(from + i))));
+        fhi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(from + i + 8))));
+        tlo = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(to + i))));
+        thi = _mm256_cvtepi32_ps(_mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(to + i + 8))));
+        flo = _mm256_fmadd_ps(_mm256_sub_ps(tlo, flo), _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_set1_ps((float)i), lanes), w), flo);
+        fhi = _mm256_fmadd_ps(_mm256_sub_ps(thi, fhi), _mm256_fmadd_ps(s, _mm256_add_ps(_mm256_set1_ps((float)(i + 8)), lanes), w), fhi);
+        _mm256_storeu_si256((__m256i *)(out + i), _mm256_permute4x64_epi64(_mm256_packs_epi32(_mm256_cvtps_epi32(flo), _mm256_cvtps_epi32(fhi)), 0xd8));
+    }
+
+    _mm256_zeroupper();
+    rawr_Stretch_FadeScalar(out + i, from + i, to + i, count - i, weight + step * i, step);
+}
+#elif RAWR_SIMD_NEON
+/* round to nearest, which 32 bit ARM has no single instruction for */
+#    if defined(__aarch64__) || defined(_M_ARM64)
+#        define RAWR_STRETCH_NEON_ROUND(v) vcvtnq_s32_f32(v)
+#    else
+#        define RAWR_STRETCH_NEON_ROUND(v) vcvtq_s32_f32(vaddq_f32((v), vbslq_f32(vcltq_f32((v), vdupq_n_f32(0.0f)), vdupq_n_f32(-0.5f), vdupq_n_f32(0.5f))))
+#    endif
+
+// private ------------------------------------------------------------------------------------------------------
+static float rawr_Stretch_DotNeon(const float *a, const float *b, int count)
+{
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+
+    for (int i = 0; i < count; i += 8) {
+        acc0 = vmlaq_f32(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = vmlaq_f32(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    }
+
+    acc0 = vaddq_f32(acc0, acc1);
+
+#    if defined(__aarch64__) || defined(_M_ARM64)
+    return vaddvq_f32(acc0);
+#    else
+    float32x2_t sum = vadd_f32(vget_low_f32(acc0), vget_high_f32(acc0));
+    return vget_lane_f32(vpadd_f32(sum, sum), 0);
+#    endif
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Stretch_FadeNeon(rawr_AudioSample *out, const rawr_AudioSample *from, const rawr_AudioSample *to, int count, float weight, float step)
+{
+    static const float laneSteps[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+    const float32x4_t lanes = vld1q_f32(laneSteps), w = vdupq_n_f32(weight);
+    float32x4_t flo, fhi, tlo, thi;
+    int16x8_t f, t;
+    int i;
+
+    for (i = 0; i + 8 <= count; i += 8) {
+        f = vld1q_s16(from + i);
+        t = vld1q_s16(to + i);
+        flo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(f)));
+        fhi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(f)));
+        tlo = vcvtq_f32_s32(vmovl_s16(vget_low_s16(t)));
+        thi = vcvtq_f32_s32(vmovl_s16(vget_high_s16(t)));
+        flo = vmlaq_f32(flo, vsubq_f32(tlo, flo), vmlaq_n_f32(w, vaddq_f32(vdupq_n_f32((float)i), lanes), step));
+        fhi = vmlaq_f32(fhi, vsubq_f32(thi, fhi), vmlaq_n_f32(w, vaddq_f32(vdupq_n_f32((float)(i + 4)), lanes), step));
+        vst1q_s16(out + i, vcombine_s16(vqmovn_s32(RAWR_STRETCH_NEON_ROUND(flo)), vqmovn_s32(RAWR_STRETCH_NEON_ROUND(fhi))));
+    }
+
+    rawr_Stretch_FadeScalar(out + i, from + i, to + i, count - i, weight + step * i, step);
+}
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static void rawr_Stretch_Kernels(rawr_StretchKernels *kernels)
+{
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    (void)features;
+
+    kernels->dot = rawr_Stretch_DotScalar;
+    kernels->fade = rawr_Stretch_FadeScalar;
+
+#if RAWR_SIMD_X86
+    if (features & rawr_SimdFeatures_AVX2) {
+        kernels->dot = rawr_Stretch_DotAvx2;
+        kernels->fade = rawr_Stretch_FadeAvx2;
+    } else if (features & rawr_SimdFeatures_SSE2) {
+        kernels->dot = rawr_Stretch_DotSse;
+        kernels->fade = rawr_Stretch_FadeSse;
+    }
+#elif RAWR_SIMD_NEON
+    if (features & rawr_SimdFeatures_NEON) {
+        kernels->dot = rawr_Stretch_DotNeon;
+        kernels->fade = rawr_Stretch_FadeNeon;
+    }
+#endif
+}
+
+/*
+ * the best lag from lagFrom to lagTo in signal, correlating window samples at the start against window samples that
+ * far on. the energy of the lagged window slides along with it rather than being summed again at every lag
+ */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Stretch_Search(rawr_Stretch *stretch, const float *signal, int window, int lagFrom, int lagTo, float *out_corr)
+{
+    const float energy = stretch->kernels.dot(signal, signal, window);
+    float lagged = stretch->kernels.dot(signal + lagFrom, signal + lagFrom, window);
+    float corr, best = -1.0f;
+    int bestLag = lagFrom;
+
+    for (int lag = lagFrom; lag <= lagTo; lag++) {
+        if (lag > lagFrom) {
+            lagged += signal[lag + window - 1] * signal[lag + window - 1] - signal[lag - 1] * signal[lag - 1];
+            if (lagged < 0.0f) lagged = 0.0f;
+        }
+
+        corr = stretch->kernels.dot(signal, signal + lag, window);
+        corr = corr > 0.0f ? corr / sqrtf(energy * lagged + 1.0f) : 0.0f;
+        if (corr > best) {
+            best = corr;
+            bestLag = lag;
+        }
+    }
+
+    *out_corr = best;
+
+    return bestLag;
+}
+
+/* the period to cut or repeat, 0 when the frame is neither periodic enough nor quiet enough to stretch */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_Stretch_Lag(rawr_Stretch *stretch, const rawr_AudioSample *frame)
+{
+    const int d = stretch->decimation;
+    float power, sum, corr;
+    int lag, from, to, background;
+
+    for (int i = 0; i < stretch->frameSize; i++) {
+        stretch->signal[i] = frame[i];
+    }
+
+    /* taking any period out of near silence is inaudible, so take the longest */
+    power = stretch->kernels.dot(stretch->signal, stretch->signal, stretch->frameSize - stretch->frameSize % RAWR_STRETCH_LANES) / stretch->frameSize;
+    if (power < RAWR_STRETCH_QUIET) return stretch->lagMax;
+
+    /* the floor drops straight to anything quieter and creeps back up, so it settles on the noise between words */
+    if (power < stretch->floor) {
+        stretch->floor = power;
+    } else {
+        stretch->floor *= stretch->floorRise;
+    }
+    background = power < stretch->floor * RAWR_STRETCH_BACKGROUND;
+
+    for (int i = 0; i < stretch->frameSize / d; i++) {
+        sum = 0.0f;
+        for (int k = 0; k < d; k++) {
+            sum += stretch->signal[i * d + k];
+        }
+        stretch->coarse[i] = sum / d;
+    }
+
+    lag = rawr_Stretch_Search(stretch, stretch->coarse, stretch->coarseWindow, (stretch->lagMin + d - 1) / d, stretch->lagMax / d, &corr);
+
+    from = lag * d - d + 1;
+    to = lag * d + d - 1;
+    if (from < stretch->lagMin) from = stretch->lagMin;
+    if (to > stretch->lagMax) to = stretch->lagMax;
+
+    lag = rawr_Stretch_Search(stretch, stretch->signal, stretch->window, from, to, &corr);
+
+    return corr >= RAWR_STRETCH_VOICED || background ? lag : 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Stretch_Setup(rawr_Stretch **out_stretch, int sampleRate, int frameSize)
+{
+    RAWR_ASSERT(out_stretch);
+
+    rawr_Stretch *stretch;
+    int decimation, lagMin, lagMax;
+
+    RAWR_GUARD(sampleRate <= 0 || sampleRate % RAWR_STRETCH_SEARCH_RATE || frameSize <= 0);
+
+    decimation = sampleRate / RAWR_STRETCH_SEARCH_RATE;
+    lagMin = (int)((int64_t)sampleRate * RAWR_STRETCH_LAG_MIN_US / 1000000);
+    lagMax = (int)((int64_t)sampleRate * RAWR_STRETCH_LAG_MAX_US / 1000000);
+    if (lagMax > frameSize / 2) lagMax = frameSize / 2;
+
+    /* the coarse search needs a few lags and a window of its own to work with */
+    RAWR_GUARD(lagMax / decimation - lagMin / decimation < 2 || (frameSize - lagMax) / decimation < RAWR_STRETCH_LANES);
+
+    RAWR_GUARD_NULL(stretch = MN_MEM_ACQUIRE(sizeof(*stretch)));
+    memset(stretch, 0, sizeof(*stretch));
+
+    stretch->sampleRate = sampleRate;
+    stretch->frameSize = frameSize;
+    stretch->decimation = decimation;
+    stretch->lagMin = lagMin;
+    stretch->lagMax = lagMax;
+    stretch->window = (frameSize - lagMax) / RAWR_STRETCH_LANES * RAWR_STRETCH_LANES;
+    stretch->coarseWindow = (frameSize - lagMax) / decimation / RAWR_STRETCH_LANES * RAWR_STRETCH_LANES;
+    stretch->floor = 32768.0f * 32768.0f;
+    stretch->floorRise = powf(10.0f, RAWR_STRETCH_FLOOR_RISE_DB * frameSize / sampleRate / 10.0f);
+
+    RAWR_GUARD_NULL_CLEANUP(stretch->memory = MN_MEM_ACQUIRE((frameSize + frameSize / decimation) * sizeof(float)));
+    stretch->signal = stretch->memory;
+    stretch->coarse = stretch->memory + frameSize;
+
+    rawr_Stretch_Kernels(&stretch->kernels);
+
+    *out_stretch = stretch;
+
+    return rawr_Success;
+
+cleanup:
+    MN_MEM_RELEASE(stretch);
+
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_Stretch_Cleanup(rawr_Stretch *stretch)
+{
+    RAWR_ASSERT(stretch);
+
+    MN_MEM_RELEASE(stretch->memory);
+    MN_MEM_RELEASE(stretch);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Stretch_OutputMax(rawr_Stretch *stretch)
+{
+    RAWR_ASSERT(stretch);
+    return stretch->frameSize + stretch->lagMax;
+}
+
+/* the period before fades into the one after it, which plays on from there, both ends meeting the frame's own */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Stretch_Accelerate(rawr_Stretch *stretch, const rawr_AudioSample *frame, rawr_AudioSample *out)
+{
+    RAWR_ASSERT(stretch && frame && out);
+
+    const int lag = rawr_Stretch_Lag(stretch, frame);
+
+    if (!lag) {
+        memcpy(out, frame, stretch->frameSize * sizeof(rawr_AudioSample));
+        return stretch->frameSize;
+    }
+
+    stretch->kernels.fade(out, frame, frame + lag, lag, 1.0f / (lag + 1), 1.0f / (lag + 1));
+    memcpy(out + lag, frame + 2 * lag, (stretch->frameSize - 2 * lag) * sizeof(rawr_AudioSample));
+
+    return stretch->frameSize - lag;
+}
+
+/* the second period fades back into the first, which plays again from there */
+// --------------------------------------------------------------------------------------------------------------
+int rawr_Stretch_Expand(rawr_Stretch *stretch, const rawr_AudioSample *frame, rawr_AudioSample *out)
+{
+    RAWR_ASSERT(stretch && frame && out);
+
+    const int lag = rawr_Stretch_Lag(stretch, frame);
+
+    if (!lag) {
+        memcpy(out, frame, stretch->frameSize * sizeof(rawr_AudioSample));
+        return stretch->frameSize;
+    }
+
+    memcpy(out, frame, lag * sizeof(rawr_AudioSample));
+    stretch->kernels.fade(out + lag, frame + lag, frame, lag, 1.0f / (lag + 1), 1.0f / (lag + 1));
+    memcpy(out + 2 * lag, frame + lag, (stretch->frameSize - lag) * sizeof(rawr_AudioSample));
+
+    return stretch->frameSize + lag;
+}
@@ -0,0 +1,503 @@
+#if defined(__linux__) && !defined(_GNU_SOURCE)
+#    define _GNU_SOURCE /* sendmmsg, recvmmsg */
+#endif
+
+#include "rawr/UdpBatch.h"
+#include "rawr/Error.h"
+
+#include "mn/allocator.h"
+#include "mn/time.h"
+
+#include "re.h"
+
+#if RAWR_SOCK_API_WINSOCK
+#    define RAWR_UDPBATCH_WOULDBLOCK() (WSAGetLastError() == WSAEWOULDBLOCK)
+#    define RAWR_UDPBATCH_INTERRUPTED() (WSAGetLastError() == WSAEINTR)
+#else
+#    include <errno.h>
+#    include <poll.h>
+#    define RAWR_UDPBATCH_WOULDBLOCK() (errno == EAGAIN || errno == EWOULDBLOCK)
+#    define RAWR_UDPBATCH_INTERRUPTED() (errno == EINTR)
+#endif
+
+#if defined(__linux__) && RAWR_SOCK_API_POSIX
+#    define RAWR_UDPBATCH_MMSG 1
+#    include <sys/uio.h>
+#    ifndef UDP_SEGMENT
+#        define UDP_SEGMENT 103
+#    endif
+#    ifndef SOL_UDP
+#        define SOL_UDP IPPROTO_UDP
+#    endif
+#endif
+
+/* enough for a few hundred calls per socket without the kernel dropping a burst */
+#define RAWR_UDPBATCH_SOCKET_BUFFER_BYTES (1024 * 1024)
+#define RAWR_UDPBATCH_GSO_BYTES_MAX 65000
+
+typedef struct rawr_UdpBatchPacket {
+    RAWR_SOCK_TYPE fd;
+    struct sa dst;
+    const uint8_t *data;
+    size_t len;
+} rawr_UdpBatchPacket;
+
+typedef struct rawr_UdpBatch {
+    int sendCapacity;
+    int sendCount;
+    rawr_UdpBatchPacket *sends;
+
+    int recvCapacity;
+    uint8_t *recvBuffers;
+    struct sa *recvFrom;
+
+#if RAWR_UDPBATCH_MMSG
+    struct iovec *sendIov;
+    struct mmsghdr *sendMsgs;
+    uint8_t *sendControl;
+    struct iovec *recvIov;
+    struct mmsghdr *recvMsgs;
+#endif
+
+    int gso;
+    rawr_UdpBatchStats stats;
+} rawr_UdpBatch;
+
+#if RAWR_UDPBATCH_MMSG
+#    define RAWR_UDPBATCH_CONTROL_BYTES CMSG_SPACE(sizeof(uint16_t))
+#endif
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_UdpBatch_SetNonBlocking(RAWR_SOCK_TYPE fd)
+{
+#if RAWR_SOCK_API_WINSOCK
+    u_long mode = 1;
+    RAWR_GUARD(ioctlsocket(fd, FIONBIO, &mode));
+#else
+    int flags;
+    RAWR_GUARD((flags = fcntl(fd, F_GETFL, 0)) < 0);
+    RAWR_GUARD(fcntl(fd, F_SETFL, flags | O_NONBLOCK));
+#endif
+    return rawr_Success;
+}
+
+/* UDP_SEGMENT arrived in 4.18, a kernel without it refuses the getsockopt */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_UdpBatch_GsoSupported(void)
+{
+#if RAWR_UDPBATCH_MMSG
+    int fd, segment = 0;
+    socklen_t len = sizeof(segment);
+    int supported;
+
+    if ((fd = socket(AF_INET, SOCK_DGRAM, 0)) < 0) return 0;
+    supported = getsockopt(fd, SOL_UDP, UDP_SEGMENT, &segment, &len) == 0;
+    close(fd);
+
+    return supported;
+#else
+    return 0;
+#endif
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_UdpBatch_SendOne(rawr_UdpBatch *batch, const rawr_UdpBatchPacket *pkt)
+{
+    batch->stats.sendCalls++;
+
+    if (sendto(pkt->fd, (const char *)pkt->data, (int)pkt->len, 0, &pkt->dst.u.sa, pkt->dst.len) < 0) {
+        batch->stats.sendErrors++;
+        return rawr_Error;
+    }
+
+    return rawr_Success;
+}
+
+#if RAWR_UDPBATCH_MMSG
+/* how many packets from first on can go out as one GSO message: same socket and peer, equal sizes but the last */
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_UdpBatch_GsoRun(rawr_UdpBatch *batch, int first)
+{
+    const rawr_UdpBatchPacket *head = batch->sends + first;
+    size_t bytes = head->len;
+    int run = 1;
+
+    if (!batch->gso) return 1;
+
+    while (first + run < batch->sendCount && run < RAWR_UDPBATCH_GSO_SEGMENTS_MAX) {
+        const rawr_UdpBatchPacket *pkt = batch->sends + first + run;
+
+        if (pkt->fd != head->fd || pkt->len > head->len) break;
+        if (batch->sends[first + run - 1].len != head->len) break;
+        if (bytes + pkt->len > RAWR_UDPBATCH_GSO_BYTES_MAX) break;
+        if (!sa_cmp(&pkt->dst, &head->dst, SA_ALL)) break;
+
+        bytes += pkt->len;
+        run++;
+    }
+
+    return run;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_UdpBatch_FlushMmsg(rawr_UdpBatch *batch)
+{
+    int first = 0;
+    int sent = 0;
+
+    while (first < batch->sendCount) {
+        const RAWR_SOCK_TYPE fd = batch->sends[first].fd;
+        int msgCount = 0;
+        int next = first;
+        int done = 0;
+        int ret;
+
+        /* one sendmmsg per run of packets sharing a socket */
+        while (next < batch->sendCount && batch->sends[next].fd == fd) {
+            struct mmsghdr *msg = batch->sendMsgs + msgCount;
+            rawr_UdpBatchPacket *pkt = batch->sends + next;
+            const int run = rawr_UdpBatch_GsoRun(batch, next);
+
+            for (int i = 0; i < run; i++) {
+                batch->sendIov[next + i].iov_base = (void *)pkt[i].data;
+                batch->sendIov[next + i].iov_len = pkt[i].len;
+            }
+
+            memset(msg, 0, sizeof(*msg));
+            msg->msg_hdr.msg_name = &pkt->dst.u.sa;
+            msg->msg_hdr.msg_namelen = pkt->dst.len;
+            msg->msg_hdr.msg_iov = batch->sendIov + next;
+            msg->msg_hdr.msg_iovlen = run;
+
+            if (run > 1) {
+                struct cmsghdr *cmsg;
+
+                msg->msg_hdr.msg_control = batch->sendControl + msgCount * RAWR_UDPBATCH_CONTROL_BYTES;
+                msg->msg_hdr.msg_controllen = RAWR_UDPBATCH_CONTROL_BYTES;
+
+                cmsg = CMSG_FIRSTHDR(&msg->msg_hdr);
+                cmsg->cmsg_level = SOL_UDP;
+                cmsg->cmsg_type = UDP_SEGMENT;
+                cmsg->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *)CMSG_DATA(cmsg) = (uint16_t)pkt->len;
+            }
+
+            msgCount++;
+            next += run;
+        }
+
+        while (done < msgCount) {
+            struct mmsghdr *msg = batch->sendMsgs + done;
+
+            batch->stats.sendCalls++;
+            ret = sendmmsg(fd, msg, msgCount - done, 0);
+            if (ret > 0) {
+                for (int i = 0; i < ret; i++) {
+                    if (msg[i].msg_hdr.msg_iovlen > 1) batch->stats.gsoSends++;
+                    sent += (int)msg[i].msg_hdr.msg_iovlen;
+                }
+                done += ret;
+                continue;
+            }
+
+            if (RAWR_UDPBATCH_INTERRUPTED()) continue;
+
+            /* only the first message failed, a GSO message gets another go one packet at a time */
+            if (msg->msg_hdr.msg_iovlen > 1) {
+                const rawr_UdpBatchPacket *pkt = batch->sends + (msg->msg_hdr.msg_iov - batch->sendIov);
+
+                batch->gso = 0;
+                for (size_t i = 0; i < msg->msg_hdr.msg_iovlen; i++) {
+                    if (rawr_UdpBatch_SendOne(batch, pkt + i) == rawr_Success) sent++;
+                }
+            } else {
+                batch->stats.sendErrors++;
+            }
+
+            done++;
+        }
+
+        first = next;
+    }
+
+    batch->stats.packetsSent += sent;
+    batch->sendCount = 0;
+
+    return sent;
+}
+
+// private ------------------------------------------------------------------------------------------------------
+static int rawr_UdpBatch_RecvMmsg(rawr_UdpBatch *batch, RAWR_SOCK_TYPE fd, rawr_UdpBatch_RecvHandler handler, void *arg)
+{
+    int received = 0;
+    int ret;
+    uint64_t arrival;
+
+    for (;;) {
+        for (int i = 0; i < batch->recvCapacity; i++) {
+            struct mmsghdr *msg = batch->recvMsgs + i;
+
+            batch->recvIov[i].iov_base = batch->recvBuffers + i * RAWR_UDPBATCH_PACKET_MAX;
+            batch->recvIov[i].iov_len = RAWR_UDPBATCH_PACKET_MAX;
+
+            memset(msg, 0, sizeof(*msg));
+            msg->msg_hdr.msg_name = &batch->recvFrom[i].u.sa;
+            msg->msg_hdr.msg_namelen = sizeof(batch->recvFrom[i].u);
+            msg->msg_hdr.msg_iov = batch->recvIov + i;
+            msg->msg_hdr.msg_iovlen = 1;
+        }
+
+        batch->stats.recvCalls++;
+        ret = recvmmsg(fd, batch->recvMsgs, batch->recvCapacity, MSG_DONTWAIT, NULL);
+        if (ret < 0) {
+            if (RAWR_UDPBATCH_INTERRUPTED()) continue;
+            if (RAWR_UDPBATCH_WOULDBLOCK()) break;
+            return rawr_Error;
+        }
+
+        arrival = mn_tstamp();
+        for (int i = 0; i < ret; i++) {
+            struct mmsghdr *msg = batch->recvMsgs + i;
+
+            /* too big to be one of ours */
+            if (msg->msg_hdr.msg_flags & MSG_TRUNC) continue;
+
+            batch->recvFrom[i].len = msg->msg_hdr.msg_namelen;
+            handler(batch->recvFrom + i, batch->recvBuffers + i * RAWR_UDPBATCH_PACKET_MAX, msg->msg_len, arrival, arg);
+        }
+
+        received += ret;
+
+        /* a short read means the socket is empty, skip the syscall that would tell us so */
+        if (ret < batch->recvCapacity) break;
+    }
+
+    batch->stats.packetsReceived += received;
+
+    return received;
+}
+#endif
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Open(RAWR_SOCK_TYPE *out_fd, struct sa *local)
+{
+    RAWR_ASSERT(out_fd && local);
+
+    RAWR_SOCK_TYPE fd;
+    int bufferBytes = RAWR_UDPBATCH_SOCKET_BUFFER_BYTES;
+
+#if RAWR_SOCK_API_WINSOCK
+    RAWR_GUARD((fd = socket(sa_af(local), SOCK_DGRAM, IPPROTO_UDP)) == INVALID_SOCKET);
+#else
+    RAWR_GUARD((fd = socket(sa_af(local), SOCK_DGRAM, IPPROTO_UDP)) < 0);
+#endif
+
+    RAWR_GUARD_CLEANUP(bind(fd, &local->u.sa, local->len));
+    local->len = sizeof(local->u);
+    RAWR_GUARD_CLEANUP(getsockname(fd, &local->u.sa, &local->len));
+    RAWR_GUARD_CLEANUP(rawr_UdpBatch_SetNonBlocking(fd));
+
+    /* best effort, the default is fine for a single call */
+    (void)setsockopt(fd, SOL_SOCKET, SO_RCVBUF, (const char *)&bufferBytes, sizeof(bufferBytes));
+    (void)setsockopt(fd, SOL_SOCKET, SO_SNDBUF, (const char *)&bufferBytes, sizeof(bufferBytes));
+
+    *out_fd = fd;
+
+    return rawr_Success;
+
+cleanup:
+    rawr_UdpBatch_Close(fd);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_UdpBatch_Close(RAWR_SOCK_TYPE fd)
+{
+#if RAWR_SOCK_API_WINSOCK
+    closesocket(fd);
+#else
+    close(fd);
+#endif
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Setup(rawr_UdpBatch **out_batch, int sendCapacity, int recvCapacity)
+{
+    RAWR_ASSERT(out_batch && sendCapacity > 0 && recvCapacity > 0);
+
+    rawr_UdpBatch *batch;
+
+    RAWR_GUARD_NULL(batch = MN_MEM_ACQUIRE(sizeof(*batch)));
+    memset(batch, 0, sizeof(*batch));
+
+    batch->sendCapacity = sendCapacity;
+    batch->recvCapacity = recvCapacity;
+    batch->gso = rawr_UdpBatch_GsoSupported();
+
+    RAWR_GUARD_NULL_CLEANUP(batch->sends = MN_MEM_ACQUIRE(sendCapacity * sizeof(*batch->sends)));
+    RAWR_GUARD_NULL_CLEANUP(batch->recvBuffers = MN_MEM_ACQUIRE(recvCapacity * RAWR_UDPBATCH_PACKET_MAX));
+    RAWR_GUARD_NULL_CLEANUP(batch->recvFrom = MN_MEM_ACQUIRE(recvCapacity * sizeof(*batch->recvFrom)));
+
+#if RAWR_UDPBATCH_MMSG
+    RAWR_GUARD_NULL_CLEANUP(batch->sendIov = MN_MEM_ACQUIRE(sendCapacity * sizeof(*batch->sendIov)));
+    RAWR_GUARD_NULL_CLEANUP(batch->sendMsgs = MN_MEM_ACQUIRE(sendCapacity * sizeof(*batch->sendMsgs)));
+    RAWR_GUARD_NULL_CLEANUP(batch->sendControl = MN_MEM_ACQUIRE(sendCapacity * RAWR_UDPBATCH_CONTROL_BYTES));
+    RAWR_GUARD_NULL_CLEANUP(batch->recvIov = MN_MEM_ACQUIRE(recvCapacity * sizeof(*batch->recvIov)));
+    RAWR_GUARD_NULL_CLEANUP(batch->recvMsgs = MN_MEM_ACQUIRE(recvCapacity * sizeof(*batch->recvMsgs)));
+    memset(batch->sendControl, 0, sendCapacity * RAWR_UDPBATCH_CONTROL_BYTES);
+#endif
+
+    *out_batch = batch;
+
+    return rawr_Success;
+
+cleanup:
+    rawr_UdpBatch_Cleanup(batch);
+    return rawr_Error;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_UdpBatch_Cleanup(rawr_UdpBatch *batch)
+{
+    RAWR_ASSERT(batch);
+
+#if RAWR_UDPBATCH_MMSG
+    if (batch->recvMsgs) MN_MEM_RELEASE(batch->recvMsgs);
+    if (batch->recvIov) MN_MEM_RELEASE(batch->recvIov);
+    if (batch->sendControl) MN_MEM_RELEASE(batch->sendControl);
+    if (batch->sendMsgs) MN_MEM_RELEASE(batch->sendMsgs);
+    if (batch->sendIov) MN_MEM_RELEASE(batch->sendIov);
+#endif
+    if (batch->recvFrom) MN_MEM_RELEASE(batch->recvFrom);
+    if (batch->recvBuffers) MN_MEM_RELEASE(batch->recvBuffers);
+    if (batch->sends) MN_MEM_RELEASE(batch->sends);
+    MN_MEM_RELEASE(batch);
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_UdpBatch_SetGso(rawr_UdpBatch *batch, int enabled)
+{
+    RAWR_ASSERT(batch);
+    batch->gso = enabled && rawr_UdpBatch_GsoSupported();
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Gso(rawr_UdpBatch *batch)
+{
+    RAWR_ASSERT(batch);
+    return batch->gso;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Queue(rawr_UdpBatch *batch, RAWR_SOCK_TYPE fd, const struct sa *dst, const uint8_t *data, size_t len)
+{
+    RAWR_ASSERT(batch && dst && data);
+
+    rawr_UdpBatchPacket *pkt;
+
+    RAWR_GUARD(len > RAWR_UDPBATCH_PACKET_MAX);
+
+    if (batch->sendCount == batch->sendCapacity) {
+        RAWR_GUARD(rawr_UdpBatch_Flush(batch) < 0);
+    }
+
+    pkt = batch->sends + batch->sendCount++;
+    pkt->fd = fd;
+    pkt->dst = *dst;
+    pkt->data = data;
+    pkt->len = len;
+
+    return rawr_Success;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Flush(rawr_UdpBatch *batch)
+{
+    RAWR_ASSERT(batch);
+
+#if RAWR_UDPBATCH_MMSG
+    return rawr_UdpBatch_FlushMmsg(batch);
+#else
+    int sent = 0;
+
+    for (int i = 0; i < batch->sendCount; i++) {
+        if (rawr_UdpBatch_SendOne(batch, batch->sends + i) == rawr_Success) sent++;
+    }
+
+    batch->stats.packetsSent += sent;
+    batch->sendCount = 0;
+
+    return sent;
+#endif
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Recv(rawr_UdpBatch *batch, RAWR_SOCK_TYPE fd, rawr_UdpBatch_RecvHandler handler, void *arg)
+{
+    RAWR_ASSERT(batch && handler);
+
+#if RAWR_UDPBATCH_MMSG
+    return rawr_UdpBatch_RecvMmsg(batch, fd, handler, arg);
+#else
+    int received = 0;
+    int ret;
+    struct sa *src = batch->recvFrom;
+
+    for (;;) {
+        src->len = sizeof(src->u);
+
+        batch->stats.recvCalls++;
+        ret = (int)recvfrom(fd, (char *)batch->recvBuffers, RAWR_UDPBATCH_PACKET_MAX, 0, &src->u.sa, &src->len);
+        if (ret < 0) {
+            if (RAWR_UDPBATCH_INTERRUPTED()) continue;
+            if (RAWR_UDPBATCH_WOULDBLOCK()) break;
+            return rawr_Error;
+        }
+
+        handler(src, batch->recvBuffers, (size_t)ret, mn_tstamp(), arg);
+        received++;
+    }
+
+    batch->stats.packetsReceived += received;
+
+    return received;
+#endif
+}
+
+// --------------------------------------------------------------------------------------------------------------
+int rawr_UdpBatch_Wait(const RAWR_SOCK_TYPE *fds, int count, int timeoutMs)
+{
+    RAWR_ASSERT(fds && count > 0 && count <= 8);
+
+    int ret;
+
+#if RAWR_SOCK_API_WINSOCK
+    WSAPOLLFD pfds[8];
+#else
+    struct pollfd pfds[8];
+#endif
+
+    for (int i = 0; i < count; i++) {
+        pfds[i].fd = fds[i];
+        pfds[i].events = POLLIN;
+        pfds[i].revents = 0;
+    }
+
+#if RAWR_SOCK_API_WINSOCK
+    ret = WSAPoll(pfds, count, timeoutMs);
+#else
+    ret = poll(pfds, count, timeoutMs);
+    if (ret < 0 && RAWR_UDPBATCH_INTERRUPTED()) return 0;
+#endif
+
+    RAWR_GUARD(ret < 0);
+
+    return ret > 0;
+}
+
+// --------------------------------------------------------------------------------------------------------------
+void rawr_UdpBatch_Stats(rawr_UdpBatch *batch, rawr_UdpBatchStats *out_stats)
+{
+    RAWR_ASSERT(batch && out_stats);
+    *out_stats = batch->stats;
+}
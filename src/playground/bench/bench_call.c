@@ -0,0 +1,546 @@
+/*
+ * The whole media path under load, with no SIP server or sound card. An engine hosts N calls which dial a SIP
+ * stand-in on loopback, built on re's sipsess. The stand-in answers each call with a leg of its own and reflects
+ * the leg's RTP and RTCP straight back to the caller, answering with the caller's own SRTP key so it never has
+ * to decrypt anything. Each call's media therefore runs capture, encode, protect, send, receive, unprotect,
+ * jitter buffer and decode against itself, and the stand-in costs one sendto per packet.
+ *
+ * Capture is low level noise, loud enough that the encoder never drops into DTX, with a tone burst once a
+ * second. The playback handler times each burst back out, which is mouth to ear latency minus the device
+ * buffers. CPU is the whole process over the measured window, stand-in included, allocations are every
+ * MN_MEM_ACQUIRE plus the change in live re blocks.
+ *
+ * usage: rawr_bench_call [pairs] [seconds] [workers]
+ */
+
+#include "rawr/Call.h"
+#include "rawr/Engine.h"
+#include "rawr/Error.h"
+#include "rawr/Histogram.h"
+#include "rawr/Net.h"
+#include "rawr/Semaphore.h"
+
+#include "mn/allocator.h"
+#include "mn/atomic.h"
+#include "mn/thread.h"
+#include "mn/time.h"
+
+#include "re.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define BENCH_PAIRS_MAX 4096
+#define BENCH_RATE 48000
+#define BENCH_NOISE_SHIFT 5 /* +-1024 */
+#define BENCH_MARKER_FRAMES 50 /* one burst a second */
+#define BENCH_MARKER_SAMPLES 480
+#define BENCH_MARKER_HZ 1000
+#define BENCH_MARKER_AMPLITUDE 20000
+#define BENCH_MARKER_THRESHOLD 8000
+#define BENCH_CONNECT_WAIT_MS 15000
+#define BENCH_WARMUP_MS 2000
+#define BENCH_POLL_MS 50
+#define BENCH_PORT_TRIES 64
+#define BENCH_PT "116"
+
+/* one answered call on the stand-in */
+typedef struct bench_leg {
+    struct sipsess *sess;
+    struct sdp_session *sdp;
+    struct sdp_media *media;
+    struct udp_sock *rtp;
+    struct udp_sock *rtcp;
+} bench_leg;
+
+typedef struct bench_standin {
+    mn_thread_t thread;
+    rawr_Semaphore *ready;
+    int err;
+
+    struct sip *sip;
+    struct tls *tls;
+    struct sipsess_sock *sock;
+    struct mqueue *queue;
+    struct sa addr;
+
+    bench_leg *legs;
+    int legCount;
+    int legMax;
+    mn_atomic_t established;
+} bench_standin;
+
+/* everything the media handlers touch runs on the call's worker, the counters are read from main */
+typedef struct bench_call {
+    rawr_Call *call;
+    uint32_t noise;
+    uint64_t frames;
+    uint64_t markerAt; /* tick the pending burst went in on, 0 when none is pending */
+
+    mn_atomic_t markersSent;
+    mn_atomic_t markersHeard;
+
+    rawr_CallStats stats;
+    rawr_CallMetrics *metrics;
+} bench_call;
+
+static bench_standin standin;
+static bench_call *calls;
+static rawr_Histogram *latency;
+static mn_atomic_t measuring;
+static rawr_AudioSample marker[BENCH_MARKER_SAMPLES];
+
+static mn_allocator_aquire_fn acquire_fn;
+static mn_atomic_t acquires;
+
+static double cpu_seconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+/* counts every MN_MEM_ACQUIRE in the process, rawr's own allocations included */
+static void *counting_acquire(const struct mn_allocator_s *allocator, size_t sz)
+{
+    mn_atomic_fetch_add(&acquires, 1);
+    return acquire_fn(allocator, sz);
+}
+
+static size_t re_blocks(void)
+{
+    struct memstat stat;
+    if (mem_get_stat(&stat)) return 0;
+    return stat.blocks_cur;
+}
+
+static void on_capture(rawr_Call *call, rawr_AudioSample *samples, int sampleCount, void *arg)
+{
+    bench_call *bc = (bench_call *)arg;
+    (void)call;
+
+    for (int i = 0; i < sampleCount; i++) {
+        bc->noise ^= bc->noise << 13;
+        bc->noise ^= bc->noise >> 17;
+        bc->noise ^= bc->noise << 5;
+        samples[i] = (rawr_AudioSample)((int16_t)bc->noise >> BENCH_NOISE_SHIFT);
+    }
+
+    if (++bc->frames % BENCH_MARKER_FRAMES) return;
+
+    memcpy(samples, marker, sizeof(marker));
+
+    /* a burst not heard by the time the next goes in counts as lost */
+    bc->markerAt = mn_tstamp();
+    if (mn_atomic_load(&measuring)) mn_atomic_fetch_add(&bc->markersSent, 1);
+}
+
+static void on_playback(rawr_Call *call, rawr_AudioSample *samples, int sampleCount, void *arg)
+{
+    bench_call *bc = (bench_call *)arg;
+    const uint64_t now = mn_tstamp();
+    (void)call;
+
+    if (!bc->markerAt) return;
+
+    for (int i = 0; i < sampleCount; i++) {
+        if (samples[i] < BENCH_MARKER_THRESHOLD && samples[i] > -BENCH_MARKER_THRESHOLD) continue;
+
+        /* the burst went in at the start of its frame, so the offset it comes out at is extra delay */
+        if (mn_atomic_load(&measuring)) {
+            rawr_Histogram_Record(latency, (now - bc->markerAt) / 1000 + (uint64_t)i * 1000000 / BENCH_RATE);
+            mn_atomic_fetch_add(&bc->markersHeard, 1);
+        }
+
+        bc->markerAt = 0;
+        return;
+    }
+}
+
+static void leg_on_rtp(const struct sa *src, struct mbuf *mb, void *arg)
+{
+    bench_leg *leg = (bench_leg *)arg;
+    (void)udp_send(leg->rtp, src, mb);
+}
+
+static void leg_on_rtcp(const struct sa *src, struct mbuf *mb, void *arg)
+{
+    bench_leg *leg = (bench_leg *)arg;
+    (void)udp_send(leg->rtcp, src, mb);
+}
+
+/* answer the first crypto line with the offer's own key, which is what lets the leg reflect without decrypting */
+static bool leg_on_crypto(const char *name, const char *value, void *arg)
+{
+    bench_leg *leg = (bench_leg *)arg;
+    (void)name;
+
+    return value && !sdp_media_set_lattr(leg->media, true, "crypto", "%s", value);
+}
+
+static void leg_on_establish(const struct sip_msg *msg, void *arg)
+{
+    (void)msg;
+    (void)arg;
+    mn_atomic_fetch_add(&standin.established, 1);
+}
+
+static void leg_on_close(int err, const struct sip_msg *msg, void *arg)
+{
+    bench_leg *leg = (bench_leg *)arg;
+    (void)err;
+    (void)msg;
+
+    leg->sess = mem_deref(leg->sess);
+}
+
+static int leg_setup(bench_leg *leg)
+{
+    struct sa rtpAddr, rtcpAddr;
+    uint16_t port = 0;
+    int err = EADDRINUSE;
+
+    rtpAddr = standin.addr;
+
+    /* RTCP on the odd port above RTP, as rawr expects */
+    for (int i = 0; err && i < BENCH_PORT_TRIES; i++) {
+        port = ((rand_u16() % 16383) + 16384) & 0xfffe;
+        sa_set_port(&rtpAddr, port);
+        rtcpAddr = rtpAddr;
+        sa_set_port(&rtcpAddr, port + 1);
+
+        if ((err = udp_listen(&leg->rtp, &rtpAddr, leg_on_rtp, leg))) continue;
+        if ((err = udp_listen(&leg->rtcp, &rtcpAddr, leg_on_rtcp, leg))) leg->rtp = mem_deref(leg->rtp);
+    }
+    if (err) return err;
+
+    if ((err = sdp_session_alloc(&leg->sdp, &rtpAddr))) return err;
+    if ((err = sdp_media_add(&leg->media, leg->sdp, "audio", port, "RTP/SAVP"))) return err;
+    sdp_media_set_lport_rtcp(leg->media, port + 1);
+
+    return sdp_format_add(NULL, leg->media, false, BENCH_PT, "opus", BENCH_RATE, 2, NULL, NULL, NULL, false, NULL);
+}
+
+static void leg_cleanup(bench_leg *leg)
+{
+    leg->sess = mem_deref(leg->sess);
+    leg->sdp = mem_deref(leg->sdp);
+    leg->rtp = mem_deref(leg->rtp);
+    leg->rtcp = mem_deref(leg->rtcp);
+}
+
+static void standin_on_connect(const struct sip_msg *msg, void *arg)
+{
+    bench_leg *leg;
+    struct mbuf *mb = NULL;
+    int err;
+    (void)arg;
+
+    if (standin.legCount == standin.legMax) {
+        (void)sip_treply(NULL, standin.sip, msg, 486, "Busy Here");
+        return;
+    }
+
+    leg = standin.legs + standin.legCount++;
+
+    err = leg_setup(leg);
+    if (!err) err = sdp_decode(leg->sdp, msg->mb, true);
+    if (!err && !sdp_media_rattr_apply(leg->media, "crypto", leg_on_crypto, leg)) err = EPROTO;
+    if (!err) err = sdp_encode(&mb, leg->sdp, false);
+    if (!err) {
+        err = sipsess_accept(&leg->sess, standin.sock, msg, 200, "OK", "bench", "application/sdp", mb, NULL, NULL, false,
+            NULL, NULL, leg_on_establish, NULL, NULL, leg_on_close, leg, NULL);
+    }
+
+    mem_deref(mb);
+
+    if (err) {
+        fprintf(stderr, "stand-in could not answer: %s\n", strerror(err));
+        (void)sip_treply(NULL, standin.sip, msg, 500, strerror(err));
+    }
+}
+
+static void standin_on_exit(void *arg)
+{
+    (void)arg;
+    re_cancel();
+}
+
+static void standin_on_message(int id, void *data, void *arg)
+{
+    (void)id;
+    (void)data;
+    (void)arg;
+
+    for (int i = 0; i < standin.legCount; i++) {
+        standin.legs[i].sess = mem_deref(standin.legs[i].sess);
+    }
+
+    sip_close(standin.sip, false);
+}
+
+static void standin_thread(void *arg)
+{
+    int signalled = 0;
+    int err;
+    (void)arg;
+
+    err = re_thread_init();
+    if (err == ENOSYS) err = 0;
+    if (err) goto out;
+
+    sa_set_str(&standin.addr, "127.0.0.1", 0);
+
+    if ((err = sip_alloc(&standin.sip, NULL, 1024, 1024, 1024, "rawr_bench_call", standin_on_exit, NULL))) goto out;
+    if ((err = tls_alloc(&standin.tls, TLS_METHOD_SSLV23, NULL, NULL))) goto out;
+    if ((err = tls_set_selfsigned_ec(standin.tls, "rawr_bench_call", "prime256v1"))) goto out;
+    if ((err = sip_transp_add(standin.sip, SIP_TRANSP_TLS, &standin.addr, standin.tls))) goto out;
+    if ((err = sip_transp_laddr(standin.sip, &standin.addr, SIP_TRANSP_TLS, NULL))) goto out;
+    if ((err = sipsess_listen(&standin.sock, standin.sip, 1024, standin_on_connect, NULL))) goto out;
+    if ((err = mqueue_alloc(&standin.queue, standin_on_message, NULL))) goto out;
+
+    rawr_Semaphore_Post(standin.ready);
+    signalled = 1;
+
+    err = re_main(NULL);
+
+out:
+    if (!signalled) {
+        standin.err = err ? err : EINVAL;
+        rawr_Semaphore_Post(standin.ready);
+    }
+
+    for (int i = 0; i < standin.legCount; i++) leg_cleanup(standin.legs + i);
+
+    standin.queue = mem_deref(standin.queue);
+    standin.sock = mem_deref(standin.sock);
+    standin.sip = mem_deref(standin.sip);
+    standin.tls = mem_deref(standin.tls);
+
+    re_thread_close();
+}
+
+/* what was recorded between two snapshots of the same histogram */
+static void snapshot_delta(rawr_HistogramSnapshot *after, const rawr_HistogramSnapshot *before)
+{
+    after->count -= before->count;
+    after->sum -= before->sum;
+    for (int i = 0; i < RAWR_HISTOGRAM_BUCKETS; i++) after->buckets[i] -= before->buckets[i];
+}
+
+static void snapshot_add(rawr_HistogramSnapshot *total, const rawr_HistogramSnapshot *snapshot)
+{
+    total->count += snapshot->count;
+    total->sum += snapshot->sum;
+    for (int i = 0; i < RAWR_HISTOGRAM_BUCKETS; i++) total->buckets[i] += snapshot->buckets[i];
+}
+
+static void print_histogram(const char *name, const rawr_HistogramSnapshot *snapshot, double scale, const char *unit)
+{
+    printf("%-22s %10.3f %10.3f %10.3f %10.3f %s\n",
+        name,
+        rawr_Histogram_Mean(snapshot) * scale,
+        rawr_Histogram_Percentile(snapshot, 50) * scale,
+        rawr_Histogram_Percentile(snapshot, 99) * scale,
+        rawr_Histogram_Percentile(snapshot, 100) * scale,
+        unit);
+}
+
+static int all_connected(int pairs)
+{
+    rawr_CallStats stats;
+
+    if ((int)mn_atomic_load(&standin.established) < pairs) return 0;
+
+    for (int i = 0; i < pairs; i++) {
+        rawr_Call_GetStats(calls[i].call, &stats);
+        if (!stats.packetsReceived) return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    int pairs = argc > 1 ? atoi(argv[1]) : 16;
+    int seconds = argc > 2 ? atoi(argv[2]) : 10;
+    int workers = argc > 3 ? atoi(argv[3]) : 0;
+    rawr_Engine *engine = NULL;
+    rawr_CallMetrics *total = NULL, *after = NULL;
+    rawr_CallStats stats;
+    rawr_HistogramSnapshot latencySnapshot;
+    char uri[128];
+    uint64_t packetsSent = 0, packetsReceived = 0, markersSent = 0, markersHeard = 0, overruns;
+    uint64_t setupAcquires, windowAcquires, startNs, waitedMs = 0;
+    long windowBlocks;
+    double cpu, wall;
+    int standinLaunched = 0, started = 0, rv = 1;
+
+    if (pairs < 1 || pairs > BENCH_PAIRS_MAX || seconds < 1 || workers < 0) {
+        fprintf(stderr, "usage: %s [pairs 1 - %d] [seconds] [workers, 0 for one per core]\n", argv[0], BENCH_PAIRS_MAX);
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_MARKER_SAMPLES; i++) {
+        marker[i] = (rawr_AudioSample)(BENCH_MARKER_AMPLITUDE * sin(2.0 * M_PI * BENCH_MARKER_HZ * i / BENCH_RATE));
+    }
+
+    acquire_fn = mn_default_allocator.acquire_fn;
+    mn_default_allocator.acquire_fn = counting_acquire;
+
+    RAWR_GUARD_CLEANUP(rawr_Net_Setup());
+    RAWR_GUARD_CLEANUP(rawr_Histogram_Setup(&latency));
+    RAWR_GUARD_NULL_CLEANUP(calls = MN_MEM_ACQUIRE(pairs * sizeof(*calls)));
+    memset(calls, 0, pairs * sizeof(*calls));
+    RAWR_GUARD_NULL_CLEANUP(total = MN_MEM_ACQUIRE(sizeof(*total)));
+    RAWR_GUARD_NULL_CLEANUP(after = MN_MEM_ACQUIRE(sizeof(*after)));
+
+    /* the stand-in */
+    RAWR_GUARD_NULL_CLEANUP(standin.legs = MN_MEM_ACQUIRE(pairs * sizeof(*standin.legs)));
+    memset(standin.legs, 0, pairs * sizeof(*standin.legs));
+    standin.legMax = pairs;
+    RAWR_GUARD_CLEANUP(rawr_Semaphore_Setup(&standin.ready));
+    RAWR_GUARD_CLEANUP(mn_thread_launch(&standin.thread, standin_thread, NULL));
+    standinLaunched = 1;
+    if (rawr_Semaphore_Wait(standin.ready, BENCH_CONNECT_WAIT_MS) || standin.err) {
+        fprintf(stderr, "SIP stand-in failed to start: %s\n", strerror(standin.err));
+        goto cleanup;
+    }
+
+    RAWR_GUARD_CLEANUP(rawr_Engine_Setup(&engine, workers));
+    RAWR_GUARD_CLEANUP(rawr_Engine_Start(engine));
+
+    re_snprintf(uri, sizeof(uri), "sip:bench@%J;transport=tls", &standin.addr);
+    setupAcquires = mn_atomic_load(&acquires);
+
+    for (int i = 0; i < pairs; i++) {
+        char from[64];
+
+        calls[i].noise = 0x9e3779b9u * (i + 1);
+        RAWR_GUARD_NULL_CLEANUP(calls[i].metrics = MN_MEM_ACQUIRE(sizeof(*calls[i].metrics)));
+
+        snprintf(from, sizeof(from), "sip:caller%d@127.0.0.1", i);
+        RAWR_GUARD_CLEANUP(rawr_Call_SetupEngine(&calls[i].call, engine, from, "caller", "", ""));
+        RAWR_GUARD_CLEANUP(rawr_Call_SetAudioHandlers(calls[i].call, on_capture, on_playback, calls + i));
+        RAWR_GUARD_CLEANUP(rawr_Call_Start(calls[i].call, uri));
+        started = i + 1;
+    }
+
+    while (!all_connected(pairs)) {
+        if ((waitedMs += BENCH_POLL_MS) > BENCH_CONNECT_WAIT_MS) {
+            fprintf(stderr, "only %d of %d calls established\n", (int)mn_atomic_load(&standin.established), pairs);
+            goto cleanup;
+        }
+        mn_thread_sleep_ms(BENCH_POLL_MS);
+    }
+
+    setupAcquires = mn_atomic_load(&acquires) - setupAcquires;
+
+    /* let the jitter buffers and the rate controllers settle */
+    mn_thread_sleep_ms(BENCH_WARMUP_MS);
+
+    for (int i = 0; i < pairs; i++) {
+        rawr_Call_GetStats(calls[i].call, &calls[i].stats);
+        rawr_Call_GetMetrics(calls[i].call, calls[i].metrics);
+    }
+
+    overruns = rawr_Engine_Overruns(engine);
+    windowAcquires = mn_atomic_load(&acquires);
+    windowBlocks = (long)re_blocks();
+    cpu = cpu_seconds();
+    startNs = mn_tstamp();
+    mn_atomic_store(&measuring, 1);
+
+    mn_thread_sleep_s(seconds);
+
+    mn_atomic_store(&measuring, 0);
+    wall = (mn_tstamp() - startNs) / 1e9;
+    cpu = cpu_seconds() - cpu;
+    windowBlocks = (long)re_blocks() - windowBlocks;
+    windowAcquires = mn_atomic_load(&acquires) - windowAcquires;
+    overruns = rawr_Engine_Overruns(engine) - overruns;
+
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < pairs; i++) {
+        rawr_Call_GetStats(calls[i].call, &stats);
+        packetsSent += stats.packetsSent - calls[i].stats.packetsSent;
+        packetsReceived += stats.packetsReceived - calls[i].stats.packetsReceived;
+
+        rawr_Call_GetMetrics(calls[i].call, after);
+        snapshot_delta(&after->encodeNs, &calls[i].metrics->encodeNs);
+        snapshot_delta(&after->decodeNs, &calls[i].metrics->decodeNs);
+        snapshot_delta(&after->srtpNs, &calls[i].metrics->srtpNs);
+        snapshot_delta(&after->jitterUs, &calls[i].metrics->jitterUs);
+        snapshot_add(&total->encodeNs, &after->encodeNs);
+        snapshot_add(&total->decodeNs, &after->decodeNs);
+        snapshot_add(&total->srtpNs, &after->srtpNs);
+        snapshot_add(&total->jitterUs, &after->jitterUs);
+        total->underflows += after->underflows - calls[i].metrics->underflows;
+        total->receiveDropped += after->receiveDropped - calls[i].metrics->receiveDropped;
+        total->latePackets += after->latePackets - calls[i].metrics->latePackets;
+        total->decodeErrors += after->decodeErrors - calls[i].metrics->decodeErrors;
+        total->acceleratedMs += after->acceleratedMs - calls[i].metrics->acceleratedMs;
+        total->expandedMs += after->expandedMs - calls[i].metrics->expandedMs;
+
+        markersSent += mn_atomic_load(&calls[i].markersSent);
+        markersHeard += mn_atomic_load(&calls[i].markersHeard);
+    }
+
+    rawr_Histogram_Snapshot(latency, &latencySnapshot);
+
+    printf("%d calls on %d media workers, %.1f s\n\n", pairs, rawr_Engine_WorkerCount(engine), wall);
+
+    printf("%-22s %10s %10s %10s %10s\n", "", "mean", "p50", "p99", "max");
+    print_histogram("mouth to ear", &latencySnapshot, 1e-3, "ms");
+    print_histogram("encode", &total->encodeNs, 1e-3, "us");
+    print_histogram("decode", &total->decodeNs, 1e-3, "us");
+    print_histogram("srtp", &total->srtpNs, 1e-3, "us");
+    print_histogram("arrival jitter", &total->jitterUs, 1e-3, "ms");
+
+    printf("\n");
+    printf("%-22s %10.3f %% of a core, %.1f calls per core\n", "cpu per call", cpu * 100.0 / (wall * pairs), wall * pairs / cpu);
+    printf("%-22s %10.0f sent %10.0f received\n", "packets per second", packetsSent / wall, packetsReceived / wall);
+    printf("%-22s %10" PRIu64 " of %" PRIu64 "\n", "bursts heard", markersHeard, markersSent);
+    printf("%-22s %10" PRIu64 " underflows %" PRIu64 " late %" PRIu64 " dropped %" PRIu64 " decode errors %" PRIu64 " overruns\n",
+        "faults", total->underflows, total->latePackets, total->receiveDropped, total->decodeErrors, overruns);
+    printf("%-22s %10" PRIu64 " ms cut %" PRIu64 " ms repeated\n", "time-stretched", total->acceleratedMs, total->expandedMs);
+    printf("%-22s %10.1f per call setup, %" PRIu64 " while running, re blocks %+ld while running\n",
+        "allocations", (double)setupAcquires / pairs, windowAcquires, windowBlocks);
+
+    rv = 0;
+
+cleanup:
+    if (rv) fprintf(stderr, "benchmark failed\n");
+
+    for (int i = 0; i < started; i++) rawr_Call_Stop(calls[i].call);
+    if (engine) {
+        rawr_Engine_Stop(engine);
+        for (int i = 0; i < pairs; i++) {
+            if (calls[i].call) rawr_Call_Cleanup(calls[i].call);
+        }
+        rawr_Engine_Cleanup(engine);
+    }
+
+    if (standinLaunched) {
+        if (standin.queue) mqueue_push(standin.queue, 0, NULL);
+        mn_thread_join(&standin.thread);
+    }
+
+    if (calls) {
+        for (int i = 0; i < pairs; i++) {
+            if (calls[i].metrics) MN_MEM_RELEASE(calls[i].metrics);
+        }
+        MN_MEM_RELEASE(calls);
+    }
+    if (standin.legs) MN_MEM_RELEASE(standin.legs);
+    if (standin.ready) rawr_Semaphore_Cleanup(standin.ready);
+    if (total) MN_MEM_RELEASE(total);
+    if (after) MN_MEM_RELEASE(after);
+    if (latency) rawr_Histogram_Cleanup(latency);
+
+    rawr_Net_Cleanup();
+
+    return rv;
+}
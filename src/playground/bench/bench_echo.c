@@ -0,0 +1,196 @@
+/*
+ * cost and effect of rawr_Echo on a synthetic call. the far end is noise shaped into talk spurts, the echo path a
+ * bulk delay and a decaying random impulse response, and the capture that echo plus a little noise of its own. each
+ * kernel this machine has runs the same audio at 16 and 48 kHz in 20 ms frames, and the cost is given per 10 ms of
+ * audio so it compares with other cancellers. the last passes per rate set budgets below the unlimited cost to show
+ * what a budget gives up, adaptation first and then cancellation.
+ *
+ * usage: rawr_bench_echo [seconds] [delayMs]
+ */
+
+#include "rawr/Echo.h"
+#include "rawr/Simd.h"
+
+#include "mn/time.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if RAWR_SIMD_X86
+#    include <x86intrin.h>
+#    define BENCH_CYCLES() __rdtsc()
+#else
+#    define BENCH_CYCLES() 0
+#endif
+
+#define BENCH_FRAME_MS 20
+#define BENCH_PATH_MS 30
+#define BENCH_SPURT_MS 400
+#define BENCH_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct bench_kernel {
+    const char *name;
+    rawr_SimdFeatures features;
+} bench_kernel;
+
+typedef struct bench_result {
+    double nsPer10ms;
+    double cyclesPer10ms;
+    uint64_t frameNs; /* mean over the last half, once the filter is running in full */
+    double erleDb;
+    rawr_EchoStats stats;
+} bench_result;
+
+static const bench_kernel kernels[] = {
+    {"scalar", rawr_SimdFeatures_None},
+    {"sse2", rawr_SimdFeatures_SSE2},
+    {"avx2", rawr_SimdFeatures_SSE2 | rawr_SimdFeatures_AVX2},
+    {"neon", rawr_SimdFeatures_NEON},
+};
+
+static const int rates[] = {16000, 48000};
+static const int budgetPercents[] = {75, 50, 25};
+
+static float noise(void)
+{
+    return (float)rand() / RAND_MAX * 2.0f - 1.0f;
+}
+
+/* far end and capture for the whole run, the capture's echo kept apart to measure what was taken out of it */
+static void bench_signals(int rate, int samples, int delayMs, rawr_AudioSample *far, rawr_AudioSample *near, float *echo)
+{
+    const int delay = rate * delayMs / 1000, taps = rate * BENCH_PATH_MS / 1000, spurt = rate * BENCH_SPURT_MS / 1000;
+    float *path = calloc(taps, sizeof(float));
+    float lowpass = 0.0f, gain = 0.0f, v;
+    int n;
+
+    srand(7);
+    for (int t = 0; t < taps; t++) {
+        path[t] = 0.6f * noise() * expf(-6.0f * t / taps);
+    }
+
+    for (int i = 0; i < samples; i++) {
+        if (i % spurt == 0) gain = (rand() % 3) ? 6000.0f + 4000.0f * noise() : 0.0f;
+        lowpass += 0.3f * (noise() - lowpass);
+        far[i] = (rawr_AudioSample)(gain * lowpass * (1.0f + 0.5f * sinf(i * 25.0f / rate)));
+    }
+
+    for (int i = 0; i < samples; i++) {
+        v = 0.0f;
+        for (int t = 0; t < taps; t++) {
+            n = i - delay - t;
+            if (n >= 0) v += path[t] * far[n];
+        }
+        echo[i] = v;
+        v += 20.0f * noise();
+        near[i] = (rawr_AudioSample)(v > 32767.0f ? 32767.0f : (v < -32768.0f ? -32768.0f : v));
+    }
+
+    free(path);
+}
+
+/* ERLE is over the last half, once the filter has had time to find the delay and converge */
+static int bench_run(int rate, int samples, const rawr_AudioSample *far, const rawr_AudioSample *near, const float *echo, uint64_t budgetNs, bench_result *out_result)
+{
+    const int frame = rate * BENCH_FRAME_MS / 1000, frames = samples / frame;
+    rawr_AudioSample *out = malloc(frame * sizeof(rawr_AudioSample));
+    rawr_Echo *canceller;
+    uint64_t ns = 0, cycles = 0, lastNs = 0, tstamp, tsc, elapsed;
+    double echoPower = 0.0, leftPower = 0.0, left;
+
+    if (rawr_Echo_Setup(&canceller, rate, frame)) return 1;
+    rawr_Echo_SetBudget(canceller, budgetNs);
+
+    for (int f = 0; f < frames; f++) {
+        const int offset = f * frame;
+
+        memcpy(out, near + offset, frame * sizeof(rawr_AudioSample));
+
+        tstamp = mn_tstamp();
+        tsc = BENCH_CYCLES();
+        rawr_Echo_Render(canceller, far + offset, frame);
+        rawr_Echo_Process(canceller, out);
+        cycles += BENCH_CYCLES() - tsc;
+        elapsed = mn_tstamp() - tstamp;
+        ns += elapsed;
+
+        if (f < frames / 2) continue;
+        lastNs += elapsed;
+        for (int i = 0; i < frame; i++) {
+            left = out[i] - (near[offset + i] - echo[offset + i]);
+            echoPower += (double)echo[offset + i] * echo[offset + i];
+            leftPower += left * left;
+        }
+    }
+
+    rawr_Echo_Stats(canceller, &out_result->stats);
+    rawr_Echo_Cleanup(canceller);
+    free(out);
+
+    out_result->nsPer10ms = (double)ns / frames * 10 / BENCH_FRAME_MS;
+    out_result->cyclesPer10ms = (double)cycles / frames * 10 / BENCH_FRAME_MS;
+    out_result->frameNs = lastNs / (frames - frames / 2);
+    out_result->erleDb = 10.0 * log10(echoPower / (leftPower > 0.0 ? leftPower : 1.0));
+
+    return 0;
+}
+
+static void bench_print(const char *name, const bench_result *result)
+{
+    printf("%-10s %12.0f %12.0f %10.1f %8d %12llu %10llu\n", name, result->cyclesPer10ms, result->nsPer10ms, result->erleDb, result->stats.delayMs, (unsigned long long)result->stats.adaptSkipped, (unsigned long long)result->stats.bypassed);
+}
+
+int main(int argc, char **argv)
+{
+    const int seconds = argc > 1 ? atoi(argv[1]) : 20;
+    const int delayMs = argc > 2 ? atoi(argv[2]) : 60;
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    rawr_AudioSample *far, *near;
+    bench_result result, unlimited;
+    char name[32];
+    float *echo;
+    int samples;
+
+    if (seconds < 1 || delayMs < 0 || delayMs + BENCH_PATH_MS > RAWR_ECHO_DELAY_MAX_MS) {
+        fprintf(stderr, "usage: %s [seconds] [delayMs up to %d]\n", argv[0], RAWR_ECHO_DELAY_MAX_MS - BENCH_PATH_MS);
+        return 1;
+    }
+
+    for (size_t r = 0; r < BENCH_COUNT(rates); r++) {
+        samples = rates[r] * seconds;
+        far = malloc(samples * sizeof(*far));
+        near = malloc(samples * sizeof(*near));
+        echo = malloc(samples * sizeof(*echo));
+        bench_signals(rates[r], samples, delayMs, far, near, echo);
+
+        printf("%d Hz, %d s in %d ms frames, %d ms to the echo path\n", rates[r], seconds, BENCH_FRAME_MS, delayMs);
+        printf("%-10s %12s %12s %10s %8s %12s %10s\n", "kernel", "cycles/10ms", "ns/10ms", "erle dB", "delayMs", "adaptSkipped", "bypassed");
+
+        for (size_t k = 0; k < BENCH_COUNT(kernels); k++) {
+            if (kernels[k].features && (features & kernels[k].features) != kernels[k].features) continue;
+
+            rawr_Simd_Limit(kernels[k].features);
+            if (bench_run(rates[r], samples, far, near, echo, 0, &result)) return 1;
+            bench_print(kernels[k].name, &result);
+        }
+
+        /* the best kernels again, with budgets of a fraction of what a frame took them once running in full */
+        rawr_Simd_Limit(rawr_SimdFeatures_All);
+        if (bench_run(rates[r], samples, far, near, echo, 0, &unlimited)) return 1;
+        for (size_t b = 0; b < BENCH_COUNT(budgetPercents); b++) {
+            const uint64_t budgetNs = unlimited.frameNs * budgetPercents[b] / 100;
+            snprintf(name, sizeof(name), "%d%% time", budgetPercents[b]);
+            if (bench_run(rates[r], samples, far, near, echo, budgetNs, &result)) return 1;
+            bench_print(name, &result);
+        }
+        printf("\n");
+
+        free(far);
+        free(near);
+        free(echo);
+    }
+
+    return 0;
+}
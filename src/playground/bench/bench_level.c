@@ -0,0 +1,157 @@
+/*
+ * cost of metering one device buffer each way, through the loop the callbacks used to run (abs, a double
+ * multiply-add per sample and two logs per buffer) and through rawr_LevelMeter with each kernel this machine has.
+ * reading a level back is timed separately, since that is what moved off the callback.
+ *
+ * usage: rawr_bench_level [buffers]
+ */
+
+#include "rawr/Level.h"
+#include "rawr/Simd.h"
+
+#include "mn/atomic.h"
+#include "mn/time.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define BENCH_FRAMES_MAX 4096
+#define BENCH_LEVEL_MULTIPLIER 10000.0
+#define BENCH_COUNT(a) (sizeof(a) / sizeof((a)[0]))
+
+typedef struct bench_kernel {
+    const char *name;
+    rawr_SimdFeatures features;
+} bench_kernel;
+
+static const bench_kernel kernels[] = {
+    {"scalar", rawr_SimdFeatures_None},
+    {"sse2", rawr_SimdFeatures_SSE2},
+    {"avx2", rawr_SimdFeatures_SSE2 | rawr_SimdFeatures_AVX2},
+    {"neon", rawr_SimdFeatures_NEON},
+};
+
+static const int frameCounts[] = {64, 256, 480, 960, 2048};
+
+static rawr_AudioSample inputSamples[BENCH_FRAMES_MAX];
+static rawr_AudioSample outputSamples[BENCH_FRAMES_MAX];
+static mn_atomic_t inputLevel, outputLevel;
+
+/* what rawr_AudioStream_AudioCallback did before the meters */
+static void legacy_meter(const rawr_AudioSample *input, const rawr_AudioSample *output, int frames)
+{
+    double inputRms, inputDb, level, outputRms, outputDb;
+    double weight = 1.0 / (double)frames;
+    double inverse = 1.0 / 32767.0;
+
+    inputRms = outputRms = 0.0;
+    for (int i = 0; i < frames; i++) {
+        inputRms += abs(input[i]) * inverse * weight;
+        outputRms += abs(output[i]) * inverse * weight;
+    }
+
+    inputDb = 20 * log(inputRms);
+    outputDb = 20 * log(outputRms);
+
+    level = 1.0 - ((fmax(20.0, fmin(200.0, inputDb * -1.0)) - 20.0) / 180.0);
+    mn_atomic_store(&inputLevel, level * BENCH_LEVEL_MULTIPLIER);
+
+    level = 1.0 - ((fmax(20.0, fmin(200.0, outputDb * -1.0)) - 20.0) / 180.0);
+    mn_atomic_store(&outputLevel, level * BENCH_LEVEL_MULTIPLIER);
+}
+
+/* every kernel has to agree with the scalar one, -32768 included */
+static int check_kernel(void)
+{
+    uint64_t sum, expectSum;
+    int peak, expectPeak, magnitude;
+
+    for (int count = 0; count <= 67; count++) {
+        expectSum = 0;
+        expectPeak = 0;
+        for (int i = 0; i < count; i++) {
+            magnitude = abs(inputSamples[i]);
+            expectSum += (uint64_t)(magnitude * magnitude);
+            if (magnitude > expectPeak) expectPeak = magnitude;
+        }
+
+        rawr_Level_Measure(inputSamples, count, &sum, &peak);
+        if (sum != expectSum || peak != expectPeak) return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    rawr_LevelMeter inputMeter, outputMeter;
+    rawr_SimdFeatures features = rawr_Simd_Features();
+    uint64_t tstamp;
+    double sink = 0.0;
+
+    if (count < 1) {
+        fprintf(stderr, "usage: %s [buffers]\n", argv[0]);
+        return 1;
+    }
+
+    srand(1);
+    for (int i = 0; i < BENCH_FRAMES_MAX; i++) {
+        inputSamples[i] = (rawr_AudioSample)((rand() & 0xffff) - 0x8000);
+        outputSamples[i] = (rawr_AudioSample)(8000.0 * sin(i * 0.07));
+    }
+    inputSamples[5] = INT16_MIN;
+    inputSamples[50] = INT16_MIN;
+
+    printf("%d buffers each way, ns per callback for input and output together\n\n", count);
+    printf("%-10s", "frames");
+    for (size_t f = 0; f < BENCH_COUNT(frameCounts); f++) {
+        printf(" %10d", frameCounts[f]);
+    }
+    printf("\n%-10s", "legacy");
+
+    for (size_t f = 0; f < BENCH_COUNT(frameCounts); f++) {
+        tstamp = mn_tstamp();
+        for (int b = 0; b < count; b++) {
+            legacy_meter(inputSamples, outputSamples, frameCounts[f]);
+        }
+        printf(" %10.1f", (double)(mn_tstamp() - tstamp) / count);
+    }
+    printf("\n");
+
+    for (size_t k = 0; k < BENCH_COUNT(kernels); k++) {
+        if (kernels[k].features && (features & kernels[k].features) != kernels[k].features) continue;
+
+        rawr_Simd_Limit(kernels[k].features);
+        rawr_LevelMeter_Reset(&inputMeter);
+        rawr_LevelMeter_Reset(&outputMeter);
+        printf("%-10s", kernels[k].name);
+
+        if (check_kernel()) {
+            printf(" %10s\n", "wrong");
+            continue;
+        }
+
+        for (size_t f = 0; f < BENCH_COUNT(frameCounts); f++) {
+            tstamp = mn_tstamp();
+            for (int b = 0; b < count; b++) {
+                rawr_LevelMeter_Record(&inputMeter, inputSamples, frameCounts[f]);
+                rawr_LevelMeter_Record(&outputMeter, outputSamples, frameCounts[f]);
+            }
+            printf(" %10.1f", (double)(mn_tstamp() - tstamp) / count);
+        }
+        printf("\n");
+    }
+
+    rawr_Simd_Limit(rawr_SimdFeatures_All);
+
+    tstamp = mn_tstamp();
+    for (int b = 0; b < count; b++) {
+        sink += rawr_LevelMeter_Rms(&inputMeter) + rawr_LevelMeter_Peak(&outputMeter);
+    }
+    printf("\nreading an rms and a peak back: %.1f ns\n", (double)(mn_tstamp() - tstamp) / count);
+    printf("input %.3f rms %.3f peak, output %.3f rms %.3f peak\n", rawr_LevelMeter_Rms(&inputMeter), rawr_LevelMeter_Peak(&inputMeter), rawr_LevelMeter_Rms(&outputMeter), rawr_LevelMeter_Peak(&outputMeter));
+
+    return sink < 0.0;
+}
@@ -0,0 +1,214 @@
+/*
+ * rawr_RingBuffer between two threads pinned to different cores, the way the audio callback and the media thread
+ * share one. Throughput streams audio samples through a ring the size AudioStream uses, in chunks from one sample
+ * to a codec frame, and checks every sample arrives in order. Latency bounces a timestamp through a pair of rings
+ * and reports half the round trip. when both sides land on the same core the spinning side yields instead, so the
+ * numbers still come out but they measure the scheduler more than the ring.
+ *
+ * usage: rawr_bench_ring [samples per chunk size] [round trips] [producer cpu] [consumer cpu]
+ */
+
+#ifndef _GNU_SOURCE
+#    define _GNU_SOURCE
+#endif
+
+#include "rawr/Histogram.h"
+#include "rawr/RingBuffer.h"
+
+#include "mn/atomic.h"
+#include "mn/thread.h"
+#include "mn/time.h"
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define BENCH_RING_SAMPLES 16384 /* what a 960 sample stream allocates */
+#define BENCH_CHUNK_MAX 960
+#define BENCH_LATENCY_ELEMENTS 64
+
+static const int chunks[] = {1, 16, 64, 240, 960};
+
+typedef struct bench_side {
+    int cpu;
+    int chunk;
+    uint64_t samples;
+    uint64_t errors;
+} bench_side;
+
+static rawr_RingBuffer ring, ping, pong;
+static int16_t ringData[BENCH_RING_SAMPLES];
+static uint64_t pingData[BENCH_LATENCY_ELEMENTS], pongData[BENCH_LATENCY_ELEMENTS];
+static mn_atomic_t stop;
+static int shared;
+
+static void pin(int cpu)
+{
+#ifdef __linux__
+    cpu_set_t set;
+
+    if (cpu < 0) return;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    if (pthread_setaffinity_np(pthread_self(), sizeof(set), &set)) fprintf(stderr, "could not pin to cpu %d\n", cpu);
+#else
+    (void)cpu;
+#endif
+}
+
+/* wait for the other side, which only gets to run when it has a core of its own */
+static void spin(void)
+{
+    if (shared) sched_yield();
+}
+
+static void producer(void *arg)
+{
+    bench_side *side = (bench_side *)arg;
+    int16_t chunk[BENCH_CHUNK_MAX];
+    uint64_t sent = 0;
+    size_t written;
+
+    pin(side->cpu);
+
+    while (sent < side->samples) {
+        int count = (int)(side->samples - sent < (uint64_t)side->chunk ? side->samples - sent : (uint64_t)side->chunk);
+        for (int i = 0; i < count; i++) {
+            chunk[i] = (int16_t)(sent + i);
+        }
+
+        /* the callback never waits, it writes what fits, so this spins on a full ring */
+        written = 0;
+        while (written < (size_t)count) {
+            written += rawr_RingBuffer_Write(&ring, chunk + written, count - written);
+            if (written < (size_t)count) spin();
+        }
+        sent += count;
+    }
+}
+
+static void consumer(void *arg)
+{
+    bench_side *side = (bench_side *)arg;
+    int16_t chunk[BENCH_CHUNK_MAX];
+    uint64_t received = 0;
+    size_t got;
+
+    pin(side->cpu);
+
+    while (received < side->samples) {
+        got = rawr_RingBuffer_Read(&ring, chunk, side->chunk);
+        if (!got) spin();
+        for (size_t i = 0; i < got; i++) {
+            if (chunk[i] != (int16_t)(received + i)) side->errors++;
+        }
+        received += got;
+    }
+}
+
+static void echo(void *arg)
+{
+    bench_side *side = (bench_side *)arg;
+    uint64_t stamp;
+
+    pin(side->cpu);
+
+    while (!mn_atomic_load_explicit(&stop, MN_ATOMIC_RELAXED)) {
+        if (rawr_RingBuffer_Read(&ping, &stamp, 1)) {
+            while (!rawr_RingBuffer_Write(&pong, &stamp, 1)) {
+                spin();
+            }
+        } else {
+            spin();
+        }
+    }
+}
+
+int main(int argc, char **argv)
+{
+    uint64_t samples = argc > 1 ? strtoull(argv[1], NULL, 10) : 200000000;
+    int trips = argc > 2 ? atoi(argv[2]) : 1000000;
+    int producerCpu = argc > 3 ? atoi(argv[3]) : 0;
+    int consumerCpu = argc > 4 ? atoi(argv[4]) : 1;
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    bench_side producerSide, consumerSide;
+    mn_thread_t producerThread, consumerThread;
+    rawr_Histogram *histogram;
+    rawr_HistogramSnapshot snapshot;
+    uint64_t tstamp, stamp;
+
+    if (!samples || trips < 1) {
+        fprintf(stderr, "usage: %s [samples per chunk size] [round trips] [producer cpu] [consumer cpu]\n", argv[0]);
+        return 1;
+    }
+
+    if (cpus > 0) {
+        producerCpu %= (int)cpus;
+        consumerCpu %= (int)cpus;
+    }
+    shared = (producerCpu == consumerCpu);
+
+    printf("%llu samples per chunk size, producer on cpu %d, consumer on cpu %d%s\n\n", (unsigned long long)samples, producerCpu, consumerCpu, shared ? " (shared, yielding)" : "");
+    printf("%-10s %14s %10s\n", "chunk", "Msamples/s", "errors");
+
+    for (size_t c = 0; c < sizeof(chunks) / sizeof(chunks[0]); c++) {
+        rawr_RingBuffer_Initialize(&ring, sizeof(int16_t), BENCH_RING_SAMPLES, ringData);
+
+        producerSide.cpu = producerCpu;
+        consumerSide.cpu = consumerCpu;
+        producerSide.chunk = consumerSide.chunk = chunks[c];
+        producerSide.samples = consumerSide.samples = samples;
+        producerSide.errors = consumerSide.errors = 0;
+
+        mn_thread_setup(&producerThread);
+        mn_thread_setup(&consumerThread);
+
+        tstamp = mn_tstamp();
+        mn_thread_launch(&consumerThread, consumer, &consumerSide);
+        mn_thread_launch(&producerThread, producer, &producerSide);
+        mn_thread_join(&producerThread);
+        mn_thread_join(&consumerThread);
+        tstamp = mn_tstamp() - tstamp;
+
+        mn_thread_cleanup(&producerThread);
+        mn_thread_cleanup(&consumerThread);
+
+        printf("%-10d %14.1f %10llu\n", chunks[c], samples * 1e3 / tstamp, (unsigned long long)consumerSide.errors);
+    }
+
+    rawr_RingBuffer_Initialize(&ping, sizeof(uint64_t), BENCH_LATENCY_ELEMENTS, pingData);
+    rawr_RingBuffer_Initialize(&pong, sizeof(uint64_t), BENCH_LATENCY_ELEMENTS, pongData);
+    if (rawr_Histogram_Setup(&histogram)) return 1;
+
+    consumerSide.cpu = consumerCpu;
+    mn_atomic_store(&stop, 0);
+    mn_thread_setup(&consumerThread);
+    mn_thread_launch(&consumerThread, echo, &consumerSide);
+    pin(producerCpu);
+
+    for (int t = 0; t < trips; t++) {
+        tstamp = mn_tstamp();
+        rawr_RingBuffer_Write(&ping, &tstamp, 1);
+        while (!rawr_RingBuffer_Read(&pong, &stamp, 1)) {
+            spin();
+        }
+        rawr_Histogram_Record(histogram, (mn_tstamp() - stamp) / 2);
+    }
+
+    mn_atomic_store(&stop, 1);
+    mn_thread_join(&consumerThread);
+    mn_thread_cleanup(&consumerThread);
+
+    rawr_Histogram_Snapshot(histogram, &snapshot);
+    printf("\n%-10s %10s %10s %10s %10s\n", "one way", "mean", "p50", "p99", "max");
+    printf("%-10s %10.1f %10llu %10llu %10llu ns\n", "",
+        rawr_Histogram_Mean(&snapshot),
+        (unsigned long long)rawr_Histogram_Percentile(&snapshot, 50),
+        (unsigned long long)rawr_Histogram_Percentile(&snapshot, 99),
+        (unsigned long long)rawr_Histogram_Percentile(&snapshot, 100));
+
+    rawr_Histogram_Cleanup(histogram);
+    return 0;
+}
@@ -0,0 +1,211 @@
+/*
+ * SRTP protect/unprotect cost per packet for every suite rawr can negotiate, through re's srtp (which rawr_Call
+ * uses, on OpenSSL's AES) and through deps/libsrtp built against OpenSSL.
+ *
+ * usage: rawr_bench_srtp [packets] [payload bytes]
+ */
+
+#include "rawr/Platform.h"
+
+#include "mn/time.h"
+
+#include "re.h"
+#include "srtp.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#define BENCH_BATCH 256
+#define BENCH_RTP_HEADER_BYTES 12
+#define BENCH_PACKET_MAX 1500
+#define BENCH_PAYLOAD_BYTES 160 /* 20 ms opus at 64 kbps */
+#define BENCH_SSRC 0xdead1ee7
+#define BENCH_KEY_MAX 46
+
+typedef struct bench_suite {
+    enum srtp_suite reSuite;
+    void (*policy)(srtp_crypto_policy_t *p);
+    size_t keyLen;
+} bench_suite;
+
+static const bench_suite suites[] = {
+    {SRTP_AES_CM_128_HMAC_SHA1_32, srtp_crypto_policy_set_aes_cm_128_hmac_sha1_32, 30},
+    {SRTP_AES_CM_128_HMAC_SHA1_80, srtp_crypto_policy_set_rtp_default, 30},
+    {SRTP_AES_256_CM_HMAC_SHA1_32, srtp_crypto_policy_set_aes_cm_256_hmac_sha1_32, 46},
+    {SRTP_AES_256_CM_HMAC_SHA1_80, srtp_crypto_policy_set_aes_cm_256_hmac_sha1_80, 46},
+    {SRTP_AES_128_GCM, srtp_crypto_policy_set_aes_gcm_128_16_auth, 28},
+    {SRTP_AES_256_GCM, srtp_crypto_policy_set_aes_gcm_256_16_auth, 44},
+};
+
+static uint8_t packets[BENCH_BATCH][BENCH_PACKET_MAX];
+static struct mbuf *buffers[BENCH_BATCH];
+
+static void write_rtp(uint8_t *pkt, uint16_t seq, uint32_t ts, int payloadBytes)
+{
+    pkt[0] = 0x80;
+    pkt[1] = 116;
+    pkt[2] = (uint8_t)(seq >> 8);
+    pkt[3] = (uint8_t)seq;
+    pkt[4] = (uint8_t)(ts >> 24);
+    pkt[5] = (uint8_t)(ts >> 16);
+    pkt[6] = (uint8_t)(ts >> 8);
+    pkt[7] = (uint8_t)ts;
+    pkt[8] = (uint8_t)(BENCH_SSRC >> 24);
+    pkt[9] = (uint8_t)(BENCH_SSRC >> 16);
+    pkt[10] = (uint8_t)(BENCH_SSRC >> 8);
+    pkt[11] = (uint8_t)BENCH_SSRC;
+    memset(pkt + BENCH_RTP_HEADER_BYTES, 0x5a, payloadBytes);
+}
+
+static int bench_re(const bench_suite *suite, const uint8_t *key, int rounds, int payloadBytes, double *out_protectNs, double *out_unprotectNs)
+{
+    struct srtp *tx = NULL, *rx = NULL;
+    uint64_t protectNs = 0, unprotectNs = 0, tstamp;
+    uint16_t seq = 0;
+    int err;
+
+    err = srtp_alloc(&tx, suite->reSuite, key, suite->keyLen, 0);
+    err |= srtp_alloc(&rx, suite->reSuite, key, suite->keyLen, 0);
+    if (err) goto out;
+
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < BENCH_BATCH; i++, seq++) {
+            mbuf_rewind(buffers[i]);
+            write_rtp(packets[i], seq, seq * 960, payloadBytes);
+            mbuf_write_mem(buffers[i], packets[i], BENCH_RTP_HEADER_BYTES + payloadBytes);
+            buffers[i]->pos = 0;
+        }
+
+        tstamp = mn_tstamp();
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            err |= srtp_encrypt(tx, buffers[i]);
+        }
+        protectNs += mn_tstamp() - tstamp;
+
+        for (int i = 0; i < BENCH_BATCH; i++) buffers[i]->pos = 0;
+
+        tstamp = mn_tstamp();
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            err |= srtp_decrypt(rx, buffers[i]);
+        }
+        unprotectNs += mn_tstamp() - tstamp;
+
+        if (err) goto out;
+    }
+
+    *out_protectNs = (double)protectNs / (rounds * BENCH_BATCH);
+    *out_unprotectNs = (double)unprotectNs / (rounds * BENCH_BATCH);
+
+out:
+    mem_deref(tx);
+    mem_deref(rx);
+    return err;
+}
+
+static int bench_libsrtp(const bench_suite *suite, const uint8_t *key, int rounds, int payloadBytes, double *out_protectNs, double *out_unprotectNs)
+{
+    srtp_policy_t policy;
+    srtp_t tx = NULL, rx = NULL;
+    uint64_t protectNs = 0, unprotectNs = 0, tstamp;
+    int lens[BENCH_BATCH];
+    uint16_t seq = 0;
+    int err = 0;
+
+    memset(&policy, 0, sizeof(policy));
+    suite->policy(&policy.rtp);
+    suite->policy(&policy.rtcp);
+    policy.key = (unsigned char *)key;
+    policy.window_size = 128;
+
+    policy.ssrc.type = ssrc_any_outbound;
+    err |= srtp_create(&tx, &policy);
+    policy.ssrc.type = ssrc_any_inbound;
+    err |= srtp_create(&rx, &policy);
+    if (err) goto out;
+
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < BENCH_BATCH; i++, seq++) {
+            write_rtp(packets[i], seq, seq * 960, payloadBytes);
+            lens[i] = BENCH_RTP_HEADER_BYTES + payloadBytes;
+        }
+
+        tstamp = mn_tstamp();
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            err |= srtp_protect(tx, packets[i], &lens[i]);
+        }
+        protectNs += mn_tstamp() - tstamp;
+
+        tstamp = mn_tstamp();
+        for (int i = 0; i < BENCH_BATCH; i++) {
+            err |= srtp_unprotect(rx, packets[i], &lens[i]);
+        }
+        unprotectNs += mn_tstamp() - tstamp;
+
+        if (err) goto out;
+    }
+
+    *out_protectNs = (double)protectNs / (rounds * BENCH_BATCH);
+    *out_unprotectNs = (double)unprotectNs / (rounds * BENCH_BATCH);
+
+out:
+    if (tx) srtp_dealloc(tx);
+    if (rx) srtp_dealloc(rx);
+    return err;
+}
+
+int main(int argc, char **argv)
+{
+    int count = argc > 1 ? atoi(argv[1]) : 200000;
+    int payloadBytes = argc > 2 ? atoi(argv[2]) : BENCH_PAYLOAD_BYTES;
+    int rounds = count / BENCH_BATCH;
+    uint8_t key[BENCH_KEY_MAX];
+    double protectNs, unprotectNs;
+    int err;
+
+    if (rounds < 1 || payloadBytes < 1 || payloadBytes > BENCH_PACKET_MAX - BENCH_RTP_HEADER_BYTES - 64) {
+        fprintf(stderr, "usage: %s [packets >= %d] [payload bytes]\n", argv[0], BENCH_BATCH);
+        return 1;
+    }
+
+    if ((err = libre_init())) {
+        fprintf(stderr, "could not initialize re: %d\n", err);
+        return 1;
+    }
+
+    if ((err = srtp_init()) != srtp_err_status_ok) {
+        fprintf(stderr, "could not initialize libsrtp: %d\n", err);
+        return 1;
+    }
+
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        if (!(buffers[i] = mbuf_alloc(BENCH_PACKET_MAX))) return 1;
+    }
+
+    rand_bytes(key, sizeof(key));
+
+    printf("%d packets of %d bytes payload, ns per packet\n\n", rounds * BENCH_BATCH, payloadBytes);
+    printf("%-26s %12s %12s %12s %12s\n", "suite", "re protect", "re unprot", "srtp protect", "srtp unprot");
+
+    for (size_t s = 0; s < ARRAY_SIZE(suites); s++) {
+        printf("%-26s", srtp_suite_name(suites[s].reSuite));
+
+        if (bench_re(suites + s, key, rounds, payloadBytes, &protectNs, &unprotectNs)) {
+            printf(" %12s %12s", "failed", "failed");
+        } else {
+            printf(" %12.1f %12.1f", protectNs, unprotectNs);
+        }
+
+        if (bench_libsrtp(suites + s, key, rounds, payloadBytes, &protectNs, &unprotectNs)) {
+            printf(" %12s %12s\n", "failed", "failed");
+        } else {
+            printf(" %12.1f %12.1f\n", protectNs, unprotectNs);
+        }
+    }
+
+    for (int i = 0; i < BENCH_BATCH; i++) mem_deref(buffers[i]);
+
+    srtp_shutdown();
+    libre_close();
+
+    return 0;
+}
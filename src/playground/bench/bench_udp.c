@@ -0,0 +1,237 @@
+/*
+ * Media socket throughput: one sendto/recvfrom per packet (what a call's re udp_sock does) against rawr_UdpBatch
+ * (sendmmsg/recvmmsg, plus UDP GSO when consecutive packets share a peer).
+ *
+ * One "worker" socket exchanges packets with a set of peer sockets over loopback, a round being one packet to or
+ * from every peer, the way an engine worker's 20 ms tick looks. Only the worker side is timed.
+ *
+ * usage: rawr_bench_udp [packets] [peers] [payload bytes]
+ */
+
+#include "rawr/Error.h"
+#include "rawr/UdpBatch.h"
+
+#include "mn/time.h"
+
+#include "re.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+
+#define BENCH_PEERS_MAX 1024
+#define BENCH_PACKET_BYTES 172 /* 20 ms opus at 64 kbps, plus RTP header and SRTP tag */
+
+/* accumulates only the time between bench_resume and bench_pause */
+typedef struct bench_result {
+    uint64_t startNs;
+    double startCpu;
+    double seconds;
+    double cpuSeconds;
+    uint64_t syscalls;
+} bench_result;
+
+static RAWR_SOCK_TYPE worker_fd;
+static RAWR_SOCK_TYPE peer_fds[BENCH_PEERS_MAX];
+static struct sa worker_addr;
+static struct sa peer_addrs[BENCH_PEERS_MAX];
+static uint8_t payload[RAWR_UDPBATCH_PACKET_MAX];
+static uint8_t scratch[RAWR_UDPBATCH_PACKET_MAX];
+static uint64_t recv_count;
+
+static double cpu_seconds(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+}
+
+static void bench_resume(bench_result *result)
+{
+    result->startNs = mn_tstamp();
+    result->startCpu = cpu_seconds();
+}
+
+static void bench_pause(bench_result *result)
+{
+    result->seconds += (mn_tstamp() - result->startNs) / 1e9;
+    result->cpuSeconds += cpu_seconds() - result->startCpu;
+}
+
+static void bench_print(const char *name, const bench_result *result, int packets)
+{
+    printf("%-34s %10.0f pkt/s %8.3f us cpu/pkt %6.3f syscalls/pkt\n",
+        name,
+        packets / result->seconds,
+        result->cpuSeconds * 1e6 / packets,
+        (double)result->syscalls / packets);
+}
+
+/* untimed, keeps the peers' receive buffers from overflowing */
+static void drain(RAWR_SOCK_TYPE fd)
+{
+    while (recv(fd, scratch, sizeof(scratch), 0) >= 0) {
+    }
+}
+
+static void on_recv(const struct sa *src, uint8_t *data, size_t len, uint64_t arrival, void *arg)
+{
+    (void)src;
+    (void)data;
+    (void)len;
+    (void)arrival;
+    (void)arg;
+    recv_count++;
+}
+
+static void send_per_packet(bench_result *result, int rounds, int peers, int perPeer, int size)
+{
+    memset(result, 0, sizeof(*result));
+    for (int r = 0; r < rounds; r++) {
+        bench_resume(result);
+        for (int i = 0; i < peers; i++) {
+            for (int j = 0; j < perPeer; j++) {
+                (void)sendto(worker_fd, payload, size, 0, &peer_addrs[i].u.sa, peer_addrs[i].len);
+                result->syscalls++;
+            }
+        }
+        bench_pause(result);
+        for (int i = 0; i < peers; i++) drain(peer_fds[i]);
+    }
+}
+
+static void send_batched(bench_result *result, rawr_UdpBatch *batch, int rounds, int peers, int perPeer, int size)
+{
+    rawr_UdpBatchStats stats;
+    uint64_t sendCalls;
+
+    memset(result, 0, sizeof(*result));
+    rawr_UdpBatch_Stats(batch, &stats);
+    sendCalls = stats.sendCalls;
+
+    for (int r = 0; r < rounds; r++) {
+        bench_resume(result);
+        for (int i = 0; i < peers; i++) {
+            for (int j = 0; j < perPeer; j++) {
+                rawr_UdpBatch_Queue(batch, worker_fd, &peer_addrs[i], payload, size);
+            }
+        }
+        rawr_UdpBatch_Flush(batch);
+        bench_pause(result);
+        for (int i = 0; i < peers; i++) drain(peer_fds[i]);
+    }
+
+    rawr_UdpBatch_Stats(batch, &stats);
+    result->syscalls = stats.sendCalls - sendCalls;
+}
+
+static void recv_per_packet(bench_result *result, int rounds, int peers, int size)
+{
+    struct sa src;
+
+    memset(result, 0, sizeof(*result));
+    recv_count = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < peers; i++) (void)sendto(peer_fds[i], payload, size, 0, &worker_addr.u.sa, worker_addr.len);
+        bench_resume(result);
+
+        for (;;) {
+            src.len = sizeof(src.u);
+            result->syscalls++;
+            if (recvfrom(worker_fd, scratch, sizeof(scratch), 0, &src.u.sa, &src.len) < 0) break;
+            recv_count++;
+        }
+        bench_pause(result);
+    }
+}
+
+static void recv_batched(bench_result *result, rawr_UdpBatch *batch, int rounds, int peers, int size)
+{
+    rawr_UdpBatchStats stats;
+    uint64_t recvCalls;
+
+    memset(result, 0, sizeof(*result));
+    rawr_UdpBatch_Stats(batch, &stats);
+    recvCalls = stats.recvCalls;
+
+    recv_count = 0;
+    for (int r = 0; r < rounds; r++) {
+        for (int i = 0; i < peers; i++) (void)sendto(peer_fds[i], payload, size, 0, &worker_addr.u.sa, worker_addr.len);
+        bench_resume(result);
+
+        rawr_UdpBatch_Recv(batch, worker_fd, on_recv, NULL);
+        bench_pause(result);
+    }
+
+    rawr_UdpBatch_Stats(batch, &stats);
+    result->syscalls = stats.recvCalls - recvCalls;
+}
+
+int main(int argc, char **argv)
+{
+    int packets = argc > 1 ? atoi(argv[1]) : 500000;
+    int peers = argc > 2 ? atoi(argv[2]) : 64;
+    int size = argc > 3 ? atoi(argv[3]) : BENCH_PACKET_BYTES;
+    int rounds;
+    rawr_UdpBatch *batch;
+    bench_result result;
+
+    if (peers < 1 || peers > BENCH_PEERS_MAX || size < 1 || size > RAWR_UDPBATCH_PACKET_MAX || packets < peers) {
+        fprintf(stderr, "usage: %s [packets] [peers 1-%d] [payload bytes 1-%d]\n", argv[0], BENCH_PEERS_MAX, RAWR_UDPBATCH_PACKET_MAX);
+        return 1;
+    }
+
+    rounds = packets / peers;
+    packets = rounds * peers;
+    memset(payload, 0xa5, sizeof(payload));
+
+    sa_set_str(&worker_addr, "127.0.0.1", 0);
+    if (rawr_UdpBatch_Open(&worker_fd, &worker_addr)) {
+        fprintf(stderr, "could not open worker socket\n");
+        return 1;
+    }
+
+    for (int i = 0; i < peers; i++) {
+        sa_set_str(&peer_addrs[i], "127.0.0.1", 0);
+        if (rawr_UdpBatch_Open(&peer_fds[i], &peer_addrs[i])) {
+            fprintf(stderr, "could not open peer socket %d\n", i);
+            return 1;
+        }
+    }
+
+    if (rawr_UdpBatch_Setup(&batch, peers, 64)) return 1;
+
+    printf("%d packets of %d bytes, %d peers, %d rounds, gso %s\n\n", packets, size, peers, rounds, rawr_UdpBatch_Gso(batch) ? "available" : "unavailable");
+
+    printf("send, one packet per peer per round\n");
+    send_per_packet(&result, rounds, peers, 1, size);
+    bench_print("  sendto", &result, packets);
+
+    rawr_UdpBatch_SetGso(batch, 0);
+    send_batched(&result, batch, rounds, peers, 1, size);
+    bench_print("  sendmmsg", &result, packets);
+
+    printf("\nsend, every packet of a round to one peer\n");
+    send_per_packet(&result, rounds, 1, peers, size);
+    bench_print("  sendto", &result, packets);
+
+    send_batched(&result, batch, rounds, 1, peers, size);
+    bench_print("  sendmmsg", &result, packets);
+
+    rawr_UdpBatch_SetGso(batch, 1);
+    send_batched(&result, batch, rounds, 1, peers, size);
+    bench_print(rawr_UdpBatch_Gso(batch) ? "  sendmmsg + gso" : "  sendmmsg (no gso)", &result, packets);
+
+    printf("\nrecv, one packet from every peer per round\n");
+    recv_per_packet(&result, rounds, peers, size);
+    bench_print("  recvfrom", &result, (int)recv_count);
+
+    recv_batched(&result, batch, rounds, peers, size);
+    bench_print("  recvmmsg", &result, (int)recv_count);
+
+    rawr_UdpBatch_Cleanup(batch);
+    for (int i = 0; i < peers; i++) rawr_UdpBatch_Close(peer_fds[i]);
+    rawr_UdpBatch_Close(worker_fd);
+
+    return 0;
+}